@@ -9,7 +9,16 @@
 
 #include "LEOChunks.h"
 #include <string.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LEO_CHUNKS_USE_AVX2			1
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LEO_CHUNKS_USE_SSE2			1
+#endif
 
 
 const char*	gLEOChunkTypeNames[kLEOChunkType_Last +1] =
@@ -97,6 +106,126 @@ uint32_t	LEOUTF8StringParseUTF32CharacterAtOffset( const char *utf8, size_t len,
 }
 
 
+// When looking for delimiters, we can skip over any bytes that are neither
+//	one of the (up to 4) delimiter bytes nor may start a multi-byte UTF-8
+//	sequence. They are all single-byte characters that aren't delimiters, so
+//	there's no need to decode them one by one. These functions return the
+//	offset of the first byte at or after inOffset that we can *not* skip, or
+//	inOffset if that is already past the end.
+
+static size_t	LEOFindDelimiterOrMultiByteCharScalar( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] )
+{
+	const uint8_t*	currByte = (const uint8_t*) inStr;
+	size_t			x = inOffset;
+	for( ; x < inLen; x++ )
+	{
+		uint8_t	currCh = currByte[x];
+		if( currCh >= 0xC0 || currCh == inDelimiters[0] || currCh == inDelimiters[1]
+			|| currCh == inDelimiters[2] || currCh == inDelimiters[3] )
+			break;
+	}
+	return x;
+}
+
+
+#if LEO_CHUNKS_USE_SSE2
+static size_t	LEOFindDelimiterOrMultiByteCharSSE2( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] )
+{
+	const __m128i	delimiter0 = _mm_set1_epi8( (char) inDelimiters[0] ),
+					delimiter1 = _mm_set1_epi8( (char) inDelimiters[1] ),
+					delimiter2 = _mm_set1_epi8( (char) inDelimiters[2] ),
+					delimiter3 = _mm_set1_epi8( (char) inDelimiters[3] ),
+					firstLeadByte = _mm_set1_epi8( (char) 0xC0 );
+	size_t			x = inOffset;
+	for( ; (x +16) <= inLen; x += 16 )
+	{
+		__m128i		bytes = _mm_loadu_si128( (const __m128i*) (inStr +x) );
+		__m128i		matches = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( bytes, delimiter0 ), _mm_cmpeq_epi8( bytes, delimiter1 ) ),
+											_mm_or_si128( _mm_cmpeq_epi8( bytes, delimiter2 ), _mm_cmpeq_epi8( bytes, delimiter3 ) ) );
+		matches = _mm_or_si128( matches, _mm_cmpeq_epi8( _mm_max_epu8( bytes, firstLeadByte ), bytes ) );	// bytes >= 0xC0.
+		unsigned	matchBits = (unsigned) _mm_movemask_epi8( matches );
+		if( matchBits != 0 )
+			return x +__builtin_ctz( matchBits );
+	}
+	return LEOFindDelimiterOrMultiByteCharScalar( inStr, x, inLen, inDelimiters );
+}
+#endif // LEO_CHUNKS_USE_SSE2
+
+
+#if LEO_CHUNKS_USE_AVX2
+__attribute__((target("avx2")))
+static size_t	LEOFindDelimiterOrMultiByteCharAVX2( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] )
+{
+	const __m256i	delimiter0 = _mm256_set1_epi8( (char) inDelimiters[0] ),
+					delimiter1 = _mm256_set1_epi8( (char) inDelimiters[1] ),
+					delimiter2 = _mm256_set1_epi8( (char) inDelimiters[2] ),
+					delimiter3 = _mm256_set1_epi8( (char) inDelimiters[3] ),
+					firstLeadByte = _mm256_set1_epi8( (char) 0xC0 );
+	size_t			x = inOffset;
+	for( ; (x +32) <= inLen; x += 32 )
+	{
+		__m256i		bytes = _mm256_loadu_si256( (const __m256i*) (inStr +x) );
+		__m256i		matches = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( bytes, delimiter0 ), _mm256_cmpeq_epi8( bytes, delimiter1 ) ),
+												_mm256_or_si256( _mm256_cmpeq_epi8( bytes, delimiter2 ), _mm256_cmpeq_epi8( bytes, delimiter3 ) ) );
+		matches = _mm256_or_si256( matches, _mm256_cmpeq_epi8( _mm256_max_epu8( bytes, firstLeadByte ), bytes ) );	// bytes >= 0xC0.
+		unsigned	matchBits = (unsigned) _mm256_movemask_epi8( matches );
+		if( matchBits != 0 )
+			return x +__builtin_ctz( matchBits );
+	}
+	return LEOFindDelimiterOrMultiByteCharScalar( inStr, x, inLen, inDelimiters );
+}
+#endif // LEO_CHUNKS_USE_AVX2
+
+
+static size_t	LEOFindDelimiterOrMultiByteCharAutoSelect( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] );
+
+// The fastest of the above this CPU can do, picked the first time we're called:
+static size_t	(*sLEOFindDelimiterOrMultiByteChar)( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] ) = LEOFindDelimiterOrMultiByteCharAutoSelect;
+
+
+static size_t	LEOFindDelimiterOrMultiByteCharAutoSelect( const char* inStr, size_t inOffset, size_t inLen, const uint8_t inDelimiters[4] )
+{
+	sLEOFindDelimiterOrMultiByteChar = LEOFindDelimiterOrMultiByteCharScalar;
+#if LEO_CHUNKS_USE_SSE2
+	sLEOFindDelimiterOrMultiByteChar = LEOFindDelimiterOrMultiByteCharSSE2;
+#endif
+#if LEO_CHUNKS_USE_AVX2
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") )
+		sLEOFindDelimiterOrMultiByteChar = LEOFindDelimiterOrMultiByteCharAVX2;
+#endif
+	
+	return sLEOFindDelimiterOrMultiByteChar( inStr, inOffset, inLen, inDelimiters );
+}
+
+
+// Fill outDelimiters with the bytes that can end a run of skippable bytes
+//	when looking for chunks of the given type. Returns false if runs of bytes
+//	can't be skipped, because the item delimiter isn't ASCII, so single bytes
+//	may decode to it:
+static bool	LEOGetChunkDelimiterBytes( LEOChunkType inType, uint32_t itemDelimiter, uint8_t outDelimiters[4] )
+{
+	if( inType == kLEOChunkTypeItem && itemDelimiter < 0x80 )
+		memset( outDelimiters, (int) itemDelimiter, 4 );
+	else if( inType == kLEOChunkTypeLine )
+	{
+		outDelimiters[0] = outDelimiters[2] = '\n';
+		outDelimiters[1] = outDelimiters[3] = '\r';
+	}
+	else if( inType == kLEOChunkTypeWord )
+	{
+		outDelimiters[0] = ' ';
+		outDelimiters[1] = '\t';
+		outDelimiters[2] = '\r';
+		outDelimiters[3] = '\n';
+	}
+	else
+		return false;
+	
+	return true;
+}
+
+
 // Gives us both the actual range of a chunk, and the range that should be deleted
 //	when deleting a chunk, since for items or lines, there may be an extra delimiter
 //	that needs to be deleted to completely get rid of a line, and not just set it
@@ -108,7 +237,65 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 							size_t *outDelChunkStart, size_t *outDelChunkEnd,
 							uint32_t itemDelimiter )
 {
-	size_t		theLen = strlen(inStr);
+	LEOGetChunkRangesWithCursor( inStr, strlen(inStr), inType, inRangeStart, inRangeEnd,
+									outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd,
+									itemDelimiter, NULL );
+}
+
+
+void	LEOGetChunkRangesOfLength( const char* inStr, size_t inLen, LEOChunkType inType,
+									size_t inRangeStart, size_t inRangeEnd,
+									size_t *outChunkStart, size_t *outChunkEnd,
+									size_t *outDelChunkStart, size_t *outDelChunkEnd,
+									uint32_t itemDelimiter )
+{
+	LEOGetChunkRangesWithCursor( inStr, inLen, inType, inRangeStart, inRangeEnd,
+									outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd,
+									itemDelimiter, NULL );
+}
+
+
+bool	LEOChunkCursorCanResume( const struct LEOChunkCursor* inCursor, size_t inLen, LEOChunkType inType,
+									size_t inRangeStart, size_t inRangeEnd, uint32_t itemDelimiter )
+{
+	return( inCursor != NULL && inCursor->type == inType && inCursor->stringLen == inLen
+			&& (inType != kLEOChunkTypeItem || inCursor->itemDelimiter == itemDelimiter)
+			&& inCursor->chunkNum <= inRangeStart && inCursor->chunkNum <= inRangeEnd );
+}
+
+
+static void	LEOChunkCursorSetPosition( struct LEOChunkCursor* ioCursor, LEOChunkType inType, uint32_t itemDelimiter, size_t inLen,
+										size_t inChunkNum, size_t inScanOffset, size_t inChunkStart, size_t inDelChunkStart )
+{
+	if( !ioCursor )
+		return;
+	
+	ioCursor->type = inType;
+	ioCursor->itemDelimiter = itemDelimiter;
+	ioCursor->stringLen = inLen;
+	ioCursor->chunkNum = inChunkNum;
+	ioCursor->scanOffset = inScanOffset;
+	ioCursor->chunkStart = inChunkStart;
+	ioCursor->delChunkStart = inDelChunkStart;
+}
+
+
+void	LEOGetChunkRangesWithCursor( const char* inStr, size_t inLen, LEOChunkType inType,
+										size_t inRangeStart, size_t inRangeEnd,
+										size_t *outChunkStart, size_t *outChunkEnd,
+										size_t *outDelChunkStart, size_t *outDelChunkEnd,
+										uint32_t itemDelimiter, struct LEOChunkCursor* ioCursor )
+{
+	size_t		theLen = inLen;
+	
+	// The chunks before the cursor can't be start or end of our range, so we
+	//	can skip them. Otherwise, start from scratch, which is the same as
+	//	continuing from a cursor at the first chunk:
+	struct LEOChunkCursor	startPos = { inType, itemDelimiter, theLen, 0, 0, 0, 0 };
+	if( LEOChunkCursorCanResume( ioCursor, theLen, inType, inRangeStart, inRangeEnd, itemDelimiter ) )
+		startPos = *ioCursor;
+	else if( inRangeStart == 0 )
+		LEOChunkCursorSetPosition( ioCursor, inType, itemDelimiter, theLen, 0, 0, 0, 0 );
 	
 	if( inType == kLEOChunkTypeByte )
 	{
@@ -129,8 +316,8 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 		*outDelChunkStart = theLen;
 		*outDelChunkEnd = theLen;
 		
-		size_t	currOffset = 0;
-		size_t	currChar = 0;
+		size_t	currOffset = startPos.scanOffset;
+		size_t	currChar = startPos.chunkNum;
 		while( currOffset < theLen )
 		{
 			if( currChar == inRangeStart )
@@ -138,6 +325,7 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 				*outChunkStart = currOffset;
 				*outDelChunkStart = currOffset;
 				didFindStart = true;
+				LEOChunkCursorSetPosition( ioCursor, inType, itemDelimiter, theLen, currChar, currOffset, currOffset, currOffset );
 			}
 			
 			/*uint32_t*/ LEOUTF8StringParseUTF32CharacterAtOffset( inStr, theLen, &currOffset );
@@ -166,10 +354,10 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 	}
 	else if( inType == kLEOChunkTypeItem || inType == kLEOChunkTypeLine )
 	{
-		size_t		itemNum = 0;
-		size_t		currChunkStart = 0,
+		size_t		itemNum = startPos.chunkNum;
+		size_t		currChunkStart = startPos.chunkStart,
 					currChunkEnd = 0,
-					currDelChunkStart = 0,
+					currDelChunkStart = startPos.delChunkStart,
 					currDelChunkEnd = 0;
 		
 		*outChunkStart = 0;
@@ -177,7 +365,9 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 		*outChunkEnd = 0;
 		*outDelChunkEnd = 0;
 		
-		size_t x = 0;
+		uint8_t		delimiterBytes[4];
+		bool		canSkip = LEOGetChunkDelimiterBytes( inType, itemDelimiter, delimiterBytes );
+		size_t x = startPos.scanOffset;
 		for( ; x < theLen; )
 		{
 			size_t		newX = x;
@@ -206,11 +396,15 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 					return;
 				}
 				itemNum++;
+				if( itemNum == inRangeStart )
+					LEOChunkCursorSetPosition( ioCursor, inType, itemDelimiter, theLen, itemNum, newX, currChunkStart, currDelChunkStart );
 			}
 			else
 			{
 				currChunkEnd = x;
 				currDelChunkEnd = x;
+				if( canSkip )
+					newX = sLEOFindDelimiterOrMultiByteChar( inStr, newX, theLen, delimiterBytes );
 			}
 			
 			x = newX;
@@ -230,13 +424,15 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 	}
 	else if( inType == kLEOChunkTypeWord )
 	{
-		size_t		wordNum = 0;
-		bool		isInWord = true;	// Ignored, initialized when we know what 1st char is.
+		size_t		wordNum = startPos.chunkNum;
+		bool		isInWord = (startPos.scanOffset == 0);	// Ignored at the start of the string, initialized when we know what 1st char is. A cursor is right before a word.
 		
 		*outChunkStart = 0;
 		*outDelChunkStart = 0;
 		
-		size_t x = 0;
+		uint8_t		delimiterBytes[4];
+		LEOGetChunkDelimiterBytes( inType, itemDelimiter, delimiterBytes );
+		size_t x = startPos.scanOffset;
 		for( ; x < theLen; )
 		{
 			size_t		newX = x;
@@ -262,8 +458,11 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 				{
 					*outChunkStart = x;
 					*outDelChunkStart = x;
+					LEOChunkCursorSetPosition( ioCursor, inType, itemDelimiter, theLen, wordNum, x, x, x );
 				}
 			}
+			if( !isWhitespace )	// Rest of word can't contain a word boundary.
+				newX = sLEOFindDelimiterOrMultiByteChar( inStr, newX, theLen, delimiterBytes );
 			
 			x = newX;
 		}
@@ -318,6 +517,8 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 		size_t		startOffset = currOffset;
 		uint32_t	currCh = 0;
 		bool		foundDelimiter = false;
+		uint8_t		delimiterBytes[4];
+		bool		canSkip = LEOGetChunkDelimiterBytes( inType, itemDelimiter, delimiterBytes );
 		
 		while( currOffset < theLen )
 		{
@@ -337,6 +538,8 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 				
 				startOffset = currOffset;
 			}
+			else if( canSkip )
+				currOffset = sLEOFindDelimiterOrMultiByteChar( inStr, currOffset, theLen, delimiterBytes );
 		}
 		
 		// There's always a last item that we haven't reported yet, though it can be empty:
@@ -349,6 +552,8 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 		
 		foundChunkStart = 0;
 		
+		uint8_t		delimiterBytes[4];
+		LEOGetChunkDelimiterBytes( inType, itemDelimiter, delimiterBytes );
 		size_t x = 0;
 		for( ; x < theLen; )
 		{
@@ -370,6 +575,8 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 				isInWord = true;
 				foundChunkStart = x;
 			}
+			if( !isWhitespace )	// Rest of word can't contain a word boundary.
+				newX = sLEOFindDelimiterOrMultiByteChar( inStr, newX, theLen, delimiterBytes );
 			
 			x = newX;
 		}
@@ -381,3 +588,194 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 		}
 	}
 }
+
+
+static void	LEOChunkIndexAddOffset( struct LEOChunkIndex* inIndex, size_t* ioMaxOffsets, size_t inOffset )
+{
+	if( inIndex->numOffsets >= (*ioMaxOffsets) )
+	{
+		(*ioMaxOffsets) *= 2;
+		inIndex->offsets = realloc( inIndex->offsets, (*ioMaxOffsets) * sizeof(size_t) );
+	}
+	inIndex->offsets[inIndex->numOffsets++] = inOffset;
+}
+
+
+struct LEOChunkIndex*	LEOChunkIndexCreate( const char* inStr, size_t inLen, LEOChunkType inType, uint32_t itemDelimiter )
+{
+	struct LEOChunkIndex*	theIndex = calloc( 1, sizeof(struct LEOChunkIndex) );
+	size_t					maxOffsets = 64;
+	
+	theIndex->type = inType;
+	theIndex->itemDelimiter = itemDelimiter;
+	theIndex->stringLen = inLen;
+	theIndex->offsets = malloc( maxOffsets * sizeof(size_t) );
+	
+	uint8_t		delimiterBytes[4];
+	bool		canSkip = LEOGetChunkDelimiterBytes( inType, itemDelimiter, delimiterBytes );
+	
+	if( inType == kLEOChunkTypeByte )
+		theIndex->numChunks = inLen;	// Bytes are found without looking at the string.
+	else if( inType == kLEOChunkTypeCharacter )
+	{
+		size_t	currOffset = 0;
+		while( currOffset < inLen )
+		{
+			LEOChunkIndexAddOffset( theIndex, &maxOffsets, currOffset );
+			LEOUTF8StringParseUTF32CharacterAtOffset( inStr, inLen, &currOffset );
+			theIndex->numChunks++;
+		}
+		LEOChunkIndexAddOffset( theIndex, &maxOffsets, currOffset );	// End of last character.
+	}
+	else if( inType == kLEOChunkTypeItem || inType == kLEOChunkTypeLine )
+	{
+		size_t	currOffset = 0;
+		while( currOffset < inLen )
+		{
+			size_t		prevOffset = currOffset;
+			uint32_t	currCh = LEOUTF8StringParseUTF32CharacterAtOffset( inStr, inLen, &currOffset );
+			bool		foundDelimiter = false;
+			if( inType == kLEOChunkTypeItem )
+				foundDelimiter = (currCh == itemDelimiter);
+			else
+				foundDelimiter = (currCh == '\n' || currCh == '\r');
+			if( foundDelimiter )
+				LEOChunkIndexAddOffset( theIndex, &maxOffsets, prevOffset );
+			else if( canSkip )
+				currOffset = sLEOFindDelimiterOrMultiByteChar( inStr, currOffset, inLen, delimiterBytes );
+		}
+		theIndex->numChunks = theIndex->numOffsets +1;	// There's always a last item, though it can be empty.
+	}
+	else if( inType == kLEOChunkTypeWord )
+	{
+		bool	isInWord = true;	// Ignored, initialized when we know what 1st char is.
+		size_t	x = 0;
+		while( x < inLen )
+		{
+			size_t		newX = x;
+			uint32_t	currCh = LEOUTF8StringParseUTF32CharacterAtOffset( inStr, inLen, &newX );
+			bool		isWhitespace = (currCh == ' ' || currCh == '\t' || currCh == '\r' || currCh == '\n');
+			if( x == 0 )
+			{
+				isInWord = !isWhitespace;
+				if( isInWord )
+					LEOChunkIndexAddOffset( theIndex, &maxOffsets, 0 );
+			}
+			else if( !isWhitespace && !isInWord )
+			{
+				isInWord = true;
+				LEOChunkIndexAddOffset( theIndex, &maxOffsets, x );
+			}
+			if( isWhitespace && isInWord )
+			{
+				isInWord = false;
+				LEOChunkIndexAddOffset( theIndex, &maxOffsets, x );
+			}
+			else if( !isWhitespace )	// Rest of word can't contain a word boundary.
+				newX = sLEOFindDelimiterOrMultiByteChar( inStr, newX, inLen, delimiterBytes );
+			
+			x = newX;
+		}
+		if( isInWord && inLen > 0 )
+			LEOChunkIndexAddOffset( theIndex, &maxOffsets, inLen );
+		theIndex->endsInWord = isInWord;
+		// Like LEODoForEachChunk(), count an empty string as one empty word:
+		theIndex->numChunks = (theIndex->numOffsets / 2) + ((inLen == 0) ? 1 : 0);
+	}
+	
+	return theIndex;
+}
+
+
+void	LEOChunkIndexFree( struct LEOChunkIndex* inIndex )
+{
+	free( inIndex->offsets );
+	free( inIndex );
+}
+
+
+void	LEOGetChunkRangesFromIndex( struct LEOChunkIndex* inIndex,
+									size_t inRangeStart, size_t inRangeEnd,
+									size_t *outChunkStart, size_t *outChunkEnd,
+									size_t *outDelChunkStart, size_t *outDelChunkEnd )
+{
+	size_t*		offsets = inIndex->offsets;
+	
+	if( inIndex->type == kLEOChunkTypeByte )
+	{
+		if( inRangeEnd > inIndex->stringLen )
+			inRangeEnd = inIndex->stringLen;
+		
+		*outChunkStart = inRangeStart;
+		*outDelChunkStart = inRangeStart;
+		*outChunkEnd = inRangeEnd;
+		*outDelChunkEnd = inRangeEnd;
+	}
+	else if( inIndex->type == kLEOChunkTypeCharacter )
+	{
+		size_t	numChars = inIndex->numChunks;
+		
+		*outChunkStart = (inRangeStart < numChars) ? offsets[inRangeStart] : offsets[numChars];
+		*outDelChunkStart = *outChunkStart;
+		*outChunkEnd = (inRangeEnd < numChars) ? offsets[inRangeEnd +1] : offsets[numChars];
+		*outDelChunkEnd = *outChunkEnd;
+	}
+	else if( inIndex->type == kLEOChunkTypeItem || inIndex->type == kLEOChunkTypeLine )
+	{
+		size_t	numDelimiters = inIndex->numOffsets;
+		bool	startIsValid = (inRangeEnd < numDelimiters) ? (inRangeStart <= inRangeEnd) : (inRangeStart <= numDelimiters);
+		
+		*outChunkStart = 0;
+		*outDelChunkStart = 0;
+		*outChunkEnd = 0;
+		*outDelChunkEnd = 0;
+		
+		if( startIsValid && inRangeStart > 0 )
+		{
+			*outChunkStart = offsets[inRangeStart -1] +1;
+			*outDelChunkStart = offsets[inRangeStart -1];
+		}
+		if( inRangeEnd < numDelimiters )
+		{
+			*outChunkEnd = offsets[inRangeEnd];
+			*outDelChunkEnd = (inRangeStart == 0) ? offsets[inRangeEnd] +1 : offsets[inRangeEnd];
+		}
+		else if( inRangeEnd == numDelimiters )
+		{
+			*outChunkEnd = inIndex->stringLen;
+			*outDelChunkEnd = inIndex->stringLen;
+		}
+	}
+	else if( inIndex->type == kLEOChunkTypeWord )
+	{
+		size_t	numWords = inIndex->numOffsets / 2;
+		size_t	numEndedWords = (inIndex->endsInWord && numWords > 0) ? numWords -1 : numWords;	// Words followed by whitespace.
+		
+		*outChunkStart = 0;
+		*outDelChunkStart = 0;
+		
+		if( inRangeEnd < numEndedWords )
+		{
+			if( inRangeStart <= inRangeEnd )
+			{
+				*outChunkStart = offsets[inRangeStart * 2];
+				*outDelChunkStart = *outChunkStart;
+			}
+			*outChunkEnd = offsets[inRangeEnd * 2 +1];
+			*outDelChunkEnd = *outChunkEnd;
+		}
+		else
+		{
+			if( inRangeStart < numWords )
+			{
+				*outChunkStart = offsets[inRangeStart * 2];
+				*outDelChunkStart = *outChunkStart;
+			}
+			if( inIndex->endsInWord && inRangeEnd == numEndedWords )
+			{
+				*outChunkEnd = inIndex->stringLen;
+				*outDelChunkEnd = inIndex->stringLen;
+			}
+		}
+	}
+}
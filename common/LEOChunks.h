@@ -104,6 +104,76 @@ void	LEOGetChunkRanges( const char* inStr, LEOChunkType inType,
 							uint32_t itemDelimiter );
 
 
+/*!
+	Like LEOGetChunkRanges(), but for a string of known length, which doesn't
+	need to be NUL-terminated and may contain NUL bytes. Use this whenever you
+	already know the length, so the string doesn't need to be measured first.
+	
+	@param inLen			The length of inStr in bytes.
+	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+*/
+void	LEOGetChunkRangesOfLength( const char* inStr, size_t inLen, LEOChunkType inType,
+									size_t inRangeStart, size_t inRangeEnd,
+									size_t *outChunkStart, size_t *outChunkEnd,
+									size_t *outDelChunkStart, size_t *outDelChunkEnd,
+									uint32_t itemDelimiter );
+
+
+/*!
+	Where LEOGetChunkRangesWithCursor() last found the start of a chunk in a
+	string, so that looking up the same or a later chunk in that string can
+	continue scanning from there instead of from the start of the string.
+	Set type to kLEOChunkTypeINVALID to indicate there is no position to
+	continue from, e.g. because the string changed.
+	@field	type			The type of chunk the position is for.
+	@field	itemDelimiter	The item delimiter that was used if type is
+							kLEOChunkTypeItem.
+	@field	stringLen		The length in bytes of the string scanned.
+	@field	chunkNum		The (zero-based) number of the chunk found.
+	@field	scanOffset		The byte offset at which to continue scanning.
+	@field	chunkStart		The start offset of the chunk, for items and lines.
+	@field	delChunkStart	The start offset of the range to delete to remove
+							the chunk, for items and lines.
+*/
+struct LEOChunkCursor
+{
+	LEOChunkType	type;
+	uint32_t		itemDelimiter;
+	size_t			stringLen;
+	size_t			chunkNum;
+	size_t			scanOffset;
+	size_t			chunkStart;
+	size_t			delChunkStart;
+};
+
+
+/*!
+	Like LEOGetChunkRangesOfLength(), but continuing the scan at the position in ioCursor if that position lies before the
+	requested chunks. On return, ioCursor is positioned at the start of the
+	first requested chunk if it was found, so consecutive lookups of the next
+	chunk only need to scan that chunk.
+	
+	@param inLen			The length of inStr in bytes.
+	@param ioCursor			The position where the previous lookup of a chunk
+							in inStr was found, or NULL to just scan from the
+							start of inStr.
+	@seealso //leo_ref/c/func/LEOGetChunkRangesOfLength LEOGetChunkRangesOfLength
+*/
+void	LEOGetChunkRangesWithCursor( const char* inStr, size_t inLen, LEOChunkType inType,
+										size_t inRangeStart, size_t inRangeEnd,
+										size_t *outChunkStart, size_t *outChunkEnd,
+										size_t *outDelChunkStart, size_t *outDelChunkEnd,
+										uint32_t itemDelimiter, struct LEOChunkCursor* ioCursor );
+
+/*!
+	Return whether LEOGetChunkRangesWithCursor() would be able to continue
+	scanning at the position in inCursor to look up the given chunk range in
+	a string of inLen bytes, instead of having to scan from its start.
+*/
+bool	LEOChunkCursorCanResume( const struct LEOChunkCursor* inCursor, size_t inLen, LEOChunkType inType,
+									size_t inRangeStart, size_t inRangeEnd, uint32_t itemDelimiter );
+
+
 /*!
 	Determine all the chunks of a certain type in a string and call the given
 	callback for each chunk.
@@ -132,4 +202,72 @@ void	LEODoForEachChunk( const char* inStr, size_t inBufSize, LEOChunkType inType
 							uint32_t itemDelimiter, void* userData );
 
 
+/*!
+	A table of where the chunks of one type are in a string, so that the n-th
+	chunk can be found without scanning the string from its start again. Create
+	one using LEOChunkIndexCreate() and dispose of it using LEOChunkIndexFree().
+	The index only stays valid as long as the string it was made for is not
+	changed.
+	@field	type			The type of chunk this index was made for.
+	@field	itemDelimiter	The item delimiter that was used if type is
+							kLEOChunkTypeItem.
+	@field	stringLen		The length in bytes of the indexed string.
+	@field	numChunks		The number of chunks LEODoForEachChunk() would
+							report for the indexed string.
+	@field	endsInWord		For words, whether the string ends in a word (or is
+							empty), i.e. whether its last word runs up to its end.
+	@field	numOffsets		The number of entries in offsets.
+	@field	offsets			For characters, the offset of each character
+							followed by the offset past the last one. For items
+							and lines, the offset of each delimiter. For words,
+							the start and end offsets of each word.
+	@field	next			Whoever owns an index may use this to keep a list of
+							several indexes for the same string.
+*/
+struct LEOChunkIndex
+{
+	LEOChunkType			type;
+	uint32_t				itemDelimiter;
+	size_t					stringLen;
+	size_t					numChunks;
+	bool					endsInWord;
+	size_t					numOffsets;
+	size_t*					offsets;
+	struct LEOChunkIndex*	next;
+};
+
+
+/*!
+	Scan inStr once and remember where all its chunks of the given type are.
+	
+	@param inStr			A UTF8-encoded string to be parsed.
+	@param inLen			The length of inStr in bytes.
+	@param inType			The type of chunk to build the index for.
+	@param itemDelimiter	The item delimiter to use when inType is kLEOChunkTypeItem.
+	@result	A new index you must dispose of using LEOChunkIndexFree().
+*/
+
+struct LEOChunkIndex*	LEOChunkIndexCreate( const char* inStr, size_t inLen, LEOChunkType inType, uint32_t itemDelimiter );
+
+/*!
+	Dispose of a chunk index created using LEOChunkIndexCreate(). This does not
+	touch any other indexes that are linked to it using its next field.
+*/
+
+void	LEOChunkIndexFree( struct LEOChunkIndex* inIndex );
+
+/*!
+	Like LEOGetChunkRanges(), but looks up the ranges in an index for the
+	string instead of parsing the string. The results are the same as
+	LEOGetChunkRanges() would give for the string the index was created for.
+	
+	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+*/
+
+void	LEOGetChunkRangesFromIndex( struct LEOChunkIndex* inIndex,
+									size_t inRangeStart, size_t inRangeEnd,
+									size_t *outChunkStart, size_t *outChunkEnd,
+									size_t *outDelChunkStart, size_t *outDelChunkEnd );
+
+
 #endif // LEO_CHUNKS_H
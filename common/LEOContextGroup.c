@@ -12,8 +12,10 @@
 // -----------------------------------------------------------------------------
 
 #include "LEOContextGroup.h"
+#include "LEOInterpreter.h"
 #include "LEOHandlerID.h"
 #include "LEOValue.h"
+#include "UTF8UTF32Utilities.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,8 +26,10 @@
 //	Constants:
 // -----------------------------------------------------------------------------
 
-#define LEOReferencesTableChunkSize			16
+#define LEOReferencesTableMinSize			16		// The references table starts out this big and then doubles in size whenever it is full.
 #define LEOHandlerNamesChunkSize			16
+#define LEOHandlerNameSlotsMinSize			64		// Must be a power of 2.
+#define LEOHandlerNameArenaBlockSize		4096
 
 
 
@@ -39,6 +43,18 @@ struct LEOObject	// What a LEOObjectID refers to. These are kept in a big array
 {
 	void*			value;	// The actual pointer to the referenced value. NULL for unused object entries.
 	LEOObjectSeed	seed;	// Whenever a referenced object entry is re-used, this seed is incremented, so people still referencing it know they're wrong.
+	LEOObjectID		nextFree;	// For unused object entries, the index of the next unused one. kLEOObjectIDINVALID for the last one.
+};
+
+
+/* Handler names are never freed individually, so we just put them one after the
+	other in big blocks of memory. */
+struct LEOHandlerNameArenaBlock
+{
+	struct LEOHandlerNameArenaBlock*	next;	// Previous (full) block.
+	size_t								size;	// Number of bytes in 'bytes'.
+	size_t								used;	// Number of bytes in 'bytes' already handed out.
+	char								bytes[];
 };
 
 
@@ -67,11 +83,36 @@ void	LEOContextGroupRelease( LEOContextGroup* inGroup )
 	inGroup->referenceCount --;
 	if( inGroup->referenceCount == 0 )
 	{
+		LEOContextGroupSetMaxPooledContexts( inGroup, 0 );
+		if( inGroup->handlerLookupCache.entries )
+		{
+			free( inGroup->handlerLookupCache.entries );
+			inGroup->handlerLookupCache.entries = NULL;
+		}
+		while( inGroup->handlerNameArena )
+		{
+			LEOHandlerNameArenaBlock*	nextBlock = inGroup->handlerNameArena->next;
+			free( inGroup->handlerNameArena );
+			inGroup->handlerNameArena = nextBlock;
+		}
+		if( inGroup->handlerNames )
+		{
+			free( inGroup->handlerNames );
+			inGroup->handlerNames = NULL;
+			inGroup->numHandlerNames = 0;
+		}
+		if( inGroup->handlerNameSlots )
+		{
+			free( inGroup->handlerNameSlots );
+			inGroup->handlerNameSlots = NULL;
+			inGroup->numHandlerNameSlots = 0;
+		}
 		if( inGroup->references )
 		{
 			free( inGroup->references );
 			inGroup->references = NULL;
 			inGroup->numReferences = 0;
+			inGroup->firstFreeReference = kLEOObjectIDINVALID;
 		}
 		if( inGroup->cleanUpUserData )
 		{
@@ -84,6 +125,54 @@ void	LEOContextGroupRelease( LEOContextGroup* inGroup )
 }
 
 
+void	LEOContextGroupSetMaxPooledContexts( LEOContextGroup* inGroup, size_t inMaxContexts )
+{
+	LEOContextPool*	pool = &inGroup->contextPool;
+	
+	while( pool->numIdleContexts > inMaxContexts )
+		LEOContextFreePooledContext( pool->idleContexts[--pool->numIdleContexts] );
+	
+	if( inMaxContexts == 0 )
+	{
+		if( pool->idleContexts )
+			free( pool->idleContexts );
+		pool->idleContexts = NULL;
+	}
+	else
+	{
+		struct LEOContext**	idleContexts = realloc( pool->idleContexts, inMaxContexts * sizeof(struct LEOContext*) );
+		if( !idleContexts )
+		{
+			printf( "*** Failed to allocate context pool! ***\n" );
+			return;
+		}
+		pool->idleContexts = idleContexts;
+	}
+	pool->maxIdleContexts = inMaxContexts;
+}
+
+
+LEOHandlerLookupCacheEntry*	LEOContextGroupGetHandlerLookupCacheEntry( LEOContextGroup* inGroup, struct LEOInstruction* inCallSite, struct LEOScript* inReceivingScript )
+{
+	LEOHandlerLookupCache*	cache = &inGroup->handlerLookupCache;
+	if( cache->disabled )
+		return NULL;
+	
+	if( !cache->entries )
+	{
+		cache->entries = calloc( LEO_HANDLER_LOOKUP_CACHE_SIZE, sizeof(LEOHandlerLookupCacheEntry) );
+		if( !cache->entries )
+		{
+			printf( "*** Failed to allocate handler lookup cache! ***\n" );
+			return NULL;
+		}
+	}
+	
+	uintptr_t	hash = ((uintptr_t)inCallSite >> 3) ^ ((uintptr_t)inReceivingScript >> 4) ^ ((uintptr_t)inReceivingScript >> 12);
+	return cache->entries +(hash & (LEO_HANDLER_LOOKUP_CACHE_SIZE -1));
+}
+
+
 void	LEOContextGroupCreateNewObjectIDAndSeedForPointer( LEOContextGroup* inContext, LEOObjectID *outObjectID, LEOObjectSeed *outSeed, void* theValue )
 {
 	*outObjectID = LEOContextGroupCreateNewObjectIDForPointer( inContext, theValue );
@@ -94,39 +183,31 @@ void	LEOContextGroupCreateNewObjectIDAndSeedForPointer( LEOContextGroup* inConte
 
 LEOObjectID	LEOContextGroupCreateNewObjectIDForPointer( LEOContextGroup* inContext, void* theValue )
 {
-	LEOObjectID		newObjectID = kLEOObjectIDINVALID;
-	if( inContext->references == NULL )
+	if( inContext->firstFreeReference == kLEOObjectIDINVALID )
 	{
-		inContext->numReferences = LEOReferencesTableChunkSize;
-		inContext->references = calloc( inContext->numReferences, sizeof(struct LEOObject) );
-		
-		newObjectID = 1;	// Can start with first item right away.
-	}
-	else
-	{
-		// +++ Optimize: remember the last one we cleared or returned or so and start scanning there.
-		
-		for( size_t x = 1; x < inContext->numReferences; x++ )
+		// No free slots left? Grow the table and put the new slots on the free list:
+		size_t		oldNumReferences = inContext->numReferences;
+		size_t		newNumReferences = oldNumReferences ? (oldNumReferences * 2) : LEOReferencesTableMinSize;
+		LEOObject*	newReferences = realloc( inContext->references, sizeof(struct LEOObject) * newNumReferences );
+		if( !newReferences )
 		{
-			if( inContext->references[x].value == NULL )	// Unused slot!
-			{
-				newObjectID = x;
-				break;
-			}
+			printf( "*** Failed to allocate references table! ***\n" );
+			return kLEOObjectIDINVALID;
 		}
+		memset( newReferences +oldNumReferences, 0, (newNumReferences -oldNumReferences) * sizeof(struct LEOObject) );
 		
-		if( newObjectID == kLEOObjectIDINVALID )
-		{
-			// No free slots left?
-			size_t		oldNumReferences = inContext->numReferences;
-			inContext->numReferences += LEOReferencesTableChunkSize;
-			inContext->references = realloc( inContext->references, sizeof(struct LEOObject) * inContext->numReferences );
-			memset( ((char*)inContext->references) +(oldNumReferences * sizeof(struct LEOObject)), 0, LEOReferencesTableChunkSize * sizeof(struct LEOObject) );
-			
-			newObjectID = oldNumReferences;	// Same as index of first new item.
-		}
+		size_t		firstNewSlot = (oldNumReferences == 0) ? 1 : oldNumReferences;	// Slot 0 is kLEOObjectIDINVALID, never hand it out.
+		for( size_t x = firstNewSlot; x < (newNumReferences -1); x++ )
+			newReferences[x].nextFree = x +1;
+		
+		inContext->references = newReferences;
+		inContext->numReferences = newNumReferences;
+		inContext->firstFreeReference = firstNewSlot;
 	}
 	
+	LEOObjectID		newObjectID = inContext->firstFreeReference;
+	inContext->firstFreeReference = inContext->references[newObjectID].nextFree;
+	inContext->references[newObjectID].nextFree = kLEOObjectIDINVALID;
 	inContext->references[newObjectID].value = theValue;
 	
 	return newObjectID;
@@ -143,6 +224,8 @@ void	LEOContextGroupRecycleObjectID( LEOContextGroup* inContext, LEOObjectID inO
 {
 	inContext->references[inObjectID].value = NULL;
 	inContext->references[inObjectID].seed += 1;	// Make sure that if this is reused, whoever still references it knows it's gone.
+	inContext->references[inObjectID].nextFree = inContext->firstFreeReference;
+	inContext->firstFreeReference = inObjectID;
 }
 
 
@@ -155,50 +238,177 @@ void*	LEOContextGroupGetPointerForObjectIDAndSeed( LEOContextGroup* inContext, L
 }
 
 
+void	LEOContextGroupRelocatePointersInRange( LEOContextGroup* inContext, void* inOldStart, size_t inOldSize, void* inNewStart )
+{
+	char*	oldStart = (char*) inOldStart;
+	char*	oldEnd = oldStart +inOldSize;
+	
+	for( size_t x = 1; x < inContext->numReferences; x++ )
+	{
+		char*	currValue = (char*) inContext->references[x].value;
+		if( currValue >= oldStart && currValue < oldEnd )
+			inContext->references[x].value = ((char*)inNewStart) +(currValue -oldStart);
+	}
+}
+
+
+// Return the next character of a UTF8 string of the given length, lowercased, and advance ioOffset past it:
+static inline uint32_t	LEONextLowercaseCharacterInHandlerName( const char* inName, size_t inNameLen, size_t *ioOffset )
+{
+	unsigned char	currCh = inName[*ioOffset];
+	if( currCh < 0x80 )	// ASCII is most common, so short-circuit that:
+	{
+		(*ioOffset)++;
+		return (currCh >= 'A' && currCh <= 'Z') ? (currCh -'A' +'a') : currCh;
+	}
+	
+	size_t		charLen = 0;
+	uint32_t	utf32Char = UTF8StringParseUTF32CharacterAtOffset( inName +(*ioOffset), inNameLen -(*ioOffset), &charLen );
+	if( charLen == 0 )	// Sequence cut off by the end of the name (e.g. Latin-1), take the byte as-is.
+	{
+		(*ioOffset)++;
+		return currCh;
+	}
+	(*ioOffset) += charLen;
+	return UTF32CharacterToLower( utf32Char );
+}
+
+
+// FNV-1a over the lowercased characters, so all spellings hash the same:
+static uint32_t	LEOHashHandlerName( const char* inName )
+{
+	uint32_t	hash = 2166136261U;
+	size_t		nameLen = strlen(inName);
+	size_t		offset = 0;
+	while( offset < nameLen )
+	{
+		hash ^= LEONextLowercaseCharacterInHandlerName( inName, nameLen, &offset );
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+
+static bool	LEOHandlerNamesAreEqual( const char* inNameA, const char* inNameB )
+{
+	size_t		nameALen = strlen(inNameA), nameBLen = strlen(inNameB);
+	size_t		offsetA = 0, offsetB = 0;
+	while( offsetA < nameALen && offsetB < nameBLen )
+	{
+		if( LEONextLowercaseCharacterInHandlerName( inNameA, nameALen, &offsetA ) != LEONextLowercaseCharacterInHandlerName( inNameB, nameBLen, &offsetB ) )
+			return false;
+	}
+	return offsetA == nameALen && offsetB == nameBLen;
+}
+
+
+static size_t	LEOContextGroupFindHandlerNameSlot( LEOContextGroup* inContext, const char* handlerName, uint32_t inHash )
+{
+	size_t	x = inHash & (inContext->numHandlerNameSlots -1);
+	while( inContext->handlerNameSlots[x] != kLEOHandlerIDINVALID )
+	{
+		if( LEOHandlerNamesAreEqual( handlerName, inContext->handlerNames[ inContext->handlerNameSlots[x] ] ) )
+			break;
+		x = (x +1) & (inContext->numHandlerNameSlots -1);
+	}
+	return x;
+}
+
+
+static char*	LEOContextGroupCopyHandlerName( LEOContextGroup* inContext, const char* handlerName )
+{
+	size_t		handlerNameLen = strlen(handlerName) +1;
+	LEOHandlerNameArenaBlock*	block = inContext->handlerNameArena;
+	if( !block || (block->size -block->used) < handlerNameLen )
+	{
+		size_t	blockSize = (handlerNameLen > LEOHandlerNameArenaBlockSize) ? handlerNameLen : LEOHandlerNameArenaBlockSize;
+		block = malloc( sizeof(LEOHandlerNameArenaBlock) +blockSize );
+		if( !block )
+			return NULL;
+		block->next = inContext->handlerNameArena;
+		block->size = blockSize;
+		block->used = 0;
+		inContext->handlerNameArena = block;
+	}
+	
+	char*	nameCopy = block->bytes +block->used;
+	memmove( nameCopy, handlerName, handlerNameLen );
+	block->used += handlerNameLen;
+	return nameCopy;
+}
+
+
 LEOHandlerID	LEOContextGroupHandlerIDForHandlerName( LEOContextGroup* inContext, const char* handlerName )
 {
-	LEOHandlerID	foundID = kLEOHandlerIDINVALID;
+	uint32_t	hash = LEOHashHandlerName( handlerName );
+	size_t		slotIndex = 0;
+	
+	if( inContext->numHandlerNameSlots > 0 )
+	{
+		slotIndex = LEOContextGroupFindHandlerNameSlot( inContext, handlerName, hash );
+		if( inContext->handlerNameSlots[slotIndex] != kLEOHandlerIDINVALID )
+			return inContext->handlerNameSlots[slotIndex];
+	}
+	
+	// Not found? Add it:
+	char*	nameCopy = LEOContextGroupCopyHandlerName( inContext, handlerName );
+	if( !nameCopy )
+	{
+		printf( "*** Failed to allocate handler name! ***\n" );
+		return kLEOHandlerIDINVALID;
+	}
 	
-	if( inContext->handlerNames && inContext->numHandlerNames > 0 )
+	LEOHandlerID	foundID = kLEOHandlerIDINVALID;
+	if( inContext->handlerNames == NULL )
+	{
+		inContext->numHandlerNames = 1;
+		inContext->handlerNames = calloc( LEOHandlerNamesChunkSize, sizeof(char*) );
+		
+		foundID = 0;	// Can start with first item right away.
+	}
+	else
 	{
-		for( LEOHandlerID x = 0; x < inContext->numHandlerNames; x++ )
+		foundID = inContext->numHandlerNames;
+		inContext->numHandlerNames ++;
+		if( (inContext->numHandlerNames % LEOHandlerNamesChunkSize) == 1 )	// Just exceeded previous block?
 		{
-			if( strcasecmp(handlerName, inContext->handlerNames[x] ) == 0 )
-			{
-				foundID = x;
-				break;
-			}
+			size_t	numSlots = inContext->numHandlerNames +LEOHandlerNamesChunkSize -1;
+			inContext->handlerNames = realloc( inContext->handlerNames, sizeof(char*) * numSlots );
 		}
 	}
+	inContext->handlerNames[foundID] = nameCopy;
 	
-	if( foundID == kLEOHandlerIDINVALID )
+	// Keep the hash table at most half full, so probe sequences stay short:
+	if( (inContext->numHandlerNames * 2) > inContext->numHandlerNameSlots )
 	{
-		if( inContext->handlerNames == NULL )
+		size_t			newNumSlots = inContext->numHandlerNameSlots ? (inContext->numHandlerNameSlots * 2) : LEOHandlerNameSlotsMinSize;
+		LEOHandlerID*	newSlots = malloc( newNumSlots * sizeof(LEOHandlerID) );
+		if( !newSlots )
 		{
-			inContext->numHandlerNames = 1;
-			inContext->handlerNames = calloc( LEOHandlerNamesChunkSize, sizeof(char*) );
-			
-			foundID = 0;	// Can start with first item right away.
+			printf( "*** Failed to allocate handler name table! ***\n" );
+			inContext->numHandlerNames--;
+			return kLEOHandlerIDINVALID;
 		}
-		else
+		for( size_t x = 0; x < newNumSlots; x++ )
+			newSlots[x] = kLEOHandlerIDINVALID;
+		if( inContext->handlerNameSlots )
+			free( inContext->handlerNameSlots );
+		inContext->handlerNameSlots = newSlots;
+		inContext->numHandlerNameSlots = newNumSlots;
+		
+		for( LEOHandlerID x = 0; x < foundID; x++ )
 		{
-			foundID = inContext->numHandlerNames;
-			inContext->numHandlerNames ++;
-			if( (inContext->numHandlerNames % LEOHandlerNamesChunkSize) == 1 )	// Just exceeded previous block?
-			{
-				size_t	numSlots = inContext->numHandlerNames +LEOHandlerNamesChunkSize -1;
-				inContext->handlerNames = realloc( inContext->handlerNames, sizeof(char*) * numSlots );
-			}
+			const char*	currName = inContext->handlerNames[x];
+			inContext->handlerNameSlots[ LEOContextGroupFindHandlerNameSlot( inContext, currName, LEOHashHandlerName( currName ) ) ] = x;
 		}
-		
-		size_t	handlerNameLen = strlen(handlerName) +1;
-		inContext->handlerNames[foundID] = calloc( handlerNameLen, sizeof(char) );
-		memmove( inContext->handlerNames[foundID], handlerName, handlerNameLen );
+		slotIndex = LEOContextGroupFindHandlerNameSlot( inContext, handlerName, hash );
 	}
+	inContext->handlerNameSlots[slotIndex] = foundID;
 	
 	return foundID;
 }
 
+
 const char*		LEOContextGroupHandlerNameForHandlerID( LEOContextGroup* inContext, LEOHandlerID inHandlerID )
 {
 	if( !inContext->handlerNames )
@@ -210,17 +420,6 @@ const char*		LEOContextGroupHandlerNameForHandlerID( LEOContextGroup* inContext,
 }
 
 
-static void	LEODebugPrintContextGroupPrintArrayKey( struct LEOArrayEntry* currEntry, bool *firstItem )
-{
-	if( !currEntry )
-		return;
-	LEODebugPrintContextGroupPrintArrayKey( currEntry->smallerItem, firstItem );
-	printf("%s\"%s\"", firstItem?"":", ", currEntry->key);
-	*firstItem = false;	// We just did an item, next one can never be first again.
-	LEODebugPrintContextGroupPrintArrayKey( currEntry->smallerItem, firstItem );
-}
-
-
 void	LEODebugPrintContextGroup( LEOContextGroup* inContext )
 {
 	printf("Context Group %p:\n", inContext);
@@ -228,7 +427,22 @@ void	LEODebugPrintContextGroup( LEOContextGroup* inContext )
 	printf("\tFlags: %s %s %s\n", ((inContext->flags & kLEOContextGroupFlagNoNetwork) ? "NoNetwork":"[]"), ((inContext->flags & kLEOContextGroupFlagHyperCardCompatibility) ? "HyperCardCompatibility":"[]"), ((inContext->flags & kLEOContextGroupFlagFromNetwork) ? "FromNetwork":"[]"));
 	printf("\tGlobals: ");
 	bool	firstItem = true;
-	LEODebugPrintContextGroupPrintArrayKey( inContext->globals, &firstItem );
+	if( inContext->globals )
+	{
+		for( size_t x = 1; x <= inContext->globals->numIndexedItems; x++ )
+		{
+			printf("%s\"%zu\"", firstItem?"":", ", x);
+			firstItem = false;
+		}
+		struct LEOArrayKeyedEntryIterator	iterator;
+		struct LEOArrayKeyedEntry		*	currEntry = NULL;
+		LEOArrayKeyedEntryIteratorInit( &iterator, inContext->globals );
+		while( (currEntry = LEOArrayKeyedEntryIteratorNext( &iterator )) )
+		{
+			printf("%s\"%s\"", firstItem?"":", ", currEntry->key);
+			firstItem = false;
+		}
+	}
 	printf("\n\tHandler IDs:\n");
 	for( size_t x = 0; x < inContext->numHandlerNames; x++ )
 		printf( "\t\t%zu: %s\n", x, inContext->handlerNames[x] );
@@ -37,6 +37,83 @@ extern "C" {
 
 typedef struct LEOObject LEOObject;
 
+typedef struct LEOHandlerNameArenaBlock LEOHandlerNameArenaBlock;
+
+struct LEOContext;
+struct LEOScript;
+struct LEOHandler;
+struct LEOInstruction;
+
+
+/*! Released contexts that a LEOContextGroup keeps around so
+	LEOContextCreateFromPool can hand them out again without allocating a
+	new context.
+	@field	maxIdleContexts		How many released contexts to keep around. 0 turns pooling off.
+	@field	numIdleContexts		Number of contexts in <tt>idleContexts</tt>.
+	@field	idleContexts		Released contexts, ready for reuse.
+	@field	numContextsInUse	Number of contexts created by LEOContextCreateFromPool that haven't been released yet.
+	@field	hits				How often LEOContextCreateFromPool could reuse an idle context.
+	@field	misses				How often LEOContextCreateFromPool had to create a new context.
+	@field	highWaterMark		The largest value <tt>numContextsInUse</tt> ever had.
+	@seealso //leo_ref/c/func/LEOContextCreateFromPool LEOContextCreateFromPool
+	@seealso //leo_ref/c/func/LEOContextGroupSetMaxPooledContexts LEOContextGroupSetMaxPooledContexts
+*/
+typedef struct LEOContextPool
+{
+	size_t					maxIdleContexts;
+	size_t					numIdleContexts;
+	struct LEOContext	**	idleContexts;
+	size_t					numContextsInUse;
+	size_t					hits;
+	size_t					misses;
+	size_t					highWaterMark;
+} LEOContextPool;
+
+
+/*! One entry in a LEOHandlerLookupCache, remembering which handler a
+	CALL_HANDLER_INSTR ended up calling when it was executed in a particular
+	script.
+	@field	callSite			The CALL_HANDLER_INSTR this entry is for.
+	@field	receivingScript		The script that was current when the call was made.
+	@field	generation			The value of gLEOHandlerLookupGeneration when this entry was made.
+	@field	startScript			The script the handler lookup started in (the parent of receivingScript when passing a message).
+	@field	foundScript			The script in which the handler was found.
+	@field	foundHandler		The handler that was found, NULL if no script had it.
+	@field	fellThroughToParent	TRUE if startScript didn't have the handler and we had to ask GetParentScript.
+	@seealso //leo_ref/c/tdef/LEOHandlerLookupCache LEOHandlerLookupCache
+*/
+typedef struct LEOHandlerLookupCacheEntry
+{
+	struct LEOInstruction*	callSite;
+	struct LEOScript*		receivingScript;
+	size_t					generation;
+	struct LEOScript*		startScript;
+	struct LEOScript*		foundScript;
+	struct LEOHandler*		foundHandler;
+	bool					fellThroughToParent;
+} LEOHandlerLookupCacheEntry;
+
+
+/*! Cache that lets CALL_HANDLER_INSTR skip walking the message path when the
+	same call site is executed again for the same script. Entries become invalid
+	whenever gLEOHandlerLookupGeneration changes.
+	@field	disabled	Set this to TRUE to always walk the message path.
+	@field	entries		LEO_HANDLER_LOOKUP_CACHE_SIZE entries, indexed by a hash of call site and receiving script, or NULL until first used.
+	@field	hits		How often a call could use the cached handler.
+	@field	misses		How often a call had to walk the message path.
+	@seealso //leo_ref/c/func/LEOInvalidateHandlerLookupCaches LEOInvalidateHandlerLookupCaches
+*/
+typedef struct LEOHandlerLookupCache
+{
+	bool							disabled;
+	LEOHandlerLookupCacheEntry*		entries;
+	size_t							hits;
+	size_t							misses;
+} LEOHandlerLookupCache;
+
+#define LEO_HANDLER_LOOKUP_CACHE_SIZE		256		// Must be a power of 2.
+
+
 
 enum
 {
@@ -54,6 +131,14 @@ typedef uint32_t		LEOContextGroupFlags;
 	@field	globals				An associative array of LEOValues of various kinds representing global variables.
 	@field	numReferences		Number of items in the <tt>references</tt> array.
 	@field	references			An array of "master pointers" to values to which references have been created.
+	@field	firstFreeReference	Index of the first unused entry in <tt>references</tt>, the others are linked from there. <tt>kLEOObjectIDINVALID</tt> if all are in use.
+	@field	numHandlerNames		Number of handler names in <tt>handlerNames</tt>.
+	@field	handlerNames		The handler names, indexed by their handler IDs.
+	@field	handlerNameSlots	Case-insensitive hash table mapping handler names to handler IDs, for LEOContextGroupHandlerIDForHandlerName.
+	@field	numHandlerNameSlots	Number of slots in <tt>handlerNameSlots</tt>, 0 or a power of 2.
+	@field	handlerNameArena	The memory the strings in <tt>handlerNames</tt> are allocated from.
+	@field	contextPool			Released contexts kept around for reuse, and statistics about them.
+	@field	handlerLookupCache	Handlers found by CALL_HANDLER_INSTR instructions, so they don't have to walk the message path again.
 	@seealso //leo_ref/c/func/LEOContextGroupCreate LEOContextGroupCreate
 */
 typedef struct LEOContextGroup
@@ -63,11 +148,17 @@ typedef struct LEOContextGroup
 	struct LEOArrayEntry	*globals;			// Associative array containing global variables.
 	LEOHandlerCount			numHandlerNames;	// Number of slots in handlerNames array.
 	char**					handlerNames;		// Array of handler names. The indexes into this array are 'handler IDs' used throughout the bytecode.
+	LEOHandlerID*			handlerNameSlots;	// Hash table of handler IDs, indexed by the case-folded hash of their name. kLEOHandlerIDINVALID for empty slots.
+	size_t					numHandlerNameSlots;	// Number of slots in handlerNameSlots.
+	LEOHandlerNameArenaBlock*	handlerNameArena;	// Linked list of blocks the strings in handlerNames are allocated from, newest first.
 	size_t					numReferences;		// Available slots in "references" array.
 	LEOObject				*references;		// "Master pointer" table for references so we can detect when a reference goes away.
+	LEOObjectID				firstFreeReference;	// Head of the list of unused entries in "references".
 	void					(*messageSent)( LEOHandlerID sentMessage, struct LEOContextGroup* inContext );
 	void*							userData;
 	LEOUserDataCleanUpFuncPtr		cleanUpUserData;
+	LEOContextPool					contextPool;		// Released contexts kept around for LEOContextCreateFromPool.
+	LEOHandlerLookupCache			handlerLookupCache;	// Results of earlier handler lookups by CALL_HANDLER_INSTR.
 } LEOContextGroup;
 
 
@@ -105,6 +196,28 @@ LEOContextGroup*	LEOContextGroupRetain( LEOContextGroup* inGroup );		// Adds 1 t
 void	LEOContextGroupRelease( LEOContextGroup* inGroup );	// Subtracts 1 from referenceCount. If it hits 0, disposes of inScript.
 
 
+/*!
+	Set how many released contexts this group keeps around for reuse by
+	LEOContextCreateFromPool. Pooling is off (0) by default. If the pool
+	currently holds more idle contexts than inMaxContexts, the surplus is freed.
+	@seealso //leo_ref/c/func/LEOContextCreateFromPool LEOContextCreateFromPool
+	@seealso //leo_ref/c/tdef/LEOContextPool LEOContextPool
+*/
+void	LEOContextGroupSetMaxPooledContexts( LEOContextGroup* inGroup, size_t inMaxContexts );
+
+
+/*!
+	Return the entry in the group's handler lookup cache that the given call
+	site would use for the given receiving script. Check whether the entry's
+	callSite, receivingScript and generation match before using it, otherwise
+	it describes a different call and you may overwrite it with the result of
+	your own lookup. Returns NULL if the cache is disabled or couldn't be
+	allocated.
+	@seealso //leo_ref/c/tdef/LEOHandlerLookupCache LEOHandlerLookupCache
+*/
+LEOHandlerLookupCacheEntry*	LEOContextGroupGetHandlerLookupCacheEntry( LEOContextGroup* inGroup, struct LEOInstruction* inCallSite, struct LEOScript* inReceivingScript );
+
+
 // Used to implement references to values that can disappear:
 /*!
 	Create a new object ID and seed that can be used to reference the given pointer.
@@ -160,9 +273,21 @@ void	LEOContextGroupRecycleObjectID( LEOContextGroup* inContext, LEOObjectID inO
 void*	LEOContextGroupGetPointerForObjectIDAndSeed( LEOContextGroup* inContext, LEOObjectID inObjectID, LEOObjectSeed inObjectSeed );
 
 
+/*!
+	Update all references that point at values in the memory block starting at
+	inOldStart and inOldSize bytes long to point at the same offset in the block
+	starting at inNewStart. This is used when a LEOContext's stack is moved to a
+	larger block of memory, to keep references to stack values working.
+	The old block must not have been freed yet when this is called.
+	@seealso //leo_ref/c/func/LEOContextGroupCreateNewObjectIDAndSeedForPointer LEOContextGroupCreateNewObjectIDAndSeedForPointer
+*/
+void	LEOContextGroupRelocatePointersInRange( LEOContextGroup* inContext, void* inOldStart, size_t inOldSize, void* inNewStart );
+
+
 /*!
 	Convert the provided handler-name into a LEOHandlerID. All different spellings
-	of the (case-insensitive) handler name map to the same handler ID.
+	of the (case-insensitive) handler name map to the same handler ID. Case is
+	folded using UTF32CharacterToLower, so this works for non-ASCII names as well.
 	@seealso //leo_ref/c/func/LEOContextGroupHandlerNameForHandlerID LEOContextGroupHandlerNameForHandlerID
 */
 LEOHandlerID	LEOContextGroupHandlerIDForHandlerName( LEOContextGroup* inContext, const char* handlerName );
@@ -113,7 +113,7 @@ void LEODebuggerPreInstructionProc( struct LEOContext* inContext )
 		}
 	}
 	
-	if( inContext->currentInstruction && inContext->currentInstruction->instructionID == LINE_MARKER_INSTR )
+	if( inContext->currentInstruction && LEOInstructionIDIsLineMarker( inContext->currentInstruction->instructionID ) )
 	{
 		LEOScript	*	theScript = LEOContextPeekCurrentScript( inContext );
 		if( theScript )
@@ -21,11 +21,13 @@
 #include "LEOContextGroup.h"
 #include "UTF8UTF32Utilities.h"
 #include "LEOStringUtilities.h"
+#include "LEOProfiler.h"
 #include <sys/types.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
 #include "AnsiStrings.h"
 
 
@@ -121,7 +123,7 @@ void	LEOInstructionsFindLineForInstruction( LEOInstruction* instr, size_t *lineN
 	//	memory. If we ever offer removing debug info and saving raw bytecode, this assumption
 	//	will break.
 	
-	while( instr->instructionID != LINE_MARKER_INSTR )
+	while( !LEOInstructionIDIsLineMarker( instr->instructionID ) )
 	{
 		instr --;
 	}
@@ -183,9 +185,10 @@ void	LEOPushArrayConstantInstruction( LEOContext* inContext )
 		size_t	currKeyIdx = x * 2;
 		union LEOValue*	keyValue = inContext->stackEndPtr -(numPairs *2) +currKeyIdx;
 		union LEOValue*	valueValue = inContext->stackEndPtr -(numPairs *2) +currKeyIdx +1;
-		char	keyBuf[1024] = {0};
-		const char*	keyStr = LEOGetValueAsString( keyValue, keyBuf, sizeof(keyBuf), inContext );
-		LEOAddArrayEntryToRoot( &theArray, keyStr, valueValue, inContext );
+		struct LEOStringView	keyView;
+		LEOGetValueAsStringView( keyValue, &keyView, inContext );
+		LEOAddArrayEntryToRoot( &theArray, keyView.string, valueValue, inContext );
+		LEOCleanUpStringView( &keyView );
 	}
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -(numPairs * 2) );	// Remove array elements from stack.
@@ -627,6 +630,10 @@ void	LEOAddIntegerInstruction( LEOContext* inContext )
 	pushed parameters, count and result from the stack again, e.g. by generating
 	the requisite POP_VALUE_INSTR instructions.
 	
+	The handler found for each call site and current script is remembered in the
+	context group's handlerLookupCache, so if your GetParentScript function may
+	return a different script than before, call LEOInvalidateHandlerLookupCaches.
+	
 	param1	-	Flags from eLEOCallHandlerFlags enum.
 	param2	-	The LEOHandlerID of the handler to call.
 	
@@ -641,47 +648,94 @@ void	LEOCallHandlerInstruction( LEOContext* inContext )
 		inContext->group->messageSent( handlerName, inContext->group );
 
 	LEOScript*		currScript = LEOContextPeekCurrentScript( inContext );
-	if( isMessagePassing
-		&& currScript && currScript->GetParentScript )
-		currScript = currScript->GetParentScript( currScript, inContext, NULL );
-	
-	#if 0
-	printf( "Calling handler '%s'\n", LEOContextGroupHandlerNameForHandlerID( inContext->group, handlerName ) );
-	#endif
-	
+	LEOScript*		firstScript = NULL;
 	LEOHandler*		foundHandler = NULL;
+	
+	// Have we done this lookup before? Then we needn't walk the message path again:
+	LEOHandlerLookupCacheEntry*	cacheEntry = NULL;
 	if( currScript )
+		cacheEntry = LEOContextGroupGetHandlerLookupCacheEntry( inContext->group, inContext->currentInstruction, currScript );
+	if( cacheEntry && cacheEntry->callSite == inContext->currentInstruction && cacheEntry->receivingScript == currScript
+		&& cacheEntry->generation == gLEOHandlerLookupGeneration )
 	{
-		while( foundHandler == NULL )
+		inContext->group->handlerLookupCache.hits++;
+		firstScript = cacheEntry->startScript;
+		currScript = cacheEntry->foundScript;
+		foundHandler = cacheEntry->foundHandler;
+		if( gLEOHandlerProfilerEnabled && cacheEntry->fellThroughToParent )
+			LEOHandlerProfilerRecordFallthrough( inContext, firstScript, handlerName, kLEOHandlerProfilerParentScriptFallthrough );
+	}
+	else
+	{
+		LEOScript*	receivingScript = currScript;
+		bool		fellThroughToParent = false;
+		
+		if( isMessagePassing
+			&& currScript && currScript->GetParentScript )
+			currScript = currScript->GetParentScript( currScript, inContext, NULL );
+		
+		#if 0
+		printf( "Calling handler '%s'\n", LEOContextGroupHandlerNameForHandlerID( inContext->group, handlerName ) );
+		#endif
+		
+		firstScript = currScript;
+		if( currScript )
 		{
-			if( (inContext->currentInstruction->param1 & kLEOCallHandler_IsFunctionFlag) == 0 )
-				foundHandler = LEOScriptFindCommandHandlerWithID( currScript, handlerName );
-			else
-				foundHandler = LEOScriptFindFunctionHandlerWithID( currScript, handlerName );
-			
-			if( foundHandler )
-			{
-				LEOContextPushHandlerScriptReturnAddressAndBasePtr( inContext, foundHandler, currScript, inContext->currentInstruction +1, inContext->stackBasePtr );
-				inContext->currentInstruction = foundHandler->instructions;
-				inContext->stackBasePtr = inContext->stackEndPtr;
-			}
-			
-			if( !foundHandler )
+			while( foundHandler == NULL )
 			{
-				if( currScript->GetParentScript )
-					currScript = currScript->GetParentScript( currScript, inContext, NULL );
+				if( (inContext->currentInstruction->param1 & kLEOCallHandler_IsFunctionFlag) == 0 )
+					foundHandler = LEOScriptFindCommandHandlerWithID( currScript, handlerName );
 				else
-					currScript = NULL;
-				if( !currScript )
-					break;
+					foundHandler = LEOScriptFindFunctionHandlerWithID( currScript, handlerName );
+				
+				if( !foundHandler )
+				{
+					if( currScript->GetParentScript )
+					{
+						if( currScript == firstScript )
+						{
+							fellThroughToParent = true;
+							if( gLEOHandlerProfilerEnabled )
+								LEOHandlerProfilerRecordFallthrough( inContext, firstScript, handlerName, kLEOHandlerProfilerParentScriptFallthrough );
+						}
+						currScript = currScript->GetParentScript( currScript, inContext, NULL );
+					}
+					else
+						currScript = NULL;
+					if( !currScript )
+						break;
+				}
 			}
 		}
+		
+		if( cacheEntry )
+		{
+			inContext->group->handlerLookupCache.misses++;
+			cacheEntry->callSite = inContext->currentInstruction;
+			cacheEntry->receivingScript = receivingScript;
+			cacheEntry->generation = gLEOHandlerLookupGeneration;
+			cacheEntry->startScript = firstScript;
+			cacheEntry->foundScript = currScript;
+			cacheEntry->foundHandler = foundHandler;
+			cacheEntry->fellThroughToParent = fellThroughToParent;
+		}
+	}
+	
+	if( foundHandler )
+	{
+		LEOContextPushHandlerScriptReturnAddressAndBasePtr( inContext, foundHandler, currScript, inContext->currentInstruction +1, inContext->stackBasePtr );
+		inContext->currentInstruction = foundHandler->instructions;
+		inContext->stackBasePtr = inContext->stackEndPtr;
 	}
 	
 	if( !foundHandler )
 	{
 		if( inContext->callNonexistentHandlerProc )
+		{
+			if( gLEOHandlerProfilerEnabled )
+				LEOHandlerProfilerRecordFallthrough( inContext, firstScript, handlerName, kLEOHandlerProfilerNonexistentHandlerFallthrough );
 			inContext->callNonexistentHandlerProc( inContext, handlerName, EMustBeHandled );
+		}
 		else
 		{
 			size_t		lineNo = SIZE_MAX;
@@ -906,7 +960,7 @@ void	LEOPushChunkReferenceInstruction( LEOContext* inContext )
 	
 	param2	-	The LEOChunkType of this chunk expression.
 	
-	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+	@seealso //leo_ref/c/func/LEOGetChunkRangesOfValue LEOGetChunkRangesOfValue
 */
 
 void	LEOPushChunkInstruction( LEOContext* inContext )
@@ -928,13 +982,13 @@ void	LEOPushChunkInstruction( LEOContext* inContext )
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 		return;
 	
-	char	str[1024] = { 0 };
-	const char*	completeStr = LEOGetValueAsString( chunkTarget, str, sizeof(str), inContext );
+	struct LEOStringView	completeStr;
+	LEOGetValueAsStringView( chunkTarget, &completeStr, inContext );
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
 	size_t	startDelOffs = 0, endDelOffs = 0;
-	LEOGetChunkRanges( completeStr, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext->itemDelimiter );
+	LEOGetChunkRangesOfValue( chunkTarget, completeStr.string, completeStr.stringLen, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext );
 	if( onStack )
 	{
 		// We need to pop the string off the stack before we can push the result
@@ -942,13 +996,15 @@ void	LEOPushChunkInstruction( LEOContext* inContext )
 		// keep the contents of the value around, overwrite the copy on the stack,
 		// and only *then* actually clean up the contents.
 		union LEOValue cleanupData = *(inContext->stackEndPtr -1);
-		LEOInitStringValue( inContext->stackEndPtr -1, completeStr +chunkStartOffs, chunkEndOffs -chunkStartOffs, kLEOInvalidateReferences, inContext );
+		LEOInitStringValueWithRangeOfValue( inContext->stackEndPtr -1, &cleanupData, completeStr.string, chunkStartOffs, chunkEndOffs, kLEOInvalidateReferences, inContext );
 		LEOCleanUpValue( &cleanupData, kLEOInvalidateReferences, inContext ); // completeStr is now possibly deallocated.
 	}
 	else
 	{
-		LEOPushStringValueOnStack( inContext, completeStr +chunkStartOffs, chunkEndOffs -chunkStartOffs );
+		LEOInitStringValueWithRangeOfValue( inContext->stackEndPtr, chunkTarget, completeStr.string, chunkStartOffs, chunkEndOffs, kLEOInvalidateReferences, inContext );
+		inContext->stackEndPtr++;
 	}
+	LEOCleanUpStringView( &completeStr );
 	inContext->currentInstruction++;
 }
 
@@ -962,7 +1018,7 @@ void	LEOPushChunkInstruction( LEOContext* inContext )
 	
 	param2	-	The LEOChunkType of this chunk expression.
 	
-	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+	@seealso //leo_ref/c/func/LEOGetChunkRangesOfValue LEOGetChunkRangesOfValue
 */
 
 void	LEOSetChunkPropertyInstruction( LEOContext* inContext )
@@ -986,19 +1042,28 @@ void	LEOSetChunkPropertyInstruction( LEOContext* inContext )
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 		return;
 
-	char	propNameStr[1024] = { 0 };
-	const char*	completePropNameStr = LEOGetValueAsString( propName, propNameStr, sizeof(propNameStr), inContext );
+	struct LEOStringView	completePropNameStr;
+	LEOGetValueAsStringView( propName, &completePropNameStr, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &completePropNameStr );
 		return;
+	}
 	
-	char	str[1024] = { 0 };
-	const char*	completeStr = LEOGetValueAsString( chunkTarget, str, sizeof(str), inContext );
+	struct LEOStringView	completeStr;
+	LEOGetValueAsStringView( chunkTarget, &completeStr, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &completeStr );
+		LEOCleanUpStringView( &completePropNameStr );
 		return;
+	}
 	
 	size_t	startDelOffs = 0, endDelOffs = 0;
-	LEOGetChunkRanges( completeStr, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext->itemDelimiter );
-	LEOSetValueForKeyOfRange( chunkTarget, completePropNameStr, propValue, chunkStartOffs, chunkEndOffs, inContext );
+	LEOGetChunkRangesOfValue( chunkTarget, completeStr.string, completeStr.stringLen, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext );
+	LEOCleanUpStringView( &completeStr );	// Setting the property may change the string.
+	LEOSetValueForKeyOfRange( chunkTarget, completePropNameStr.string, propValue, chunkStartOffs, chunkEndOffs, inContext );
+	LEOCleanUpStringView( &completePropNameStr );
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -4 -(onStack ? 1 : 0) );
 	
@@ -1015,7 +1080,7 @@ void	LEOSetChunkPropertyInstruction( LEOContext* inContext )
 	
 	param2	-	The LEOChunkType of this chunk expression.
 	
-	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+	@seealso //leo_ref/c/func/LEOGetChunkRangesOfValue LEOGetChunkRangesOfValue
 */
 
 void	LEOPushChunkPropertyInstruction( LEOContext* inContext )
@@ -1052,17 +1117,19 @@ void	LEOPushChunkPropertyInstruction( LEOContext* inContext )
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 		return;
 	
-	char	propNameStr[1024] = { 0 };
-	const char*	completePropNameStr = LEOGetValueAsString( propName, propNameStr, sizeof(propNameStr), inContext );
+	struct LEOStringView	completePropNameStr;
+	LEOGetValueAsStringView( propName, &completePropNameStr, inContext );
 	
-	char	str[1024] = { 0 };
-	const char*	completeStr = LEOGetValueAsString( chunkTarget, str, sizeof(str), inContext );
+	struct LEOStringView	completeStr;
+	LEOGetValueAsStringView( chunkTarget, &completeStr, inContext );
 	
 	size_t	startDelOffs = 0, endDelOffs = 0;
-	LEOGetChunkRanges( completeStr, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext->itemDelimiter );
+	LEOGetChunkRangesOfValue( chunkTarget, completeStr.string, completeStr.stringLen, inContext->currentInstruction->param2, chunkStartOffs, chunkEndOffs, &chunkStartOffs, &chunkEndOffs, &startDelOffs, &endDelOffs, inContext );
+	LEOCleanUpStringView( &completeStr );
 	LEOCleanUpValue( chunkStart, kLEOInvalidateReferences, inContext );
 	
-	LEOGetValueForKeyOfRange( chunkTarget, completePropNameStr, chunkStartOffs, chunkEndOffs, chunkStart, inContext );
+	LEOGetValueForKeyOfRange( chunkTarget, completePropNameStr.string, chunkStartOffs, chunkEndOffs, chunkStart, inContext );
+	LEOCleanUpStringView( &completePropNameStr );
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -(onStack ? 3 : 2) );
 	
@@ -1197,12 +1264,10 @@ void	LEOPushParametersInstruction( LEOContext* inContext )
 	LEOValuePtr	paramCountValue = inContext->stackBasePtr -1;
 	LEOInteger	paramCount = LEOGetValueAsInteger( paramCountValue, NULL, inContext );
 	struct LEOArrayEntry *inArray = NULL;
-	char	currKey[100] = {0};
 	for( int x = 1; x <= paramCount; x++ )
 	{
-		snprintf( currKey, sizeof(currKey)-1, "%d", x );
 		//LEODebugPrintContext( inContext );
-		LEOAddArrayEntryToRoot( &inArray, currKey, inContext->stackBasePtr -x -1, inContext );	// 
+		LEOAddArrayEntryWithIndexToRoot( &inArray, x, inContext->stackBasePtr -x -1, inContext );
 	}
 	if( inArray != NULL )
 	{
@@ -1238,26 +1303,20 @@ void	LEOParameterCountInstruction( LEOContext* inContext )
 
 
 /*!
-	(CONCATENATE_VALUES_INSTR)
+	Replace the last two values on the stack with a string value containing
+	the second one appended to the first, separated by delimChar unless that
+	is 0. If the first value is a string not referenced by anyone, we append
+	to it in place, so building up a string piece by piece is amortized O(1).
 */
 
-void	LEOConcatenateValuesInstruction( LEOContext* inContext )
+static void	LEOConcatenateLastTwoValues( LEOContext* inContext, uint32_t delimChar )
 {
 	union LEOValue*	secondArgumentValue = inContext->stackEndPtr -1;
 	union LEOValue*	firstArgumentValue = inContext->stackEndPtr -2;
-	size_t			startOffs = 0, endOffs = SIZE_MAX,
-					startDelOffs, endDelOffs;
-	uint32_t		delimChar = inContext->currentInstruction->param2;
-	char			tempStr[1024] = { 0 };
-	char			tempStr2[1024] = { 0 };
-	size_t			offs = 0;
-	
-	const char*		secondArgumentString = LEOGetValueAsString( secondArgumentValue, NULL, 0, inContext );
-	if( !secondArgumentString )
-		secondArgumentString = LEOGetValueAsString( secondArgumentValue, tempStr +offs, sizeof(tempStr) -offs, inContext );
-	const char*		firstArgumentString = LEOGetValueAsString( firstArgumentValue, NULL, 0, inContext );
-	if( !firstArgumentString )
-		firstArgumentString = LEOGetValueAsString( firstArgumentValue, tempStr2, sizeof(tempStr2), inContext );
+	struct LEOStringView	secondArgumentString;
+	LEOGetValueAsStringView( secondArgumentValue, &secondArgumentString, inContext );
+	bool			appendInPlace = (firstArgumentValue->base.isa == &kLeoValueTypeString || firstArgumentValue->base.isa == &kLeoValueTypeStringVariant)
+									&& firstArgumentValue->base.refObjectID == kLEOObjectIDINVALID;
 	
 	// We need to clean up the parameters before we can push the result on the
 	//	stack in the spot where our first parameter used to be. But we can't
@@ -1268,15 +1327,17 @@ void	LEOConcatenateValuesInstruction( LEOContext* inContext )
 	union LEOValue firstCleanUpValue = *firstArgumentValue;
 	union LEOValue secondCleanUpValue = *secondArgumentValue;
 	inContext->stackEndPtr -= 1;
-
-	LEOInitStringValue( firstArgumentValue, firstArgumentString, strlen(firstArgumentString), kLEOInvalidateReferences, inContext );
-
-	// Measure length of first argument in a NUL-safe way, so we can append
-	// to it in that spot:
-	LEODetermineChunkRangeOfSubstring( firstArgumentValue, &startOffs, &endOffs,
-										&startDelOffs, &endDelOffs,
-										kLEOChunkTypeByte,
-										SIZE_MAX, SIZE_MAX, inContext );
+	
+	if( appendInPlace )
+		firstArgumentValue->base.isa = &kLeoValueTypeString;
+	else
+	{
+		struct LEOStringView	firstArgumentString;
+		LEOGetValueAsStringView( &firstCleanUpValue, &firstArgumentString, inContext );
+		LEOInitStringValue( firstArgumentValue, firstArgumentString.string, firstArgumentString.stringLen, kLEOInvalidateReferences, inContext );
+		LEOCleanUpStringView( &firstArgumentString );
+	}
+	
 	if( delimChar != 0 )
 	{
 		// Insert delimiter:
@@ -1286,14 +1347,26 @@ void	LEOConcatenateValuesInstruction( LEOContext* inContext )
 		delimiter[usedLength] = 0;
 		
 		// Append
-		LEOSetValuePredeterminedRangeAsString( firstArgumentValue, endOffs, endOffs, delimiter, inContext );
-		endOffs += usedLength;
+		LEOSetStringValuePredeterminedRangeAsStringOfLength( firstArgumentValue, SIZE_MAX, SIZE_MAX, delimiter, usedLength, inContext );
 	}
 
-	LEOSetValuePredeterminedRangeAsString( firstArgumentValue, endOffs, endOffs, secondArgumentString, inContext );
+	// firstArgumentValue is a dynamic string now, so we can pass on the length we already know:
+	LEOSetStringValuePredeterminedRangeAsStringOfLength( firstArgumentValue, SIZE_MAX, SIZE_MAX, secondArgumentString.string, secondArgumentString.stringLen, inContext );
 
-	LEOCleanUpValue(&firstCleanUpValue, kLEOInvalidateReferences, inContext);
+	LEOCleanUpStringView( &secondArgumentString );
+	if( !appendInPlace )
+		LEOCleanUpValue(&firstCleanUpValue, kLEOInvalidateReferences, inContext);
 	LEOCleanUpValue(&secondCleanUpValue, kLEOInvalidateReferences, inContext);
+}
+
+
+/*!
+	(CONCATENATE_VALUES_INSTR)
+*/
+
+void	LEOConcatenateValuesInstruction( LEOContext* inContext )
+{
+	LEOConcatenateLastTwoValues( inContext, inContext->currentInstruction->param2 );
 	
 	inContext->currentInstruction++;
 }
@@ -1301,59 +1374,13 @@ void	LEOConcatenateValuesInstruction( LEOContext* inContext )
 
 void	LEOConcatenateValuesWithSpaceInstruction( LEOContext* inContext )
 {
-	union LEOValue*	secondArgumentValue = inContext->stackEndPtr -1;
-	union LEOValue*	firstArgumentValue = inContext->stackEndPtr -2;
-	size_t			startOffs = 0, endOffs = SIZE_MAX,
-	startDelOffs, endDelOffs;
 	uint32_t		delimChar = inContext->currentInstruction->param2;
-	char			tempStr[1024] = { 0 };
-	char			tempStr2[1024] = { 0 };
-	size_t			offs = 0;
-	
 	if( delimChar == 0 )
 	{
 		delimChar = ' ';
 	}
 	
-	const char*		secondArgumentString = LEOGetValueAsString( secondArgumentValue, NULL, 0, inContext );
-	if( !secondArgumentString )
-		secondArgumentString = LEOGetValueAsString( secondArgumentValue, tempStr +offs, sizeof(tempStr) -offs, inContext );
-	const char*		firstArgumentString = LEOGetValueAsString( firstArgumentValue, NULL, 0, inContext );
-	if( !firstArgumentString )
-		firstArgumentString = LEOGetValueAsString( firstArgumentValue, tempStr2, sizeof(tempStr2), inContext );
-	
-	// We need to clean up the parameters before we can push the result on the
-	//	stack in the spot where our first parameter used to be. But we can't
-	//	clean up firstArgumentValue and secondArgumentValue yet, that could
-	//	deallocate firstArgumentString and secondArgumentString. So we keep
-	//	their contents around to clean up later, and do a lightweight version
-	//	of LEOCleanUpStackToPtr(stackEnd - 2).
-	union LEOValue firstCleanUpValue = *firstArgumentValue;
-	union LEOValue secondCleanUpValue = *secondArgumentValue;
-	inContext->stackEndPtr -= 1;
-	
-	LEOInitStringValue( firstArgumentValue, firstArgumentString, strlen(firstArgumentString), kLEOInvalidateReferences, inContext );
-	
-	// Measure length of first argument in a NUL-safe way, so we can append
-	// to it in that spot:
-	LEODetermineChunkRangeOfSubstring( firstArgumentValue, &startOffs, &endOffs,
-									  &startDelOffs, &endDelOffs,
-									  kLEOChunkTypeByte,
-									  SIZE_MAX, SIZE_MAX, inContext );
-	// Insert delimiter:
-	char delimiter[5] = {0};
-	size_t usedLength = 0;
-	UTF8BytesForUTF32Character( delimChar, delimiter, &usedLength );
-	delimiter[usedLength] = 0;
-	
-	// Append
-	LEOSetValuePredeterminedRangeAsString( firstArgumentValue, endOffs, endOffs, delimiter, inContext );
-	endOffs += usedLength;
-	
-	LEOSetValuePredeterminedRangeAsString( firstArgumentValue, endOffs, endOffs, secondArgumentString, inContext );
-	
-	LEOCleanUpValue(&firstCleanUpValue, kLEOInvalidateReferences, inContext);
-	LEOCleanUpValue(&secondCleanUpValue, kLEOInvalidateReferences, inContext);
+	LEOConcatenateLastTwoValues( inContext, delimChar );
 	
 	inContext->currentInstruction++;
 }
@@ -1675,6 +1702,33 @@ void	LEODivideOperatorInstruction( LEOContext* inContext )
 }
 
 
+/*!
+	Compare the string representations of two values the way the comparison
+	operators do when the values aren't both numbers, i.e. case-insensitively.
+	Returns a number less than, equal to or greater than 0 like strcasecmp(),
+	but compares all of both strings, even if they contain NUL bytes.
+*/
+
+static int	LEOCompareValuesAsStrings( LEOValuePtr inFirstValue, LEOValuePtr inSecondValue, LEOContext* inContext )
+{
+	struct LEOStringView	firstArgumentStr, secondArgumentStr;
+	LEOGetValueAsStringView( inFirstValue, &firstArgumentStr, inContext );
+	LEOGetValueAsStringView( inSecondValue, &secondArgumentStr, inContext );
+	
+	size_t	commonLen = (firstArgumentStr.stringLen < secondArgumentStr.stringLen) ? firstArgumentStr.stringLen : secondArgumentStr.stringLen;
+	int		result = 0;
+	for( size_t x = 0; x < commonLen && result == 0; x++ )
+		result = tolower( (unsigned char)firstArgumentStr.string[x] ) -tolower( (unsigned char)secondArgumentStr.string[x] );
+	if( result == 0 && firstArgumentStr.stringLen != secondArgumentStr.stringLen )
+		result = (firstArgumentStr.stringLen < secondArgumentStr.stringLen) ? -1 : 1;
+	
+	LEOCleanUpStringView( &firstArgumentStr );
+	LEOCleanUpStringView( &secondArgumentStr );
+	
+	return result;
+}
+
+
 void	LEOGreaterThanOperatorInstruction( LEOContext* inContext )
 {
 	union LEOValue*	secondArgumentValue = inContext->stackEndPtr -1;
@@ -1702,17 +1756,7 @@ void	LEOGreaterThanOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument > secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" > \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) > 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) > 0);
 
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -1749,17 +1793,7 @@ void	LEOLessThanOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument < secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" < \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) < 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) < 0);
 
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -1796,17 +1830,7 @@ void	LEOGreaterThanEqualOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument >= secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" >= \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) >= 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) >= 0);
 
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -1843,17 +1867,7 @@ void	LEOLessThanEqualOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument <= secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" <= \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) <= 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) <= 0);
 
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -1961,17 +1975,7 @@ void	LEOEqualOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument == secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" == \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) == 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) == 0);
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -2008,17 +2012,7 @@ void	LEONotEqualOperatorInstruction( LEOContext* inContext )
 		isEqual = (firstArgument != secondArgument);
 	}
 	else
-	{
-		char		firstArgumentBuf[1024] = { 0 };
-		char		secondArgumentBuf[1024] = { 0 };
-		const char* firstArgumentStr = LEOGetValueAsString(firstArgumentValue, firstArgumentBuf, sizeof(firstArgumentBuf), inContext);
-		const char* secondArgumentStr = LEOGetValueAsString(secondArgumentValue, secondArgumentBuf, sizeof(secondArgumentBuf), inContext);
-		
-//		printf("COMPARING \"%s", LEOStringEscapedForPrintingInQuotes(firstArgumentStr));
-//		printf("\" != \"%s\"\n", LEOStringEscapedForPrintingInQuotes(secondArgumentStr));
-		
-		isEqual = (strcasecmp(firstArgumentStr, secondArgumentStr) != 0);
-	}
+		isEqual = (LEOCompareValuesAsStrings( firstArgumentValue, secondArgumentValue, inContext ) != 0);
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
@@ -2047,6 +2041,8 @@ struct LEOAssignChunkArrayUserData
 {
 	struct LEOArrayEntry *	array;
 	size_t					numItems;
+	LEOValuePtr				srcValue;
+	const char			*	srcString;
 	struct LEOContext	*	context;
 };
 
@@ -2054,13 +2050,11 @@ struct LEOAssignChunkArrayUserData
 static bool LEOAssignChunkArrayChunkCallback( const char *currStr, size_t currLen, size_t currStart, size_t currEnd, void *userData )
 {
 	struct LEOAssignChunkArrayUserData	*	ud = (struct LEOAssignChunkArrayUserData *) userData;
-	char									keyString[20] = { 0 };
-	snprintf( keyString, sizeof(keyString) -1, "%lu", ++ud->numItems );
 	
-	union LEOValue		tempStringValue = {.base = {0}};
-	LEOInitStringValue( &tempStringValue, currStr, currLen, kLEOInvalidateReferences, ud->context );
-	LEOAddArrayEntryToRoot( &ud->array, keyString, &tempStringValue, ud->context );
-	LEOCleanUpValue( &tempStringValue, kLEOInvalidateReferences, ud->context );
+	LEOValuePtr		newValue = LEOAddArrayEntryWithIndexToRoot( &ud->array, ++ud->numItems, NULL, ud->context );
+	if( !newValue )
+		return false;
+	LEOInitStringValueWithRangeOfValue( newValue, ud->srcValue, ud->srcString, currStart, currEnd, kLEOInvalidateReferences, ud->context );	// Long items share their characters.
 	
 	return true;
 }
@@ -2083,9 +2077,14 @@ void	LEOAssignChunkArrayInstruction( LEOContext* inContext )
 	union LEOValue	*		srcValue = inContext->stackEndPtr -1;
 	struct LEOAssignChunkArrayUserData	userData = { 0 };
 	userData.context = inContext;
-	char					tempStr[1024] = { 0 };	// TODO: Make this work with any length of string.
-	
-	LEOGetValueAsString( srcValue, tempStr, sizeof(tempStr), inContext );
+	userData.srcValue = srcValue;
+	struct LEOStringView	srcStr;
+	
+	// Build the array before we pop srcValue, which may own the string:
+	LEOGetValueAsStringView( srcValue, &srcStr, inContext );
+	userData.srcString = srcStr.string;
+	LEODoForEachChunk( srcStr.string, srcStr.stringLen, inContext->currentInstruction->param2, LEOAssignChunkArrayChunkCallback, inContext->itemDelimiter, &userData );
+	LEOCleanUpStringView( &srcStr );
 	LEOCleanUpStackToPtr( inContext, srcValue );	// Pop srcValue off the stack.
 	
 	bool			onStack = (inContext->currentInstruction->param1 == BACK_OF_STACK);
@@ -2093,7 +2092,6 @@ void	LEOAssignChunkArrayInstruction( LEOContext* inContext )
 	if( !onStack )
 		LEOCleanUpValue( dstValue, kLEOKeepReferences, inContext );
 	
-	LEODoForEachChunk( tempStr, strlen(tempStr), inContext->currentInstruction->param2, LEOAssignChunkArrayChunkCallback, inContext->itemDelimiter, &userData );
 	LEOInitArrayValue( &dstValue->array, userData.array, kLEOKeepReferences, inContext );
 
 	inContext->currentInstruction++;
@@ -2107,15 +2105,6 @@ struct LEOCountChunksUserData
 };
 
 
-static bool LEOCountChunksChunkCallback( const char *currStr, size_t currLen, size_t currStart, size_t currEnd, void *userData )
-{
-	size_t	*	numItems = (size_t *) userData;
-	++(*numItems);
-		
-	return true;
-}
-
-
 /*!
 	@function LEOCountChunksInstruction
 	Determine the number of chunks of the given type in a value's string
@@ -2129,12 +2118,11 @@ static bool LEOCountChunksChunkCallback( const char *currStr, size_t currLen, si
 void	LEOCountChunksInstruction( LEOContext* inContext )
 {
 	union LEOValue	*		srcValue = inContext->stackEndPtr -1;
-	int						numItems = 0;
-	char					tempStr[1024] = {0};
-	
-	const char* str = LEOGetValueAsString( srcValue, tempStr, sizeof(tempStr), inContext );
+	struct LEOStringView	srcStr;
+	LEOGetValueAsStringView( srcValue, &srcStr, inContext );
 	
-	LEODoForEachChunk( str, strlen(str), inContext->currentInstruction->param2, LEOCountChunksChunkCallback, inContext->itemDelimiter, &numItems );
+	size_t		numItems = LEOGetChunkCountOfValue( srcValue, srcStr.string, srcStr.stringLen, inContext->currentInstruction->param2, inContext );
+	LEOCleanUpStringView( &srcStr );
 	
 	LEOCleanUpValue( srcValue, kLEOInvalidateReferences, inContext );
 	LEOInitIntegerValue( srcValue, numItems, kLEOUnitNone, kLEOInvalidateReferences, inContext );
@@ -2162,11 +2150,18 @@ void	LEOGetArrayItemInstruction( LEOContext* inContext )
 	union LEOValue	*		keyValue = inContext->stackEndPtr -2;
 	union LEOValue	*		srcValue = inContext->stackEndPtr -1;
 	
-	char					keyStr[1024] = { 0 };	// TODO: Make this work with any length of string.
+	struct LEOStringView	keyStr;
 	
-	
-	LEOGetValueAsString( keyValue, keyStr, sizeof(keyStr), inContext );	
-	LEOValuePtr		foundItem = LEOGetValueForKey( srcValue, keyStr, dstValue, (onStack ? kLEOInvalidateReferences : kLEOKeepReferences), inContext );
+	LEOGetValueAsStringView( keyValue, &keyStr, inContext );
+	LEOValuePtr		foundItem = NULL;
+	LEOValuePtr		arrayValue = LEOFollowReferencesAndReturnValueOfType( srcValue, &kLeoValueTypeArray, inContext );
+	if( !arrayValue )
+		arrayValue = LEOFollowReferencesAndReturnValueOfType( srcValue, &kLeoValueTypeArrayVariant, inContext );
+	if( arrayValue )	// Copy the item straight out, so the array needn't be prepared for references to its items and can stay shared:
+		foundItem = LEOGetArrayValueForKey( arrayValue->array.array, keyStr.string );
+	else
+		foundItem = LEOGetValueForKey( srcValue, keyStr.string, dstValue, (onStack ? kLEOInvalidateReferences : kLEOKeepReferences), inContext );
+	LEOCleanUpStringView( &keyStr );
 	if( foundItem == NULL )
 		LEOInitUnsetValue( dstValue, (onStack ? kLEOInvalidateReferences : kLEOKeepReferences), inContext );
 	else if( foundItem != dstValue )
@@ -2208,9 +2203,10 @@ void	LEOSetStringInstruction( LEOContext* inContext )
 {
 	bool			onStack = (inContext->currentInstruction->param1 == BACK_OF_STACK);
 	union LEOValue*	destValue = onStack ? (inContext->stackEndPtr -2) : inContext->stackBasePtr +inContext->currentInstruction->param1;
-	char			strBuf[1024] = { 0 };
-	const char*		str = LEOGetValueAsString( inContext->stackEndPtr -1, strBuf, sizeof(strBuf), inContext );
-	LEOSetValueAsString( destValue, str, strlen(str), inContext );	// TODO: Make NUL-safe.
+	struct LEOStringView	str;
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &str, inContext );
+	LEOSetValueAsString( destValue, str.string, str.stringLen, inContext );
+	LEOCleanUpStringView( &str );
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr +(onStack ? -2 : -1) );
 	
 	inContext->currentInstruction++;
@@ -2229,11 +2225,11 @@ void	LEOPushItemDelimiterInstruction( LEOContext* inContext )
 
 void	LEOSetItemDelimiterInstruction( LEOContext* inContext )
 {
-	char		delimStr[8] = { 0 };
-	LEOGetValueAsString( inContext->stackEndPtr -1, delimStr, sizeof(delimStr), inContext );
+	struct LEOStringView	delimStr;
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &delimStr, inContext );
+	inContext->itemDelimiter = delimStr.string[0];	// TODO: Make this work with more than 1-byte characters.
+	LEOCleanUpStringView( &delimStr );
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
-
-	inContext->itemDelimiter = delimStr[0];	// TODO: Make this work with more than 1-byte characters.
 	
 	inContext->currentInstruction++;
 }
@@ -2243,21 +2239,25 @@ void	LEOSetItemDelimiterInstruction( LEOContext* inContext )
 */
 void	LEOPushGlobalReferenceInstruction( LEOContext* inContext )
 {
-	char		globalNameBuf[1024] = { 0 };
-	const char*	globalName = LEOGetValueAsString( inContext->stackEndPtr -1, globalNameBuf, sizeof(globalNameBuf), inContext );
+	struct LEOStringView	globalNameStr;
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &globalNameStr, inContext );
+	const char*	globalName = globalNameStr.string;
 	
 	LEOValuePtr	theGlobal = LEOGetArrayValueForKey( inContext->group->globals, globalName );
 	if( !theGlobal )
 	{
 		union LEOValue		emptyString = {.base = {0}};
 		LEOInitStringVariantValue( &emptyString, "", kLEOInvalidateReferences, inContext );
-		theGlobal = LEOAddArrayEntryToRoot( &inContext->group->globals, globalName, &emptyString, inContext );
+		LEOAddArrayEntryToRoot( &inContext->group->globals, globalName, &emptyString, inContext );
 		LEOCleanUpValue( &emptyString, kLEOInvalidateReferences, inContext );
 	}
+	LEOPrepareArrayForItemReferences( &inContext->group->globals, inContext );
+	theGlobal = LEOGetArrayValueForKey( inContext->group->globals, globalName );
 	
 	union LEOValue	tmpRefValue = {.base = {0}};
 	
 	LEOInitReferenceValue( &tmpRefValue, theGlobal, kLEOInvalidateReferences, kLEOChunkTypeINVALID, 0, 0, inContext );
+	LEOCleanUpStringView( &globalNameStr );
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitCopy( &tmpRefValue, inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOCleanUpValue( &tmpRefValue, kLEOInvalidateReferences, inContext );
@@ -2295,12 +2295,13 @@ void	LEONumToCharInstruction( LEOContext* inContext )
 
 void	LEOCharToNumInstruction( LEOContext* inContext )
 {
-	char	utf8CharStr[9] = { 0 };
-	size_t	ioOffset = 0;
+	struct LEOStringView	theStr;
+	size_t					ioOffset = 0;
 	
-	const char* theStr = LEOGetValueAsString( inContext->stackEndPtr -1, utf8CharStr, sizeof(utf8CharStr), inContext );
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &theStr, inContext );
 	
-	uint32_t utf32Char = UTF8StringParseUTF32CharacterAtOffset( theStr, strlen(theStr), &ioOffset );
+	uint32_t utf32Char = UTF8StringParseUTF32CharacterAtOffset( theStr.string, theStr.stringLen, &ioOffset );
+	LEOCleanUpStringView( &theStr );
 	
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitIntegerValue( inContext->stackEndPtr -1, utf32Char, kLEOUnitNone, kLEOInvalidateReferences, inContext );
@@ -2328,12 +2329,13 @@ void	LEONumToHexInstruction( LEOContext* inContext )
 
 void	LEOHexToNumInstruction( LEOContext* inContext )
 {
-	char	hexStr[16] = { 0 };
-	char*	endPtr = NULL;
+	struct LEOStringView	theStr;
+	char*					endPtr = NULL;
 	
-	const char* theStr = LEOGetValueAsString( inContext->stackEndPtr -1, hexStr, sizeof(hexStr), inContext );
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &theStr, inContext );
 	
-	LEOInteger theNumber = strtol( theStr, &endPtr, 16 );
+	LEOInteger theNumber = strtol( theStr.string, &endPtr, 16 );
+	LEOCleanUpStringView( &theStr );
 	
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitIntegerValue( inContext->stackEndPtr -1, theNumber, kLEOUnitNone, kLEOInvalidateReferences, inContext );
@@ -2381,12 +2383,13 @@ void	LEONumToBinaryInstruction( LEOContext* inContext )
 
 void	LEOBinaryToNumInstruction( LEOContext* inContext )
 {
-	char	hexStr[16] = { 0 };
-	char*	endPtr = NULL;
+	struct LEOStringView	theStr;
+	char*					endPtr = NULL;
 	
-	const char* theStr = LEOGetValueAsString( inContext->stackEndPtr -1, hexStr, sizeof(hexStr), inContext );
+	LEOGetValueAsStringView( inContext->stackEndPtr -1, &theStr, inContext );
 	
-	LEOInteger theNumber = strtol( theStr, &endPtr, 2 );
+	LEOInteger theNumber = strtol( theStr.string, &endPtr, 2 );
+	LEOCleanUpStringView( &theStr );
 	
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitIntegerValue( inContext->stackEndPtr -1, theNumber, kLEOUnitNone, kLEOInvalidateReferences, inContext );
@@ -2495,6 +2498,294 @@ void	LEOIsTypeInstruction( LEOContext* inContext )
 }
 
 
+#pragma mark -
+#pragma mark Superinstructions
+
+
+// Execute the instruction at currentInstruction using firstProc, and if that
+//	just advanced to the next instruction, run that one using secondProc right
+//	away, without going through the interpreter loop:
+static inline void	LEORunFusedInstructionPair( LEOContext* inContext, LEOInstructionFuncPtr firstProc, LEOInstructionFuncPtr secondProc )
+{
+	LEOInstruction*	secondInstruction = inContext->currentInstruction +1;
+	
+	firstProc( inContext );
+	
+	if( inContext->currentInstruction == secondInstruction
+		&& (inContext->flags & (kLEOContextKeepRunning | kLEOContextPause)) == kLEOContextKeepRunning )
+		secondProc( inContext );
+}
+
+
+/*!
+	A LINE_MARKER_INSTR fused with whatever instruction follows it. Takes the
+	same parameters as LINE_MARKER_INSTR, so LEOInstructionsFindLineForInstruction
+	still finds it. (LINE_MARKER_AND_NEXT_INSTR)
+	
+	param1		-	The file ID.
+	param2		-	The line number.
+*/
+
+void	LEOLineMarkerAndNextInstruction( LEOContext* inContext )
+{
+	inContext->currentInstruction++;
+	
+	LEOInstructionID	currID = inContext->currentInstruction->instructionID;
+	if( currID >= gNumInstructions )
+		currID = 0;	// First instruction is the special "unimplemented" instruction.
+	gInstructions[currID].proc( inContext );
+}
+
+
+/*!
+	EQUAL_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEOEqualOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOEqualOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	NOT_EQUAL_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(NOT_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEONotEqualOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEONotEqualOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	LESS_THAN_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(LESS_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEOLessThanOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOLessThanOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	GREATER_THAN_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(GREATER_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEOGreaterThanOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOGreaterThanOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	LESS_THAN_EQUAL_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(LESS_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEOLessThanEqualOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOLessThanEqualOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	GREATER_THAN_EQUAL_OPERATOR_INSTR fused with the JUMP_RELATIVE_IF_FALSE_INSTR after it.
+	(GREATER_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR)
+*/
+
+void	LEOGreaterThanEqualOperatorAndJumpIfFalseInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOGreaterThanEqualOperatorInstruction, LEOJumpRelativeIfFalseInstruction );
+}
+
+
+/*!
+	ADD_INTEGER_INSTR fused with the JUMP_RELATIVE_IF_GT_ZERO_INSTR after it,
+	as used for counting loops. (ADD_INTEGER_AND_JUMP_IF_GT_ZERO_INSTR)
+*/
+
+void	LEOAddIntegerAndJumpIfGreaterThanZeroInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOAddIntegerInstruction, LEOJumpRelativeIfGreaterThanZeroInstruction );
+}
+
+
+/*!
+	PUSH_REFERENCE_INSTR fused with the ADD_COMMAND_INSTR after it, as used for
+	"add x to variable". (PUSH_REFERENCE_AND_ADD_COMMAND_INSTR)
+*/
+
+void	LEOPushReferenceAndAddCommandInstruction( LEOContext* inContext )
+{
+	LEORunFusedInstructionPair( inContext, LEOPushReferenceInstruction, LEOAddCommandInstruction );
+}
+
+
+#pragma mark -
+#pragma mark Instruction fusion
+
+
+#define LEOAnyInstructionID						UINT16_MAX
+#define LEOInstructionFusionMinPairPercentage	1	// Percentage of all recorded pairs a pair must make up to be fused in kLEOInstructionFusionProfileGuided mode.
+
+
+struct LEOInstructionFusionRule
+{
+	LEOInstructionID	firstID;
+	LEOInstructionID	secondID;	// LEOAnyInstructionID to match any but another line marker.
+	LEOInstructionID	fusedID;
+};
+
+
+static const struct LEOInstructionFusionRule	sInstructionFusionRules[] =
+{
+	{ LINE_MARKER_INSTR, LEOAnyInstructionID, LINE_MARKER_AND_NEXT_INSTR },
+	{ EQUAL_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ NOT_EQUAL_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, NOT_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ LESS_THAN_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, LESS_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ GREATER_THAN_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, GREATER_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ LESS_THAN_EQUAL_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, LESS_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ GREATER_THAN_EQUAL_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR, GREATER_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR },
+	{ ADD_INTEGER_INSTR, JUMP_RELATIVE_IF_GT_ZERO_INSTR, ADD_INTEGER_AND_JUMP_IF_GT_ZERO_INSTR },
+	{ PUSH_REFERENCE_INSTR, ADD_COMMAND_INSTR, PUSH_REFERENCE_AND_ADD_COMMAND_INSTR }
+};
+
+
+LEOInstructionFusionMode	gInstructionFusionMode = kLEOInstructionFusionAll;
+
+// Pair counts are kept in a (LEO_NUMBER_OF_INSTRUCTIONS +1)^2 table, where the
+//	last row/column counts all host-defined instructions:
+static size_t*				sInstructionPairCounts = NULL;
+static size_t				sNumInstructionPairsRecorded = 0;
+static LEOInstruction*		sLastProfiledInstruction = NULL;
+static LEOInstructionID		sLastProfiledInstructionID = INVALID_INSTR;
+
+
+void	LEOSetInstructionFusionMode( LEOInstructionFusionMode inMode )
+{
+	gInstructionFusionMode = inMode;
+}
+
+
+LEOInstructionFusionMode	LEOGetInstructionFusionMode( void )
+{
+	return gInstructionFusionMode;
+}
+
+
+static size_t	LEOInstructionPairCountIndex( LEOInstructionID firstID, LEOInstructionID secondID )
+{
+	if( firstID > LEO_NUMBER_OF_INSTRUCTIONS )
+		firstID = LEO_NUMBER_OF_INSTRUCTIONS;
+	if( secondID > LEO_NUMBER_OF_INSTRUCTIONS )
+		secondID = LEO_NUMBER_OF_INSTRUCTIONS;
+	return (firstID * (LEO_NUMBER_OF_INSTRUCTIONS +1)) +secondID;
+}
+
+
+void	LEOInstructionPairProfilePreInstructionProc( LEOContext* inContext )
+{
+	LEOInstruction*	currInstruction = inContext->currentInstruction;
+	if( !currInstruction )
+		return;
+	
+	if( sInstructionPairCounts == NULL )
+	{
+		sInstructionPairCounts = calloc( (LEO_NUMBER_OF_INSTRUCTIONS +1) * (LEO_NUMBER_OF_INSTRUCTIONS +1), sizeof(size_t) );
+		if( !sInstructionPairCounts )
+		{
+			printf( "*** Failed to allocate instruction pair counts! ***\n" );
+			return;
+		}
+	}
+	
+	// We only count instructions that follow each other in the instruction
+	//	array, as those are the only ones that LEOFuseInstructions can fuse:
+	if( currInstruction == sLastProfiledInstruction +1 )
+	{
+		sInstructionPairCounts[ LEOInstructionPairCountIndex( sLastProfiledInstructionID, currInstruction->instructionID ) ]++;
+		sNumInstructionPairsRecorded++;
+	}
+	
+	sLastProfiledInstruction = currInstruction;
+	sLastProfiledInstructionID = currInstruction->instructionID;
+}
+
+
+size_t	LEOGetInstructionPairCount( LEOInstructionID firstID, LEOInstructionID secondID )
+{
+	if( !sInstructionPairCounts )
+		return 0;
+	
+	if( secondID == LEOAnyInstructionID )
+	{
+		size_t	numPairs = 0;
+		for( LEOInstructionID x = 0; x <= LEO_NUMBER_OF_INSTRUCTIONS; x++ )
+		{
+			if( !LEOInstructionIDIsLineMarker( x ) )
+				numPairs += sInstructionPairCounts[ LEOInstructionPairCountIndex( firstID, x ) ];
+		}
+		return numPairs;
+	}
+	
+	return sInstructionPairCounts[ LEOInstructionPairCountIndex( firstID, secondID ) ];
+}
+
+
+void	LEOResetInstructionPairCounts( void )
+{
+	if( sInstructionPairCounts )
+		memset( sInstructionPairCounts, 0, (LEO_NUMBER_OF_INSTRUCTIONS +1) * (LEO_NUMBER_OF_INSTRUCTIONS +1) * sizeof(size_t) );
+	sNumInstructionPairsRecorded = 0;
+	sLastProfiledInstruction = NULL;
+	sLastProfiledInstructionID = INVALID_INSTR;
+}
+
+
+void	LEOFuseInstructions( LEOInstruction instructions[], size_t numInstructions )
+{
+	if( gInstructionFusionMode == kLEOInstructionFusionOff || numInstructions < 2 )
+		return;
+	
+	const size_t	numRules = sizeof(sInstructionFusionRules) / sizeof(struct LEOInstructionFusionRule);
+	bool			ruleIsHot[sizeof(sInstructionFusionRules) / sizeof(struct LEOInstructionFusionRule)];
+	
+	for( size_t r = 0; r < numRules; r++ )
+	{
+		if( gInstructionFusionMode == kLEOInstructionFusionProfileGuided )
+		{
+			size_t	numPairs = LEOGetInstructionPairCount( sInstructionFusionRules[r].firstID, sInstructionFusionRules[r].secondID );
+			ruleIsHot[r] = numPairs > 0 && (numPairs * 100) >= (sNumInstructionPairsRecorded * LEOInstructionFusionMinPairPercentage);
+		}
+		else
+			ruleIsHot[r] = true;
+	}
+	
+	// We never remove the second instruction of a pair, so jumps to it and
+	//	relative jump offsets across it stay valid:
+	for( size_t x = 0; x < (numInstructions -1); x++ )
+	{
+		LEOInstructionID	firstID = instructions[x].instructionID;
+		LEOInstructionID	secondID = instructions[x +1].instructionID;
+		
+		for( size_t r = 0; r < numRules; r++ )
+		{
+			if( !ruleIsHot[r] || sInstructionFusionRules[r].firstID != firstID )
+				continue;
+			if( sInstructionFusionRules[r].secondID == LEOAnyInstructionID ? LEOInstructionIDIsLineMarker( secondID ) : (sInstructionFusionRules[r].secondID != secondID) )
+				continue;
+			
+			instructions[x].instructionID = sInstructionFusionRules[r].fusedID;
+			break;
+		}
+	}
+}
+
+
 #pragma mark -
 #pragma mark Instruction table
 
@@ -2582,7 +2873,16 @@ LEOINSTR(LEOParseErrorInstruction)
 LEOINSTR(LEOIsWithinInstruction)
 LEOINSTR(LEOIntersectsInstruction)
 LEOINSTR(LEOIsUnsetInstruction)
-LEOINSTR_LAST(LEOIsTypeInstruction)
+LEOINSTR(LEOIsTypeInstruction)
+LEOINSTR(LEOLineMarkerAndNextInstruction)
+LEOINSTR(LEOEqualOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEONotEqualOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEOLessThanOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEOGreaterThanOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEOLessThanEqualOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEOGreaterThanEqualOperatorAndJumpIfFalseInstruction)
+LEOINSTR(LEOAddIntegerAndJumpIfGreaterThanZeroInstruction)
+LEOINSTR_LAST(LEOPushReferenceAndAddCommandInstruction)
 
 
 
@@ -109,6 +109,18 @@ enum
 	INTERSECTS_INSTR,
 	IS_UNSET_INSTR,
 	IS_TYPE_INSTR,
+	
+	// Superinstructions generated by LEOFuseInstructions(). Each of these
+	//	replaces the first instruction of a pair and also executes the second:
+	LINE_MARKER_AND_NEXT_INSTR,	// Like LINE_MARKER_INSTR, with the same params.
+	EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	NOT_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	LESS_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	GREATER_THAN_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	LESS_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	GREATER_THAN_EQUAL_OPERATOR_AND_JUMP_IF_FALSE_INSTR,
+	ADD_INTEGER_AND_JUMP_IF_GT_ZERO_INSTR,
+	PUSH_REFERENCE_AND_ADD_COMMAND_INSTR,
 
 	LEO_NUMBER_OF_INSTRUCTIONS	// MUST BE LAST.
 };
@@ -127,10 +139,21 @@ enum eLEOCallHandlerFlags // at most uint16_t
 };
 
 
+// Modes for LEOSetInstructionFusionMode():
+typedef enum
+{
+	kLEOInstructionFusionOff = 0,		// LEOFuseInstructions() leaves instructions alone.
+	kLEOInstructionFusionAll,			// Fuse every pair we have a superinstruction for (the default).
+	kLEOInstructionFusionProfileGuided	// Only fuse pairs that showed up often in the pair counts recorded by LEOInstructionPairProfilePreInstructionProc().
+} LEOInstructionFusionMode;
+
+
 // -----------------------------------------------------------------------------
 //	Helper functions:
 // -----------------------------------------------------------------------------
 
+static inline bool	LEOInstructionIDIsLineMarker( LEOInstructionID inID )	{ return inID == LINE_MARKER_INSTR || inID == LINE_MARKER_AND_NEXT_INSTR; }
+
 // For handling messages for which no handler exists:
 void		LEOCleanUpHandlerParametersFromEndOfStack( LEOContext* inContext );
 LEOValuePtr	LEOGetParameterAtIndexFromEndOfStack( LEOContext* inContext, LEOInteger paramIndex );
@@ -140,6 +163,21 @@ void		LEOInvalidInstruction( LEOContext* inContext );	// Gets called when an ins
 
 void		LEOInstructionsFindLineForInstruction( LEOInstruction* instr, size_t *lineNo, uint16_t *fileID );
 
+// Optimization pass to run once over a handler's instructions after they have been
+//	generated. Replaces the first instruction of common pairs with a superinstruction
+//	that also executes the second one. Since the second instruction is left in
+//	place, jump offsets stay valid and jumps to it still work. Note that the
+//	preInstructionProc is not called for the second instruction of a fused pair.
+void		LEOFuseInstructions( LEOInstruction instructions[], size_t numInstructions );
+void		LEOSetInstructionFusionMode( LEOInstructionFusionMode inMode );
+LEOInstructionFusionMode	LEOGetInstructionFusionMode( void );
+
+// Install this as a context's preInstructionProc to record how often each pair of
+//	instructions is executed in a row, for use by kLEOInstructionFusionProfileGuided:
+void		LEOInstructionPairProfilePreInstructionProc( LEOContext* inContext );
+size_t		LEOGetInstructionPairCount( LEOInstructionID firstID, LEOInstructionID secondID );
+void		LEOResetInstructionPairCounts( void );
+
 // -----------------------------------------------------------------------------
 //	Globals:
 // -----------------------------------------------------------------------------
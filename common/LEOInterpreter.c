@@ -15,6 +15,7 @@
 #include "LEOInstructions.h"
 #include "LEOContextGroup.h"
 #include "LEOScript.h"
+#include "LEOProfiler.h"
 #include "LEOStringUtilities.h"
 #include "AnsiStrings.h"
 #include <sys/types.h>
@@ -87,6 +88,8 @@ uint16_t		LEOFileIDForFileName( const char* inFileName )
 
 const char*	LEOFileNameForFileID( uint16_t inFileID )
 {
+	if( inFileID >= gFileNamesTableSize )
+		return "";
 	return gFileNamesTable[inFileID];
 }
 
@@ -98,9 +101,8 @@ void	LEODoNothingPreInstructionProc( LEOContext* inContext )
 }
 
 
-LEOContext*	LEOContextCreate( struct LEOContextGroup* inGroup, void* inUserData, LEOUserDataCleanUpFuncPtr inCleanUpFunc )
+static void	LEOContextSetUp( LEOContext* theContext, struct LEOContextGroup* inGroup, void* inUserData, LEOUserDataCleanUpFuncPtr inCleanUpFunc )
 {
-	LEOContext*	theContext = calloc( 1, sizeof(LEOContext) );
 	theContext->referenceCount = 1;
 	theContext->preInstructionProc = LEODoNothingPreInstructionProc;
 	theContext->promptProc = LEODoNothingPreInstructionProc;
@@ -110,6 +112,55 @@ LEOContext*	LEOContextCreate( struct LEOContextGroup* inGroup, void* inUserData,
 	theContext->flags = kLEOContextKeepRunning;
 	theContext->userData = inUserData;
 	theContext->cleanUpUserData = inCleanUpFunc;
+}
+
+
+LEOContext*	LEOContextCreate( struct LEOContextGroup* inGroup, void* inUserData, LEOUserDataCleanUpFuncPtr inCleanUpFunc )
+{
+	LEOContext*	theContext = calloc( 1, sizeof(LEOContext) );
+	theContext->stack = calloc( LEO_STACK_INITIAL_SIZE, sizeof(union LEOValue) );
+	theContext->stackSize = LEO_STACK_INITIAL_SIZE;
+	LEOContextSetUp( theContext, inGroup, inUserData, inCleanUpFunc );
+	return theContext;
+}
+
+
+LEOContext*	LEOContextCreateFromPool( struct LEOContextGroup* inGroup, void* inUserData, LEOUserDataCleanUpFuncPtr inCleanUpFunc )
+{
+	LEOContextPool*	pool = &inGroup->contextPool;
+	LEOContext*		theContext = NULL;
+	
+	if( pool->numIdleContexts > 0 )
+	{
+		theContext = pool->idleContexts[--pool->numIdleContexts];
+		pool->hits++;
+		
+		// LEOContextRelease already emptied the stacks and released the user
+		//	data, so all that's left is resetting the simple fields:
+		theContext->errMsg[0] = 0;
+		theContext->errLine = 0;
+		theContext->errOffset = 0;
+		theContext->errFileID = 0;
+		theContext->numSteps = 0;
+		theContext->currentInstruction = NULL;
+		theContext->stackBasePtr = NULL;
+		theContext->stackEndPtr = NULL;
+		theContext->contextCompleted = NULL;
+		theContext->profileLineNo = 0;
+		theContext->profileFileID = 0;
+		LEOContextSetUp( theContext, inGroup, inUserData, inCleanUpFunc );
+	}
+	else
+	{
+		theContext = LEOContextCreate( inGroup, inUserData, inCleanUpFunc );
+		pool->misses++;
+	}
+	
+	theContext->returnToPool = true;
+	pool->numContextsInUse++;
+	if( pool->numContextsInUse > pool->highWaterMark )
+		pool->highWaterMark = pool->numContextsInUse;
+	
 	return theContext;
 }
 
@@ -122,24 +173,36 @@ LEOContext*	LEOContextRetain( LEOContext* inContext )
 }
 
 
+void	LEOContextFreePooledContext( LEOContext* inContext )
+{
+	if( inContext->callStackEntries )
+		free( inContext->callStackEntries );
+	free( inContext->stack );
+	free( inContext );
+}
+
+
 void	LEOContextRelease( LEOContext* theContext )
 {
 	if( --theContext->referenceCount == 0 )
 	{
 		LEOCleanUpStackToPtr( theContext, theContext->stack );
-		LEOContextGroupRelease( theContext->group );
+		theContext->stackEndPtr = theContext->stackBasePtr = NULL;
+		LEOContextGroup*	group = theContext->group;
 		theContext->group = NULL;
 		if( theContext->callStackEntries )
 		{
+			for( size_t x = theContext->numCallStackEntries; x > 0; x-- )	// Handlers we exited due to an error or EXIT_TO_TOP_INSTR.
+			{
+				if( theContext->callStackEntries[x -1].profileEntryIndex != SIZE_MAX )
+					LEOHandlerProfilerExitHandler( theContext, x -1 );
+			}
 			for( size_t x = 0; x < theContext->numCallStackEntries; x++ )
 			{
 				LEOScriptRelease( theContext->callStackEntries[x].script );
 				theContext->callStackEntries[x].script = NULL;
 				theContext->callStackEntries[x].handler = NULL;	// Script owns handlers, so this is invalid now, too.
 			}
-			
-			free( theContext->callStackEntries );
-			theContext->callStackEntries = NULL;
 			theContext->numCallStackEntries = 0;
 		}
 		
@@ -149,7 +212,30 @@ void	LEOContextRelease( LEOContext* theContext )
 			theContext->cleanUpUserData = NULL;
 			theContext->userData = NULL;
 		}
-		free(theContext);
+		
+		if( theContext->returnToPool )
+		{
+			LEOContextPool*	pool = &group->contextPool;
+			pool->numContextsInUse--;
+			if( pool->numIdleContexts < pool->maxIdleContexts )
+			{
+				pool->idleContexts[pool->numIdleContexts++] = theContext;
+				theContext = NULL;	// Pool owns it now.
+			}
+		}
+		
+		if( theContext )
+		{
+			if( theContext->callStackEntries )
+				free( theContext->callStackEntries );
+			theContext->callStackEntries = NULL;
+			free( theContext->stack );
+			theContext->stack = NULL;
+			theContext->stackSize = 0;
+			free( theContext );
+		}
+		
+		LEOContextGroupRelease( group );
 	}
 }
 
@@ -179,6 +265,12 @@ void	LEOContextPushHandlerScriptReturnAddressAndBasePtr( LEOContext* inContext,
 	inContext->callStackEntries[newEntryIndex].script = LEOScriptRetain( inScript );
 	inContext->callStackEntries[newEntryIndex].returnAddress = returnAddress;
 	inContext->callStackEntries[newEntryIndex].oldBasePtr = oldBP;
+	inContext->callStackEntries[newEntryIndex].profileEntryIndex = SIZE_MAX;
+	inContext->callStackEntries[newEntryIndex].profileLineNo = 0;
+	inContext->callStackEntries[newEntryIndex].profileFileID = 0;
+	inContext->callStackEntries[newEntryIndex].profileFrameID = SIZE_MAX;
+	if( gLEOHandlerProfilerEnabled )
+		LEOHandlerProfilerEnterHandler( inContext, newEntryIndex );
 }
 
 
@@ -253,6 +345,9 @@ void	LEOContextPopHandlerScriptReturnAddressAndBasePtr( LEOContext* inContext )
 		return;
 	}
 	
+	if( inContext->callStackEntries[inContext->numCallStackEntries -1].profileEntryIndex != SIZE_MAX )
+		LEOHandlerProfilerExitHandler( inContext, inContext->numCallStackEntries -1 );
+	
 	inContext->numCallStackEntries--;
 	LEOScriptRelease( inContext->callStackEntries[inContext->numCallStackEntries].script );
 	
@@ -263,10 +358,95 @@ void	LEOContextPopHandlerScriptReturnAddressAndBasePtr( LEOContext* inContext )
 }
 
 
+static bool	LEOContextResizeStack( LEOContext* inContext, size_t newSize )
+{
+	union LEOValue*	oldStack = inContext->stack;
+	union LEOValue*	newStack = calloc( newSize, sizeof(union LEOValue) );
+	if( !newStack )
+	{
+		printf( "*** Failed to allocate stack! ***\n" );
+		return false;
+	}
+	
+	size_t	numUsed = inContext->stackEndPtr ? (inContext->stackEndPtr -oldStack) : 0;
+	memmove( newStack, oldStack, numUsed * sizeof(union LEOValue) );
+	
+	// Now move everything that points into the stack over to the new one:
+	if( inContext->stackEndPtr )
+		inContext->stackEndPtr = newStack +numUsed;
+	if( inContext->stackBasePtr )
+		inContext->stackBasePtr = newStack +(inContext->stackBasePtr -oldStack);
+	for( size_t x = 0; x < inContext->numCallStackEntries; x++ )
+	{
+		if( inContext->callStackEntries[x].oldBasePtr )
+			inContext->callStackEntries[x].oldBasePtr = newStack +(inContext->callStackEntries[x].oldBasePtr -oldStack);
+	}
+	LEOContextGroupRelocatePointersInRange( inContext->group, oldStack, inContext->stackSize * sizeof(union LEOValue), newStack );
+	
+	free( oldStack );
+	inContext->stack = newStack;
+	inContext->stackSize = newSize;
+	
+	return true;
+}
+
+
+bool	LEOContextEnsureStackSpace( LEOContext* inContext, size_t numSlots )
+{
+	if( !inContext->stackEndPtr )
+		inContext->stackEndPtr = inContext->stack;
+	
+	size_t	numNeeded = (inContext->stackEndPtr -inContext->stack) +numSlots;
+	if( numNeeded > inContext->stackSize )
+	{
+		// Grow geometrically so pushing stays O(1) amortized, but don't
+		//	allocate more than LEO_STACK_SIZE unless we absolutely have to:
+		size_t	newSize = inContext->stackSize * 2;
+		if( newSize > LEO_STACK_SIZE )
+			newSize = LEO_STACK_SIZE;
+		if( newSize < numNeeded )
+			newSize = numNeeded;
+		if( !LEOContextResizeStack( inContext, newSize ) )
+		{
+			size_t		lineNo = SIZE_MAX;
+			uint16_t	fileID = 0;
+			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Out of memory." );
+			return false;
+		}
+	}
+	
+	if( numNeeded > LEO_STACK_SIZE )
+	{
+		// We still grew the stack above, so whoever is pushing gets valid memory.
+		if( (inContext->flags & kLEOContextKeepRunning) != 0 )
+		{
+			size_t		lineNo = SIZE_MAX;
+			uint16_t	fileID = 0;
+			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Stack overflow." );
+		}
+		return false;
+	}
+	
+	return true;
+}
+
+
 LEOValuePtr	LEOPushValueOnStack( LEOContext* theContext, LEOValuePtr inValueToCopy )
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+	{
+		// Growing may move the stack, so find a value that's on it again afterwards:
+		size_t	valueIndex = SIZE_MAX;
+		if( inValueToCopy >= theContext->stack && inValueToCopy < theContext->stack +theContext->stackSize )
+			valueIndex = inValueToCopy -theContext->stack;
+		LEOContextEnsureStackSpace( theContext, 1 );
+		if( valueIndex != SIZE_MAX )
+			inValueToCopy = theContext->stack +valueIndex;
+	}
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -283,6 +463,8 @@ LEOValuePtr	LEOPushUnsetValueOnStack( LEOContext* theContext )
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -298,6 +480,8 @@ LEOValuePtr	LEOPushEmptyValueOnStack( LEOContext* theContext )
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -313,6 +497,17 @@ LEOValuePtr	LEOPushStringValueOnStack( LEOContext* theContext, const char* inStr
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+	{
+		// Short strings live inside their value, so inString may be on the stack, which growing may move:
+		const char*	oldStack = (const char*) theContext->stack;
+		size_t		stringOffset = SIZE_MAX;
+		if( inString >= oldStack && inString < (const char*)(theContext->stack +theContext->stackSize) )
+			stringOffset = inString -oldStack;
+		LEOContextEnsureStackSpace( theContext, 1 );
+		if( stringOffset != SIZE_MAX )
+			inString = ((const char*) theContext->stack) +stringOffset;
+	}
 	
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -328,6 +523,8 @@ LEOValuePtr	LEOPushStringConstantValueOnStack( LEOContext* theContext, const cha
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 	
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -343,6 +540,8 @@ LEOValuePtr	LEOPushIntegerOnStack( LEOContext* theContext, LEOInteger inInteger,
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -358,6 +557,8 @@ LEOValuePtr	LEOPushNumberOnStack( LEOContext* theContext, LEONumber inNumber, LE
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -373,6 +574,8 @@ LEOValuePtr	LEOPushBooleanOnStack( LEOContext* theContext, bool inBoolean )
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -388,6 +591,8 @@ LEOValuePtr	LEOPushPointOnStack( LEOContext* theContext, LEOInteger l, LEOIntege
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -403,6 +608,8 @@ LEOValuePtr	LEOPushRectOnStack( LEOContext* theContext, LEOInteger l, LEOInteger
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -418,6 +625,8 @@ LEOValuePtr	LEOPushArrayValueOnStack( LEOContext* theContext, struct LEOArrayEnt
 {
 	if( !theContext->stackEndPtr )
 		theContext->stackEndPtr = theContext->stack;
+	if( theContext->stackEndPtr >= theContext->stack +theContext->stackSize )
+		LEOContextEnsureStackSpace( theContext, 1 );
 	
 	LEOValuePtr		theValue = theContext->stackEndPtr;
 	
@@ -457,6 +666,17 @@ void	LEORunInContext( LEOInstruction instructions[], LEOContext *inContext )
 }
 
 
+void	LEORunInContextFast( LEOInstruction instructions[], LEOContext *inContext )
+{
+	LEOPrepareContextForRunning( instructions, inContext );
+	
+	LEOContinueRunningContextFast( inContext );
+	
+	if( (inContext->flags & kLEOContextPause) == 0 && inContext->contextCompleted )
+		inContext->contextCompleted( inContext );
+}
+
+
 static LEOContext*	sContextToResume = NULL;
 
 
@@ -511,11 +731,24 @@ void	LEOPrepareContextForRunning( LEOInstruction instructions[], LEOContext *inC
 		inContext->stackEndPtr = inContext->stack;
 	inContext->stackBasePtr = inContext->stackEndPtr;
 	inContext->errMsg[0] = 0;
+	LEOContextUpdateHooksActiveFlag( inContext );
 	
 	// +++ Should we call LEOCleanUpStackToPtr here? Would be necessary for reusing a context.
 }
 
 
+void	LEOContextUpdateHooksActiveFlag( LEOContext *inContext )
+{
+	if( inContext->preInstructionProc != LEODoNothingPreInstructionProc
+		|| gInstructionIDToDebugPrintBefore != INVALID_INSTR
+		|| gInstructionIDToDebugPrintAfter != INVALID_INSTR
+		|| gLEOProfilerEnabled )
+		inContext->flags |= kLEOContextHooksActive;
+	else
+		inContext->flags &= ~kLEOContextHooksActive;
+}
+
+
 bool	LEOContinueRunningContext( LEOContext *inContext )
 {
 	inContext->errMsg[0] = 0;
@@ -527,11 +760,18 @@ bool	LEOContinueRunningContext( LEOContext *inContext )
 	LEOInstructionID	currID = inContext->currentInstruction->instructionID;
 	if( currID >= gNumInstructions )
 		currID = 0;	// First instruction is the special "unimplemented" instruction.
-		
+	
+	if( (inContext->stackEndPtr +LEO_STACK_RED_ZONE) > (inContext->stack +inContext->stackSize)
+		&& !LEOContextEnsureStackSpace( inContext, LEO_STACK_RED_ZONE ) )
+		return false;
+	
 	if( gInstructionIDToDebugPrintBefore == currID )
 		LEODebugPrintContext(inContext);
-		
-	gInstructions[currID].proc(inContext);
+	
+	if( gLEOProfilerEnabled )
+		LEOProfilerRunInstruction( inContext, currID );
+	else
+		gInstructions[currID].proc(inContext);
 	
 	if( gInstructionIDToDebugPrintAfter == currID )
 		LEODebugPrintContext(inContext);
@@ -540,6 +780,42 @@ bool	LEOContinueRunningContext( LEOContext *inContext )
 }
 
 
+void	LEOContinueRunningContextFast( LEOContext *inContext )
+{
+	struct LEOInstructionEntry*	instructions = gInstructions;
+	LEOInstructionID			numInstructions = gNumInstructions;
+	
+	while( true )
+	{
+		// As long as only kLEOContextKeepRunning is set, there are no hooks to
+		//	call and nobody asked us to pause or stop, so we can just dispatch:
+		if( inContext->flags == kLEOContextKeepRunning )
+		{
+			LEOInstruction*		currInstruction = inContext->currentInstruction;
+			if( currInstruction == NULL )
+				break;
+			
+			LEOInstructionID	currID = currInstruction->instructionID;
+			if( currID >= numInstructions )
+				currID = 0;	// First instruction is the special "unimplemented" instruction.
+			
+			if( (inContext->stackEndPtr +LEO_STACK_RED_ZONE) > (inContext->stack +inContext->stackSize)
+				&& !LEOContextEnsureStackSpace( inContext, LEO_STACK_RED_ZONE ) )
+				break;
+			
+			instructions[currID].proc( inContext );
+		}
+		else if( (inContext->flags & (kLEOContextHooksActive | kLEOContextKeepRunning | kLEOContextPause)) == (kLEOContextHooksActive | kLEOContextKeepRunning) )
+		{
+			if( !LEOContinueRunningContext( inContext ) )
+				break;
+		}
+		else
+			break;
+	}
+}
+
+
 void	LEOContextStopWithError( LEOContext* inContext, size_t errLine, size_t errOffset, uint16_t fileID, const char* inErrorFmt, ... )
 {
 	va_list		varargs;
@@ -592,7 +868,7 @@ void	LEODebugPrintInstr( LEOInstruction* instruction, LEOScript* inScript, LEOHa
 		printf("%p: UNKNOWN_%d", instruction, currID);
 		printf("( %u, %d );", instruction->param1, instruction->param2 );
 	}
-	else if( currID == LINE_MARKER_INSTR )
+	else if( LEOInstructionIDIsLineMarker( currID ) )
 		printf("# LINE %d \"%s\"", instruction->param2, LEOFileNameForFileID( instruction->param1 ) );
 	else
 	{
@@ -53,9 +53,20 @@ extern "C" {
 //	Constants:
 // -----------------------------------------------------------------------------
 
-/*! How many LEOValues can be on the stack before we run out of stack space. */
+/*! How many LEOValues can be on the stack before we run out of stack space
+	and abort the script with a "Stack overflow" error. */
 #define LEO_STACK_SIZE			1024
 
+/*! How many LEOValues we allocate for a new context's stack. The stack grows
+	on demand up to LEO_STACK_SIZE entries. */
+#define LEO_STACK_INITIAL_SIZE	32
+
+/*! The interpreter loop ensures there are at least this many free entries on
+	the stack before each instruction, so instructions that push only a few
+	values never cause the stack to move while they are holding pointers to
+	values on it. */
+#define LEO_STACK_RED_ZONE		16
+
 /*!
 	Pass this as param1 to some instructions that take a
 	basePtr-relative address to make it pop the last
@@ -200,6 +211,12 @@ typedef struct LEOCallStackEntry
 	struct LEOHandler*	handler;		// The current handler, so we can show a nice call stack.
 	LEOInstruction*		returnAddress;	// Instruction at which we are to continue when this handler returns.
 	LEOValuePtr			oldBasePtr;		// The base pointer relative to which we calculate our parameters' and local variables' addresses.
+	size_t				profileEntryIndex;	// Index of this handler's entry in the handler profile, SIZE_MAX if the handler profiler wasn't on when it was called.
+	uint64_t			profileStartTime;	// When the handler profiler saw this handler get called.
+	uint64_t			profileChildTime;	// Time spent in handlers called by this one, so far.
+	size_t				profileLineNo;		// Line of the last LINE_MARKER_INSTR the profiler saw in this handler.
+	uint16_t			profileFileID;		// File of the last LINE_MARKER_INSTR the profiler saw in this handler.
+	size_t				profileFrameID;		// The profiler's ID for the chain of handler calls that led here, SIZE_MAX if it hasn't looked it up yet.
 } LEOCallStackEntry;
 
 
@@ -208,7 +225,8 @@ enum
 {
 	kLEOContextKeepRunning	= (1 << 0),	//! Clear this bit to stop script execution. Used on errors and for ExitToTop.
 	kLEOContextPause		= (1 << 1),	//! Set by the current instruction when it wants to pause the current context (e.g. to perform some async tasks which should appear synchronous to scripts). The instruction should not advance the PC until the context is resumed, which it can detect by looking at the kLEOContextResuming flag.
-	kLEOContextResuming		= (1 << 2)	//! Context was just resumed from being paused. The current instruction can now finish its work, advance the PC and return.
+	kLEOContextResuming		= (1 << 2),	//! Context was just resumed from being paused. The current instruction can now finish its work, advance the PC and return.
+	kLEOContextHooksActive	= (1 << 3)	//! A preInstructionProc or debug-print instruction is installed, or the profiler is enabled. LEOContinueRunningContextFast() only calls these hooks while this is set. Set by LEOPrepareContextForRunning() or LEOContextUpdateHooksActiveFlag().
 };
 typedef uint32_t	LEOContextFlags;
 
@@ -233,9 +251,13 @@ typedef uint32_t	LEOContextFlags;
 	@field	stackBasePtr		Base pointer into stack, used during function calls to find parameters & start of local variable section.
 	@field	stackEndPtr			Stack pointer indicating used size of our stack. Always points at element after last element.
 	@field	stack				The stack containing all our local variables, parameters etc.
+									This grows on demand and may move in memory between
+									instructions, so do not keep pointers into it around.
+	@field	stackSize			Number of LEOValues allocated for the stack.
 	@field	userData			A pointer for use by the client, for storing additional information in.
 	@field	cleanUpUserData		A function that will be passed the userData pointer and called right before we free the context's memory, which you can provide to free any memory used by the userData.
 	@field	contextCompleted	A function that is called once execution aborts due to an error or the outermost function completes. It can retrieve result values from the context and free its memory.
+	@field	returnToPool		Set for contexts created by LEOContextCreateFromPool, so LEOContextRelease hands them back to their group's pool instead of freeing them.
 	
 	@seealso //leo_ref/c/tag/LEOValueReference LEOValueReference
 	@seealso //leo_ref/c/tdef/LEOValuePtr LEOValuePtr
@@ -261,10 +283,14 @@ typedef struct LEOContext
 	LEOInstruction			*		currentInstruction;		// PC
 	union LEOValue			*		stackBasePtr;			// BP
 	union LEOValue			*		stackEndPtr;			// SP (always points at element after last element)
-	union LEOValue					stack[LEO_STACK_SIZE];	// The stack.
+	union LEOValue			*		stack;					// The stack.
+	size_t							stackSize;				// Number of entries allocated for the stack.
 	void*							userData;
 	LEOUserDataCleanUpFuncPtr		cleanUpUserData;
 	LEOContextCompletionFuncPtr		contextCompleted;
+	bool							returnToPool;			// Created by LEOContextCreateFromPool, give back to group's contextPool when released.
+	size_t							profileLineNo;			// Line of the last LINE_MARKER_INSTR the profiler saw outside any handler.
+	uint16_t						profileFileID;			// File of the last LINE_MARKER_INSTR the profiler saw outside any handler.
 } LEOContext;
 
 
@@ -287,6 +313,27 @@ typedef struct LEOContext
 LEOContext*	LEOContextCreate( struct LEOContextGroup* inGroup, void* inUserData,
 								LEOUserDataCleanUpFuncPtr inCleanUpFunc );
 
+/*! Like LEOContextCreate, but reuses a previously released context from the
+	given group's context pool if one is available. The context you get back
+	looks just like a new one: its stack and call stack are empty, and its
+	flags, error message, item delimiter and callbacks are reset to their
+	defaults. When you release your last reference to it, it is cleaned up and
+	returned to the pool instead of being freed (unless the pool is full).
+	Use LEOContextGroupSetMaxPooledContexts to turn on pooling for a group.
+	@seealso //leo_ref/c/func/LEOContextCreate LEOContextCreate
+	@seealso //leo_ref/c/func/LEOContextGroupSetMaxPooledContexts LEOContextGroupSetMaxPooledContexts
+	@seealso //leo_ref/c/tdef/LEOContextPool LEOContextPool
+*/
+LEOContext*	LEOContextCreateFromPool( struct LEOContextGroup* inGroup, void* inUserData,
+										LEOUserDataCleanUpFuncPtr inCleanUpFunc );
+
+/*! Free the memory of a context that has been released into its group's
+	context pool. You generally do not call this yourself, the LEOContextGroup
+	does that when its pool shrinks or the group goes away.
+	@seealso //leo_ref/c/func/LEOContextGroupSetMaxPooledContexts LEOContextGroupSetMaxPooledContexts
+*/
+void		LEOContextFreePooledContext( LEOContext* inContext );
+
 /*! Release your reference to this context. If you were the last owner of this
 	context, disposes of the given context's associated data structures
 	and releases the reference to its context group that the context
@@ -311,6 +358,16 @@ LEOContext*	LEOContextRetain( LEOContext* inContext );	// returns inContext.
 */
 void	LEORunInContext( LEOInstruction instructions[], LEOContext *inContext );
 
+/*! Like LEORunInContext, but uses LEOContinueRunningContextFast to execute
+	the instructions. The preInstructionProc and the instructions set up using
+	LEOSetInstructionIDToDebugPrintBefore/After are only honored if they were
+	installed before this call (or LEOContextUpdateHooksActiveFlag has been
+	called since).
+	@seealso //leo_ref/c/func/LEORunInContext LEORunInContext
+	@seealso //leo_ref/c/func/LEOContinueRunningContextFast LEOContinueRunningContextFast
+*/
+void	LEORunInContextFast( LEOInstruction instructions[], LEOContext *inContext );
+
 
 /*! Queues up a paused context for resumption of execution the next time
 	LEOContextResumeIfAvailable is called.
@@ -350,6 +407,26 @@ void	LEOPrepareContextForRunning( LEOInstruction instructions[], LEOContext *inC
 */
 bool	LEOContinueRunningContext( LEOContext *inContext );
 
+/*! Execute instructions in the context until the code has finished executing,
+	exited with an error or was paused. Unlike calling LEOContinueRunningContext
+	in a loop, this does not check for the preInstructionProc, debug printing
+	or clear the errMsg before each instruction unless the kLEOContextHooksActive
+	flag is set, in which case it behaves just like LEOContinueRunningContext.
+	@seealso //leo_ref/c/func/LEORunInContextFast LEORunInContextFast
+	@seealso //leo_ref/c/func/LEOContextUpdateHooksActiveFlag LEOContextUpdateHooksActiveFlag
+*/
+void	LEOContinueRunningContextFast( LEOContext *inContext );
+
+/*! Set or clear the kLEOContextHooksActive flag depending on whether the given
+	context has a preInstructionProc, there is an instruction to debug-print or
+	the profiler is enabled.
+	LEOPrepareContextForRunning calls this for you, but if you change the
+	preInstructionProc of a running context, call this so
+	LEOContinueRunningContextFast notices.
+	@seealso //leo_ref/c/func/LEOContinueRunningContextFast LEOContinueRunningContextFast
+*/
+void	LEOContextUpdateHooksActiveFlag( LEOContext *inContext );
+
 /*! Stop execution in the given context with an error message.
 	Currently sets the errMsg field of the context to the given string and set
 	keepRunning to FALSE. inErrorFmt is a format string like you pass it to
@@ -364,6 +441,19 @@ void	LEOContextStopWithError( LEOContext* inContext, size_t errLine, size_t errO
 */
 void	LEOContextSetLocalVariable( LEOContext* inContext, const char* varName, const char* inMessageFmt, ... );
 
+/*! Make sure there are at least numSlots unused entries at the end of the
+	stack, growing it if needed. Returns false and stops the context with a
+	"Stack overflow" error if that would exceed LEO_STACK_SIZE.
+	Growing the stack may move it in memory. Base pointers, the call stack and
+	references to values on the stack are updated, but any other pointers into
+	the stack you may be holding are invalid afterwards.
+	The interpreter loop already guarantees LEO_STACK_RED_ZONE free entries
+	before each instruction, so you only need this if your instruction pushes
+	more values than that.
+	@seealso //leo_ref/c/func/LEOPushValueOnStack LEOPushValueOnStack
+*/
+bool	LEOContextEnsureStackSpace( LEOContext* inContext, size_t numSlots );
+
 /*! Push a copy of the given value onto the stack, returning a pointer to it.
  @seealso //leo_ref/c/func/LEOCleanUpStackToPtr LEOCleanUpStackToPtr
  @seealso //leo_ref/c/func/LEOPushIntegerOnStack LEOPushIntegerOnStack
@@ -0,0 +1,846 @@
+/*
+ *  LEOProfiler.c
+ *  Leonie
+ *
+ *  Created by Uli Kusterer on 17.10.26.
+ *  Copyright 2026 Uli Kusterer. All rights reserved.
+ *
+ */
+
+#include "LEOProfiler.h"
+#include "LEOInstructions.h"
+#include "LEOScript.h"
+#include "LEOContextGroup.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define LEO_PROFILER_USE_RDTSC		1
+#endif
+
+
+#define LEO_PROFILER_INITIAL_NUM_SITES		256		// Must be a power of 2.
+#define LEO_PROFILER_INITIAL_FRAME_SLOTS	64		// Must be a power of 2.
+#define LEO_HANDLER_PROFILER_INITIAL_SLOTS	64		// Must be a power of 2.
+
+
+// One entry per chain of handler calls that we've seen. Frame 0 stands for
+//	code that isn't in any handler, and is always the first one added:
+typedef struct LEOProfilerFrame
+{
+	size_t				parentFrameIndex;	// Frame of the handler that called this one, SIZE_MAX for frame 0.
+	struct LEOHandler*	handler;
+	char*				handlerName;		// Copied, so we can still print it after the script has gone away.
+} LEOProfilerFrame;
+
+
+// One entry per combination of call chain, line and instruction ID that we've seen:
+typedef struct LEOProfilerSite
+{
+	size_t				frameIndex;		// Index into sProfilerFrames.
+	struct LEOHandler*	handler;		// Handler of that frame, so we don't have to look it up for each site.
+	size_t				lineNo;
+	uint16_t			fileID;
+	LEOInstructionID	instructionID;
+	bool				inUse;
+	uint64_t			count;
+	uint64_t			ticks;
+} LEOProfilerSite;
+
+
+// Used to add up sites for output:
+typedef struct LEOProfilerTotal
+{
+	LEOProfilerSite*	site;			// First site that contributed to this total.
+	uint64_t			count;
+	uint64_t			ticks;
+} LEOProfilerTotal;
+
+
+typedef bool (*LEOProfilerSitesMatchFuncPtr)( LEOProfilerSite* a, LEOProfilerSite* b );
+
+
+bool					gLEOProfilerEnabled = false;
+
+static LEOProfilerSite*	sProfilerSites = NULL;
+static size_t			sProfilerNumSites = 0;
+static size_t			sProfilerSitesCapacity = 0;
+static LEOProfilerFrame*	sProfilerFrames = NULL;
+static size_t			sProfilerNumFrames = 0;
+static size_t*			sProfilerFrameSlots = NULL;		// Hash table of indexes into sProfilerFrames, SIZE_MAX for unused slots.
+static size_t			sProfilerNumFrameSlots = 0;
+static size_t			sProfilerFirstFrameID = 0;		// Frame IDs are this plus the frame index, so call stack entries can tell IDs from before a reset.
+static uint64_t			sProfilerStartTicks = 0;
+static uint64_t			sProfilerStartNanoseconds = 0;
+
+bool							gLEOHandlerProfilerEnabled = false;
+
+static LEOHandlerProfileEntry*	sHandlerProfileEntries = NULL;
+static size_t					sHandlerProfileNumEntries = 0;
+static size_t*					sHandlerProfileSlots = NULL;	// Hash table of indexes into sHandlerProfileEntries, SIZE_MAX for unused slots.
+static size_t					sHandlerProfileNumSlots = 0;
+static uint64_t					sHandlerProfileResetTime = 0;	// Handlers called before this aren't recorded when they return.
+
+
+static uint64_t	LEOProfilerNanoseconds( void )
+{
+	struct timespec		now = { 0, 0 };
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ((uint64_t)now.tv_sec * 1000000000ULL) +(uint64_t)now.tv_nsec;
+}
+
+
+static inline uint64_t	LEOProfilerTicks( void )
+{
+#if LEO_PROFILER_USE_RDTSC
+	return __rdtsc();
+#else
+	return LEOProfilerNanoseconds();
+#endif
+}
+
+
+void	LEOProfilerSetEnabled( bool inEnabled )
+{
+	if( inEnabled && sProfilerStartNanoseconds == 0 )
+	{
+		sProfilerStartTicks = LEOProfilerTicks();
+		sProfilerStartNanoseconds = LEOProfilerNanoseconds();
+	}
+	gLEOProfilerEnabled = inEnabled;
+}
+
+
+void	LEOProfilerReset( void )
+{
+	if( sProfilerSites )
+		free( sProfilerSites );
+	sProfilerSites = NULL;
+	sProfilerNumSites = 0;
+	sProfilerSitesCapacity = 0;
+	
+	for( size_t x = 0; x < sProfilerNumFrames; x++ )
+	{
+		if( sProfilerFrames[x].handlerName )
+			free( sProfilerFrames[x].handlerName );
+	}
+	if( sProfilerFrames )
+		free( sProfilerFrames );
+	sProfilerFrames = NULL;
+	if( sProfilerFrameSlots )
+		free( sProfilerFrameSlots );
+	sProfilerFrameSlots = NULL;
+	sProfilerNumFrameSlots = 0;
+	sProfilerFirstFrameID += sProfilerNumFrames;
+	sProfilerNumFrames = 0;
+	
+	sProfilerStartTicks = LEOProfilerTicks();
+	sProfilerStartNanoseconds = LEOProfilerNanoseconds();
+}
+
+
+double	LEOProfilerTicksPerSecond( void )
+{
+#if LEO_PROFILER_USE_RDTSC
+	uint64_t	elapsedNanoseconds = LEOProfilerNanoseconds() -sProfilerStartNanoseconds;
+	uint64_t	elapsedTicks = LEOProfilerTicks() -sProfilerStartTicks;
+	if( sProfilerStartNanoseconds == 0 || elapsedNanoseconds == 0 )
+		return 1000000000.0;	// Don't know yet, best guess.
+	return elapsedTicks / (elapsedNanoseconds / 1000000000.0);
+#else
+	return 1000000000.0;
+#endif
+}
+
+
+static inline size_t	LEOProfilerHashFrame( size_t inParentFrameIndex, struct LEOHandler* inHandler )
+{
+	size_t	hash = (size_t)(uintptr_t)inHandler;
+	hash = (hash ^ (hash >> 7)) * 31 +inParentFrameIndex;
+	return hash ^ (hash >> 16);
+}
+
+
+static size_t	LEOProfilerFindFrameSlot( size_t inParentFrameIndex, struct LEOHandler* inHandler )
+{
+	size_t	x = LEOProfilerHashFrame( inParentFrameIndex, inHandler ) & (sProfilerNumFrameSlots -1);
+	while( sProfilerFrameSlots[x] != SIZE_MAX )
+	{
+		LEOProfilerFrame*	currFrame = sProfilerFrames +sProfilerFrameSlots[x];
+		if( currFrame->parentFrameIndex == inParentFrameIndex && currFrame->handler == inHandler )
+			break;
+		x = (x +1) & (sProfilerNumFrameSlots -1);
+	}
+	return x;
+}
+
+
+// Returns SIZE_MAX if we couldn't allocate a new frame:
+static size_t	LEOProfilerFindOrAddFrame( LEOContext* inContext, size_t inParentFrameIndex, struct LEOHandler* inHandler )
+{
+	if( sProfilerNumFrameSlots > 0 )
+	{
+		size_t	slotIndex = LEOProfilerFindFrameSlot( inParentFrameIndex, inHandler );
+		if( sProfilerFrameSlots[slotIndex] != SIZE_MAX )
+			return sProfilerFrameSlots[slotIndex];
+	}
+	
+	// Not found, need to add a frame. Slots are rehashed whenever we grow, and
+	//	we keep twice as many slots as frames, so there's always a free one:
+	if( (sProfilerNumFrames +1) * 2 > sProfilerNumFrameSlots )
+	{
+		size_t	newNumSlots = sProfilerNumFrameSlots ? (sProfilerNumFrameSlots * 2) : LEO_PROFILER_INITIAL_FRAME_SLOTS;
+		LEOProfilerFrame*	newFrames = realloc( sProfilerFrames, (newNumSlots / 2) * sizeof(LEOProfilerFrame) );
+		if( !newFrames )
+		{
+			printf( "*** Failed to allocate profiler frames! ***\n" );
+			return SIZE_MAX;
+		}
+		sProfilerFrames = newFrames;
+		size_t*	newSlots = malloc( newNumSlots * sizeof(size_t) );
+		if( !newSlots )
+		{
+			printf( "*** Failed to allocate profiler frames! ***\n" );
+			return SIZE_MAX;
+		}
+		if( sProfilerFrameSlots )
+			free( sProfilerFrameSlots );
+		sProfilerFrameSlots = newSlots;
+		sProfilerNumFrameSlots = newNumSlots;
+		for( size_t x = 0; x < newNumSlots; x++ )
+			newSlots[x] = SIZE_MAX;
+		for( size_t x = 0; x < sProfilerNumFrames; x++ )
+			newSlots[ LEOProfilerFindFrameSlot( newFrames[x].parentFrameIndex, newFrames[x].handler ) ] = x;
+	}
+	
+	size_t				newIndex = sProfilerNumFrames++;
+	LEOProfilerFrame*	newFrame = sProfilerFrames +newIndex;
+	newFrame->parentFrameIndex = inParentFrameIndex;
+	newFrame->handler = inHandler;
+	newFrame->handlerName = NULL;
+	if( inHandler && inContext->group )
+	{
+		const char*	handlerName = LEOContextGroupHandlerNameForHandlerID( inContext->group, inHandler->handlerName );
+		if( handlerName )
+			newFrame->handlerName = strdup( handlerName );
+	}
+	sProfilerFrameSlots[ LEOProfilerFindFrameSlot( inParentFrameIndex, inHandler ) ] = newIndex;
+	
+	return newIndex;
+}
+
+
+// Returns the index of the frame for the context's current call stack, or
+//	SIZE_MAX if we couldn't allocate it. Call stack entries remember their
+//	frame, so usually this only has to look at the innermost one:
+static size_t	LEOProfilerFrameForCallStack( LEOContext* inContext )
+{
+	size_t	firstNewEntry = inContext->numCallStackEntries;
+	while( firstNewEntry > 0 )
+	{
+		size_t	frameID = inContext->callStackEntries[firstNewEntry -1].profileFrameID;
+		if( frameID != SIZE_MAX && frameID >= sProfilerFirstFrameID )
+			break;
+		firstNewEntry--;
+	}
+	
+	size_t	frameIndex = 0;
+	if( firstNewEntry > 0 )
+		frameIndex = inContext->callStackEntries[firstNewEntry -1].profileFrameID -sProfilerFirstFrameID;
+	else if( sProfilerNumFrames == 0 )
+		frameIndex = LEOProfilerFindOrAddFrame( inContext, SIZE_MAX, NULL );
+	
+	for( size_t x = firstNewEntry; x < inContext->numCallStackEntries && frameIndex != SIZE_MAX; x++ )
+	{
+		frameIndex = LEOProfilerFindOrAddFrame( inContext, frameIndex, inContext->callStackEntries[x].handler );
+		if( frameIndex != SIZE_MAX )
+			inContext->callStackEntries[x].profileFrameID = sProfilerFirstFrameID +frameIndex;
+	}
+	
+	return frameIndex;
+}
+
+
+static inline size_t	LEOProfilerHashSite( size_t inFrameIndex, uint16_t inFileID, size_t inLineNo, LEOInstructionID inID )
+{
+	size_t	hash = inFrameIndex;
+	hash = hash * 31 +inFileID;
+	hash = hash * 31 +inLineNo;
+	hash = hash * 31 +inID;
+	return hash ^ (hash >> 16);
+}
+
+
+static bool	LEOProfilerGrowSites( void )
+{
+	size_t				newCapacity = sProfilerSitesCapacity ? (sProfilerSitesCapacity * 2) : LEO_PROFILER_INITIAL_NUM_SITES;
+	LEOProfilerSite*	newSites = calloc( newCapacity, sizeof(LEOProfilerSite) );
+	if( !newSites )
+	{
+		printf( "*** Failed to allocate profiler sites! ***\n" );
+		return false;
+	}
+	
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		LEOProfilerSite*	oldSite = sProfilerSites +x;
+		if( !oldSite->inUse )
+			continue;
+		
+		size_t	y = LEOProfilerHashSite( oldSite->frameIndex, oldSite->fileID, oldSite->lineNo, oldSite->instructionID ) & (newCapacity -1);
+		while( newSites[y].inUse )
+			y = (y +1) & (newCapacity -1);
+		newSites[y] = *oldSite;
+	}
+	
+	if( sProfilerSites )
+		free( sProfilerSites );
+	sProfilerSites = newSites;
+	sProfilerSitesCapacity = newCapacity;
+	
+	return true;
+}
+
+
+static LEOProfilerSite*	LEOProfilerFindOrAddSite( size_t inFrameIndex, uint16_t inFileID, size_t inLineNo, LEOInstructionID inID )
+{
+	if( (sProfilerNumSites +1) * 4 > sProfilerSitesCapacity * 3 && !LEOProfilerGrowSites() )	// Keep load factor below 75%.
+		return NULL;
+	
+	size_t	x = LEOProfilerHashSite( inFrameIndex, inFileID, inLineNo, inID ) & (sProfilerSitesCapacity -1);
+	while( sProfilerSites[x].inUse )
+	{
+		LEOProfilerSite*	currSite = sProfilerSites +x;
+		if( currSite->frameIndex == inFrameIndex && currSite->lineNo == inLineNo
+			&& currSite->fileID == inFileID && currSite->instructionID == inID )
+			return currSite;
+		x = (x +1) & (sProfilerSitesCapacity -1);
+	}
+	
+	LEOProfilerSite*	newSite = sProfilerSites +x;
+	newSite->inUse = true;
+	newSite->frameIndex = inFrameIndex;
+	newSite->handler = sProfilerFrames[inFrameIndex].handler;
+	newSite->fileID = inFileID;
+	newSite->lineNo = inLineNo;
+	newSite->instructionID = inID;
+	sProfilerNumSites++;
+	
+	return newSite;
+}
+
+
+void	LEOProfilerRunInstruction( LEOContext* inContext, LEOInstructionID inID )
+{
+	// The current line is kept in the context, so contexts that run interleaved
+	//	(e.g. one running another from a host command) don't mix up their lines:
+	size_t				depth = inContext->numCallStackEntries;
+	LEOCallStackEntry*	callStackEntry = (depth > 0) ? (inContext->callStackEntries +depth -1) : NULL;
+	size_t*				currLineNo = callStackEntry ? &callStackEntry->profileLineNo : &inContext->profileLineNo;
+	uint16_t*			currFileID = callStackEntry ? &callStackEntry->profileFileID : &inContext->profileFileID;
+	
+	if( LEOInstructionIDIsLineMarker( inID ) )
+	{
+		*currFileID = inContext->currentInstruction->param1;
+		*currLineNo = inContext->currentInstruction->param2;
+	}
+	
+	uint16_t	fileID = *currFileID;
+	size_t		lineNo = *currLineNo;
+	size_t		frameIndex = LEOProfilerFrameForCallStack( inContext );
+	size_t		firstFrameID = sProfilerFirstFrameID;
+	
+	uint64_t	startTicks = LEOProfilerTicks();
+	gInstructions[inID].proc( inContext );
+	uint64_t	endTicks = LEOProfilerTicks();
+	
+	if( frameIndex == SIZE_MAX || firstFrameID != sProfilerFirstFrameID )
+		return;	// Out of memory, or the instruction reset the profiler.
+	
+	// Only look up the site now, as instructions that run nested contexts may add sites, moving them around:
+	LEOProfilerSite*	site = LEOProfilerFindOrAddSite( frameIndex, fileID, lineNo, inID );
+	if( site )
+	{
+		site->count++;
+		site->ticks += endTicks -startTicks;
+	}
+}
+
+
+void	LEOProfilerGetInstructionStats( LEOInstructionID inID, uint64_t *outCount, uint64_t *outTicks )
+{
+	*outCount = 0;
+	*outTicks = 0;
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		if( sProfilerSites[x].inUse && sProfilerSites[x].instructionID == inID )
+		{
+			*outCount += sProfilerSites[x].count;
+			*outTicks += sProfilerSites[x].ticks;
+		}
+	}
+}
+
+
+void	LEOProfilerGetLineStats( uint16_t inFileID, size_t inLineNo, uint64_t *outCount, uint64_t *outTicks )
+{
+	*outCount = 0;
+	*outTicks = 0;
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		if( sProfilerSites[x].inUse && sProfilerSites[x].fileID == inFileID && sProfilerSites[x].lineNo == inLineNo )
+		{
+			*outCount += sProfilerSites[x].count;
+			*outTicks += sProfilerSites[x].ticks;
+		}
+	}
+}
+
+
+void	LEOProfilerGetHandlerStats( struct LEOHandler* inHandler, uint64_t *outCount, uint64_t *outTicks )
+{
+	*outCount = 0;
+	*outTicks = 0;
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		if( sProfilerSites[x].inUse && sProfilerSites[x].handler == inHandler )
+		{
+			*outCount += sProfilerSites[x].count;
+			*outTicks += sProfilerSites[x].ticks;
+		}
+	}
+}
+
+
+#pragma mark -
+#pragma mark Output
+
+
+static bool	LEOProfilerSitesHaveSameInstruction( LEOProfilerSite* a, LEOProfilerSite* b )
+{
+	return a->instructionID == b->instructionID;
+}
+
+
+static bool	LEOProfilerSitesHaveSameHandler( LEOProfilerSite* a, LEOProfilerSite* b )
+{
+	return a->handler == b->handler;
+}
+
+
+static bool	LEOProfilerSitesHaveSameLine( LEOProfilerSite* a, LEOProfilerSite* b )
+{
+	return a->fileID == b->fileID && a->lineNo == b->lineNo;
+}
+
+
+static int	LEOProfilerCompareTotalsByTicks( const void* a, const void* b )
+{
+	const LEOProfilerTotal*	totalA = a;
+	const LEOProfilerTotal*	totalB = b;
+	if( totalA->ticks > totalB->ticks )
+		return -1;
+	else if( totalA->ticks < totalB->ticks )
+		return 1;
+	return 0;
+}
+
+
+// Add up all sites that are equal according to the given function. Returns a
+//	list sorted by ticks, most expensive first, which the caller must free():
+static LEOProfilerTotal*	LEOProfilerCopyTotals( LEOProfilerSitesMatchFuncPtr sitesMatch, size_t *outNumTotals )
+{
+	*outNumTotals = 0;
+	if( sProfilerNumSites == 0 )
+		return NULL;
+	
+	LEOProfilerTotal*	totals = calloc( sProfilerNumSites, sizeof(LEOProfilerTotal) );
+	if( !totals )
+	{
+		printf( "*** Failed to allocate profiler totals! ***\n" );
+		return NULL;
+	}
+	
+	size_t	numTotals = 0;
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		LEOProfilerSite*	currSite = sProfilerSites +x;
+		if( !currSite->inUse )
+			continue;
+		
+		size_t	y = 0;
+		for( ; y < numTotals; y++ )
+		{
+			if( sitesMatch( totals[y].site, currSite ) )
+				break;
+		}
+		if( y == numTotals )
+			totals[numTotals++].site = currSite;
+		totals[y].count += currSite->count;
+		totals[y].ticks += currSite->ticks;
+	}
+	
+	qsort( totals, numTotals, sizeof(LEOProfilerTotal), LEOProfilerCompareTotalsByTicks );
+	
+	*outNumTotals = numTotals;
+	return totals;
+}
+
+
+static const char*	LEOProfilerInstructionName( LEOInstructionID inID )
+{
+	if( inID < gNumInstructions && gInstructions[inID].name )
+		return gInstructions[inID].name;
+	return "UNKNOWN_INSTR";
+}
+
+
+static void	LEOProfilerWriteJSONString( FILE* inFile, const char* inString )
+{
+	fputc( '"', inFile );
+	for( const char* currCh = inString; *currCh != 0; currCh++ )
+	{
+		if( *currCh == '"' || *currCh == '\\' )
+			fprintf( inFile, "\\%c", *currCh );
+		else if( (unsigned char)*currCh < 0x20 )
+			fprintf( inFile, "\\u%04x", (unsigned char)*currCh );
+		else
+			fputc( *currCh, inFile );
+	}
+	fputc( '"', inFile );
+}
+
+
+void	LEOProfilerWriteJSON( FILE* inFile )
+{
+	size_t				numTotals = 0;
+	LEOProfilerTotal*	totals = NULL;
+	
+	fprintf( inFile, "{\n\t\"ticksPerSecond\": %.0f,\n\t\"instructions\": [", LEOProfilerTicksPerSecond() );
+	totals = LEOProfilerCopyTotals( LEOProfilerSitesHaveSameInstruction, &numTotals );
+	for( size_t x = 0; x < numTotals; x++ )
+	{
+		fprintf( inFile, "%s\n\t\t{ \"name\": ", (x > 0) ? "," : "" );
+		LEOProfilerWriteJSONString( inFile, LEOProfilerInstructionName( totals[x].site->instructionID ) );
+		fprintf( inFile, ", \"count\": %llu, \"ticks\": %llu }", (unsigned long long)totals[x].count, (unsigned long long)totals[x].ticks );
+	}
+	if( totals )
+		free( totals );
+	
+	fprintf( inFile, "\n\t],\n\t\"handlers\": [" );
+	totals = LEOProfilerCopyTotals( LEOProfilerSitesHaveSameHandler, &numTotals );
+	for( size_t x = 0; x < numTotals; x++ )
+	{
+		fprintf( inFile, "%s\n\t\t{ \"name\": ", (x > 0) ? "," : "" );
+		const char*	handlerName = sProfilerFrames[totals[x].site->frameIndex].handlerName;
+		if( handlerName )
+			LEOProfilerWriteJSONString( inFile, handlerName );
+		else
+			fprintf( inFile, "null" );
+		fprintf( inFile, ", \"count\": %llu, \"ticks\": %llu }", (unsigned long long)totals[x].count, (unsigned long long)totals[x].ticks );
+	}
+	if( totals )
+		free( totals );
+	
+	fprintf( inFile, "\n\t],\n\t\"lines\": [" );
+	totals = LEOProfilerCopyTotals( LEOProfilerSitesHaveSameLine, &numTotals );
+	for( size_t x = 0; x < numTotals; x++ )
+	{
+		fprintf( inFile, "%s\n\t\t{ \"file\": ", (x > 0) ? "," : "" );
+		LEOProfilerWriteJSONString( inFile, LEOFileNameForFileID( totals[x].site->fileID ) );
+		fprintf( inFile, ", \"line\": %zu, \"count\": %llu, \"ticks\": %llu }", totals[x].site->lineNo, (unsigned long long)totals[x].count, (unsigned long long)totals[x].ticks );
+	}
+	if( totals )
+		free( totals );
+	
+	fprintf( inFile, "\n\t]\n}\n" );
+}
+
+
+static void	LEOProfilerWriteFoldedFrameName( FILE* inFile, const char* inName )
+{
+	// Semicolons separate stack frames, and the last space separates the
+	//	value, so neither may occur in a frame name:
+	for( const char* currCh = inName; *currCh != 0; currCh++ )
+		fputc( (*currCh == ';' || *currCh == ' ' || *currCh == '\n') ? '_' : *currCh, inFile );
+}
+
+
+void	LEOProfilerWriteFoldedStacks( FILE* inFile )
+{
+	size_t*	chain = NULL;	// Frame indexes of the current site, innermost first.
+	if( sProfilerNumFrames > 0 )
+	{
+		chain = malloc( sProfilerNumFrames * sizeof(size_t) );
+		if( !chain )
+		{
+			printf( "*** Failed to allocate profiler call chain! ***\n" );
+			return;
+		}
+	}
+	
+	for( size_t x = 0; x < sProfilerSitesCapacity; x++ )
+	{
+		LEOProfilerSite*	currSite = sProfilerSites +x;
+		if( !currSite->inUse || currSite->ticks == 0 )
+			continue;
+		
+		size_t	chainLength = 0;
+		for( size_t currFrame = currSite->frameIndex; currFrame != 0; currFrame = sProfilerFrames[currFrame].parentFrameIndex )
+			chain[chainLength++] = currFrame;
+		
+		if( chainLength == 0 )
+			LEOProfilerWriteFoldedFrameName( inFile, "(no handler)" );
+		for( size_t y = chainLength; y > 0; y-- )
+		{
+			const char*	handlerName = sProfilerFrames[chain[y -1]].handlerName;
+			LEOProfilerWriteFoldedFrameName( inFile, handlerName ? handlerName : "(unknown handler)" );
+			if( y > 1 )
+				fputc( ';', inFile );
+		}
+		fputc( ';', inFile );
+		LEOProfilerWriteFoldedFrameName( inFile, LEOFileNameForFileID( currSite->fileID ) );
+		fprintf( inFile, ":%zu;%s %llu\n", currSite->lineNo, LEOProfilerInstructionName( currSite->instructionID ), (unsigned long long)currSite->ticks );
+	}
+	
+	if( chain )
+		free( chain );
+}
+
+
+#pragma mark -
+#pragma mark Handler profiler
+
+
+void	LEOHandlerProfilerSetEnabled( bool inEnabled )
+{
+	gLEOHandlerProfilerEnabled = inEnabled;
+}
+
+
+void	LEOHandlerProfilerReset( void )
+{
+	for( size_t x = 0; x < sHandlerProfileNumEntries; x++ )
+	{
+		if( sHandlerProfileEntries[x].handlerName )
+			free( sHandlerProfileEntries[x].handlerName );
+	}
+	if( sHandlerProfileEntries )
+		free( sHandlerProfileEntries );
+	sHandlerProfileEntries = NULL;
+	sHandlerProfileNumEntries = 0;
+	
+	if( sHandlerProfileSlots )
+		free( sHandlerProfileSlots );
+	sHandlerProfileSlots = NULL;
+	sHandlerProfileNumSlots = 0;
+	
+	sHandlerProfileResetTime = LEOProfilerNanoseconds();
+}
+
+
+static inline size_t	LEOHandlerProfilerHash( struct LEOScript* inScript, LEOHandlerID inHandlerID )
+{
+	size_t	hash = (size_t)(uintptr_t)inScript;
+	hash = (hash ^ (hash >> 9)) * 31 +inHandlerID;
+	return hash ^ (hash >> 16);
+}
+
+
+static size_t	LEOHandlerProfilerFindSlot( struct LEOScript* inScript, LEOHandlerID inHandlerID )
+{
+	size_t	x = LEOHandlerProfilerHash( inScript, inHandlerID ) & (sHandlerProfileNumSlots -1);
+	while( sHandlerProfileSlots[x] != SIZE_MAX )
+	{
+		LEOHandlerProfileEntry*	currEntry = sHandlerProfileEntries +sHandlerProfileSlots[x];
+		if( currEntry->script == inScript && currEntry->handlerID == inHandlerID )
+			break;
+		x = (x +1) & (sHandlerProfileNumSlots -1);
+	}
+	return x;
+}
+
+
+// Returns SIZE_MAX if we couldn't allocate a new entry:
+static size_t	LEOHandlerProfilerFindOrAddEntry( LEOContext* inContext, struct LEOScript* inScript, LEOHandlerID inHandlerID )
+{
+	if( sHandlerProfileNumSlots > 0 )
+	{
+		size_t	slotIndex = LEOHandlerProfilerFindSlot( inScript, inHandlerID );
+		if( sHandlerProfileSlots[slotIndex] != SIZE_MAX )
+			return sHandlerProfileSlots[slotIndex];
+	}
+	
+	// Not found, need to add an entry. Slots are rehashed whenever we grow, and
+	//	we keep twice as many slots as entries, so there's always a free one:
+	if( (sHandlerProfileNumEntries +1) * 2 > sHandlerProfileNumSlots )
+	{
+		size_t	newNumSlots = sHandlerProfileNumSlots ? (sHandlerProfileNumSlots * 2) : LEO_HANDLER_PROFILER_INITIAL_SLOTS;
+		LEOHandlerProfileEntry*	newEntries = realloc( sHandlerProfileEntries, (newNumSlots / 2) * sizeof(LEOHandlerProfileEntry) );
+		if( !newEntries )
+		{
+			printf( "*** Failed to allocate handler profile entries! ***\n" );
+			return SIZE_MAX;
+		}
+		sHandlerProfileEntries = newEntries;
+		size_t*	newSlots = malloc( newNumSlots * sizeof(size_t) );
+		if( !newSlots )
+		{
+			printf( "*** Failed to allocate handler profile entries! ***\n" );
+			return SIZE_MAX;
+		}
+		if( sHandlerProfileSlots )
+			free( sHandlerProfileSlots );
+		sHandlerProfileSlots = newSlots;
+		sHandlerProfileNumSlots = newNumSlots;
+		for( size_t x = 0; x < newNumSlots; x++ )
+			newSlots[x] = SIZE_MAX;
+		for( size_t x = 0; x < sHandlerProfileNumEntries; x++ )
+			newSlots[ LEOHandlerProfilerFindSlot( newEntries[x].script, newEntries[x].handlerID ) ] = x;
+	}
+	
+	size_t					newIndex = sHandlerProfileNumEntries++;
+	LEOHandlerProfileEntry*	newEntry = sHandlerProfileEntries +newIndex;
+	memset( newEntry, 0, sizeof(LEOHandlerProfileEntry) );
+	newEntry->script = inScript;
+	newEntry->handlerID = inHandlerID;
+	if( inContext->group )
+	{
+		const char*	handlerName = LEOContextGroupHandlerNameForHandlerID( inContext->group, inHandlerID );
+		if( handlerName )
+			newEntry->handlerName = strdup( handlerName );
+	}
+	sHandlerProfileSlots[ LEOHandlerProfilerFindSlot( inScript, inHandlerID ) ] = newIndex;
+	
+	return newIndex;
+}
+
+
+void	LEOHandlerProfilerEnterHandler( LEOContext* inContext, size_t inCallStackEntryIndex )
+{
+	LEOCallStackEntry*	callStackEntry = inContext->callStackEntries +inCallStackEntryIndex;
+	size_t				entryIndex = LEOHandlerProfilerFindOrAddEntry( inContext, callStackEntry->script, callStackEntry->handler->handlerName );
+	if( entryIndex == SIZE_MAX )
+		return;
+	
+	LEOHandlerProfileEntry*	entry = sHandlerProfileEntries +entryIndex;
+	entry->callCount++;
+	entry->currentRecursionDepth++;
+	if( entry->currentRecursionDepth > entry->maxRecursionDepth )
+		entry->maxRecursionDepth = entry->currentRecursionDepth;
+	
+	callStackEntry->profileEntryIndex = entryIndex;
+	callStackEntry->profileChildTime = 0;
+	callStackEntry->profileStartTime = LEOProfilerNanoseconds();
+}
+
+
+void	LEOHandlerProfilerExitHandler( LEOContext* inContext, size_t inCallStackEntryIndex )
+{
+	LEOCallStackEntry*	callStackEntry = inContext->callStackEntries +inCallStackEntryIndex;
+	uint64_t			elapsedTime = LEOProfilerNanoseconds() -callStackEntry->profileStartTime;
+	size_t				entryIndex = callStackEntry->profileEntryIndex;
+	callStackEntry->profileEntryIndex = SIZE_MAX;
+	
+	if( callStackEntry->profileStartTime < sHandlerProfileResetTime || entryIndex >= sHandlerProfileNumEntries )
+		return;	// Was called before the last reset.
+	
+	LEOHandlerProfileEntry*	entry = sHandlerProfileEntries +entryIndex;
+	entry->currentRecursionDepth--;
+	if( entry->currentRecursionDepth == 0 )	// Outermost call includes time of recursive calls.
+		entry->inclusiveNanoseconds += elapsedTime;
+	if( elapsedTime > callStackEntry->profileChildTime )
+		entry->exclusiveNanoseconds += elapsedTime -callStackEntry->profileChildTime;
+	
+	if( inCallStackEntryIndex > 0 )
+		callStackEntry[-1].profileChildTime += elapsedTime;
+}
+
+
+void	LEOHandlerProfilerRecordFallthrough( LEOContext* inContext, struct LEOScript* inScript, LEOHandlerID inHandlerID, LEOHandlerProfilerFallthroughKind inKind )
+{
+	size_t	entryIndex = LEOHandlerProfilerFindOrAddEntry( inContext, inScript, inHandlerID );
+	if( entryIndex == SIZE_MAX )
+		return;
+	
+	if( inKind == kLEOHandlerProfilerParentScriptFallthrough )
+		sHandlerProfileEntries[entryIndex].parentScriptFallthroughs++;
+	else
+		sHandlerProfileEntries[entryIndex].nonexistentHandlerCalls++;
+}
+
+
+size_t	LEOHandlerProfilerGetNumEntries( void )
+{
+	return sHandlerProfileNumEntries;
+}
+
+
+const LEOHandlerProfileEntry*	LEOHandlerProfilerGetEntryAtIndex( size_t inIndex )
+{
+	if( inIndex >= sHandlerProfileNumEntries )
+		return NULL;
+	return sHandlerProfileEntries +inIndex;
+}
+
+
+const LEOHandlerProfileEntry*	LEOHandlerProfilerFindEntry( struct LEOScript* inScript, LEOHandlerID inHandlerID )
+{
+	if( sHandlerProfileNumSlots == 0 )
+		return NULL;
+	
+	size_t	slotIndex = LEOHandlerProfilerFindSlot( inScript, inHandlerID );
+	if( sHandlerProfileSlots[slotIndex] == SIZE_MAX )
+		return NULL;
+	return sHandlerProfileEntries +sHandlerProfileSlots[slotIndex];
+}
+
+
+static int	LEOHandlerProfilerCompareEntriesByInclusiveTime( const void* a, const void* b )
+{
+	const LEOHandlerProfileEntry*	entryA = *(const LEOHandlerProfileEntry**)a;
+	const LEOHandlerProfileEntry*	entryB = *(const LEOHandlerProfileEntry**)b;
+	if( entryA->inclusiveNanoseconds > entryB->inclusiveNanoseconds )
+		return -1;
+	else if( entryA->inclusiveNanoseconds < entryB->inclusiveNanoseconds )
+		return 1;
+	return 0;
+}
+
+
+void	LEOHandlerProfilerWriteJSON( FILE* inFile )
+{
+	LEOHandlerProfileEntry**	sortedEntries = NULL;
+	if( sHandlerProfileNumEntries > 0 )
+	{
+		sortedEntries = malloc( sHandlerProfileNumEntries * sizeof(LEOHandlerProfileEntry*) );
+		if( !sortedEntries )
+		{
+			printf( "*** Failed to allocate handler profile report! ***\n" );
+			return;
+		}
+		for( size_t x = 0; x < sHandlerProfileNumEntries; x++ )
+			sortedEntries[x] = sHandlerProfileEntries +x;
+		qsort( sortedEntries, sHandlerProfileNumEntries, sizeof(LEOHandlerProfileEntry*), LEOHandlerProfilerCompareEntriesByInclusiveTime );
+	}
+	
+	fprintf( inFile, "[" );
+	for( size_t x = 0; x < sHandlerProfileNumEntries; x++ )
+	{
+		LEOHandlerProfileEntry*	currEntry = sortedEntries[x];
+		fprintf( inFile, "%s\n\t{ \"name\": ", (x > 0) ? "," : "" );
+		if( currEntry->handlerName )
+			LEOProfilerWriteJSONString( inFile, currEntry->handlerName );
+		else
+			fprintf( inFile, "null" );
+		fprintf( inFile, ", \"script\": \"%p\", \"calls\": %llu, \"inclusiveNanoseconds\": %llu, \"exclusiveNanoseconds\": %llu, \"maxRecursionDepth\": %zu, \"parentScriptFallthroughs\": %llu, \"nonexistentHandlerCalls\": %llu }",
+					currEntry->script, (unsigned long long)currEntry->callCount, (unsigned long long)currEntry->inclusiveNanoseconds,
+					(unsigned long long)currEntry->exclusiveNanoseconds, currEntry->maxRecursionDepth,
+					(unsigned long long)currEntry->parentScriptFallthroughs, (unsigned long long)currEntry->nonexistentHandlerCalls );
+	}
+	fprintf( inFile, "\n]\n" );
+	
+	if( sortedEntries )
+		free( sortedEntries );
+}
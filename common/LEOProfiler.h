@@ -0,0 +1,193 @@
+/*
+ *  LEOProfiler.h
+ *  Leonie
+ *
+ *  Created by Uli Kusterer on 17.10.26.
+ *  Copyright 2026 Uli Kusterer. All rights reserved.
+ *
+ */
+
+#ifndef LEO_PROFILER_H
+#define LEO_PROFILER_H		1
+
+/*!
+	@header LEOProfiler
+	A counting profiler for bytecode. While it is enabled, the interpreter
+	records how often each instruction is executed and how much time it takes,
+	broken down by instruction ID, handler, chain of handler calls and source
+	line (as set by the most recent LINE_MARKER_INSTR in the current handler).
+
+	Times are measured in "ticks", which are CPU cycles where a cycle counter
+	is available and nanoseconds otherwise. Use LEOProfilerTicksPerSecond() to
+	convert them.
+
+	When the profiler is off, the only cost is that LEOContinueRunningContext
+	checks gLEOProfilerEnabled once per instruction. Since enabling the profiler
+	sets kLEOContextHooksActive, LEOContinueRunningContextFast doesn't even do
+	that.
+	
+	The handler profiler is a separate, cheaper profiler that only looks at
+	handler calls and returns, and records call counts and wall-clock times for
+	each handler.
+*/
+
+// -----------------------------------------------------------------------------
+//	Headers:
+// -----------------------------------------------------------------------------
+
+#include "LEOInterpreter.h"
+#include <stdio.h>
+
+
+#if __cplusplus
+extern "C" {
+#endif
+
+
+struct LEOHandler;
+struct LEOScript;
+
+
+/*! One entry in the handler profile, collecting the information about all calls
+	to a particular handler in a particular script.
+	@field	script						The script the handler belongs to. Only used to tell entries apart, may have been freed by now.
+	@field	handlerID					The ID of the handler that was called.
+	@field	handlerName					The name of the handler, as returned by LEOContextGroupHandlerNameForHandlerID.
+	@field	callCount					How often the handler was called.
+	@field	inclusiveNanoseconds		Time spent in this handler and the handlers it called. Recursive calls are only counted once.
+	@field	exclusiveNanoseconds		Time spent in this handler itself, without the handlers it called.
+	@field	maxRecursionDepth			The largest number of calls to this handler that were on the call stack at once.
+	@field	parentScriptFallthroughs	How often a call to this handler ID in this script was not handled by this script and had to be looked up in the parent script.
+	@field	nonexistentHandlerCalls		How often a call to this handler ID in this script was not handled by any script and ended up in the context's callNonexistentHandlerProc.
+	@seealso //leo_ref/c/func/LEOHandlerProfilerGetEntryAtIndex LEOHandlerProfilerGetEntryAtIndex */
+typedef struct LEOHandlerProfileEntry
+{
+	struct LEOScript*	script;
+	LEOHandlerID		handlerID;
+	char*				handlerName;
+	uint64_t			callCount;
+	uint64_t			inclusiveNanoseconds;
+	uint64_t			exclusiveNanoseconds;
+	size_t				maxRecursionDepth;
+	uint64_t			parentScriptFallthroughs;
+	uint64_t			nonexistentHandlerCalls;
+	size_t				currentRecursionDepth;	// Private.
+} LEOHandlerProfileEntry;
+
+
+/*! Kinds of fallthroughs for LEOHandlerProfilerRecordFallthrough. */
+typedef enum
+{
+	kLEOHandlerProfilerParentScriptFallthrough,		//! The handler wasn't found in the script and we asked GetParentScript.
+	kLEOHandlerProfilerNonexistentHandlerFallthrough	//! The handler wasn't found anywhere and we called callNonexistentHandlerProc.
+} LEOHandlerProfilerFallthroughKind;
+
+
+// -----------------------------------------------------------------------------
+//	Globals:
+// -----------------------------------------------------------------------------
+
+extern bool			gLEOProfilerEnabled;		// Read-only. Use LEOProfilerSetEnabled() to change this.
+extern bool			gLEOHandlerProfilerEnabled;	// Read-only. Use LEOHandlerProfilerSetEnabled() to change this.
+
+
+// -----------------------------------------------------------------------------
+//	Prototypes:
+// -----------------------------------------------------------------------------
+
+/*! Turn the profiler on or off. Contexts pick up the change the next time they
+	are prepared for running, or when you call LEOContextUpdateHooksActiveFlag()
+	on them. Turning the profiler off keeps the data recorded so far.
+	@seealso //leo_ref/c/func/LEOProfilerReset LEOProfilerReset */
+void		LEOProfilerSetEnabled( bool inEnabled );
+
+/*! Discard all data recorded by the profiler so far.
+	@seealso //leo_ref/c/func/LEOProfilerSetEnabled LEOProfilerSetEnabled */
+void		LEOProfilerReset( void );
+
+/*! Execute the current instruction of the given context, whose ID is inID,
+	and record it in the profile. Called by LEOContinueRunningContext while the
+	profiler is enabled. */
+void		LEOProfilerRunInstruction( LEOContext* inContext, LEOInstructionID inID );
+
+/*! The number of ticks per second, to convert the times recorded by the profiler
+	into seconds. This is estimated from how much time passed since the profiler
+	was last reset. */
+double		LEOProfilerTicksPerSecond( void );
+
+/*! Return the number of times instructions with the given ID were executed,
+	and how many ticks they took in total. */
+void		LEOProfilerGetInstructionStats( LEOInstructionID inID, uint64_t *outCount, uint64_t *outTicks );
+
+/*! Return the number of instructions executed on the given line of the given
+	file, and how many ticks they took in total. */
+void		LEOProfilerGetLineStats( uint16_t inFileID, size_t inLineNo, uint64_t *outCount, uint64_t *outTicks );
+
+/*! Return the number of instructions executed in the given handler (NULL for
+	code that isn't in a handler), and how many ticks they took in total. */
+void		LEOProfilerGetHandlerStats( struct LEOHandler* inHandler, uint64_t *outCount, uint64_t *outTicks );
+
+/*! Write the recorded data to the given file as a JSON object with
+	"instructions", "handlers" and "lines" arrays, each sorted with the most
+	expensive entry first.
+	@seealso //leo_ref/c/func/LEOProfilerWriteFoldedStacks LEOProfilerWriteFoldedStacks */
+void		LEOProfilerWriteJSON( FILE* inFile );
+
+/*! Write the recorded data to the given file in the "folded stacks" format
+	used by flame graph tools, one "outer;...;handler;file:line;INSTRUCTION ticks"
+	entry per line. The frames before the line are the chain of handler calls
+	that led to the instruction, outermost first, so recursive calls and
+	handlers called from several places show up as separate stacks. Code
+	outside any handler is listed under "(no_handler)".
+	@seealso //leo_ref/c/func/LEOProfilerWriteJSON LEOProfilerWriteJSON */
+void		LEOProfilerWriteFoldedStacks( FILE* inFile );
+
+
+/*! Turn the handler profiler on or off. This takes effect for the next handler
+	call. Turning it off keeps the data recorded so far.
+	@seealso //leo_ref/c/func/LEOHandlerProfilerReset LEOHandlerProfilerReset */
+void		LEOHandlerProfilerSetEnabled( bool inEnabled );
+
+/*! Discard all data recorded by the handler profiler so far, e.g. to profile
+	each request separately. Handlers that are currently running when you call
+	this are not recorded when they return.
+	@seealso //leo_ref/c/func/LEOHandlerProfilerSetEnabled LEOHandlerProfilerSetEnabled */
+void		LEOHandlerProfilerReset( void );
+
+/*! Called by LEOContextPushHandlerScriptReturnAddressAndBasePtr while the
+	handler profiler is enabled, after it has added the call stack entry at
+	the given index. */
+void		LEOHandlerProfilerEnterHandler( LEOContext* inContext, size_t inCallStackEntryIndex );
+
+/*! Called for the call stack entry at the given index before it is removed,
+	if LEOHandlerProfilerEnterHandler was called on it. */
+void		LEOHandlerProfilerExitHandler( LEOContext* inContext, size_t inCallStackEntryIndex );
+
+/*! Called by LEOCallHandlerInstruction while the handler profiler is enabled,
+	when a call to inHandlerID that started out in inScript couldn't be
+	handled there. */
+void		LEOHandlerProfilerRecordFallthrough( LEOContext* inContext, struct LEOScript* inScript, LEOHandlerID inHandlerID, LEOHandlerProfilerFallthroughKind inKind );
+
+/*! Return the number of entries recorded by the handler profiler.
+	@seealso //leo_ref/c/func/LEOHandlerProfilerGetEntryAtIndex LEOHandlerProfilerGetEntryAtIndex */
+size_t		LEOHandlerProfilerGetNumEntries( void );
+
+/*! Return the entry at the given index in the handler profile. The pointer is
+	only valid until the next handler call or LEOHandlerProfilerReset().
+	@seealso //leo_ref/c/func/LEOHandlerProfilerGetNumEntries LEOHandlerProfilerGetNumEntries */
+const LEOHandlerProfileEntry*	LEOHandlerProfilerGetEntryAtIndex( size_t inIndex );
+
+/*! Return the entry for the given handler in the given script, or NULL if
+	it hasn't been called (or fallen through) since the last reset. */
+const LEOHandlerProfileEntry*	LEOHandlerProfilerFindEntry( struct LEOScript* inScript, LEOHandlerID inHandlerID );
+
+/*! Write the handler profile to the given file as a JSON array, sorted by
+	inclusive time, most expensive handler first. */
+void		LEOHandlerProfilerWriteJSON( FILE* inFile );
+
+
+#if __cplusplus
+}
+#endif
+
+#endif // LEO_PROFILER_H
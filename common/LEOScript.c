@@ -14,18 +14,117 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "LEOContextGroup.h"
+#include "LEOInstructions.h"
 #include "LEOStringUtilities.h"
 #include "AnsiStrings.h"
 
 
 #define		NUM_INSTRUCTIONS_PER_CHUNK		16
 #define		NUM_STRINGS_PER_CHUNK			16
+#define		LEO_HANDLER_INDEX_MIN_HANDLERS	8		// Scripts with fewer handlers than this are just scanned.
+#define		LEO_HANDLER_INDEX_MIN_SLOTS		16		// Must be a power of 2.
 
 
 void	LEOInitHandlerWithID( LEOHandler* inStorage, LEOHandlerID inHandlerName );
 void	LEOCleanUpHandler( LEOHandler* inStorage );
 
 
+size_t	gLEOHandlerLookupGeneration = 1;	// Starts at 1 so empty cache entries never match.
+
+
+static void	LEOHandlerIndexFree( LEOHandlerIndex* inIndex );
+
+
+static inline size_t	LEOHandlerIndexHash( LEOHandlerID inHandlerName )
+{
+	return inHandlerName * 2654435761U;	// Knuth's multiplicative hash spreads consecutive IDs.
+}
+
+
+static void	LEOHandlerIndexInsert( LEOHandlerIndex* inIndex, LEOHandler* inHandlers, size_t inHandlerIndex )
+{
+	LEOHandlerID	handlerName = inHandlers[inHandlerIndex].handlerName;
+	size_t			x = LEOHandlerIndexHash( handlerName ) & (inIndex->numSlots -1);
+	while( inIndex->slots[x] != 0 )
+	{
+		if( inHandlers[inIndex->slots[x] -1].handlerName == handlerName )
+			return;	// Duplicate handler, first one wins, like it would when scanning.
+		x = (x +1) & (inIndex->numSlots -1);
+	}
+	inIndex->slots[x] = (uint32_t)(inHandlerIndex +1);
+}
+
+
+// Call this after adding a handler to the end of inHandlers:
+static void	LEOHandlerIndexAddLastHandler( LEOHandlerIndex* inIndex, LEOHandler* inHandlers, size_t inNumHandlers )
+{
+	if( inNumHandlers < LEO_HANDLER_INDEX_MIN_HANDLERS )
+		return;
+	
+	if( (inNumHandlers * 2) > inIndex->numSlots )	// Keep load factor at or below 50%, rehash if needed.
+	{
+		size_t		newNumSlots = inIndex->numSlots ? inIndex->numSlots : LEO_HANDLER_INDEX_MIN_SLOTS;
+		while( (inNumHandlers * 2) > newNumSlots )
+			newNumSlots *= 2;
+		uint32_t*	newSlots = calloc( newNumSlots, sizeof(uint32_t) );
+		if( !newSlots )
+		{
+			printf( "*** Failed to allocate handler index! ***\n" );
+			LEOHandlerIndexFree( inIndex );	// Old index would be missing this handler, so drop it and just scan.
+			return;
+		}
+		if( inIndex->slots )
+			free( inIndex->slots );
+		inIndex->slots = newSlots;
+		inIndex->numSlots = newNumSlots;
+		for( size_t x = 0; x < inNumHandlers; x++ )
+			LEOHandlerIndexInsert( inIndex, inHandlers, x );
+	}
+	else
+		LEOHandlerIndexInsert( inIndex, inHandlers, inNumHandlers -1 );
+}
+
+
+static LEOHandler*	LEOHandlerIndexFindHandler( LEOHandlerIndex* inIndex, LEOHandler* inHandlers, size_t inNumHandlers, LEOHandlerID inHandlerName )
+{
+	if( inIndex->numSlots == 0 )
+	{
+		for( size_t x = 0; x < inNumHandlers; x++ )
+		{
+			if( inHandlers[x].handlerName == inHandlerName )
+				return inHandlers + x;
+		}
+		return NULL;
+	}
+	
+	size_t	x = LEOHandlerIndexHash( inHandlerName ) & (inIndex->numSlots -1);
+	while( inIndex->slots[x] != 0 )
+	{
+		LEOHandler*	currHandler = inHandlers +inIndex->slots[x] -1;
+		if( currHandler->handlerName == inHandlerName )
+			return currHandler;
+		x = (x +1) & (inIndex->numSlots -1);
+	}
+	
+	return NULL;
+}
+
+
+static void	LEOHandlerIndexFree( LEOHandlerIndex* inIndex )
+{
+	if( inIndex->slots )
+		free( inIndex->slots );
+	inIndex->slots = NULL;
+	inIndex->numSlots = 0;
+}
+
+
+void	LEOInvalidateHandlerLookupCaches( void )
+{
+	gLEOHandlerLookupGeneration++;
+}
+
+
 
 void	LEOInitHandlerWithID( LEOHandler* inStorage, LEOHandlerID inHandlerName )
 {
@@ -79,6 +178,12 @@ void	LEOHandlerAddInstruction( LEOHandler* inHandler, LEOInstructionID instructi
 }
 
 
+void	LEOHandlerFuseInstructions( LEOHandler* inHandler )
+{
+	LEOFuseInstructions( inHandler->instructions, inHandler->numInstructions );
+}
+
+
 void	LEOHandlerAddVariableNameMapping( LEOHandler* inHandler, const char* inName, const char *inRealName, size_t inBPRelativeAddress )
 {
 	if( !inHandler->varNames )
@@ -229,14 +334,19 @@ void	LEOScriptRelease( LEOScript* inScript )
 		}
 		if( inScript->parseErrors )
 			free( inScript->parseErrors );
+		LEOHandlerIndexFree( &inScript->commandsIndex );
+		LEOHandlerIndexFree( &inScript->functionsIndex );
 		
 		free( inScript );
+		LEOInvalidateHandlerLookupCaches();	// A new script might end up at the same address.
 	}
 }
 
 
 LEOHandler*	LEOScriptAddCommandHandlerWithID( LEOScript* inScript, LEOHandlerID inHandlerName )
 {
+	LEOInvalidateHandlerLookupCaches();	// Handler may move in memory, and may override one in a parent script.
+	
 	inScript->numCommands++;
 	LEOHandler*		commandsArray = NULL;
 	if( inScript->commands )
@@ -247,6 +357,7 @@ LEOHandler*	LEOScriptAddCommandHandlerWithID( LEOScript* inScript, LEOHandlerID
 	{
 		LEOInitHandlerWithID( commandsArray +inScript->numCommands -1, inHandlerName );
 		inScript->commands = commandsArray;
+		LEOHandlerIndexAddLastHandler( &inScript->commandsIndex, inScript->commands, inScript->numCommands );
 		
 		return commandsArray +inScript->numCommands -1;
 	}
@@ -257,6 +368,8 @@ LEOHandler*	LEOScriptAddCommandHandlerWithID( LEOScript* inScript, LEOHandlerID
 
 LEOHandler*	LEOScriptAddFunctionHandlerWithID( LEOScript* inScript, LEOHandlerID inHandlerName )
 {
+	LEOInvalidateHandlerLookupCaches();	// Handler may move in memory, and may override one in a parent script.
+	
 	inScript->numFunctions++;
 	LEOHandler*		commandsArray = NULL;
 	if( inScript->functions )
@@ -267,6 +380,7 @@ LEOHandler*	LEOScriptAddFunctionHandlerWithID( LEOScript* inScript, LEOHandlerID
 	{
 		LEOInitHandlerWithID( commandsArray +inScript->numFunctions -1, inHandlerName );
 		inScript->functions = commandsArray;
+		LEOHandlerIndexAddLastHandler( &inScript->functionsIndex, inScript->functions, inScript->numFunctions );
 		
 		return commandsArray +inScript->numFunctions -1;
 	}
@@ -277,25 +391,19 @@ LEOHandler*	LEOScriptAddFunctionHandlerWithID( LEOScript* inScript, LEOHandlerID
 
 LEOHandler*	LEOScriptFindCommandHandlerWithID( LEOScript* inScript, LEOHandlerID inHandlerName )
 {
-	for( size_t x = 0; x < inScript->numCommands; x++ )
-	{
-		if( inScript->commands[x].handlerName == inHandlerName )
-			return inScript->commands + x;
-	}
-	
-	return NULL;
+	return LEOHandlerIndexFindHandler( &inScript->commandsIndex, inScript->commands, inScript->numCommands, inHandlerName );
 }
 
 
 LEOHandler*	LEOScriptFindFunctionHandlerWithID( LEOScript* inScript, LEOHandlerID inHandlerName )
 {
-	for( size_t x = 0; x < inScript->numFunctions; x++ )
-	{
-		if( inScript->functions[x].handlerName == inHandlerName )
-			return inScript->functions + x;
-	}
-	
-	return NULL;
+	return LEOHandlerIndexFindHandler( &inScript->functionsIndex, inScript->functions, inScript->numFunctions, inHandlerName );
+}
+
+
+size_t	LEOScriptGetHandlerIndexMemoryUsage( LEOScript* inScript )
+{
+	return (inScript->commandsIndex.numSlots +inScript->functionsIndex.numSlots) * sizeof(uint32_t);
 }
 
 
@@ -185,6 +185,19 @@ typedef struct LEOParseErrorEntry
 	@seealso //leo_ref/c/tdef/LEODebugPrintScript LEODebugPrintScript */
 // -----------------------------------------------------------------------------
 
+/*! Open-addressing hash index from LEOHandlerID to the position of a handler
+	in a LEOScript's commands or functions array. Scripts with only a few
+	handlers don't get an index, as scanning those is just as fast.
+	@field	numSlots	Number of entries in slots, 0 or a power of 2.
+	@field	slots		Index of the handler in the handler array +1, or 0 for an empty slot.
+	@seealso //leo_ref/c/func/LEOScriptGetHandlerIndexMemoryUsage LEOScriptGetHandlerIndexMemoryUsage */
+typedef struct LEOHandlerIndex
+{
+	size_t		numSlots;
+	uint32_t*	slots;
+} LEOHandlerIndex;
+
+
 typedef struct LEOScript
 {
 	size_t				referenceCount;
@@ -201,9 +214,28 @@ typedef struct LEOScript
 	LEOParseErrorEntry*			parseErrors;		// List of errors for the PARSE_ERROR_INSTR instruction to refer to.
 	size_t						numBreakpointLines;	// Number of elements in breakpointLines array.
 	size_t					*	breakpointLines;	// List of line numbers where the user set a breakpoint.
+	LEOHandlerIndex				commandsIndex;		// Hash index over the handler IDs in commands.
+	LEOHandlerIndex				functionsIndex;		// Hash index over the handler IDs in functions.
 } LEOScript;
 
 
+// Incremented whenever a script gains handlers or goes away, or the host calls
+//	LEOInvalidateHandlerLookupCaches(). Handler lookup cache entries made under
+//	a different generation are ignored:
+extern size_t	gLEOHandlerLookupGeneration;
+
+
+/*!
+	Tell the interpreter that the message path has changed, e.g. because an
+	object was moved to a different parent, so GetParentScript would now return
+	a different script. This invalidates the handler lookups cached by
+	CALL_HANDLER_INSTR. Adding handlers to a script or releasing a script
+	does this automatically.
+	@seealso //leo_ref/c/tdef/LEOHandlerLookupCache LEOHandlerLookupCache
+*/
+void		LEOInvalidateHandlerLookupCaches( void );
+
+
 /*!
 	Creates a script referencing the given owner. The LEOScript* is reference-
 	counted and its reference count is set to 1, so when you're done with it,
@@ -285,6 +317,14 @@ LEOHandler*	LEOScriptFindCommandHandlerWithID( LEOScript* inScript, LEOHandlerID
 */
 LEOHandler*	LEOScriptFindFunctionHandlerWithID( LEOScript* inScript, LEOHandlerID inHandlerName );
 
+/*!
+	Return the number of bytes used by the hash indexes that speed up
+	LEOScriptFindCommandHandlerWithID and LEOScriptFindFunctionHandlerWithID
+	for this script.
+	@seealso //leo_ref/c/tdef/LEOHandlerIndex LEOHandlerIndex
+*/
+size_t		LEOScriptGetHandlerIndexMemoryUsage( LEOScript* inScript );
+
 /*!
 	Add an instruction with the given instruction ID and parameters to a handler.
 	Use this only when initially setting up a script and parsing/compiling
@@ -296,6 +336,17 @@ LEOHandler*	LEOScriptFindFunctionHandlerWithID( LEOScript* inScript, LEOHandlerI
 void	LEOHandlerAddInstruction( LEOHandler* inHandler, LEOInstructionID instructionID, uint16_t param1, uint32_t param2 );
 
 
+/*!
+	Replace common pairs of instructions in this handler with superinstructions,
+	according to the current instruction fusion mode. Call this once after you
+	have added the last instruction to a handler. It does not change the number
+	or position of instructions, so jump offsets and line numbers stay valid.
+	@seealso //leo_ref/c/func/LEOHandlerAddInstruction LEOHandlerAddInstruction
+	@seealso //leo_ref/c/func/LEOFuseInstructions LEOFuseInstructions
+*/
+void	LEOHandlerFuseInstructions( LEOHandler* inHandler );
+
+
 /*!
 	Add an entry to this handler so we can display a name for this variable.
 	@param	inHandler	The handler to add this variable name mapping to.
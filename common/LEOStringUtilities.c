@@ -79,4 +79,63 @@ const char*	LEOStringEscapedForPrintingInQuotes( const char* inStr )
 	}
 	
 	return sTempBuf;
-}
\ No newline at end of file
+}
+
+
+void	LEOStringBuilderInit( LEOStringBuilder* outBuilder )
+{
+	outBuilder->string = NULL;
+	outBuilder->stringLen = 0;
+	outBuilder->capacity = 0;
+	outBuilder->outOfMemory = false;
+}
+
+
+bool	LEOStringBuilderAppend( LEOStringBuilder* ioBuilder, const char* inStr, size_t inLen )
+{
+	if( ioBuilder->outOfMemory )
+		return false;
+	
+	size_t		neededBytes = ioBuilder->stringLen +inLen +1;
+	if( neededBytes > ioBuilder->capacity )	// Grow by doubling, so appending is amortized O(1).
+	{
+		size_t	newCapacity = ioBuilder->capacity ? (ioBuilder->capacity * 2) : 256;
+		while( newCapacity < neededBytes )
+			newCapacity *= 2;
+		char*	largerPtr = realloc( ioBuilder->string, newCapacity );
+		if( !largerPtr )
+		{
+			printf( "*** Failed to allocate string builder buffer! ***\n" );
+			ioBuilder->outOfMemory = true;
+			return false;
+		}
+		ioBuilder->string = largerPtr;
+		ioBuilder->capacity = newCapacity;
+	}
+	
+	memmove( ioBuilder->string +ioBuilder->stringLen, inStr, inLen );
+	ioBuilder->stringLen += inLen;
+	ioBuilder->string[ioBuilder->stringLen] = 0;
+	
+	return true;
+}
+
+
+bool	LEOStringBuilderAppendCString( LEOStringBuilder* ioBuilder, const char* inStr )
+{
+	return LEOStringBuilderAppend( ioBuilder, inStr, strlen(inStr) );
+}
+
+
+const char*	LEOStringBuilderGetCString( LEOStringBuilder* inBuilder )
+{
+	return inBuilder->string ? inBuilder->string : "";
+}
+
+
+void	LEOStringBuilderCleanUp( LEOStringBuilder* ioBuilder )
+{
+	if( ioBuilder->string )
+		free( ioBuilder->string );
+	LEOStringBuilderInit( ioBuilder );
+}
@@ -10,7 +10,26 @@
 #define LEOStringUtilities_h
 
 #include <stdio.h>
+#include <stdbool.h>
 
 extern const char*	LEOStringEscapedForPrintingInQuotes( const char* inStr );	// Returns an internal buffer, not suitable for concurrent use, and you are NOT supposed to free it.
 
+
+// A string that grows as you append to it, for building strings whose length
+//	you don't know up front. Starts out empty and doesn't allocate until you
+//	append something:
+typedef struct LEOStringBuilder
+{
+	char*	string;			// NUL-terminated, or NULL if nothing has been appended yet.
+	size_t	stringLen;		// Number of bytes in string, not counting the NUL.
+	size_t	capacity;		// Number of bytes string has room for, including the NUL.
+	bool	outOfMemory;	// Set if an append failed, string then contains what fit until then.
+} LEOStringBuilder;
+
+extern void			LEOStringBuilderInit( LEOStringBuilder* outBuilder );
+extern bool			LEOStringBuilderAppend( LEOStringBuilder* ioBuilder, const char* inStr, size_t inLen );
+extern bool			LEOStringBuilderAppendCString( LEOStringBuilder* ioBuilder, const char* inStr );
+extern const char*	LEOStringBuilderGetCString( LEOStringBuilder* inBuilder );	// Never NULL, owned by the builder.
+extern void			LEOStringBuilderCleanUp( LEOStringBuilder* ioBuilder );
+
 #endif /* LEOStringUtilities_h */
@@ -22,16 +22,22 @@
 #include "LEOInterpreter.h"
 #include "LEOContextGroup.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
 #include "LEOInstructions.h"
 #include "AnsiStrings.h"
+#include "LEOStringUtilities.h"
 
 
 #define OTHER_VALUE_SHORT_STRING_MAX_LENGTH		256
 #define LEO_MAX_ARRAY_KEY_SIZE					1024
+#define LEO_MIN_ARRAY_INDEXED_ITEMS_CAPACITY	8
+#define LEO_ARRAY_KEYED_ENTRY_SIZE_STEP			16
+#define LEO_MIN_ARRAY_KEYED_ENTRY_BLOCK_SIZE	512
+#define LEO_MAX_ARRAY_KEYED_ENTRY_BLOCK_SIZE	(256 * 1024)
 
 
 // Users shouldn't care if something is a variant, but it helps when debugging the engine:
@@ -60,6 +66,9 @@ LEOUnitGroup		gUnitGroupsForLabels[kLEOUnit_Last +1] =
 };
 
 
+size_t				gLEONumStringValueAllocations = 0;
+
+
 #pragma mark ISA v-tables
 // -----------------------------------------------------------------------------
 //	ISA v-tables for the subclasses:
@@ -113,7 +122,9 @@ struct LEOValueType	kLeoValueTypeNumber =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCanGetNumberValueAsInteger
+	LEOCanGetNumberValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -165,7 +176,9 @@ struct LEOValueType	kLeoValueTypeInteger =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCanGetValueAsInteger
+	LEOCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -200,7 +213,7 @@ struct LEOValueType	kLeoValueTypeString =
 	LEOGetStringValueForKey,
 	LEOSetStringLikeValueForKey,
 	LEOSetStringLikeValueAsArray,
-	LEOGetStringLikeValueKeyCount,
+	LEOGetStringValueKeyCount,
 	
 	LEOCantGetValueForKeyOfRange,
 	LEOCantSetValueForKeyOfRange,
@@ -217,7 +230,9 @@ struct LEOValueType	kLeoValueTypeString =
 	LEOSetStringValueAsRange,
 	LEOGetStringValueAsRange,
 	
-	LEOCanGetStringValueAsInteger
+	LEOCanGetStringValueAsInteger,
+	
+	LEOGetStringValueAsStringView
 };
 
 
@@ -269,7 +284,9 @@ struct LEOValueType	kLeoValueTypeStringConstant =
 	LEOSetStringConstantValueAsRange,
 	LEOGetStringValueAsRange,
 	
-	LEOCanGetStringValueAsInteger
+	LEOCanGetStringValueAsInteger,
+	
+	LEOGetStringValueAsStringView
 };
 
 
@@ -321,7 +338,9 @@ struct LEOValueType	kLeoValueTypeRect =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -373,7 +392,9 @@ struct LEOValueType	kLeoValueTypePoint =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -425,7 +446,9 @@ struct LEOValueType	kLeoValueTypeRange =
 	LEOSetRangeValueAsRange,
 	LEOGetRangeValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -477,7 +500,9 @@ struct LEOValueType	kLeoValueTypeBoolean =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -529,7 +554,9 @@ struct LEOValueType	kLeoValueTypeNativeObject =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -581,7 +608,9 @@ struct LEOValueType	kLeoValueTypeReference =
 	LEOSetReferenceValueAsRange,
 	LEOGetReferenceValueAsRange,
 	
-	LEOCanGetReferenceValueAsInteger
+	LEOCanGetReferenceValueAsInteger,
+	
+	LEOGetReferenceValueAsStringView
 };
 
 
@@ -633,7 +662,9 @@ struct LEOValueType	kLeoValueTypeNumberVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCanGetNumberValueAsInteger
+	LEOCanGetNumberValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -685,7 +716,9 @@ struct LEOValueType	kLeoValueTypeIntegerVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCanGetValueAsInteger
+	LEOCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -720,7 +753,7 @@ struct LEOValueType	kLeoValueTypeStringVariant =
 	LEOGetStringVariantValueForKey,
 	LEOSetStringVariantValueValueForKey,
 	LEOSetVariantValueAsArray,
-	LEOGetStringLikeValueKeyCount,
+	LEOGetStringVariantValueKeyCount,
 	
 	LEOCantGetValueForKeyOfRange,
 	LEOCantSetValueForKeyOfRange,
@@ -737,7 +770,9 @@ struct LEOValueType	kLeoValueTypeStringVariant =
 	LEOSetVariantValueAsRange,
 	LEOGetStringValueAsRange,
 	
-	LEOCanGetStringValueAsInteger
+	LEOCanGetStringValueAsInteger,
+	
+	LEOGetStringValueAsStringView
 };
 
 
@@ -789,7 +824,9 @@ struct LEOValueType	kLeoValueTypeBooleanVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -841,7 +878,9 @@ struct LEOValueType	kLeoValueTypeRectVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -893,7 +932,9 @@ struct LEOValueType	kLeoValueTypePointVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -945,7 +986,9 @@ struct LEOValueType	kLeoValueTypeRangeVariant =
 	LEOSetVariantValueAsRange,
 	LEOGetRangeValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -997,7 +1040,9 @@ struct LEOValueType	kLeoValueTypeNativeObjectVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetAnyValueAsStringView
 };
 
 
@@ -1049,7 +1094,9 @@ struct LEOValueType	kLeoValueTypeArray =
 	LEOCantSetValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetArrayValueAsStringView
 };
 
 
@@ -1101,7 +1148,9 @@ struct LEOValueType	kLeoValueTypeArrayVariant =
 	LEOSetVariantValueAsRange,
 	LEOCantGetValueAsRange,
 	
-	LEOCantCanGetValueAsInteger
+	LEOCantCanGetValueAsInteger,
+	
+	LEOGetArrayValueAsStringView
 };
 
 
@@ -1346,46 +1395,369 @@ void	LEOCantSetValueForKey( LEOValuePtr self, const char* keyName, LEOValuePtr i
 }
 
 
-LEOValuePtr	LEOGetStringValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
+/*!
+	Create a new LEOStringBuffer with room for inCapacity bytes, referenced
+	once, by whoever called this.
+*/
+
+static struct LEOStringBuffer*	LEOStringBufferCreate( size_t inCapacity )
 {
-	if( !tempStorage )
+	struct LEOStringBuffer*	theBuffer = malloc( sizeof(struct LEOStringBuffer) +inCapacity );
+	theBuffer->refCount = 1;
+	theBuffer->capacity = inCapacity;
+	theBuffer->chunkIndexes = NULL;
+	theBuffer->wasChunkScanned = false;
+	theBuffer->chunkCursor.type = kLEOChunkTypeINVALID;
+	gLEONumStringValueAllocations++;
+	
+	return theBuffer;
+}
+
+
+/*!
+	Release the chunk indexes of a LEOStringBuffer and forget where its chunk
+	cursor is. Call this whenever its characters change, or they would be out
+	of date.
+*/
+
+static void	LEOStringBufferForgetChunkOffsets( struct LEOStringBuffer* inBuffer )
+{
+	while( inBuffer->chunkIndexes )
 	{
-		size_t		lineNo = SIZE_MAX;
-		uint16_t	fileID = 0;
-		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Internal error converting %s to array.", self->base.isa->displayTypeName );
-		return NULL;
+		struct LEOChunkIndex*	nextIndex = inBuffer->chunkIndexes->next;
+		LEOChunkIndexFree( inBuffer->chunkIndexes );
+		inBuffer->chunkIndexes = nextIndex;
 	}
-	
-	struct LEOArrayEntry	*	convertedArray = NULL;
-	if( self->string.string != NULL && self->string.stringLen != 0 )
+	inBuffer->wasChunkScanned = false;
+	inBuffer->chunkCursor.type = kLEOChunkTypeINVALID;
+}
+
+
+/*!
+	Release the array a dynamic string value was parsed into, if any. Call this
+	whenever the string changes, or the cached array would be out of date.
+*/
+
+static void	LEOStringValueForgetParsedArray( LEOValuePtr self, struct LEOContext* inContext )
+{
+	if( self->string.string && self->string.storage.buffer.parsedArray )	// Only long strings have room for one.
 	{
-		convertedArray = LEOCreateArrayFromString( self->string.string, self->string.stringLen, inContext );
-		if( !convertedArray )
+		LEOCleanUpArray( self->string.storage.buffer.parsedArray, inContext );
+		self->string.storage.buffer.parsedArray = NULL;
+	}
+}
+
+
+/*!
+	Release the buffer a dynamic string value shares its characters with, if
+	any. Afterwards, the value holds an empty short string.
+*/
+
+static void	LEOStringValueFreeStorage( LEOValuePtr self, struct LEOContext* inContext )
+{
+	if( self->string.string )
+	{
+		LEOStringValueForgetParsedArray( self, inContext );
+		if( --self->string.storage.buffer.sharedBuffer->refCount == 0 )
 		{
-			size_t		lineNo = SIZE_MAX;
-			uint16_t	fileID = 0;
-			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Expected array, found %s", self->base.isa->displayTypeName );
-			return NULL;
+			LEOStringBufferForgetChunkOffsets( self->string.storage.buffer.sharedBuffer );
+			free( self->string.storage.buffer.sharedBuffer );
 		}
+		self->string.string = NULL;
+	}
+	self->string.stringLen = 0;
+	self->string.storage.shortString[0] = 0;
+}
+
+
+/*!
+	Make a dynamic string value reference the characters of the given buffer,
+	which the caller has already retained for it, and which holds inLen bytes
+	followed by a terminating NUL. Any previous characters must have been
+	released.
+*/
+
+static void	LEOStringValueTakeBuffer( LEOValuePtr self, struct LEOStringBuffer* inBuffer, size_t inLen )
+{
+	self->string.string = inBuffer->characters;
+	self->string.stringLen = inLen;
+	self->string.storage.buffer.sharedBuffer = inBuffer;
+	self->string.storage.buffer.parsedArray = NULL;
+}
+
+
+/*!
+	Make room for inLen bytes in a dynamic string value, replacing its current
+	characters. Short strings are kept inside the value, longer ones reuse the
+	value's buffer if nobody else shares it and it is large enough, but not
+	wastefully large. Returns the address to copy the characters to. The
+	terminating NUL is already there.
+*/
+
+static char*	LEOStringValuePrepareStorage( LEOValuePtr self, size_t inLen, struct LEOContext* inContext )
+{
+	if( inLen <= LEO_SHORT_STRING_MAX_LENGTH )
+	{
+		LEOStringValueFreeStorage( self, inContext );
+		self->string.storage.shortString[inLen] = 0;
+		self->string.stringLen = inLen;
+		return self->string.storage.shortString;
+	}
+	
+	size_t					neededBytes = inLen +1;
+	struct LEOStringBuffer*	theBuffer = self->string.string ? self->string.storage.buffer.sharedBuffer : NULL;
+	if( theBuffer && theBuffer->refCount == 1 && theBuffer->capacity >= neededBytes
+		&& (theBuffer->capacity / 2) <= neededBytes )
+	{
+		LEOStringValueForgetParsedArray( self, inContext );
+		LEOStringBufferForgetChunkOffsets( theBuffer );
+	}
+	else
+	{
+		LEOStringValueFreeStorage( self, inContext );
+		theBuffer = LEOStringBufferCreate( neededBytes );
+	}
+	LEOStringValueTakeBuffer( self, theBuffer, inLen );
+	self->string.string[inLen] = 0;
+	
+	return self->string.string;
+}
+
+
+/*!
+	Replace the characters of a dynamic string value with the characters from
+	inOldStr, where the bytes from inStart to inEnd have been replaced by inBuf.
+	inOldStr and inBuf may point into the value's own storage.
+	If inOldStr is the value's string and nobody else shares its buffer, the
+	change is made in place if it fits and doesn't leave most of the buffer
+	unused. A string that grows gets a buffer with room to spare, so appending
+	to a string over and over is amortized O(1).
+*/
+
+static void	LEOStringValueSetSplicedString( LEOValuePtr self, const char* inOldStr, size_t inOldLen,
+											size_t inStart, size_t inEnd, const char* inBuf, size_t inBufLen,
+											struct LEOContext* inContext )
+{
+	size_t					finalLen = inOldLen -(inEnd -inStart) +inBufLen;
+	struct LEOStringBuffer*	ownBuffer = self->string.string ? self->string.storage.buffer.sharedBuffer : NULL;
+	if( ownBuffer && ownBuffer->refCount == 1 && inOldStr == ownBuffer->characters && self->string.string == ownBuffer->characters
+		&& finalLen < ownBuffer->capacity && (ownBuffer->capacity / 4) <= finalLen && finalLen > LEO_SHORT_STRING_MAX_LENGTH
+		&& (inBuf == NULL || inBuf < ownBuffer->characters || inBuf >= (ownBuffer->characters +ownBuffer->capacity)) )
+	{
+		LEOStringValueForgetParsedArray( self, inContext );
+		LEOStringBufferForgetChunkOffsets( ownBuffer );
+		memmove( ownBuffer->characters +inStart +inBufLen, inOldStr +inEnd, inOldLen -inEnd );	// Move after chunk.
+		if( inBufLen > 0 )
+			memmove( ownBuffer->characters +inStart, inBuf, inBufLen );	// Copy new value of chunk.
+		ownBuffer->characters[finalLen] = 0;
+		self->string.stringLen = finalLen;
+		return;
+	}
+	
+	char					shortStr[LEO_SHORT_STRING_MAX_LENGTH +1];
+	char*					newStr = shortStr;
+	struct LEOStringBuffer*	newBuffer = NULL;
+	if( finalLen > LEO_SHORT_STRING_MAX_LENGTH )
+	{
+		newBuffer = LEOStringBufferCreate( (finalLen > inOldLen) ? ((finalLen +1) * 2) : (finalLen +1) );
+		newStr = newBuffer->characters;
+	}
+	memmove( newStr, inOldStr, inStart );	// Copy before chunk.
+	if( inBufLen > 0 )
+		memmove( newStr +inStart, inBuf, inBufLen );	// Copy new value of chunk.
+	memmove( newStr +inStart +inBufLen, inOldStr +inEnd, inOldLen -inEnd );	// Copy after chunk.
+	newStr[finalLen] = 0;
+	
+	LEOStringValueFreeStorage( self, inContext );
+	if( newBuffer )
+		LEOStringValueTakeBuffer( self, newBuffer, finalLen );
+	else
+	{
+		memmove( self->string.storage.shortString, shortStr, finalLen +1 );
+		self->string.stringLen = finalLen;
+	}
+}
+
+
+/*!
+	Replace the characters of a dynamic string value with a copy of the given
+	ones, which may be part of the value's current string, even if the value
+	has just been re-initialized.
+*/
+
+static void	LEOStringValueSetCharacters( LEOValuePtr self, const char* inString, size_t inLen, struct LEOContext* inContext )
+{
+	struct LEOStringBuffer*	ownBuffer = self->string.string ? self->string.storage.buffer.sharedBuffer : NULL;
+	bool	inOwnStorage = (inString >= (const char*)self && inString < (const char*)(self +1))
+							|| (ownBuffer && inString >= ownBuffer->characters && inString <= (ownBuffer->characters +ownBuffer->capacity));
+	if( inOwnStorage )
+		LEOStringValueSetSplicedString( self, inString, inLen, 0, 0, NULL, 0, inContext );
+	else if( inLen > 0 )
+		memmove( LEOStringValuePrepareStorage( self, inLen, inContext ), inString, inLen );
+	else
+		LEOStringValueFreeStorage( self, inContext );
+}
+
+
+/*!
+	Return the characters of a dynamic string value as a NUL-terminated C
+	string. A value that shares only a range of another string's characters
+	gets a copy of its own the first time this is needed.
+*/
+
+static const char*	LEOStringValueCString( LEOValuePtr self, struct LEOContext* inContext )
+{
+	if( self->string.string && self->string.string[self->string.stringLen] != 0 )
+		LEOStringValueSetCharacters( self, self->string.string, self->string.stringLen, inContext );
+	
+	return LEOStringValueCharacters(self);
+}
+
+
+/*!
+	Return the chunk index of the given type for a long dynamic string value,
+	or NULL if its string should just be scanned. If inMayCreate is true and
+	there is no index yet, one is built the second time the string would have
+	to be scanned from its start, so strings that are only looked at once don't
+	pay for indexing all of them. The index is kept with the string's buffer,
+	so copies of the string share it.
+*/
+
+static struct LEOChunkIndex*	LEOStringValueGetChunkIndex( LEOValuePtr self, LEOChunkType inType, bool inMayCreate, struct LEOContext* inContext )
+{
+	if( !self->string.string || inType == kLEOChunkTypeByte )
+		return NULL;
+	
+	struct LEOStringBuffer*	theBuffer = self->string.storage.buffer.sharedBuffer;
+	if( self->string.string != theBuffer->characters )	// Ranges of a buffer's string don't get an index.
+		return NULL;
+	
+	struct LEOChunkIndex*	currIndex = theBuffer->chunkIndexes;
+	for( ; currIndex != NULL; currIndex = currIndex->next )
+	{
+		if( currIndex->type == inType && currIndex->stringLen == self->string.stringLen
+			&& (inType != kLEOChunkTypeItem || currIndex->itemDelimiter == inContext->itemDelimiter) )
+			return currIndex;
+	}
+	
+	if( !inMayCreate )
+		return NULL;
+	if( !theBuffer->wasChunkScanned )
+	{
+		theBuffer->wasChunkScanned = true;
+		return NULL;
+	}
+	
+	currIndex = LEOChunkIndexCreate( self->string.string, self->string.stringLen, inType, inContext->itemDelimiter );
+	currIndex->next = theBuffer->chunkIndexes;
+	theBuffer->chunkIndexes = currIndex;
+	
+	return currIndex;
+}
+
+
+/*!
+	Like LEOGetChunkRanges(), but for the string of a dynamic or constant
+	string value, which is never measured or copied. Lookups in a dynamic
+	string of the same or a following chunk continue scanning where the
+	previous one found its chunk, others use the string's chunk index.
+*/
+
+static void	LEOGetStringValueChunkRanges( LEOValuePtr self, LEOChunkType inType,
+											size_t inRangeStart, size_t inRangeEnd,
+											size_t *outChunkStart, size_t *outChunkEnd,
+											size_t *outDelChunkStart, size_t *outDelChunkEnd,
+											struct LEOContext* inContext )
+{
+	if( self->base.isa == &kLeoValueTypeStringConstant )	// No buffer to keep a cursor or index in.
+	{
+		LEOGetChunkRangesOfLength( self->string.string, self->string.stringLen, inType, inRangeStart, inRangeEnd,
+									outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd, inContext->itemDelimiter );
+		return;
 	}
+	
+	struct LEOChunkCursor*	theCursor = NULL;
+	if( self->string.string && self->string.string == self->string.storage.buffer.sharedBuffer->characters )
+		theCursor = &self->string.storage.buffer.sharedBuffer->chunkCursor;	// Ranges of a buffer's string can't use its cursor.
+	bool					canResume = LEOChunkCursorCanResume( theCursor, self->string.stringLen, inType, inRangeStart, inRangeEnd, inContext->itemDelimiter );
+	struct LEOChunkIndex*	theIndex = LEOStringValueGetChunkIndex( self, inType, !canResume, inContext );
+	if( theIndex )
+		LEOGetChunkRangesFromIndex( theIndex, inRangeStart, inRangeEnd, outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd );
 	else
+		LEOGetChunkRangesWithCursor( LEOStringValueCharacters(self), self->string.stringLen, inType, inRangeStart, inRangeEnd,
+										outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd,
+										inContext->itemDelimiter, theCursor );
+}
+
+
+/*!
+	Return the array form of a dynamic string value. The array is parsed only
+	the first time a long string is used as one and then kept around, while
+	short strings are quick enough to parse each time. The caller must release
+	the array using LEOCleanUpArray(). Returns NULL and aborts execution of the
+	current LEOContext if the string is empty or not a valid array.
+*/
+
+static struct LEOArrayEntry*	LEOGetStringValueParsedArray( LEOValuePtr self, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry	*	convertedArray = NULL;
+	if( self->string.string )
+	{
+		if( self->string.storage.buffer.parsedArray == NULL )
+			self->string.storage.buffer.parsedArray = LEOCreateArrayFromString( self->string.string, self->string.stringLen, inContext );
+		convertedArray = LEOCopyArray( self->string.storage.buffer.parsedArray, inContext );
+	}
+	else if( self->string.stringLen != 0 )
+		convertedArray = LEOCreateArrayFromString( self->string.storage.shortString, self->string.stringLen, inContext );
+	if( convertedArray == NULL )
 	{
 		size_t		lineNo = SIZE_MAX;
 		uint16_t	fileID = 0;
 		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
 		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Expected array, found %s", self->base.isa->displayTypeName );
+	}
+	
+	return convertedArray;
+}
+
+
+LEOValuePtr	LEOGetStringValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
+{
+	if( !tempStorage )
+	{
+		size_t		lineNo = SIZE_MAX;
+		uint16_t	fileID = 0;
+		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Internal error converting %s to array.", self->base.isa->displayTypeName );
 		return NULL;
 	}
 	
-	LEOValuePtr	theValue = LEOGetArrayValueForKey( convertedArray, keyName );
-	if( theValue == NULL )
+	struct LEOArrayEntry	*	convertedArray = LEOGetStringValueParsedArray( self, inContext );
+	if( !convertedArray )
 		return NULL;
-	LEOInitCopy( theValue, tempStorage, keepReferences, inContext );
+	
+	LEOValuePtr	theValue = LEOGetArrayValueForKey( convertedArray, keyName );
+	if( theValue != NULL )
+	{
+		LEOInitCopy( theValue, tempStorage, keepReferences, inContext );
+		theValue = tempStorage;
+	}
 	LEOCleanUpArray( convertedArray, inContext );
 	
-	return tempStorage;
+	return theValue;
+}
+
+
+size_t	LEOGetStringValueKeyCount( LEOValuePtr self, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry	*	convertedArray = LEOGetStringValueParsedArray( self, inContext );
+	if( !convertedArray )
+		return 0;
+	
+	size_t		numKeys = LEOGetArrayKeyCount( convertedArray );
+	LEOCleanUpArray( convertedArray, inContext );
+	
+	return numKeys;
 }
 
 
@@ -1414,9 +1786,9 @@ void	LEOSetStringLikeValueAsNativeObject( LEOValuePtr self, void* inNativeObject
 void	LEOSetStringLikeValueForKey( LEOValuePtr self, const char* keyName, LEOValuePtr inValue, struct LEOContext* inContext )
 {
 	struct LEOArrayEntry	*	convertedArray = NULL;
-	if( self->string.string != NULL && self->string.stringLen != 0 )
+	if( self->string.stringLen != 0 )
 	{
-		convertedArray = LEOCreateArrayFromString( self->string.string, self->string.stringLen, inContext );
+		convertedArray = LEOCreateArrayFromString( LEOStringValueCharacters(self), self->string.stringLen, inContext );
 		if( !convertedArray )
 		{
 			size_t		lineNo = SIZE_MAX;
@@ -1428,9 +1800,11 @@ void	LEOSetStringLikeValueForKey( LEOValuePtr self, const char* keyName, LEOValu
 	}
 	LEOAddArrayEntryToRoot( &convertedArray, keyName, inValue, inContext );
 	
-	char	str[1024] = { 0 };	// TODO: Make work with arbitrary string sizes.
-	LEOPrintArray( convertedArray, str, sizeof(str), inContext );
-	LEOSetValueAsString( self, str, strlen(str), inContext );	// TODO: Make this binary data safe.
+	LEOStringBuilder	arrayStr;
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( convertedArray, &arrayStr, inContext );
+	LEOSetValueAsString( self, LEOStringBuilderGetCString( &arrayStr ), arrayStr.stringLen, inContext );
+	LEOStringBuilderCleanUp( &arrayStr );
 	
 	LEOCleanUpArray( convertedArray, inContext );
 }
@@ -1623,6 +1997,94 @@ void	LEODetermineChunkRangeOfSubstringOfAnyValue( LEOValuePtr self, size_t *ioBy
 }
 
 
+/*!
+	Generic method implementation for values that don't have a better way to
+	provide their string. Borrows the value's own string if GetAsString returns
+	one when not given a buffer. Otherwise the string is generated into the view,
+	and if it fills the buffer it may have been cut off, so we try again with
+	ever larger buffers on the heap.
+*/
+
+void	LEOGetAnyValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext )
+{
+	outView->spilledString = NULL;
+	outView->shortString[0] = 0;
+	
+	bool	wasRunning = inContext && (inContext->flags & kLEOContextKeepRunning);
+	outView->string = LEOGetValueAsString( self, NULL, 0, inContext );
+	if( outView->string )
+	{
+		outView->stringLen = strlen(outView->string);
+		return;
+	}
+	if( wasRunning && (inContext->flags & kLEOContextKeepRunning) == 0 )	// Failed, don't report the error again.
+	{
+		outView->string = outView->shortString;
+		outView->stringLen = 0;
+		return;
+	}
+	
+	char*	buffer = outView->shortString;
+	size_t	bufferSize = sizeof(outView->shortString);
+	while( true )
+	{
+		buffer[0] = 0;
+		outView->string = LEOGetValueAsString( self, buffer, bufferSize, inContext );
+		if( !outView->string )
+			outView->string = buffer;
+		outView->stringLen = strlen(outView->string);
+		
+		// Most implementations pass bufSize -1 to snprintf() or strlcpy(), so
+		//	they stop one byte earlier than they'd have to:
+		if( outView->string != buffer || (outView->stringLen +2) < bufferSize )
+			break;
+		
+		char*	biggerBuffer = malloc( bufferSize * 2 );
+		if( !biggerBuffer )
+			break;	// Better a cut-off string than none.
+		if( outView->spilledString )
+			free( outView->spilledString );
+		outView->spilledString = buffer = biggerBuffer;
+		bufferSize *= 2;
+	}
+}
+
+
+/*!
+	Make the given view hold a copy of the given string, on the heap if it is
+	too long for the view's own buffer.
+*/
+
+static void	LEOStringViewSetCopy( struct LEOStringView* outView, const char* inString, size_t inStringLen )
+{
+	char*	theCopy = outView->shortString;
+	outView->spilledString = NULL;
+	if( inStringLen >= sizeof(outView->shortString) )
+	{
+		outView->spilledString = malloc( inStringLen +1 );
+		if( outView->spilledString )
+			theCopy = outView->spilledString;
+		else
+			inStringLen = 0;
+	}
+	memmove( theCopy, inString, inStringLen );
+	theCopy[inStringLen] = 0;
+	outView->string = theCopy;
+	outView->stringLen = inStringLen;
+}
+
+
+void	LEOCleanUpStringView( struct LEOStringView* ioView )
+{
+	if( ioView->spilledString )
+		free( ioView->spilledString );
+	ioView->spilledString = NULL;
+	ioView->shortString[0] = 0;
+	ioView->string = ioView->shortString;
+	ioView->stringLen = 0;
+}
+
+
 bool	LEOCanGetValueAsNumber( LEOValuePtr self, struct LEOContext* inContext )
 {
 	return true;
@@ -1655,11 +2117,12 @@ size_t	LEOCantGetKeyCount( LEOValuePtr self, struct LEOContext* inContext )
 
 size_t	LEOGetStringLikeValueKeyCount( LEOValuePtr self, struct LEOContext* inContext )
 {
-	size_t		numKeys = 0;
-	char		strBuf[1024] = { 0 };	// TODO: Make work with arbitrary string sizes.
-	const char* str = LEOGetValueAsString( self, strBuf, sizeof(strBuf), inContext );
+	size_t					numKeys = 0;
+	struct LEOStringView	strView;
+	LEOGetValueAsStringView( self, &strView, inContext );
 
-	struct LEOArrayEntry*	theArray = LEOCreateArrayFromString( str, strlen(str), inContext );
+	struct LEOArrayEntry*	theArray = LEOCreateArrayFromString( strView.string, strView.stringLen, inContext );
+	LEOCleanUpStringView( &strView );
 	if( theArray )
 	{
 		numKeys = LEOGetArrayKeyCount( theArray );
@@ -1696,9 +2159,11 @@ void	LEOCantSetValueAsArray( LEOValuePtr self, struct LEOArrayEntry *inArray, st
 
 void	LEOSetStringLikeValueAsArray( LEOValuePtr self, struct LEOArrayEntry *inArray, struct LEOContext* inContext )
 {
-	char	str[1024] = { 0 };	// TODO: Make work with arbitrary string sizes.
-	LEOPrintArray( inArray, str, sizeof(str), inContext );
-	LEOSetValueAsString( self, str, strlen(str), inContext );	// TODO: Make this binary data safe.
+	LEOStringBuilder	arrayStr;
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( inArray, &arrayStr, inContext );
+	LEOSetValueAsString( self, LEOStringBuilderGetCString( &arrayStr ), arrayStr.stringLen, inContext );
+	LEOStringBuilderCleanUp( &arrayStr );
 }
 
 
@@ -2097,30 +2562,126 @@ void	LEOInitStringValue( LEOValuePtr inStorage, const char* inString, size_t inL
 	inStorage->base.isa = &kLeoValueTypeString;
 	if( keepReferences == kLEOInvalidateReferences )
 		inStorage->base.refObjectID = kLEOObjectIDINVALID;
-	inStorage->string.stringLen = inLen;
-	inStorage->string.string = calloc( inLen +1, sizeof(char) );
-	memmove( inStorage->string.string, inString, inLen );
+	inStorage->string.string = NULL;
+	inStorage->string.stringLen = 0;
+	LEOStringValueSetCharacters( inStorage, inString, inLen, inContext );
+}
+
+
+void	LEOInitStringValueWithRangeOfValue( LEOValuePtr inStorage, LEOValuePtr inValue, const char* inString, size_t inStart, size_t inEnd, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
+{
+	LEOValuePtr		stringValue = LEOFollowReferencesAndReturnValueOfType( inValue, &kLeoValueTypeString, inContext );
+	if( !stringValue )
+		stringValue = LEOFollowReferencesAndReturnValueOfType( inValue, &kLeoValueTypeStringVariant, inContext );
+	// Only share if the range is a large part of the buffer. A short range
+	//	would keep the whole buffer alive, and would keep its owner from
+	//	appending in place because the buffer is shared:
+	if( !stringValue || stringValue->string.string != inString || (inEnd -inStart) <= LEO_SHORT_STRING_MAX_LENGTH
+		|| ((inEnd -inStart) * 2) < stringValue->string.storage.buffer.sharedBuffer->capacity )
+	{
+		LEOInitStringValue( inStorage, inString +inStart, inEnd -inStart, keepReferences, inContext );
+		return;
+	}
+	
+	struct LEOStringBuffer*	theBuffer = stringValue->string.storage.buffer.sharedBuffer;
+	theBuffer->refCount++;
+	inStorage->base.isa = &kLeoValueTypeString;
+	if( keepReferences == kLEOInvalidateReferences )
+		inStorage->base.refObjectID = kLEOObjectIDINVALID;
+	LEOStringValueTakeBuffer( inStorage, theBuffer, inEnd -inStart );
+	inStorage->string.string += inStart;
 }
 
 
 /*!
-	Implementation of GetAsNumber for string values. If the given string can't
-	be completely converted into a number, this will fail with an error message
-	and abort execution of the current LEOContext.
+	If inValue is or references a string value of any kind whose characters
+	are inString (i.e. inString was obtained from it using LEOGetValueAsString()),
+	return that value, so its length is known and it can keep track of its
+	chunks. Otherwise return NULL.
 */
 
-LEONumber	LEOGetStringValueAsNumber( LEOValuePtr self, LEOUnit *outUnit, struct LEOContext* inContext )
+static LEOValuePtr	LEOFollowReferencesAndReturnValueOfStringType( LEOValuePtr inValue, const char* inString, struct LEOContext* inContext )
 {
-	// Determine if there's a unit on this number, remove it but remember it:
-	LEOUnit		theUnit = kLEOUnitNone;
-	size_t		lengthToParse = self->string.stringLen;
+	LEOValuePtr		stringValue = LEOFollowReferencesAndReturnValueOfType( inValue, &kLeoValueTypeString, inContext );
+	if( !stringValue )
+		stringValue = LEOFollowReferencesAndReturnValueOfType( inValue, &kLeoValueTypeStringVariant, inContext );
+	if( !stringValue )
+		stringValue = LEOFollowReferencesAndReturnValueOfType( inValue, &kLeoValueTypeStringConstant, inContext );
+	if( stringValue && LEOStringValueCharacters(stringValue) == inString )
+		return stringValue;
 	
-	for( int x = 1; x < kLEOUnit_Last; x++ )	// Skip first one, which is empty string for 'no unit' and would match anything.
-	{
-		size_t	unitLen = strlen(gUnitLabels[x]);
-		if( unitLen < lengthToParse )
+	return NULL;
+}
+
+
+void	LEOGetChunkRangesOfValue( LEOValuePtr inValue, const char* inString, size_t inStringLen, LEOChunkType inType,
+									size_t inRangeStart, size_t inRangeEnd,
+									size_t *outChunkStart, size_t *outChunkEnd,
+									size_t *outDelChunkStart, size_t *outDelChunkEnd,
+									struct LEOContext* inContext )
+{
+	LEOValuePtr		stringValue = LEOFollowReferencesAndReturnValueOfStringType( inValue, inString, inContext );
+	if( stringValue )
+		LEOGetStringValueChunkRanges( stringValue, inType, inRangeStart, inRangeEnd,
+										outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd, inContext );
+	else
+		LEOGetChunkRangesOfLength( inString, inStringLen, inType, inRangeStart, inRangeEnd,
+									outChunkStart, outChunkEnd, outDelChunkStart, outDelChunkEnd, inContext->itemDelimiter );
+}
+
+
+static bool	LEOCountChunksCallback( const char* currStr, size_t currLen, size_t currStart, size_t currEnd, void* userData )
+{
+	size_t*		numChunks = (size_t*)userData;
+	
+	(*numChunks)++;
+	
+	return true;
+}
+
+
+size_t	LEOGetChunkCountOfValue( LEOValuePtr inValue, const char* inString, size_t inStringLen, LEOChunkType inType, struct LEOContext* inContext )
+{
+	if( inType == kLEOChunkTypeByte )
+		return inStringLen;
+	
+	LEOValuePtr		stringValue = LEOFollowReferencesAndReturnValueOfStringType( inValue, inString, inContext );
+	if( stringValue )
+	{
+		if( stringValue->base.isa != &kLeoValueTypeStringConstant )
+		{
+			struct LEOChunkIndex*	theIndex = LEOStringValueGetChunkIndex( stringValue, inType, true, inContext );
+			if( theIndex )
+				return theIndex->numChunks;
+		}
+	}
+	
+	size_t		numChunks = 0;
+	LEODoForEachChunk( inString, inStringLen, inType, LEOCountChunksCallback, inContext->itemDelimiter, &numChunks );
+	
+	return numChunks;
+}
+
+
+/*!
+	Implementation of GetAsNumber for string values. If the given string can't
+	be completely converted into a number, this will fail with an error message
+	and abort execution of the current LEOContext.
+*/
+
+LEONumber	LEOGetStringValueAsNumber( LEOValuePtr self, LEOUnit *outUnit, struct LEOContext* inContext )
+{
+	// Determine if there's a unit on this number, remove it but remember it:
+	LEOUnit		theUnit = kLEOUnitNone;
+	const char*	str = LEOStringValueCString( self, inContext );
+	size_t		lengthToParse = self->string.stringLen;
+	
+	for( int x = 1; x < kLEOUnit_Last; x++ )	// Skip first one, which is empty string for 'no unit' and would match anything.
+	{
+		size_t	unitLen = strlen(gUnitLabels[x]);
+		if( unitLen < lengthToParse )
 		{
-			if( strcasecmp( self->string.string +(lengthToParse -unitLen), gUnitLabels[x] ) == 0 )
+			if( strcasecmp( str +(lengthToParse -unitLen), gUnitLabels[x] ) == 0 )
 			{
 				lengthToParse -= unitLen;
 				theUnit = x;
@@ -2130,8 +2691,8 @@ LEONumber	LEOGetStringValueAsNumber( LEOValuePtr self, LEOUnit *outUnit, struct
 	}
 
 	char*		endPtr = NULL;
-	LEONumber	num = strtof( self->string.string, &endPtr );
-	if( endPtr != (self->string.string +lengthToParse) )
+	LEONumber	num = strtof( str, &endPtr );
+	if( endPtr != (str +lengthToParse) )
 		LEOCantGetValueAsNumber( self, outUnit, inContext );
 	
 	if( outUnit )
@@ -2151,6 +2712,7 @@ LEOInteger	LEOGetStringValueAsInteger( LEOValuePtr self, LEOUnit* outUnit, struc
 {
 	// Determine if there's a unit on this number, remove it but remember it:
 	LEOUnit		theUnit = kLEOUnitNone;
+	const char*	str = LEOStringValueCString( self, inContext );
 	size_t		lengthToParse = self->string.stringLen;
 	
 	for( int x = 1; x < kLEOUnit_Last; x++ )	// Skip first one, which is empty string for 'no unit' and would match anything.
@@ -2158,7 +2720,7 @@ LEOInteger	LEOGetStringValueAsInteger( LEOValuePtr self, LEOUnit* outUnit, struc
 		size_t	unitLen = strlen(gUnitLabels[x]);
 		if( unitLen < lengthToParse )
 		{
-			if( strcasecmp( self->string.string +(lengthToParse -unitLen), gUnitLabels[x] ) == 0 )
+			if( strcasecmp( str +(lengthToParse -unitLen), gUnitLabels[x] ) == 0 )
 			{
 				lengthToParse -= unitLen;
 				theUnit = x;
@@ -2168,8 +2730,8 @@ LEOInteger	LEOGetStringValueAsInteger( LEOValuePtr self, LEOUnit* outUnit, struc
 	}
 
 	char*		endPtr = NULL;
-	LEOInteger	num = strtoll( self->string.string, &endPtr, 10 );
-	if( endPtr != (self->string.string +lengthToParse) )
+	LEOInteger	num = strtoll( str, &endPtr, 10 );
+	if( endPtr != (str +lengthToParse) )
 		LEOCantGetValueAsInteger( self, outUnit, inContext );
 	
 	if( outUnit )
@@ -2185,9 +2747,28 @@ LEOInteger	LEOGetStringValueAsInteger( LEOValuePtr self, LEOUnit* outUnit, struc
 
 const char*	LEOGetStringValueAsString( LEOValuePtr self, char* outBuf, size_t bufSize, struct LEOContext* inContext )
 {
-	if( outBuf )	// If given a buffer, copy over, caller may really want a copy. Always return our internal buffer, which contains the whole string.
-		strlcpy( outBuf, self->string.string, bufSize );	// TODO: Not NUL-safe!
-	return self->string.string;
+	const char*	str = LEOStringValueCString( self, inContext );
+	if( outBuf && bufSize > 0 )	// If given a buffer, copy over, caller may really want a copy. Always return our internal buffer, which contains the whole string.
+	{
+		size_t	copyLen = (self->string.stringLen < bufSize) ? self->string.stringLen : (bufSize -1);	// Unlike strlcpy(), doesn't have to measure all of a long string.
+		memmove( outBuf, str, copyLen );
+		outBuf[copyLen] = 0;
+	}
+	return str;
+}
+
+
+/*!
+	Implementation of GetAsStringView for dynamic and constant string values.
+	A value that shares only a range of another string's characters makes a
+	copy of its own once, so there is a NUL to end the string with.
+*/
+
+void	LEOGetStringValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext )
+{
+	outView->spilledString = NULL;
+	outView->string = LEOStringValueCString( self, inContext );
+	outView->stringLen = self->string.stringLen;
 }
 
 
@@ -2197,10 +2778,9 @@ const char*	LEOGetStringValueAsString( LEOValuePtr self, char* outBuf, size_t bu
 
 void	LEOSetStringValueAsNumber( LEOValuePtr self, LEONumber inNumber, LEOUnit inUnit, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = calloc( OTHER_VALUE_SHORT_STRING_MAX_LENGTH, sizeof(char) );
-	self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH, "%g%s", inNumber, gUnitLabels[inUnit] );
+	char		numStr[OTHER_VALUE_SHORT_STRING_MAX_LENGTH] = { 0 };
+	size_t		numLen = snprintf( numStr, sizeof(numStr), "%g%s", inNumber, gUnitLabels[inUnit] );
+	LEOStringValueSetCharacters( self, numStr, numLen, inContext );
 }
 
 
@@ -2210,10 +2790,9 @@ void	LEOSetStringValueAsNumber( LEOValuePtr self, LEONumber inNumber, LEOUnit in
 
 void	LEOSetStringValueAsInteger( LEOValuePtr self, LEOInteger inInteger, LEOUnit inUnit, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = calloc( OTHER_VALUE_SHORT_STRING_MAX_LENGTH, sizeof(char) );
-	self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH, "%lld%s", inInteger, gUnitLabels[inUnit] );
+	char		numStr[OTHER_VALUE_SHORT_STRING_MAX_LENGTH] = { 0 };
+	size_t		numLen = snprintf( numStr, sizeof(numStr), "%lld%s", inInteger, gUnitLabels[inUnit] );
+	LEOStringValueSetCharacters( self, numStr, numLen, inContext );
 }
 
 
@@ -2225,9 +2804,10 @@ void	LEOSetStringValueAsInteger( LEOValuePtr self, LEOInteger inInteger, LEOUnit
 
 bool	LEOGetStringValueAsBoolean( LEOValuePtr self, struct LEOContext* inContext )
 {
-	if( strcasecmp( self->string.string, "true" ) == 0 && self->string.stringLen == 4 )
+	const char*	str = LEOStringValueCString( self, inContext );
+	if( strcasecmp( str, "true" ) == 0 && self->string.stringLen == 4 )
 		return true;
-	else if( strcasecmp( self->string.string, "false" ) == 0 && self->string.stringLen == 5 )
+	else if( strcasecmp( str, "false" ) == 0 && self->string.stringLen == 5 )
 		return false;
 	else
 		return LEOCantGetValueAsBoolean( self, inContext );
@@ -2246,14 +2826,13 @@ void	LEOGetStringValueAsRangeOfString( LEOValuePtr self, LEOChunkType inType,
 				outChunkEnd = 0,
 				outDelChunkStart = 0,
 				outDelChunkEnd = 0;
-	LEOGetChunkRanges( self->string.string, inType,	// TODO: Make NUL-safe.
-						inRangeStart, inRangeEnd,
-						&outChunkStart, &outChunkEnd,
-						&outDelChunkStart, &outDelChunkEnd, inContext->itemDelimiter );
+	LEOGetStringValueChunkRanges( self, inType, inRangeStart, inRangeEnd,
+									&outChunkStart, &outChunkEnd,
+									&outDelChunkStart, &outDelChunkEnd, inContext );
 	size_t		len = outChunkEnd -outChunkStart;
 	if( len > bufSize )
 		len = bufSize -1;
-	memmove( outBuf, self->string.string +outChunkStart, len );
+	memmove( outBuf, LEOStringValueCharacters(self) +outChunkStart, len );
 	outBuf[len] = 0;
 }
 
@@ -2271,11 +2850,7 @@ void LEOSetStringValueAsString( LEOValuePtr self, const char* inString, size_t i
 		LEOSetStringValueAsStringConstant( self, "", inContext );
 		return;
 	}
-	if( self->string.string )
-		free( self->string.string );
-	self->string.stringLen = inStringLen;
-	self->string.string = calloc( self->string.stringLen +1, sizeof(char) );
-	memmove( self->string.string, inString, self->string.stringLen );
+	LEOStringValueSetCharacters( self, inString, inStringLen, inContext );
 }
 
 
@@ -2315,8 +2890,7 @@ void LEOSetStringValueAsBoolean( LEOValuePtr self, bool inBoolean, struct LEOCon
 
 void LEOSetStringValueAsStringConstant( LEOValuePtr self, const char* inString, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
+	LEOStringValueFreeStorage( self, inContext );
 	
 	self->base.isa = &kLeoValueTypeStringConstant;
 	self->string.string = (char*) inString;
@@ -2325,7 +2899,8 @@ void LEOSetStringValueAsStringConstant( LEOValuePtr self, const char* inString,
 
 
 /*!
-	Implementation of InitCopy for string values.
+	Implementation of InitCopy for string values. Long strings share their
+	characters with the copy instead of duplicating them.
 */
 
 void	LEOInitStringValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
@@ -2333,16 +2908,40 @@ void	LEOInitStringValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferenc
 	dest->base.isa = &kLeoValueTypeString;
 	if( keepReferences == kLEOInvalidateReferences )
 		dest->base.refObjectID = kLEOObjectIDINVALID;
-	size_t		theLen = self->string.stringLen +1;
-	dest->string.string = calloc( theLen, sizeof(char) );
+	dest->string.string = self->string.string;
 	dest->string.stringLen = self->string.stringLen;
-	strlcpy( dest->string.string, self->string.string, theLen );
+	dest->string.storage = self->string.storage;
+	if( dest->string.string )	// Same string, so we can share its array form, too.
+	{
+		dest->string.storage.buffer.sharedBuffer->refCount++;
+		dest->string.storage.buffer.parsedArray = LEOCopyArray( self->string.storage.buffer.parsedArray, inContext );
+	}
 }
 
 
+/*!
+	Implementation of PutValueIntoValue for string values. Putting a long
+	string into a string or variant shares its characters.
+*/
+
 void	LEOPutStringValueIntoValue( LEOValuePtr self, LEOValuePtr dest, struct LEOContext* inContext )
 {
-	LEOSetValueAsString( dest, self->string.string, self->string.stringLen, inContext );
+	bool	destIsVariant = (dest->base.isa->SetAsString == LEOSetVariantValueAsString);
+	if( self->string.string && (destIsVariant || dest->base.isa == &kLeoValueTypeString) )
+	{
+		if( self == dest )
+			return;
+		
+		union LEOValue	sharedCopy;	// Copy first, in case dest owns self.
+		LEOInitStringValueCopy( self, &sharedCopy, kLEOInvalidateReferences, inContext );
+		LEOCleanUpValue( dest, kLEOKeepReferences, inContext );
+		dest->string.base.isa = destIsVariant ? &kLeoValueTypeStringVariant : &kLeoValueTypeString;
+		dest->string.string = sharedCopy.string.string;
+		dest->string.stringLen = sharedCopy.string.stringLen;
+		dest->string.storage = sharedCopy.string.storage;
+	}
+	else
+		LEOSetValueAsString( dest, LEOStringValueCharacters(self), self->string.stringLen, inContext );
 }
 
 
@@ -2351,17 +2950,25 @@ void	LEODetermineChunkRangeOfSubstringOfStringValue( LEOValuePtr self, size_t *i
 														LEOChunkType inType, size_t inRangeStart, size_t inRangeEnd,
 														struct LEOContext* inContext )
 {
-	char*		str = self->string.string;
-	size_t		maxOffs = *ioBytesEnd -((size_t)str);
-	str += (*ioBytesStart);
+	size_t		selfLen = self->string.stringLen;
+	if( (*ioBytesStart) > selfLen )
+		(*ioBytesStart) = selfLen;
+	size_t		maxOffs = ((*ioBytesEnd) < selfLen) ? (*ioBytesEnd) : selfLen;
+	if( maxOffs < (*ioBytesStart) )
+		maxOffs = (*ioBytesStart);
+	maxOffs -= (*ioBytesStart);
 	
 	size_t		chunkStart, chunkEnd, delChunkStart, delChunkEnd;
 	
-	LEOGetChunkRanges( str, inType,					// TODO: Make NUL-safe.
-						inRangeStart, inRangeEnd,
-						&chunkStart, &chunkEnd,
-						&delChunkStart, &delChunkEnd,
-						inContext->itemDelimiter );
+	if( (*ioBytesStart) == 0 && maxOffs == selfLen )	// Whole string? Can use its cursor and index.
+		LEOGetStringValueChunkRanges( self, inType, inRangeStart, inRangeEnd,
+										&chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, inContext );
+	else
+		LEOGetChunkRangesOfLength( LEOStringValueCharacters(self) +(*ioBytesStart), maxOffs, inType,
+									inRangeStart, inRangeEnd,
+									&chunkStart, &chunkEnd,
+									&delChunkStart, &delChunkEnd,
+									inContext->itemDelimiter );
 	if( chunkStart > maxOffs )
 		chunkStart = maxOffs;
 	if( chunkEnd > maxOffs )
@@ -2391,57 +2998,47 @@ void	LEOSetStringValueRangeAsString( LEOValuePtr self, LEOChunkType inType,
 				outDelChunkStart = 0,
 				outDelChunkEnd = 0,
 				inBufLen = inBuf ? strlen(inBuf) : 0,
-				selfLen = self->string.stringLen,
-				finalLen = 0;
-	LEOGetChunkRanges( self->string.string, inType,	// TODO: Make NUL-safe.
-						inRangeStart, inRangeEnd,
-						&outChunkStart, &outChunkEnd,
-						&outDelChunkStart, &outDelChunkEnd, inContext->itemDelimiter );
+				selfLen = self->string.stringLen;
+	LEOGetStringValueChunkRanges( self, inType, inRangeStart, inRangeEnd,
+									&outChunkStart, &outChunkEnd,
+									&outDelChunkStart, &outDelChunkEnd, inContext );
 	if( !inBuf )	// NULL string means 'delete'.
 	{
 		outChunkStart = outDelChunkStart;
 		outChunkEnd = outDelChunkEnd;
 	}
-	size_t		chunkLen = outChunkEnd -outChunkStart;
-	finalLen = selfLen -chunkLen +inBufLen;
-		
-	char*		newStr = calloc( finalLen +1, sizeof(char) );
-	memmove( newStr, self->string.string, outChunkStart );	// Copy before chunk.
-	if( inBufLen > 0 )
-		memmove( newStr +outChunkStart, inBuf, inBufLen );	// Copy new value of chunk.
-	memmove( newStr +outChunkStart +inBufLen, self->string.string +outChunkEnd, selfLen -outChunkEnd );	// Copy after chunk.
-	newStr[finalLen] = 0;
-	
-	free( self->string.string );
-	self->string.string = newStr;
-	self->string.stringLen = finalLen;
+	LEOStringValueSetSplicedString( self, LEOStringValueCharacters(self), selfLen, outChunkStart, outChunkEnd, inBuf, inBufLen, inContext );
 }
 
 
 /*!
-	Implementation of SetPredeterminedRangeAsString for string values.
+	Implementation of SetPredeterminedRangeAsString for string values. Offsets past
+	the end of the string mean its end, so SIZE_MAX can be used to append.
 */
 
 void	LEOSetStringValuePredeterminedRangeAsString( LEOValuePtr self,
 											size_t inRangeStart, size_t inRangeEnd,
 											const char* inBuf, struct LEOContext* inContext )
 {
-	size_t		inBufLen = inBuf ? strlen(inBuf) : 0,
-				selfLen = self->string.stringLen,
-				finalLen = 0,
-				chunkLen = inRangeEnd -inRangeStart;
-	finalLen = selfLen -chunkLen +inBufLen;
-		
-	char*		newStr = calloc( finalLen +1, sizeof(char) );
-	memmove( newStr, self->string.string, inRangeStart );	// Copy before chunk.
-	if( inBufLen > 0 )
-		memmove( newStr +inRangeStart, inBuf, inBufLen );	// Copy new value of chunk.
-	memmove( newStr +inRangeStart +inBufLen, self->string.string +inRangeEnd, selfLen -inRangeEnd );	// Copy after chunk.
-	newStr[finalLen] = 0;
-	
-	free( self->string.string );
-	self->string.string = newStr;
-	self->string.stringLen = finalLen;
+	LEOSetStringValuePredeterminedRangeAsStringOfLength( self, inRangeStart, inRangeEnd, inBuf, inBuf ? strlen(inBuf) : 0, inContext );
+}
+
+
+/*!
+	Like LEOSetStringValuePredeterminedRangeAsString, but for when you already
+	know the length of inBuf, which may contain NUL bytes.
+*/
+
+void	LEOSetStringValuePredeterminedRangeAsStringOfLength( LEOValuePtr self,
+											size_t inRangeStart, size_t inRangeEnd,
+											const char* inBuf, size_t inBufLen, struct LEOContext* inContext )
+{
+	size_t		selfLen = self->string.stringLen;
+	if( inRangeEnd > selfLen )	// So SIZE_MAX can be used to append.
+		inRangeEnd = selfLen;
+	if( inRangeStart > inRangeEnd )
+		inRangeStart = inRangeEnd;
+	LEOStringValueSetSplicedString( self, LEOStringValueCharacters(self), selfLen, inRangeStart, inRangeEnd, inBuf, inBufLen, inContext );
 }
 
 
@@ -2453,10 +3050,7 @@ void	LEOSetStringValuePredeterminedRangeAsString( LEOValuePtr self,
 void	LEOCleanUpStringValue( LEOValuePtr self, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
 {
 	self->base.isa = NULL;
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = NULL;
-	self->string.stringLen = 0;
+	LEOStringValueFreeStorage( self, inContext );
 	if( keepReferences == kLEOInvalidateReferences && self->base.refObjectID != kLEOObjectIDINVALID )
 	{
 		LEOContextGroupRecycleObjectID( inContext->group, self->base.refObjectID );
@@ -2470,18 +3064,19 @@ bool	LEOCanGetStringValueAsNumber( LEOValuePtr self, struct LEOContext* inContex
 	if( self->string.stringLen == 0 )	// Empty string? Not a number!
 		return false;
 	
+	const char*	str = LEOStringValueCString( self, inContext );
 	bool hadDot = false;
 	bool isFirst = true;
 	
 	for( size_t x = 0; x < self->string.stringLen; x++ )
 	{
-		if( isFirst && self->string.string[x] == '-' )
+		if( isFirst && str[x] == '-' )
 			;	// It's OK to have negative numbers.
-		else if( !hadDot && self->string.string[x] == '.' )
+		else if( !hadDot && str[x] == '.' )
 		{
 			hadDot = true;
 		}
-		else if( self->string.string[x] < '0' || self->string.string[x] > '9' )
+		else if( str[x] < '0' || str[x] > '9' )
 		{
 			return false;
 		}
@@ -2497,13 +3092,14 @@ bool	LEOCanGetStringValueAsInteger( LEOValuePtr self, struct LEOContext* inConte
 	if( self->string.stringLen == 0 )	// Empty string? Not a number!
 		return false;
 	
+	const char*	str = LEOStringValueCString( self, inContext );
 	bool isFirst = true;
 
 	for( size_t x = 0; x < self->string.stringLen; x++ )
 	{
-		if( isFirst && self->string.string[x] == '-' )
+		if( isFirst && str[x] == '-' )
 			;	// It's OK to have negative numbers.
-		else if( self->string.string[x] < '0' || self->string.string[x] > '9' )
+		else if( str[x] < '0' || str[x] > '9' )
 			return false;
 		
 		isFirst = false;
@@ -2515,55 +3111,55 @@ bool	LEOCanGetStringValueAsInteger( LEOValuePtr self, struct LEOContext* inConte
 
 void	LEOSetStringValueAsRect( LEOValuePtr self, LEOInteger l, LEOInteger t, LEOInteger r, LEOInteger b, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = calloc(sizeof(char), OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
+	char		rectStr[OTHER_VALUE_SHORT_STRING_MAX_LENGTH] = { 0 };
+	size_t		rectLen = 0;
 	if( inContext->group->flags & kLEOContextGroupFlagHyperCardCompatibility )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%lld,%lld,%lld,%lld", l, t, r, b );
+		rectLen = snprintf( rectStr, sizeof(rectStr), "%lld,%lld,%lld,%lld", l, t, r, b );
 	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "left:%lld\ntop:%lld\nright:%lld\nbottom:%lld", l, t, r, b );
+		rectLen = snprintf( rectStr, sizeof(rectStr), "left:%lld\ntop:%lld\nright:%lld\nbottom:%lld", l, t, r, b );
+	LEOStringValueSetCharacters( self, rectStr, rectLen, inContext );
 }
 
 
 void	LEOSetStringValueAsPoint( LEOValuePtr self, LEOInteger l, LEOInteger t, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = calloc(sizeof(char), OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
+	char		pointStr[OTHER_VALUE_SHORT_STRING_MAX_LENGTH] = { 0 };
+	size_t		pointLen = 0;
 	if( inContext->group->flags & kLEOContextGroupFlagHyperCardCompatibility )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%lld,%lld", l, t );
+		pointLen = snprintf( pointStr, sizeof(pointStr), "%lld,%lld", l, t );
 	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "horizontal:%lld\nvertical:%lld", l, t );
+		pointLen = snprintf( pointStr, sizeof(pointStr), "horizontal:%lld\nvertical:%lld", l, t );
+	LEOStringValueSetCharacters( self, pointStr, pointLen, inContext );
 }
 
 
 void	LEOGetStringValueAsRect( LEOValuePtr self, LEOInteger *l, LEOInteger *t, LEOInteger *r, LEOInteger *b, struct LEOContext* inContext )
 {
-	LEOStringToRect( self->string.string, self->string.stringLen, l, t, r, b, inContext );
+	LEOStringToRect( LEOStringValueCharacters(self), self->string.stringLen, l, t, r, b, inContext );
 }
 
 
 void	LEOGetStringValueAsPoint( LEOValuePtr self, LEOInteger *l, LEOInteger *t, struct LEOContext* inContext )
 {
-	LEOStringToPoint( self->string.string, self->string.stringLen, l, t, inContext );
+	LEOStringToPoint( LEOStringValueCharacters(self), self->string.stringLen, l, t, inContext );
 }
 
 
 void	LEOSetStringValueAsRange( LEOValuePtr self, LEOInteger s, LEOInteger e, LEOChunkType t, struct LEOContext* inContext )
 {
-	if( self->string.string )
-		free( self->string.string );
-	self->string.string = calloc(sizeof(char), OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
+	char		rangeStr[OTHER_VALUE_SHORT_STRING_MAX_LENGTH] = { 0 };
+	size_t		rangeLen = 0;
 	if( s == e )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%s %lld", gLEOChunkTypeNames[t], s );
+		rangeLen = snprintf( rangeStr, sizeof(rangeStr), "%s %lld", gLEOChunkTypeNames[t], s );
 	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%s %lld to %lld", gLEOChunkTypeNames[t], s, e );
+		rangeLen = snprintf( rangeStr, sizeof(rangeStr), "%s %lld to %lld", gLEOChunkTypeNames[t], s, e );
+	LEOStringValueSetCharacters( self, rangeStr, rangeLen, inContext );
 }
 
 
 void	LEOGetStringValueAsRange( LEOValuePtr self, LEOInteger *s, LEOInteger *e, LEOChunkType *t, struct LEOContext* inContext )
 {
-	LEOStringToRange( self->string.string, self->string.stringLen, s, e, t, inContext );
+	LEOStringToRange( LEOStringValueCharacters(self), self->string.stringLen, s, e, t, inContext );
 }
 
 
@@ -2653,6 +3249,19 @@ void	LEOInitUnsetValue( LEOValuePtr inStorage, LEOKeepReferencesFlag keepReferen
 }
 
 
+/*!
+	Turn a string constant value into an empty dynamic string value, so one of
+	the LEOSetStringValue...() functions can give it its new contents.
+*/
+
+static void	LEOStringConstantValueMakeDynamic( LEOValuePtr self )
+{
+	self->base.isa = &kLeoValueTypeString;
+	self->string.string = NULL;
+	self->string.stringLen = 0;
+}
+
+
 /*!
 	Implementation of SetAsNumber for string constant values. This turns the
 	value into a regular (dynamic) string value.
@@ -2661,9 +3270,8 @@ void	LEOInitUnsetValue( LEOValuePtr inStorage, LEOKeepReferencesFlag keepReferen
 void	LEOSetStringConstantValueAsNumber( LEOValuePtr self, LEONumber inNumber, LEOUnit inUnit, struct LEOContext* inContext )
 {
 	// Turn this into a non-constant string:
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc( OTHER_VALUE_SHORT_STRING_MAX_LENGTH, sizeof(char) );
-	self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH, "%g%s", inNumber, gUnitLabels[inUnit] );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOSetStringValueAsNumber( self, inNumber, inUnit, inContext );
 }
 
 
@@ -2675,9 +3283,8 @@ void	LEOSetStringConstantValueAsNumber( LEOValuePtr self, LEONumber inNumber, LE
 void	LEOSetStringConstantValueAsInteger( LEOValuePtr self, LEOInteger inInteger, LEOUnit inUnit, struct LEOContext* inContext )
 {
 	// Turn this into a non-constant string:
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc( OTHER_VALUE_SHORT_STRING_MAX_LENGTH, sizeof(char) );
-	self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH, "%lld%s", inInteger, gUnitLabels[inUnit] );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOSetStringValueAsInteger( self, inInteger, inUnit, inContext );
 }
 
 
@@ -2695,10 +3302,8 @@ void	LEOSetStringConstantValueAsString( LEOValuePtr self, const char* inString,
 		return;
 	}
 	// Turn this into a non-constant string:
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc( inStringLen +1, sizeof(char) );
-	self->string.stringLen = inStringLen;
-	memmove( self->string.string, inString, inStringLen );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOStringValueSetCharacters( self, inString, inStringLen, inContext );
 }
 
 
@@ -2741,31 +3346,21 @@ void	LEOSetStringConstantValueRangeAsString( LEOValuePtr self, LEOChunkType inTy
 				outDelChunkStart = 0,
 				outDelChunkEnd = 0,
 				inBufLen = inBuf ? strlen(inBuf) : 0,
-				selfLen = self->string.stringLen,
-				finalLen = 0;
-	LEOGetChunkRanges( self->string.string, inType,		// Make NUL-safe
-						inRangeStart, inRangeEnd,
-						&outChunkStart, &outChunkEnd,
-						&outDelChunkStart, &outDelChunkEnd, inContext->itemDelimiter );
+				selfLen = self->string.stringLen;
+	LEOGetChunkRangesOfLength( self->string.string, selfLen, inType,
+								inRangeStart, inRangeEnd,
+								&outChunkStart, &outChunkEnd,
+								&outDelChunkStart, &outDelChunkEnd, inContext->itemDelimiter );
 	if( !inBuf )	// NULL string means 'delete'.
 	{
 		outChunkStart = outDelChunkStart;
 		outChunkEnd = outDelChunkEnd;
 	}
-	size_t		chunkLen = outChunkEnd -outChunkStart;
-	finalLen = selfLen -chunkLen +inBufLen;
-		
-	char*		newStr = calloc( finalLen +1, sizeof(char) );
-	memmove( newStr, self->string.string, outChunkStart );	// Copy before chunk.
-	if( inBufLen > 0 )
-		memmove( newStr +outChunkStart, inBuf, inBufLen );	// Copy new value of chunk.
-	memmove( newStr +outChunkStart +inBufLen, self->string.string +outChunkEnd, selfLen -outChunkEnd );	// Copy after chunk.
-	newStr[finalLen] = 0;
 	
 	// Turn this into a non-constant string:
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = newStr;
-	self->string.stringLen = finalLen;
+	const char*	oldStr = self->string.string;
+	LEOStringConstantValueMakeDynamic( self );
+	LEOStringValueSetSplicedString( self, oldStr, selfLen, outChunkStart, outChunkEnd, inBuf, inBufLen, inContext );
 }
 
 
@@ -2802,34 +3397,22 @@ void	LEOCleanUpStringConstantValue( LEOValuePtr self, LEOKeepReferencesFlag keep
 
 void	LEOSetStringConstantValueAsRect( LEOValuePtr self, LEOInteger l, LEOInteger t, LEOInteger r, LEOInteger b, struct LEOContext* inContext )
 {
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc(sizeof(char),OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
-	if( inContext->group->flags & kLEOContextGroupFlagHyperCardCompatibility )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%lld,%lld,%lld,%lld", l, t, r, b );
-	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "left:%lld\ntop:%lld\nright:%lld\nbottom:%lld", l, t, r, b );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOSetStringValueAsRect( self, l, t, r, b, inContext );
 }
 
 
 void	LEOSetStringConstantValueAsPoint( LEOValuePtr self, LEOInteger l, LEOInteger t, struct LEOContext* inContext )
 {
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc(sizeof(char),OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
-	if( inContext->group->flags & kLEOContextGroupFlagHyperCardCompatibility )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%lld,%lld", l, t );
-	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "horizontal:%lld\nvertical:%lld", l, t );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOSetStringValueAsPoint( self, l, t, inContext );
 }
 
 
 void	LEOSetStringConstantValueAsRange( LEOValuePtr self, LEOInteger s, LEOInteger e, LEOChunkType t, struct LEOContext* inContext )
 {
-	self->base.isa = &kLeoValueTypeString;
-	self->string.string = calloc(sizeof(char),OTHER_VALUE_SHORT_STRING_MAX_LENGTH);	// +++ realloc when we know the size?
-	if( s == e )
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%s %lld", gLEOChunkTypeNames[t], s );
-	else
-		self->string.stringLen = snprintf( self->string.string, OTHER_VALUE_SHORT_STRING_MAX_LENGTH -1, "%s %lld to %lld", gLEOChunkTypeNames[t], s, e );
+	LEOStringConstantValueMakeDynamic( self );
+	LEOSetStringValueAsRange( self, s, e, t, inContext );
 }
 
 
@@ -4015,6 +4598,39 @@ const char*	LEOGetReferenceValueAsString( LEOValuePtr self, char* outBuf, size_t
 }
 
 
+/*!
+	Implementation of GetAsStringView for reference values. References to a
+	chunk of a value get a copy of that chunk.
+*/
+
+void	LEOGetReferenceValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext )
+{
+	LEOValuePtr		theValue = LEOContextGroupGetPointerForObjectIDAndSeed( inContext->group, self->reference.objectID, self->reference.objectSeed );
+	if( theValue == NULL )
+	{
+		LEOStringViewSetCopy( outView, "", 0 );
+		
+		size_t		lineNo = SIZE_MAX;
+		uint16_t	fileID = 0;
+		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "The referenced value doesn't exist anymore." );
+	}
+	else if( self->reference.chunkType != kLEOChunkTypeINVALID )
+	{
+		struct LEOStringView	wholeView;
+		size_t					chunkStart = 0, chunkEnd = 0, delChunkStart = 0, delChunkEnd = 0;
+		LEOGetValueAsStringView( theValue, &wholeView, inContext );
+		LEOGetChunkRangesOfValue( theValue, wholeView.string, wholeView.stringLen, self->reference.chunkType,
+									self->reference.chunkStart, self->reference.chunkEnd,
+									&chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, inContext );
+		LEOStringViewSetCopy( outView, wholeView.string +chunkStart, chunkEnd -chunkStart );
+		LEOCleanUpStringView( &wholeView );
+	}
+	else
+		LEOGetValueAsStringView( theValue, outView, inContext );
+}
+
+
 /*!
 	Implementation of GetAsNumber for reference values.
 */
@@ -4489,9 +5105,11 @@ void		LEOSetReferenceValueAsArray( LEOValuePtr self, struct LEOArrayEntry * inAr
 	}
 	else if( self->reference.chunkType != kLEOChunkTypeINVALID )
 	{
-		char		str[1024] = {0};	// TODO: Make this work for all lengths.
-		LEOPrintArray( inArray, str, sizeof(str), inContext );
-		LEOSetValueRangeAsString( theValue, self->reference.chunkType, self->reference.chunkStart, self->reference.chunkEnd, str, inContext );
+		LEOStringBuilder	arrayStr;
+		LEOStringBuilderInit( &arrayStr );
+		LEOPrintArrayToStringBuilder( inArray, &arrayStr, inContext );
+		LEOSetValueRangeAsString( theValue, self->reference.chunkType, self->reference.chunkStart, self->reference.chunkEnd, LEOStringBuilderGetCString( &arrayStr ), inContext );
+		LEOStringBuilderCleanUp( &arrayStr );
 	}
 	else
 		LEOSetValueAsArray( theValue, inArray, inContext );
@@ -4913,9 +5531,9 @@ void	LEOSetVariantValueAsNativeObject( LEOValuePtr self, void* inNativeObject, s
 
 void	LEOSetVariantValueAsArray( LEOValuePtr self, struct LEOArrayEntry *inArray, struct LEOContext* inContext )
 {
+	struct LEOArrayEntry*	arrayCopy = LEOCopyArray( inArray, inContext );	// Copy first, in case inArray is our own array.
 	LEOCleanUpValue( self, kLEOKeepReferences, inContext );
-	LEOInitArrayValue( &self->array, NULL, kLEOKeepReferences, inContext );
-	self->array.array = LEOCopyArray( inArray, inContext );
+	LEOInitArrayValue( &self->array, arrayCopy, kLEOKeepReferences, inContext );
 	self->base.isa = &kLeoValueTypeArrayVariant;
 }
 
@@ -4940,18 +5558,21 @@ void	LEOSetVariantValuePredeterminedRangeAsString( LEOValuePtr self,
 													size_t inRangeStart, size_t inRangeEnd,
 													const char* inBuf, struct LEOContext* inContext )
 {
-	LEOSetVariantValueRangeAsString( self, kLEOChunkTypeByte,
-										inRangeStart, inRangeEnd,
-										inBuf, inContext );
+	if( self->base.isa == &kLeoValueTypeStringVariant )	// Already a string, no need to look at the characters.
+		LEOSetStringValuePredeterminedRangeAsString( self, inRangeStart, inRangeEnd, inBuf, inContext );
+	else
+		LEOSetVariantValueRangeAsString( self, kLEOChunkTypeByte,
+											inRangeStart, inRangeEnd,
+											inBuf, inContext );
 }
 
 
 LEOValuePtr	LEOGetStringVariantValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
 {
 	struct LEOArrayEntry	*	convertedArray = NULL;
-	if( self->string.string != NULL && self->string.stringLen != 0 )
+	if( self->string.stringLen != 0 )
 	{
-		convertedArray = LEOCreateArrayFromString( self->string.string, self->string.stringLen, inContext );
+		convertedArray = LEOCreateArrayFromString( LEOStringValueCharacters(self), self->string.stringLen, inContext );
 		if( !convertedArray )
 		{
 			size_t		lineNo = SIZE_MAX;
@@ -4976,6 +5597,7 @@ LEOValuePtr	LEOGetStringVariantValueForKey( LEOValuePtr self, const char* keyNam
 	self->array.array = convertedArray;
 	self->base.isa = &kLeoValueTypeArrayVariant;
 	
+	LEOPrepareArrayForItemReferences( &self->array.array, inContext );
 	LEOValuePtr		foundValue = LEOGetArrayValueForKey( self->array.array, keyName );
 	if( foundValue == NULL )
 		return NULL;
@@ -4991,13 +5613,13 @@ void	LEOSetStringVariantValueValueForKey( LEOValuePtr self, const char* inKey, L
 {
 	if( self->string.stringLen != 0 )	// Not an empty string
 	{
-		struct LEOArrayEntry	*	convertedArray = LEOCreateArrayFromString( self->string.string, self->string.stringLen, inContext );
+		struct LEOArrayEntry	*	convertedArray = LEOCreateArrayFromString( LEOStringValueCharacters(self), self->string.stringLen, inContext );
 		if( !convertedArray )
 		{
 			size_t		lineNo = SIZE_MAX;
 			uint16_t	fileID = 0;
 			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Expected array here, found \"%s\".", self->string.string );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Expected array here, found \"%s\".", LEOStringValueCString( self, inContext ) );
 			return;
 		}
 		
@@ -5014,6 +5636,29 @@ void	LEOSetStringVariantValueValueForKey( LEOValuePtr self, const char* inKey, L
 }
 
 
+size_t	LEOGetStringVariantValueKeyCount( LEOValuePtr self, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry	*	convertedArray = NULL;
+	if( self->string.stringLen != 0 )
+		convertedArray = LEOCreateArrayFromString( LEOStringValueCharacters(self), self->string.stringLen, inContext );
+	if( !convertedArray )
+	{
+		size_t		lineNo = SIZE_MAX;
+		uint16_t	fileID = 0;
+		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Expected an array, found %s.", self->base.isa->displayTypeName );
+		return 0;
+	}
+	
+	// Transform us into an array, so the keys don't have to be parsed again:
+	LEOCleanUpValue( self, kLEOKeepReferences, inContext );
+	LEOInitArrayValue( &self->array, convertedArray, kLEOKeepReferences, inContext );
+	self->base.isa = &kLeoValueTypeArrayVariant;
+	
+	return LEOGetArrayKeyCount( self->array.array );
+}
+
+
 void	LEOInitNumberVariantValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext )
 {
 	LEOInitNumberValueCopy( self, dest, keepReferences, inContext );
@@ -5101,6 +5746,25 @@ const char*	LEOGetArrayValueAsString( LEOValuePtr self, char* outBuf, size_t buf
 }
 
 
+void	LEOGetArrayValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext )
+{
+	LEOStringBuilder	arrayStr;
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( self->array.array, &arrayStr, inContext );
+	if( arrayStr.stringLen > 0 && arrayStr.string[arrayStr.stringLen -1] == '\n' )	// Remove trailing return, like LEOGetArrayValueAsString().
+		arrayStr.string[--arrayStr.stringLen] = 0;
+	
+	if( arrayStr.string == NULL )
+		LEOStringViewSetCopy( outView, "", 0 );
+	else
+	{
+		outView->spilledString = arrayStr.string;	// Take over the builder's string instead of copying it.
+		outView->string = arrayStr.string;
+		outView->stringLen = arrayStr.stringLen;
+	}
+}
+
+
 void	LEOGetArrayValueAsRangeOfString( LEOValuePtr self, LEOChunkType inType,
 									size_t inRangeStart, size_t inRangeEnd,
 									char* outBuf, size_t bufSize, struct LEOContext* inContext )
@@ -5154,6 +5818,7 @@ void	LEOCleanUpArrayValue( LEOValuePtr self, LEOKeepReferencesFlag keepReference
 
 LEOValuePtr		LEOGetArrayValueValueForKey( LEOValuePtr self, const char* inKey, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext * inContext )
 {
+	LEOPrepareArrayForItemReferences( &self->array.array, inContext );
 	LEOValuePtr	foundValue = LEOGetArrayValueForKey( self->array.array, inKey );
 	if( foundValue )
 	{
@@ -5179,8 +5844,9 @@ size_t	LEOGetArrayValueKeyCount( LEOValuePtr self, struct LEOContext* inContext
 
 void	LEOSetArrayValueAsArray( LEOValuePtr self, struct LEOArrayEntry *inArray, struct LEOContext* inContext )
 {
+	struct LEOArrayEntry*	arrayCopy = LEOCopyArray( inArray, inContext );	// Copy first, in case inArray is our own array.
 	LEOCleanUpArray( self->array.array, inContext );
-	self->array.array = LEOCopyArray( inArray, inContext );
+	self->array.array = arrayCopy;
 }
 
 
@@ -5243,86 +5909,12 @@ void	LEOGetArrayValueAsPoint( LEOValuePtr self, LEOInteger *l, LEOInteger *t, st
 #pragma mark -
 
 
-struct LEOArrayEntry	*	LEOCreateArrayFromString( const char* inString, size_t inStringLen, struct LEOContext* inContext )
-{
-	struct LEOArrayEntry*	theArray = NULL;
-	size_t					x = 0, keyStartOffs = 0, keyEndOffs = 0,
-							valueStartOffs = 0, valueEndOffs = 0;
-	bool					isInKey = true;
-	char					keyStr[LEO_MAX_ARRAY_KEY_SIZE] = { 0 };
-	
-	for( ; x < inStringLen; x++ )
-	{
-		if( isInKey && inString[x] == ':' )
-		{
-			keyEndOffs = x;
-			valueStartOffs = valueEndOffs = x+1;
-			isInKey = false;
-		}
-		else if( !isInKey && (inString[x] == '\n' || inString[x] == '\r') )
-		{
-			if( x <= 1 || inString[x-2] != ((char)0xc2) || inString[x-1] != ((char)0xac) )	// Is a real return end-of-entry, not an escaped return in data?
-			{
-				valueEndOffs = x;	// No +1, the return at the end is a delimiter that should be removed.
-				size_t	keyLen = keyEndOffs -keyStartOffs;
-				if( keyLen >= LEO_MAX_ARRAY_KEY_SIZE )
-					keyLen = LEO_MAX_ARRAY_KEY_SIZE -1;
-				if( keyLen > 0 )
-					memmove( keyStr, inString +keyStartOffs, keyLen );
-				else	// Error, not a valid array!
-				{
-					LEOCleanUpArray( theArray, inContext );
-					return NULL;
-				}
-				keyStr[keyLen] = 0;
-				
-				LEOValuePtr	newValue = LEOAddArrayEntryToRoot( &theArray, keyStr, NULL, inContext );
-				LEOInitStringValue( newValue, inString +valueStartOffs, valueEndOffs -valueStartOffs, kLEOInvalidateReferences, inContext );
-				
-				isInKey = true;
-				keyEndOffs = keyStartOffs = valueEndOffs = valueStartOffs = x +1;
-			}
-		}
-		else if( !isInKey )
-			valueEndOffs = x +1;
-		else if( isInKey )
-			keyEndOffs = x+1;
-	}
-	
-	if( !isInKey && (keyEndOffs > keyStartOffs || valueEndOffs > valueStartOffs) )	// No return at end, we have one leftover key-value pair?
-	{
-		size_t	keyLen = keyEndOffs -keyStartOffs;
-		if( keyLen >= LEO_MAX_ARRAY_KEY_SIZE )
-			keyLen = LEO_MAX_ARRAY_KEY_SIZE -1;
-		if( keyLen > 0 )
-			memmove( keyStr, inString +keyStartOffs, keyLen );
-		else	// Error, not a valid array!
-		{
-			LEOCleanUpArray( theArray, inContext );
-			return NULL;
-		}
-		keyStr[keyLen] = 0;
-		
-		LEOValuePtr	newValue = LEOAddArrayEntryToRoot( &theArray, keyStr, NULL, inContext );
-		LEOInitStringValue( newValue, inString +valueStartOffs, valueEndOffs -valueStartOffs, kLEOInvalidateReferences, inContext );
-	}
-	
-	return theArray;
-}
-
-
 struct LEOArrayEntry	*	LEOAllocNewEntry( const char* inKey, LEOValuePtr inValue, struct LEOContext* inContext )
 {
-	struct LEOArrayEntry	*	newEntry = NULL;
-	size_t						inKeyLen = strlen(inKey);
-	newEntry = calloc( sizeof(struct LEOArrayEntry) +inKeyLen, 1 ); // String's NUL byte is already size of the array in the struct.
-	memmove( newEntry->key, inKey, inKeyLen +1 );
-	if( inValue )
-		LEOInitCopy( inValue, &newEntry->value, kLEOInvalidateReferences, inContext );
-	newEntry->smallerItem = NULL;
-	newEntry->largerItem = NULL;
+	struct LEOArrayEntry	*	newArray = NULL;
+	LEOAddArrayEntryToRoot( &newArray, inKey, inValue, inContext );
 	
-	return newEntry;
+	return newArray;
 }
 
 
@@ -5393,154 +5985,337 @@ LEOValuePtr	LEOAddArrayArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByRefere
 }
 
 
-LEOValuePtr	LEOAddArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, LEOValuePtr inValue, struct LEOContext* inContext )
+// Keys that are canonical positive integers ("1", "2" ... but not "0", "01"
+//	or "+1") can go in the list part of an array, and are compared numerically
+//	in the keyed part, so lists come out in the right order. The key ends
+//	after inKeyLen bytes or at a NUL byte, whichever comes first:
+static bool	LEOGetArrayKeyOfLengthAsIndex( const char* inKey, size_t inKeyLen, size_t *outIndex )
 {
-	struct LEOArrayEntry	*	currEntry = NULL;
+	size_t		theIndex = 0;
+	size_t		x = 0;
 	
-	if( *arrayPtrByReference == NULL )
-	{
-		*arrayPtrByReference = LEOAllocNewEntry( inKey, inValue, inContext );
-		return &(*arrayPtrByReference)->value;
-	}
-	else
+	if( inKeyLen == 0 || inKey[0] == '0' )
+		return false;
+	for( x = 0; x < inKeyLen && inKey[x] >= '0' && inKey[x] <= '9'; x++ )
 	{
-		currEntry = *arrayPtrByReference;
-		while( true )
-		{
-			int			cmpResult = strcasecmp( currEntry->key, inKey );
-			if( cmpResult > 0 )	// inKey is larger? Go down 'larger' side one step.
-			{
-				if( currEntry->largerItem == NULL )
-				{
-					currEntry->largerItem = LEOAllocNewEntry( inKey, inValue, inContext );
-					return &currEntry->largerItem->value;
-				}
-				else
-					currEntry = currEntry->largerItem;
-			}
-			else if( cmpResult < 0 )	// inKey is smaller? Go down 'smaller' side one step.
-			{
-				if( currEntry->smallerItem == NULL )
-				{
-					currEntry->smallerItem = LEOAllocNewEntry( inKey, inValue, inContext );
-					return &currEntry->smallerItem->value;
-				}
-				else
-					currEntry = currEntry->smallerItem;
-			}
-			else if( cmpResult == 0 )	// Key already exists? Replace value!
-			{
-				LEOCleanUpValue( &currEntry->value, kLEOKeepReferences, inContext );
-				if( inValue )
-					LEOInitCopy( inValue, &currEntry->value, kLEOKeepReferences, inContext );
-				return &currEntry->value;
-			}
-		}
+		if( x >= 18 )	// Too long to be sure it fits? Treat it as a string.
+			return false;
+		theIndex = (theIndex * 10) +(inKey[x] -'0');
 	}
+	if( x == 0 || (x < inKeyLen && inKey[x] != 0) )
+		return false;
 	
-	return NULL;
+	*outIndex = theIndex;
+	return true;
 }
 
 
-void	LEODeleteArrayEntryFromRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, struct LEOContext* inContext )
+static inline bool	LEOGetArrayKeyAsIndex( const char* inKey, size_t *outIndex )
 {
-	struct LEOArrayEntry**	parentPtr = arrayPtrByReference;
-	struct LEOArrayEntry*	currEntry = *arrayPtrByReference;
-	while( true )
-	{
-		if( !currEntry )
-			return;
-		
-		int			cmpResult = strcasecmp( currEntry->key, inKey );
-		if( cmpResult > 0 )	// Key is larger? Go down 'larger' side one step.
-		{
-			parentPtr = &currEntry->largerItem;
-			currEntry = currEntry->largerItem;
-		}
-		else if( cmpResult < 0 )	// Key is smaller? Go down 'smaller' side one step.
-		{
-			parentPtr = &currEntry->smallerItem;
-			currEntry = currEntry->smallerItem;
-		}
-		else if( cmpResult == 0 )	// Found key!
-		{
-			LEOCleanUpValue( &currEntry->value, kLEOInvalidateReferences, inContext );
-			*parentPtr = NULL;
-			
-			if( currEntry->smallerItem && currEntry->largerItem )	// Have two sub-trees?
-			{
-				// Append the smaller subtree to the larger subtree:
-				*parentPtr = currEntry->largerItem;
-				struct LEOArrayEntry*	currEntry2 = currEntry->smallerItem;
-				
-				while( true )
-				{
-					int		cmpResult2 = strcasecmp( currEntry2->key, currEntry->smallerItem->key );
-					assert( cmpResult2 != 0 );
-					if( cmpResult2 > 0 )	// Key is larger? Go down 'larger' side one step.
-					{
-						if( currEntry2->largerItem == NULL )	// No larger side? Insert here!
-						{
-							currEntry2->largerItem = currEntry->smallerItem;
-							break;
-						}
-						currEntry2 = currEntry2->largerItem;
-					}
-					else if( cmpResult2 < 0 )	// Key is smaller? Go down 'smaller' side one step.
-					{
-						if( currEntry2->smallerItem == NULL )	// No smaller side? Insert here!
-						{
-							currEntry2->smallerItem = currEntry->smallerItem;
-							break;
-						}
-						currEntry2 = currEntry2->smallerItem;
-					}
-				}
-			}
-			else if( currEntry->smallerItem )
-			{
-				*parentPtr = currEntry->smallerItem;
-			}
-			else if( currEntry->largerItem )
-			{
-				*parentPtr = currEntry->largerItem;
-			}
-			
-			free( currEntry );
-		}
-	}
+	return LEOGetArrayKeyOfLengthAsIndex( inKey, SIZE_MAX, outIndex );
 }
 
 
-struct LEOArrayEntry*	LEOCopyArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
+// Like LEOCompareArrayKeys, but inKeyA doesn't need to be NUL-terminated:
+static int	LEOCompareArrayKeyOfLength( const char* inKeyA, size_t inKeyALen, const char* inKeyB )
 {
-	if( !arrayPtr )
+	size_t		indexA = 0, indexB = 0;
+	bool		isIndexA = LEOGetArrayKeyOfLengthAsIndex( inKeyA, inKeyALen, &indexA ),
+				isIndexB = LEOGetArrayKeyAsIndex( inKeyB, &indexB );
+	if( isIndexA && isIndexB )
+		return (indexA < indexB) ? -1 : ((indexA > indexB) ? 1 : 0);
+	else if( isIndexA )
+		return -1;
+	else if( isIndexB )
+		return 1;
+	
+	int		cmpResult = strncasecmp( inKeyA, inKeyB, inKeyALen );
+	if( cmpResult == 0 && strnlen( inKeyB, inKeyALen +1 ) > inKeyALen )	// inKeyA is a prefix of inKeyB?
+		cmpResult = -1;
+	return cmpResult;
+}
+
+
+static int	LEOCompareArrayKeys( const char* inKeyA, const char* inKeyB )
+{
+	size_t		indexA = 0, indexB = 0;
+	bool		isIndexA = LEOGetArrayKeyAsIndex( inKeyA, &indexA ),
+				isIndexB = LEOGetArrayKeyAsIndex( inKeyB, &indexB );
+	if( isIndexA && isIndexB )
+		return (indexA < indexB) ? -1 : ((indexA > indexB) ? 1 : 0);
+	else if( isIndexA )
+		return -1;
+	else if( isIndexB )
+		return 1;
+	
+	return strcasecmp( inKeyA, inKeyB );
+}
+
+
+static struct LEOArrayEntry*	LEOCreateEmptyArray( void )
+{
+	struct LEOArrayEntry*	newArray = calloc( 1, sizeof(struct LEOArrayEntry) );
+	if( !newArray )
+		printf( "*** Failed to allocate array! ***\n" );
+	else
+		newArray->referenceCount = 1;
+	return newArray;
+}
+
+
+// Move a value to a new address, making sure references to it follow:
+static void	LEOMoveArrayValue( LEOValuePtr inValue, LEOValuePtr outValue, struct LEOContext* inContext )
+{
+	memmove( outValue, inValue, sizeof(union LEOValue) );
+	if( outValue->base.refObjectID != kLEOObjectIDINVALID && inContext )
+		LEOContextGroupRelocatePointersInRange( inContext->group, inValue, sizeof(union LEOValue), outValue );
+}
+
+
+#pragma mark Keyed entries
+
+// Number of bytes an entry for a key of the given length takes up in the arena:
+static inline size_t	LEOArrayKeyedEntrySize( size_t inKeyLen )
+{
+	size_t		neededSize = offsetof(struct LEOArrayKeyedEntry, key) +inKeyLen +1;
+	return ((neededSize +LEO_ARRAY_KEYED_ENTRY_SIZE_STEP -1) / LEO_ARRAY_KEYED_ENTRY_SIZE_STEP) * LEO_ARRAY_KEYED_ENTRY_SIZE_STEP;
+}
+
+
+// Index into freeEntries for entries of the given size. Entries whose size class
+//	is LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES or larger aren't in the arena.
+static inline size_t	LEOArrayKeyedEntrySizeClass( size_t inEntrySize )
+{
+	return (inEntrySize -LEOArrayKeyedEntrySize( 0 )) / LEO_ARRAY_KEYED_ENTRY_SIZE_STEP;
+}
+
+
+static struct LEOArrayKeyedEntry*	LEOAllocNewKeyedEntry( struct LEOArrayEntry* inArray, const char* inKey, size_t inKeyLen, LEOValuePtr inValue, struct LEOContext* inContext )
+{
+	struct LEOArrayKeyedEntryArena*	arena = &inArray->keyedItemsArena;
+	struct LEOArrayKeyedEntry	*	newEntry = NULL;
+	inKeyLen = strnlen( inKey, inKeyLen );	// Key ends at a NUL, and LEOFreeKeyedEntry() will look at its strlen().
+	size_t							entrySize = LEOArrayKeyedEntrySize( inKeyLen );
+	size_t							sizeClass = LEOArrayKeyedEntrySizeClass( entrySize );
+	
+	if( sizeClass >= LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES )	// Huge key? Not worth keeping around for reuse.
+		newEntry = malloc( entrySize );
+	else if( arena->freeEntries[sizeClass] )	// Reuse a deleted entry.
+	{
+		newEntry = arena->freeEntries[sizeClass];
+		arena->freeEntries[sizeClass] = newEntry->smallerItem;
+	}
+	else
+	{
+		struct LEOArrayKeyedEntryBlock*	currBlock = arena->blocks;
+		if( !currBlock || (currBlock->size -currBlock->usedSize) < entrySize )
+		{
+			size_t		blockSize = currBlock ? (currBlock->size * 2) : LEO_MIN_ARRAY_KEYED_ENTRY_BLOCK_SIZE;
+			if( blockSize > LEO_MAX_ARRAY_KEYED_ENTRY_BLOCK_SIZE )
+				blockSize = LEO_MAX_ARRAY_KEYED_ENTRY_BLOCK_SIZE;
+			currBlock = malloc( sizeof(struct LEOArrayKeyedEntryBlock) +blockSize );
+			if( currBlock )
+			{
+				currBlock->nextBlock = arena->blocks;
+				currBlock->size = blockSize;
+				currBlock->usedSize = 0;
+				arena->blocks = currBlock;
+				arena->numBlocks++;
+			}
+		}
+		if( currBlock )
+		{
+			newEntry = (struct LEOArrayKeyedEntry*) (((char*)(currBlock +1)) +currBlock->usedSize);
+			currBlock->usedSize += entrySize;
+		}
+	}
+	if( !newEntry )
+	{
+		printf( "*** Failed to allocate array entry! ***\n" );
 		return NULL;
+	}
+	inArray->numKeyedItems++;
+	
+	memmove( newEntry->key, inKey, inKeyLen );
+	newEntry->key[inKeyLen] = 0;
+	memset( &newEntry->value, 0, sizeof(union LEOValue) );
+	if( inValue )
+		LEOInitCopy( inValue, &newEntry->value, kLEOInvalidateReferences, inContext );
+	newEntry->smallerItem = NULL;
+	newEntry->largerItem = NULL;
+	newEntry->height = 1;
 	
-	struct LEOArrayEntry*	entryCopy = LEOAllocNewEntry( arrayPtr->key, &arrayPtr->value, inContext );
+	return newEntry;
+}
+
+
+// Give back an entry whose value has already been cleaned up:
+static void	LEOFreeKeyedEntry( struct LEOArrayEntry* inArray, struct LEOArrayKeyedEntry* inEntry )
+{
+	inArray->numKeyedItems--;
 	
-	if( arrayPtr->smallerItem )
-		entryCopy->smallerItem = LEOCopyArray( arrayPtr->smallerItem, inContext );
+	size_t		sizeClass = LEOArrayKeyedEntrySizeClass( LEOArrayKeyedEntrySize( strlen(inEntry->key) ) );
+	if( sizeClass >= LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES )
+		free( inEntry );
+	else
+	{
+		inEntry->smallerItem = inArray->keyedItemsArena.freeEntries[sizeClass];
+		inArray->keyedItemsArena.freeEntries[sizeClass] = inEntry;
+	}
+}
+
+
+static inline size_t	LEOArrayEntryHeight( struct LEOArrayKeyedEntry* inEntry )
+{
+	return inEntry ? inEntry->height : 0;
+}
+
+
+static inline void	LEOArrayEntryUpdateHeight( struct LEOArrayKeyedEntry* inEntry )
+{
+	size_t	smallerHeight = LEOArrayEntryHeight( inEntry->smallerItem ),
+			largerHeight = LEOArrayEntryHeight( inEntry->largerItem );
+	inEntry->height = ((smallerHeight > largerHeight) ? smallerHeight : largerHeight) +1;
+}
+
+
+static struct LEOArrayKeyedEntry*	LEORotateArrayEntryTowardsSmaller( struct LEOArrayKeyedEntry* inEntry )
+{
+	struct LEOArrayKeyedEntry*	newRoot = inEntry->largerItem;
+	inEntry->largerItem = newRoot->smallerItem;
+	newRoot->smallerItem = inEntry;
+	LEOArrayEntryUpdateHeight( inEntry );
+	LEOArrayEntryUpdateHeight( newRoot );
+	return newRoot;
+}
+
+
+static struct LEOArrayKeyedEntry*	LEORotateArrayEntryTowardsLarger( struct LEOArrayKeyedEntry* inEntry )
+{
+	struct LEOArrayKeyedEntry*	newRoot = inEntry->smallerItem;
+	inEntry->smallerItem = newRoot->largerItem;
+	newRoot->largerItem = inEntry;
+	LEOArrayEntryUpdateHeight( inEntry );
+	LEOArrayEntryUpdateHeight( newRoot );
+	return newRoot;
+}
+
+
+// Restore the AVL property for the subtree at inEntry after one of its subtrees
+//	changed height by one. Only relinks entries, so pointers to their values
+//	stay valid. Returns the new root of the subtree.
+static struct LEOArrayKeyedEntry*	LEORebalanceArrayEntry( struct LEOArrayKeyedEntry* inEntry )
+{
+	LEOArrayEntryUpdateHeight( inEntry );
 	
-	if( arrayPtr->largerItem )
-		entryCopy->largerItem = LEOCopyArray( arrayPtr->largerItem, inContext );
+	size_t	smallerHeight = LEOArrayEntryHeight( inEntry->smallerItem ),
+			largerHeight = LEOArrayEntryHeight( inEntry->largerItem );
+	if( smallerHeight > (largerHeight +1) )
+	{
+		struct LEOArrayKeyedEntry*	smallerItem = inEntry->smallerItem;
+		if( LEOArrayEntryHeight( smallerItem->largerItem ) > LEOArrayEntryHeight( smallerItem->smallerItem ) )
+			inEntry->smallerItem = LEORotateArrayEntryTowardsSmaller( smallerItem );
+		return LEORotateArrayEntryTowardsLarger( inEntry );
+	}
+	else if( largerHeight > (smallerHeight +1) )
+	{
+		struct LEOArrayKeyedEntry*	largerItem = inEntry->largerItem;
+		if( LEOArrayEntryHeight( largerItem->smallerItem ) > LEOArrayEntryHeight( largerItem->largerItem ) )
+			inEntry->largerItem = LEORotateArrayEntryTowardsLarger( largerItem );
+		return LEORotateArrayEntryTowardsSmaller( inEntry );
+	}
 	
-	return entryCopy;
+	return inEntry;
 }
 
 
-LEOValuePtr		LEOGetArrayValueForKey( struct LEOArrayEntry* arrayPtr, const char* inKey )
+static struct LEOArrayKeyedEntry*	LEOAddArrayEntryToSubtree( struct LEOArrayEntry* inArray, struct LEOArrayKeyedEntry* inEntry, const char* inKey, size_t inKeyLen, LEOValuePtr inValue, LEOValuePtr *outValue, struct LEOContext* inContext )
 {
-	struct LEOArrayEntry*	currEntry = arrayPtr;
+	if( inEntry == NULL )
+	{
+		struct LEOArrayKeyedEntry*	newEntry = LEOAllocNewKeyedEntry( inArray, inKey, inKeyLen, inValue, inContext );
+		*outValue = newEntry ? &newEntry->value : NULL;
+		return newEntry;
+	}
+	
+	int			cmpResult = LEOCompareArrayKeyOfLength( inKey, inKeyLen, inEntry->key );
+	if( cmpResult < 0 )
+		inEntry->smallerItem = LEOAddArrayEntryToSubtree( inArray, inEntry->smallerItem, inKey, inKeyLen, inValue, outValue, inContext );
+	else if( cmpResult > 0 )
+		inEntry->largerItem = LEOAddArrayEntryToSubtree( inArray, inEntry->largerItem, inKey, inKeyLen, inValue, outValue, inContext );
+	else	// Key already exists? Replace value!
+	{
+		LEOCleanUpValue( &inEntry->value, kLEOKeepReferences, inContext );
+		if( inValue )
+			LEOInitCopy( inValue, &inEntry->value, kLEOKeepReferences, inContext );
+		*outValue = &inEntry->value;
+		return inEntry;
+	}
+	
+	return LEORebalanceArrayEntry( inEntry );
+}
+
+
+// Unlink the entry with the smallest key from the given subtree and return
+//	it in *outEntry. Returns the new root of the subtree:
+static struct LEOArrayKeyedEntry*	LEORemoveSmallestArrayEntryFromSubtree( struct LEOArrayKeyedEntry* inEntry, struct LEOArrayKeyedEntry** outEntry )
+{
+	if( inEntry->smallerItem == NULL )
+	{
+		*outEntry = inEntry;
+		return inEntry->largerItem;
+	}
+	
+	inEntry->smallerItem = LEORemoveSmallestArrayEntryFromSubtree( inEntry->smallerItem, outEntry );
+	return LEORebalanceArrayEntry( inEntry );
+}
+
+
+static struct LEOArrayKeyedEntry*	LEODeleteArrayEntryFromSubtree( struct LEOArrayEntry* inArray, struct LEOArrayKeyedEntry* inEntry, const char* inKey, struct LEOContext* inContext )
+{
+	if( inEntry == NULL )
+		return NULL;
+	
+	int			cmpResult = LEOCompareArrayKeys( inKey, inEntry->key );
+	if( cmpResult < 0 )
+		inEntry->smallerItem = LEODeleteArrayEntryFromSubtree( inArray, inEntry->smallerItem, inKey, inContext );
+	else if( cmpResult > 0 )
+		inEntry->largerItem = LEODeleteArrayEntryFromSubtree( inArray, inEntry->largerItem, inKey, inContext );
+	else	// Found key!
+	{
+		struct LEOArrayKeyedEntry*	replacement = NULL;
+		if( inEntry->smallerItem && inEntry->largerItem )	// Have two sub-trees? Take the next larger entry's place.
+		{
+			struct LEOArrayKeyedEntry*	largerItem = LEORemoveSmallestArrayEntryFromSubtree( inEntry->largerItem, &replacement );
+			replacement->smallerItem = inEntry->smallerItem;
+			replacement->largerItem = largerItem;
+			replacement = LEORebalanceArrayEntry( replacement );
+		}
+		else
+			replacement = inEntry->smallerItem ? inEntry->smallerItem : inEntry->largerItem;
+		
+		LEOCleanUpValue( &inEntry->value, kLEOInvalidateReferences, inContext );
+		LEOFreeKeyedEntry( inArray, inEntry );
+		
+		return replacement;
+	}
+	
+	return LEORebalanceArrayEntry( inEntry );
+}
+
+
+static LEOValuePtr	LEOGetArrayValueForKeyInSubtree( struct LEOArrayKeyedEntry* inEntry, const char* inKey )
+{
+	struct LEOArrayKeyedEntry*	currEntry = inEntry;
 	
 	while( currEntry )
 	{
-		int			cmpResult = strcasecmp( currEntry->key, inKey );
-		if( cmpResult > 0 )	// Key is larger? Go down 'larger' side one step.
-			currEntry = currEntry->largerItem;
-		else if( cmpResult < 0 )	// Key is smaller? Go down 'smaller' side one step.
+		int			cmpResult = LEOCompareArrayKeys( inKey, currEntry->key );
+		if( cmpResult < 0 )	// Key sorts before this one? Go down 'smaller' side one step.
 			currEntry = currEntry->smallerItem;
-		else if( cmpResult == 0 )	// Found key!
+		else if( cmpResult > 0 )	// Key sorts after this one? Go down 'larger' side one step.
+			currEntry = currEntry->largerItem;
+		else	// Found key!
 			return &currEntry->value;
 	}
 	
@@ -5548,142 +6323,528 @@ LEOValuePtr		LEOGetArrayValueForKey( struct LEOArrayEntry* arrayPtr, const char*
 }
 
 
-void	LEOPrintArray( struct LEOArrayEntry* arrayPtr, char* strBuf, size_t bufSize, struct LEOContext* inContext )
+void	LEOArrayKeyedEntryIteratorInit( struct LEOArrayKeyedEntryIterator* outIterator, struct LEOArrayEntry* arrayPtr )
 {
-	if( bufSize <= 1 )
-		return;
-	
-	strBuf[0] = 0;
-	if( arrayPtr == NULL )
-		return;
+	outIterator->numPendingEntries = 0;
+	for( struct LEOArrayKeyedEntry* currEntry = (arrayPtr ? arrayPtr->keyedItems : NULL); currEntry; currEntry = currEntry->smallerItem )
+		outIterator->pendingEntries[outIterator->numPendingEntries++] = currEntry;
+}
+
+
+struct LEOArrayKeyedEntry*	LEOArrayKeyedEntryIteratorNext( struct LEOArrayKeyedEntryIterator* ioIterator )
+{
+	if( ioIterator->numPendingEntries == 0 )
+		return NULL;
 	
-	char valBuf[1024];
+	// Next entry is the one whose smaller subtree we just finished, after that
+	//	come the ones in its larger subtree, smallest first:
+	struct LEOArrayKeyedEntry*	nextEntry = ioIterator->pendingEntries[--ioIterator->numPendingEntries];
+	for( struct LEOArrayKeyedEntry* currEntry = nextEntry->largerItem; currEntry; currEntry = currEntry->smallerItem )
+		ioIterator->pendingEntries[ioIterator->numPendingEntries++] = currEntry;
 	
-	const char* valStr = LEOGetValueAsString( &arrayPtr->value, valBuf, sizeof(valBuf), inContext );
-	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
-		return;
+	return nextEntry;
+}
+
+
+// Copy the keyed part of arrayPtr into the arena of arrayCopy, keeping the tree's shape:
+static void	LEOCopyArrayKeyedItems( struct LEOArrayEntry* arrayPtr, struct LEOArrayEntry* arrayCopy, struct LEOContext* inContext )
+{
+	struct LEOArrayKeyedEntry	*	pendingEntries[LEO_ARRAY_MAX_TREE_HEIGHT +1];
+	struct LEOArrayKeyedEntry	**	pendingCopyDestinations[LEO_ARRAY_MAX_TREE_HEIGHT +1];
+	size_t							numPendingEntries = 0;
 	
-	size_t	offs = snprintf( strBuf, bufSize, "%s:", arrayPtr->key );
-	for( int x = 0; true; x++ )
+	arrayCopy->keyedItems = NULL;
+	if( arrayPtr->keyedItems )
 	{
-		if( (bufSize -offs) == 0 )
+		pendingEntries[0] = arrayPtr->keyedItems;
+		pendingCopyDestinations[0] = &arrayCopy->keyedItems;
+		numPendingEntries = 1;
+	}
+	while( numPendingEntries > 0 )
+	{
+		numPendingEntries--;
+		struct LEOArrayKeyedEntry*	currEntry = pendingEntries[numPendingEntries];
+		struct LEOArrayKeyedEntry*	entryCopy = LEOAllocNewKeyedEntry( arrayCopy, currEntry->key, SIZE_MAX, &currEntry->value, inContext );
+		*pendingCopyDestinations[numPendingEntries] = entryCopy;
+		if( !entryCopy )
+			continue;
+		entryCopy->height = currEntry->height;
+		
+		// We only ever have one sibling per level waiting, so this fits:
+		if( currEntry->largerItem )
 		{
-			strBuf[offs] = 0;
-			break;
+			pendingEntries[numPendingEntries] = currEntry->largerItem;
+			pendingCopyDestinations[numPendingEntries++] = &entryCopy->largerItem;
 		}
-		if( valStr[x] == '\n' || valStr[x] == '\r' )	// Replace with "¬\n" resp. "¬\r" (2-byte char + line feed).
+		if( currEntry->smallerItem )
 		{
-			strBuf[offs++] = 0xc2;
-			if( (bufSize -offs) == 0 )
-			{
-				strBuf[offs -1] = 0;
-				break;
-			}
-			strBuf[offs++] = 0xac;
-			if( (bufSize -offs) == 0 )
-			{
-				strBuf[offs -2] = 0;
-				break;
-			}
-			strBuf[offs++] = valStr[x];
+			pendingEntries[numPendingEntries] = currEntry->smallerItem;
+			pendingCopyDestinations[numPendingEntries++] = &entryCopy->smallerItem;
 		}
-		else if( valStr[x] == (char)0xc2 )
+	}
+}
+
+
+// Clean up the values in the keyed part. The entries themselves go away
+//	with the arena, except for ones with huge keys, which are freed here:
+static void	LEOCleanUpArrayKeyedItems( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
+{
+	struct LEOArrayKeyedEntryIterator	iterator;
+	struct LEOArrayKeyedEntry		*	currEntry = NULL;
+	
+	LEOArrayKeyedEntryIteratorInit( &iterator, arrayPtr );
+	while( (currEntry = LEOArrayKeyedEntryIteratorNext( &iterator )) )
+	{
+		LEOCleanUpValue( &currEntry->value, kLEOInvalidateReferences, inContext );
+		if( LEOArrayKeyedEntrySizeClass( LEOArrayKeyedEntrySize( strlen(currEntry->key) ) ) >= LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES )
+			free( currEntry );
+	}
+	arrayPtr->keyedItems = NULL;
+	arrayPtr->numKeyedItems = 0;
+}
+
+
+static void	LEOFreeArrayKeyedEntryArena( struct LEOArrayKeyedEntryArena* inArena )
+{
+	struct LEOArrayKeyedEntryBlock*	currBlock = inArena->blocks;
+	while( currBlock )
+	{
+		struct LEOArrayKeyedEntryBlock*	nextBlock = currBlock->nextBlock;
+		free( currBlock );
+		currBlock = nextBlock;
+	}
+	memset( inArena, 0, sizeof(struct LEOArrayKeyedEntryArena) );
+}
+
+
+#pragma mark Indexed items
+
+// Make sure the list part of the array has room for at least inMinCapacity items:
+static bool	LEOGrowArrayIndexedItems( struct LEOArrayEntry* inArray, size_t inMinCapacity, struct LEOContext* inContext )
+{
+	if( inMinCapacity <= inArray->indexedItemsCapacity )
+		return true;
+	
+	size_t		newCapacity = inArray->indexedItemsCapacity ? (inArray->indexedItemsCapacity * 2) : LEO_MIN_ARRAY_INDEXED_ITEMS_CAPACITY;
+	while( newCapacity < inMinCapacity )
+		newCapacity *= 2;
+	
+	bool		haveReferences = false;
+	for( size_t x = 0; x < inArray->numIndexedItems && !haveReferences; x++ )
+		haveReferences = (inArray->indexedItems[x].base.refObjectID != kLEOObjectIDINVALID);
+	
+	union LEOValue*	oldItems = inArray->indexedItems;
+	union LEOValue*	newItems = NULL;
+	if( haveReferences && inContext )	// References need the old block to still be there while we relocate them:
+	{
+		newItems = malloc( newCapacity * sizeof(union LEOValue) );
+		if( newItems )
 		{
-			if( valStr[x+1] == (char)0xac )
-			{
-				x++;
-				
-				strBuf[offs++] = 0xc2;
-				if( (bufSize -offs) == 0 )
-				{
-					strBuf[offs -1] = 0;
-					break;
-				}
-				strBuf[offs++] = 0xac;
-				if( (bufSize -offs) == 0 )
-				{
-					strBuf[offs -2] = 0;
-					break;
-				}
-				strBuf[offs++] = 0xc2;
-				if( (bufSize -offs) == 0 )
-				{
-					strBuf[offs -1] = 0;
-					break;
-				}
-				strBuf[offs++] = 0xac;
-				if( (bufSize -offs) == 0 )
-				{
-					strBuf[offs -2] = 0;
-					break;
-				}
-			}
-			else
-				strBuf[offs++] = valStr[x];
+			memmove( newItems, oldItems, inArray->numIndexedItems * sizeof(union LEOValue) );
+			LEOContextGroupRelocatePointersInRange( inContext->group, oldItems, inArray->numIndexedItems * sizeof(union LEOValue), newItems );
+			free( oldItems );
 		}
-		else
-			strBuf[offs++] = valStr[x];
-		if( (bufSize -offs) <= 1 )
-		{
-			strBuf[offs] = 0;
+	}
+	else
+		newItems = realloc( oldItems, newCapacity * sizeof(union LEOValue) );
+	if( !newItems )
+	{
+		printf( "*** Failed to allocate array items! ***\n" );
+		return false;
+	}
+	
+	inArray->indexedItems = newItems;
+	inArray->indexedItemsCapacity = newCapacity;
+	
+	return true;
+}
+
+
+// Keys that come right after the list part may have been added before it got
+//	that long. Move them over from the keyed part:
+static void	LEOMoveKeyedEntriesToIndexedItems( struct LEOArrayEntry* inArray, struct LEOContext* inContext )
+{
+	while( inArray->keyedItems )
+	{
+		struct LEOArrayKeyedEntry*	smallestEntry = inArray->keyedItems;
+		while( smallestEntry->smallerItem )
+			smallestEntry = smallestEntry->smallerItem;
+		size_t		theIndex = 0;
+		if( !LEOGetArrayKeyAsIndex( smallestEntry->key, &theIndex ) || theIndex != (inArray->numIndexedItems +1) )
 			break;
-		}
-		if( valStr[x] == 0 )
+		if( !LEOGrowArrayIndexedItems( inArray, theIndex, inContext ) )
 			break;
+		
+		inArray->keyedItems = LEORemoveSmallestArrayEntryFromSubtree( inArray->keyedItems, &smallestEntry );
+		LEOMoveArrayValue( &smallestEntry->value, inArray->indexedItems +inArray->numIndexedItems, inContext );
+		inArray->numIndexedItems++;
+		LEOFreeKeyedEntry( inArray, smallestEntry );
 	}
-	if( (bufSize -offs) > 0 )
+}
+
+
+static LEOValuePtr	LEOAppendArrayIndexedItem( struct LEOArrayEntry* inArray, LEOValuePtr inValue, struct LEOContext* inContext )
+{
+	size_t		newItemIndex = inArray->numIndexedItems;
+	size_t		inValueIndex = SIZE_MAX;	// In case we're appending a copy of one of our own items.
+	if( inValue >= inArray->indexedItems && inValue < (inArray->indexedItems +inArray->numIndexedItems) )
+		inValueIndex = inValue -inArray->indexedItems;
+	
+	if( !LEOGrowArrayIndexedItems( inArray, newItemIndex +1, inContext ) )
+		return NULL;
+	if( inValueIndex != SIZE_MAX )
+		inValue = inArray->indexedItems +inValueIndex;
+	
+	LEOValuePtr	newValue = inArray->indexedItems +newItemIndex;
+	memset( newValue, 0, sizeof(union LEOValue) );
+	if( inValue )
+		LEOInitCopy( inValue, newValue, kLEOInvalidateReferences, inContext );
+	inArray->numIndexedItems++;
+	
+	LEOMoveKeyedEntriesToIndexedItems( inArray, inContext );
+	
+	return inArray->indexedItems +newItemIndex;	// Moving keyed entries over may have moved the items.
+}
+
+
+// The list part can't have gaps, so when an item is deleted from the middle,
+//	the ones after it are moved to the keyed part:
+static void	LEODeleteArrayIndexedItem( struct LEOArrayEntry* inArray, size_t inIndex, struct LEOContext* inContext )
+{
+	char		keyStr[LEO_MAX_ARRAY_KEY_SIZE] = { 0 };
+	
+	LEOCleanUpValue( inArray->indexedItems +inIndex -1, kLEOInvalidateReferences, inContext );
+	for( size_t x = inIndex; x < inArray->numIndexedItems; x++ )
 	{
-		strBuf[offs -1] = '\n';
-		strBuf[offs++] = 0;
+		LEOValuePtr	keyedValue = NULL;
+		snprintf( keyStr, sizeof(keyStr), "%zu", x +1 );
+		inArray->keyedItems = LEOAddArrayEntryToSubtree( inArray, inArray->keyedItems, keyStr, strlen(keyStr), NULL, &keyedValue, inContext );
+		if( keyedValue )
+			LEOMoveArrayValue( inArray->indexedItems +x, keyedValue, inContext );
+		else
+			LEOCleanUpValue( inArray->indexedItems +x, kLEOInvalidateReferences, inContext );
 	}
+	inArray->numIndexedItems = inIndex -1;
+}
+
+
+static struct LEOArrayEntry*	LEODeepCopyArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry*	arrayCopy = LEOCreateEmptyArray();
+	if( !arrayCopy )
+		return NULL;
 	
-	if( arrayPtr->smallerItem )
+	if( arrayPtr->numIndexedItems > 0 && LEOGrowArrayIndexedItems( arrayCopy, arrayPtr->numIndexedItems, inContext ) )
 	{
-		offs = strlen(strBuf);
-		LEOPrintArray( arrayPtr->smallerItem, strBuf +offs, bufSize -offs, inContext );
+		memset( arrayCopy->indexedItems, 0, arrayPtr->numIndexedItems * sizeof(union LEOValue) );
+		for( size_t x = 0; x < arrayPtr->numIndexedItems; x++ )
+			LEOInitCopy( arrayPtr->indexedItems +x, arrayCopy->indexedItems +x, kLEOInvalidateReferences, inContext );
+		arrayCopy->numIndexedItems = arrayPtr->numIndexedItems;
 	}
-	if( arrayPtr->largerItem )
+	LEOCopyArrayKeyedItems( arrayPtr, arrayCopy, inContext );
+	
+	return arrayCopy;
+}
+
+
+// Give the array in *arrayPtrByReference its own copy of the items if it shares
+//	them with other arrays, so it can be modified. Returns the array, or NULL
+//	if it's empty or we ran out of memory.
+static struct LEOArrayEntry*	LEOMakeArrayUnique( struct LEOArrayEntry** arrayPtrByReference, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry*	theArray = *arrayPtrByReference;
+	if( theArray && theArray->referenceCount > 1 )
 	{
-		offs = strlen(strBuf);
-		LEOPrintArray( arrayPtr->largerItem, strBuf +offs, bufSize -offs, inContext );
+		struct LEOArrayEntry*	arrayCopy = LEODeepCopyArray( theArray, inContext );
+		if( !arrayCopy )
+			return NULL;
+		theArray->referenceCount--;
+		*arrayPtrByReference = theArray = arrayCopy;
 	}
+	return theArray;
 }
 
 
-size_t	LEOGetArrayKeyCount( struct LEOArrayEntry* arrayPtr )
+#pragma mark Array API
+
+LEOValuePtr	LEOAddArrayEntryWithIndexToRoot( struct LEOArrayEntry** arrayPtrByReference, size_t inIndex, LEOValuePtr inValue, struct LEOContext* inContext )
 {
-	if( arrayPtr == NULL )
-		return 0;
+	if( *arrayPtrByReference == NULL )
+		*arrayPtrByReference = LEOCreateEmptyArray();
+	struct LEOArrayEntry*	theArray = LEOMakeArrayUnique( arrayPtrByReference, inContext );
+	if( theArray == NULL )
+		return NULL;
 	
-	size_t	numEntries = 1;
+	if( inIndex >= 1 && inIndex <= theArray->numIndexedItems )	// Key already exists? Replace value!
+	{
+		LEOValuePtr	existingValue = theArray->indexedItems +inIndex -1;
+		LEOCleanUpValue( existingValue, kLEOKeepReferences, inContext );
+		if( inValue )
+			LEOInitCopy( inValue, existingValue, kLEOKeepReferences, inContext );
+		return existingValue;
+	}
+	else if( inIndex == (theArray->numIndexedItems +1) )
+		return LEOAppendArrayIndexedItem( theArray, inValue, inContext );
 	
-	if( arrayPtr->smallerItem )
-		numEntries += LEOGetArrayKeyCount( arrayPtr->smallerItem );
+	// Would leave a gap in the list part? Add it to the keyed part:
+	char			keyStr[LEO_MAX_ARRAY_KEY_SIZE] = { 0 };
+	LEOValuePtr		outValue = NULL;
+	snprintf( keyStr, sizeof(keyStr), "%zu", inIndex );
+	theArray->keyedItems = LEOAddArrayEntryToSubtree( theArray, theArray->keyedItems, keyStr, strlen(keyStr), inValue, &outValue, inContext );
+	return outValue;
+}
+
+
+// Like LEOAddArrayEntryToRoot, but the key doesn't need to be NUL-terminated:
+static LEOValuePtr	LEOAddArrayEntryWithKeyOfLengthToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, size_t inKeyLen, LEOValuePtr inValue, struct LEOContext* inContext )
+{
+	size_t		theIndex = 0;
+	if( LEOGetArrayKeyOfLengthAsIndex( inKey, inKeyLen, &theIndex ) )
+		return LEOAddArrayEntryWithIndexToRoot( arrayPtrByReference, theIndex, inValue, inContext );
 	
-	if( arrayPtr->largerItem )
-		numEntries += LEOGetArrayKeyCount( arrayPtr->largerItem );
+	if( *arrayPtrByReference == NULL )
+		*arrayPtrByReference = LEOCreateEmptyArray();
+	struct LEOArrayEntry*	theArray = LEOMakeArrayUnique( arrayPtrByReference, inContext );
+	if( theArray == NULL )
+		return NULL;
 	
-	return numEntries;
+	LEOValuePtr		outValue = NULL;
+	theArray->keyedItems = LEOAddArrayEntryToSubtree( theArray, theArray->keyedItems, inKey, inKeyLen, inValue, &outValue, inContext );
+	return outValue;
 }
 
 
-void	LEOCleanUpArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
+LEOValuePtr	LEOAddArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, LEOValuePtr inValue, struct LEOContext* inContext )
+{
+	return LEOAddArrayEntryWithKeyOfLengthToRoot( arrayPtrByReference, inKey, strlen(inKey), inValue, inContext );
+}
+
+
+void	LEODeleteArrayEntryFromRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, struct LEOContext* inContext )
+{
+	if( *arrayPtrByReference == NULL )
+		return;
+	struct LEOArrayEntry*	theArray = LEOMakeArrayUnique( arrayPtrByReference, inContext );
+	if( theArray == NULL )
+		return;
+	
+	size_t		theIndex = 0;
+	if( LEOGetArrayKeyAsIndex( inKey, &theIndex ) && theIndex <= theArray->numIndexedItems )
+		LEODeleteArrayIndexedItem( theArray, theIndex, inContext );
+	else
+		theArray->keyedItems = LEODeleteArrayEntryFromSubtree( theArray, theArray->keyedItems, inKey, inContext );
+	
+	if( theArray->numIndexedItems == 0 && theArray->keyedItems == NULL )	// Deleted last entry? Array is empty, and empty arrays are NULL.
+	{
+		LEOCleanUpArray( theArray, inContext );
+		*arrayPtrByReference = NULL;
+	}
+}
+
+
+struct LEOArrayEntry*	LEOCopyArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
 {
 	if( !arrayPtr )
-		return;	// Nothing to do, never added a value to the array.
+		return NULL;
+	
+	// References to items must keep pointing at the items of the original, and
+	//	go away with it, so those arrays need a real copy:
+	if( arrayPtr->itemsMayBeReferenced )
+		return LEODeepCopyArray( arrayPtr, inContext );
 	
-	if( arrayPtr->smallerItem )
+	arrayPtr->referenceCount++;
+	return arrayPtr;
+}
+
+
+void	LEOPrepareArrayForItemReferences( struct LEOArrayEntry** arrayPtrByReference, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry*	theArray = LEOMakeArrayUnique( arrayPtrByReference, inContext );
+	if( theArray )
+		theArray->itemsMayBeReferenced = true;
+}
+
+
+LEOValuePtr		LEOGetArrayValueForIndex( struct LEOArrayEntry* arrayPtr, size_t inIndex )
+{
+	if( !arrayPtr )
+		return NULL;
+	
+	if( inIndex >= 1 && inIndex <= arrayPtr->numIndexedItems )
+		return arrayPtr->indexedItems +inIndex -1;
+	
+	if( !arrayPtr->keyedItems )
+		return NULL;
+	
+	char		keyStr[LEO_MAX_ARRAY_KEY_SIZE] = { 0 };
+	snprintf( keyStr, sizeof(keyStr), "%zu", inIndex );
+	return LEOGetArrayValueForKeyInSubtree( arrayPtr->keyedItems, keyStr );
+}
+
+
+LEOValuePtr		LEOGetArrayValueForKey( struct LEOArrayEntry* arrayPtr, const char* inKey )
+{
+	if( !arrayPtr )
+		return NULL;
+	
+	size_t		theIndex = 0;
+	if( arrayPtr->numIndexedItems > 0 && LEOGetArrayKeyAsIndex( inKey, &theIndex ) && theIndex <= arrayPtr->numIndexedItems )
+		return arrayPtr->indexedItems +theIndex -1;
+	
+	return LEOGetArrayValueForKeyInSubtree( arrayPtr->keyedItems, inKey );
+}
+
+
+// Print one "key:value\n" line of an array:
+// Parses the "key:value\n" form LEOPrintArray generates. A return preceded by
+//	"¬" is part of the value, not the end of the entry:
+struct LEOArrayEntry	*	LEOCreateArrayFromString( const char* inString, size_t inStringLen, struct LEOContext* inContext )
+{
+	struct LEOArrayEntry*	theArray = NULL;
+	size_t					entryStartOffs = 0;
+	
+	while( entryStartOffs < inStringLen )
 	{
-		LEOCleanUpArray( arrayPtr->smallerItem, inContext );
-		arrayPtr->smallerItem = NULL;
+		const char*	keyStart = inString +entryStartOffs;
+		const char*	colon = memchr( keyStart, ':', inStringLen -entryStartOffs );
+		if( !colon )	// Trailing text without a colon is ignored.
+			break;
+		size_t		keyLen = colon -keyStart;
+		if( keyLen == 0 )	// Error, not a valid array!
+		{
+			LEOCleanUpArray( theArray, inContext );
+			return NULL;
+		}
+		
+		size_t		valueStartOffs = (colon -inString) +1,
+					valueEndOffs = valueStartOffs;
+		while( valueEndOffs < inStringLen )
+		{
+			char	currCh = inString[valueEndOffs];
+			if( (currCh == '\n' || currCh == '\r')
+				&& (valueEndOffs <= 1 || inString[valueEndOffs -2] != ((char)0xc2) || inString[valueEndOffs -1] != ((char)0xac)) )	// Is a real return end-of-entry, not an escaped return in data?
+				break;
+			valueEndOffs++;
+		}
+		
+		LEOValuePtr	newValue = LEOAddArrayEntryWithKeyOfLengthToRoot( &theArray, keyStart, keyLen, NULL, inContext );
+		if( newValue )
+			LEOInitStringValue( newValue, inString +valueStartOffs, valueEndOffs -valueStartOffs, kLEOInvalidateReferences, inContext );
+		
+		entryStartOffs = valueEndOffs +1;	// Skip the return, it's a delimiter, not part of the value.
 	}
-	if( arrayPtr->largerItem )
+	
+	return theArray;
+}
+
+
+// Append "key:value\n" to ioBuilder, escaping returns in the value as "¬\n"
+//	resp. "¬\r" and any "¬" as "¬¬":
+static void	LEOPrintArrayEntry( const char* inKey, size_t inKeyLen, LEOValuePtr inValue, LEOStringBuilder* ioBuilder, struct LEOContext* inContext )
+{
+	struct LEOStringView	valView;
+	LEOGetValueAsStringView( inValue, &valView, inContext );	// Not limited in size, nested arrays included.
+	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 	{
-		LEOCleanUpArray( arrayPtr->largerItem, inContext );
-		arrayPtr->smallerItem = NULL;
+		LEOCleanUpStringView( &valView );
+		return;
 	}
 	
-	LEOCleanUpValue( &arrayPtr->value, kLEOInvalidateReferences, inContext );
+	LEOStringBuilderAppend( ioBuilder, inKey, inKeyLen );
+	LEOStringBuilderAppend( ioBuilder, ":", 1 );
+	
+	// Copy runs of characters that don't need escaping in one go:
+	const char*	valStr = valView.string;
+	size_t		runStart = 0, x = 0;
+	for( ; x < valView.stringLen; x++ )
+	{
+		if( valStr[x] == '\n' || valStr[x] == '\r' )
+		{
+			LEOStringBuilderAppend( ioBuilder, valStr +runStart, x -runStart );
+			LEOStringBuilderAppend( ioBuilder, "\xc2\xac", 2 );
+			runStart = x;	// Return itself goes out with the next run.
+		}
+		else if( valStr[x] == (char)0xc2 && valStr[x +1] == (char)0xac )
+		{
+			LEOStringBuilderAppend( ioBuilder, valStr +runStart, x -runStart );
+			LEOStringBuilderAppend( ioBuilder, "\xc2\xac\xc2\xac", 4 );
+			x++;
+			runStart = x +1;
+		}
+	}
+	LEOStringBuilderAppend( ioBuilder, valStr +runStart, x -runStart );
+	LEOStringBuilderAppend( ioBuilder, "\n", 1 );
+	
+	LEOCleanUpStringView( &valView );
+}
+
+
+void	LEOPrintArrayToStringBuilder( struct LEOArrayEntry* arrayPtr, LEOStringBuilder* ioBuilder, struct LEOContext* inContext )
+{
+	if( arrayPtr == NULL )
+		return;
+	
+	// List part first, then the keyed part, which sorts after it:
+	char	keyStr[32] = { 0 };
+	for( size_t x = 0; x < arrayPtr->numIndexedItems; x++ )
+	{
+		size_t	keyLen = snprintf( keyStr, sizeof(keyStr), "%zu", x +1 );
+		LEOPrintArrayEntry( keyStr, keyLen, arrayPtr->indexedItems +x, ioBuilder, inContext );
+		if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+			return;
+	}
+	
+	struct LEOArrayKeyedEntryIterator	iterator;
+	struct LEOArrayKeyedEntry		*	currEntry = NULL;
+	LEOArrayKeyedEntryIteratorInit( &iterator, arrayPtr );
+	while( (currEntry = LEOArrayKeyedEntryIteratorNext( &iterator )) )
+	{
+		LEOPrintArrayEntry( currEntry->key, strlen(currEntry->key), &currEntry->value, ioBuilder, inContext );
+		if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+			return;
+	}
+}
+
+
+void	LEOPrintArray( struct LEOArrayEntry* arrayPtr, char* strBuf, size_t bufSize, struct LEOContext* inContext )
+{
+	if( bufSize <= 1 )
+		return;
+	
+	LEOStringBuilder	arrayStr;
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( arrayPtr, &arrayStr, inContext );
+	size_t		numBytes = (arrayStr.stringLen < bufSize) ? arrayStr.stringLen : (bufSize -1);
+	memmove( strBuf, LEOStringBuilderGetCString( &arrayStr ), numBytes );
+	strBuf[numBytes] = 0;
+	LEOStringBuilderCleanUp( &arrayStr );
+}
+
+
+size_t	LEOGetArrayKeyCount( struct LEOArrayEntry* arrayPtr )
+{
+	if( arrayPtr == NULL )
+		return 0;
+	
+	return arrayPtr->numIndexedItems +arrayPtr->numKeyedItems;
+}
+
+
+void	LEOCleanUpArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext )
+{
+	if( !arrayPtr )
+		return;	// Nothing to do, never added a value to the array.
+	
+	if( --arrayPtr->referenceCount > 0 )	// Someone else is still using our items.
+		return;
+	
+	for( size_t x = 0; x < arrayPtr->numIndexedItems; x++ )
+		LEOCleanUpValue( arrayPtr->indexedItems +x, kLEOInvalidateReferences, inContext );
+	if( arrayPtr->indexedItems )
+		free( arrayPtr->indexedItems );
+	LEOCleanUpArrayKeyedItems( arrayPtr, inContext );
+	LEOFreeArrayKeyedEntryArena( &arrayPtr->keyedItemsArena );
+	
 	free( arrayPtr );
 }
 
@@ -116,9 +116,12 @@ enum
 
 extern const char*	gUnitLabels[kLEOUnit_Last +1];	// first item is none (empty string), last is a NULL (hence +1). Rest is suffixes for each unit.
 extern LEOUnitGroup	gUnitGroupsForLabels[kLEOUnit_Last +1];
+extern size_t		gLEONumStringValueAllocations;	// How often a dynamic string value had to allocate memory for its characters. Only for benchmarks.
 
 struct LEOContext;
 struct LEOArrayEntry;
+struct LEOStringBuilder;
+struct LEOStringView;
 
 
 /*! Layout of the virtual function tables for all the LEOValue subclasses:
@@ -181,6 +184,35 @@ struct LEOValueType
 	void		(*GetValueAsRange)( LEOValuePtr self, LEOInteger *s, LEOInteger *e, LEOChunkType *t, struct LEOContext* inContext );
 
 	bool		(*CanGetAsInteger)( LEOValuePtr self, struct LEOContext* inContext );
+	
+	void		(*GetAsStringView)( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext );	// Borrows the value's own string if it has one, never truncates. If NULL, LEOGetAnyValueAsStringView() is used.
+};
+
+
+/*! Size of the buffer in a LEOStringView for strings that had to be generated. */
+#define LEO_STRING_VIEW_SHORT_STRING_MAX_LENGTH		256
+
+
+/*!
+	The string representation of a value as obtained by LEOGetValueAsStringView().
+	If the value holds its string already, this just points to it, otherwise it
+	holds a generated string. Dispose of it using LEOCleanUpStringView().
+	@field	string			The NUL-terminated string. If this belongs to the
+							value, it is only valid as long as the value isn't
+							changed or disposed of.
+	@field	stringLen		The length of string in bytes, not counting the NUL.
+							The string may contain NUL bytes before this.
+	@field	spilledString	A heap block holding a generated string that didn't
+							fit in shortString, or NULL.
+	@field	shortString		Where short generated strings, like the string
+							representation of a number, are kept.
+*/
+struct LEOStringView
+{
+	const char*	string;
+	size_t		stringLen;
+	char*		spilledString;
+	char		shortString[LEO_STRING_VIEW_SHORT_STRING_MAX_LENGTH];
 };
 
 
@@ -251,21 +283,87 @@ struct LEOValueInteger
 typedef struct LEOValueInteger	LEOValueInteger;
 
 
+/*!
+	The longest string (in bytes, not counting the terminating NUL) that a
+	dynamic string value keeps inside the value itself instead of allocating
+	memory for it.
+*/
+#define	LEO_SHORT_STRING_MAX_LENGTH		15
+
+
+/*!
+	A reference-counted block of memory holding the characters of long dynamic
+	string values. Copies of a string value share its buffer, and a value may
+	reference just a range of it. Once shared, the characters never change, a
+	value that wants to modify its string gets a buffer of its own instead.
+	@field	refCount	The number of string values referencing this buffer.
+	@field	capacity	The size of the characters array, in bytes.
+	@field	chunkIndexes	A list of chunk offset tables for the string that
+						starts at characters, one for each chunk type that was
+						looked up in it repeatedly. Any change to the
+						characters must release these.
+	@field	wasChunkScanned	Whether the string was scanned for chunks from its
+						start before, without building an index for it.
+	@field	chunkCursor	Where in the string a chunk was last found, so
+						looking up the next chunks doesn't need to scan from
+						the start. Any change to the characters must reset this.
+	@field	characters	The characters. The string this buffer was created for
+						is NUL-terminated, ranges of it usually aren't.
+*/
+struct LEOStringBuffer
+{
+	size_t					refCount;
+	size_t					capacity;
+	struct LEOChunkIndex*	chunkIndexes;
+	bool					wasChunkScanned;
+	struct LEOChunkCursor	chunkCursor;
+	char					characters[];
+};
+
+
+/*!
+	What a dynamic string value keeps about a string that was too long to keep
+	inline.
+	@field	sharedBuffer	The buffer that string points into.
+	@field	parsedArray	The array this string was parsed into the last time it
+						was used as one, or NULL. Any change to the string must
+						release this.
+*/
+struct LEOValueStringBuffer
+{
+	struct LEOStringBuffer*	sharedBuffer;
+	struct LEOArrayEntry*	parsedArray;
+};
+
+
 /*!
 	This is used both for strings we dynamically allocated, and for ones referencing
 	C string constants built into the program:
 	It can happen that such a string value gets turned from constant into an
 	dynamic one or back.
+	Dynamic strings of up to LEO_SHORT_STRING_MAX_LENGTH bytes are kept in
+	storage.shortString and have a NULL string pointer, as a value may be
+	moved to another address at any time. Use LEOStringValueCharacters() to get
+	at the characters of either kind.
 	@field	base	The instance variables inherited from the base class.
-	@field	string	A pointer to the string constant, or to a malloced block
-					of memory holding the string, depending on what kind of
-					string class it is.
+	@field	string	A pointer to the string constant, or into the shared
+					buffer holding the string, depending on what kind of
+					string class it is. NULL for short dynamic strings.
+	@field	stringLen	The length of the string in bytes, not counting the
+					terminating NUL.
+	@field	storage	Only used by dynamic strings: The characters of a short
+					string, or the shared buffer of a long one.
 */
 struct LEOValueString
 {
-	struct LEOValueBase	base;
-	char*				string;
-	size_t				stringLen;
+	struct LEOValueBase		base;
+	char*					string;
+	size_t					stringLen;
+	union
+	{
+		struct LEOValueStringBuffer	buffer;
+		char						shortString[LEO_SHORT_STRING_MAX_LENGTH +1];
+	}						storage;
 };
 typedef struct LEOValueString	LEOValueString;
 
@@ -384,7 +482,7 @@ typedef struct LEOValueReference	LEOValueReference;
 	Arrays in our language are <i>associative</i> arrays, so they're not necessarily
 	continuously numbered, but rather contain items associated with a string.
 	@field	base	The instance variables inherited from the base class.
-	@field	array	Pointer to the root of a B-tree that holds all the array items.
+	@field	array	The array items, a list part for the keys "1" through "N" and a balanced (AVL) tree for all other keys.
 */
 struct LEOValueArray
 {
@@ -463,6 +561,53 @@ void		LEOInitIntegerValue( LEOValuePtr inStorage, LEOInteger inNumber, LEOUnit i
 */
 void		LEOInitStringValue( LEOValuePtr inStorage, const char* inString, size_t inLen, LEOKeepReferencesFlag keepReferences, struct LEOContext *inContext );
 
+/*!
+	Initialize the given storage so it's a valid string value containing the
+	bytes from inStart to inEnd of inString, which must be what
+	LEOGetValueAsString() returned for inValue. If inValue is (or references)
+	a long dynamic string and the range makes up at least half of its buffer,
+	the new value shares its characters instead of copying them.
+
+	@seealso //leo_ref/c/func/LEOInitStringValue LEOInitStringValue
+*/
+void		LEOInitStringValueWithRangeOfValue( LEOValuePtr inStorage, LEOValuePtr inValue, const char* inString, size_t inStart, size_t inEnd, LEOKeepReferencesFlag keepReferences, struct LEOContext *inContext );
+
+/*!
+	Determine the byte ranges of a chunk of inString like LEOGetChunkRanges()
+	does, where inString must be what LEOGetValueAsString() or
+	LEOGetValueAsStringView() returned for inValue, and inStringLen its
+	length. If inValue is (or references) a long dynamic string that chunks
+	are looked up in repeatedly, the offsets of all its chunks are remembered,
+	so the n-th chunk can be found without scanning the string again.
+
+	@seealso //leo_ref/c/func/LEOGetChunkRanges LEOGetChunkRanges
+	@seealso //leo_ref/c/func/LEOGetChunkCountOfValue LEOGetChunkCountOfValue
+*/
+void		LEOGetChunkRangesOfValue( LEOValuePtr inValue, const char* inString, size_t inStringLen, LEOChunkType inType,
+										size_t inRangeStart, size_t inRangeEnd,
+										size_t *outChunkStart, size_t *outChunkEnd,
+										size_t *outDelChunkStart, size_t *outDelChunkEnd,
+										struct LEOContext *inContext );
+
+/*!
+	Return the number of chunks of the given type in inString, which must be
+	what LEOGetValueAsString() or LEOGetValueAsStringView() returned for
+	inValue, and inStringLen its length. Like
+	LEOGetChunkRangesOfValue(), this uses and builds the chunk index of a long
+	dynamic string.
+
+	@seealso //leo_ref/c/func/LEOGetChunkRangesOfValue LEOGetChunkRangesOfValue
+*/
+size_t		LEOGetChunkCountOfValue( LEOValuePtr inValue, const char* inString, size_t inStringLen, LEOChunkType inType, struct LEOContext *inContext );
+
+/*!
+	Dispose of the string in a LEOStringView obtained using
+	LEOGetValueAsStringView(), if it had to be generated.
+
+	@seealso //leo_ref/c/func/LEOGetValueAsStringView LEOGetValueAsStringView
+*/
+void		LEOCleanUpStringView( struct LEOStringView* ioView );
+
 /*!
 	Initialize the given storage so it's a valid string constant value directly
 	referencing the given string. The caller is responsible for ensuring that
@@ -797,6 +942,16 @@ void		LEOInitArrayVariantValue( LEOValuePtr self, struct LEOArrayEntry* array, L
 */
 #define		LEOGetStringValueSize()				(kLeoValueTypeString.size)		
 
+/*!
+	@function LEOStringValueCharacters
+	Returns a pointer to the characters of a dynamic or constant string value
+	(or string variant). A dynamic string that shares a range of another
+	string's characters is not NUL-terminated, so use string.stringLen, or call
+	LEOGetValueAsString() if you need a C string. Short strings live inside the
+	value, so the pointer is only valid as long as the value isn't changed or moved.
+*/
+#define		LEOStringValueCharacters(v)			(((LEOValuePtr)(v))->string.string ? ((LEOValuePtr)(v))->string.string : ((LEOValuePtr)(v))->string.storage.shortString)
+
 /*!
 	@function LEOGetStringConstantValueSize
 	Returns the size (in bytes) of storage you need to provide to LEOInitCopy for
@@ -896,6 +1051,25 @@ void		LEOInitArrayVariantValue( LEOValuePtr self, struct LEOArrayEntry* array, L
 */
 #define 	LEOGetValueAsString(v,s,l,c)	((LEOValuePtr)(v))->base.isa->GetAsString(((LEOValuePtr)(v)),(s),(l),(c))
 
+/*!
+	@function LEOGetValueAsStringView
+	Provides the entire string representation of the given value, converting
+	it, if necessary. Unlike LEOGetValueAsString(), the string is never
+	truncated, and values that hold a string just lend you theirs instead of
+	copying it. Call LEOCleanUpStringView() once you're done with the string.
+	If conversion isn't possible, it will fail with an error message and stop
+	execution in the current LEOContext, and give you an empty string.
+	@param	v	The value you wish to read.
+	@param	sv	A pointer to an uninitialized struct LEOStringView to fill out.
+	@param	c	The context in which your script is currently running and in
+				which errors will be stored.
+	Value types that were written before GetAsStringView existed don't have
+	it, those get their string using GetAsString, which is called again with
+	larger buffers if the string fills the one it was given.
+	@seealso //leo_ref/c/func/LEOCleanUpStringView LEOCleanUpStringView
+*/
+#define 	LEOGetValueAsStringView(v,sv,c)	(((LEOValuePtr)(v))->base.isa->GetAsStringView ? ((LEOValuePtr)(v))->base.isa->GetAsStringView : LEOGetAnyValueAsStringView)(((LEOValuePtr)(v)),(sv),(c))
+
 /*!
 	@function LEOGetValueAsBoolean
 	Returns the given value as a <tt>bool</tt>, converting it, if necessary.
@@ -1100,7 +1274,10 @@ void		LEOInitArrayVariantValue( LEOValuePtr self, struct LEOArrayEntry* array, L
 				which errors will be stored.
 	@result		A LEOValuePtr pointing to the actual value in the array. If this is equal to
 				t, you need to call LEOCleanUpValue on it.
-
+	
+	As this gives you a reference to the item, the array can't share its items
+	with copies of it anymore. If you only want to read an item, use
+	LEOGetArrayValueForKey() on the array itself.
 */
 #define 	LEOGetValueForKey(v,ak,t,k,c)			((LEOValuePtr)(v))->base.isa->GetValueForKey(((LEOValuePtr)(v)),(ak),(t),(k),(c))
 
@@ -1377,6 +1554,7 @@ void		LEODetermineChunkRangeOfSubstringOfAnyValue( LEOValuePtr self, size_t *ioB
 														size_t *ioBytesDelStart, size_t *ioBytesDelEnd,
 														LEOChunkType inType, size_t inRangeStart, size_t inRangeEnd,
 														struct LEOContext* inContext );
+void		LEOGetAnyValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext );	// Uses GetAsString, with ever larger buffers until the string fits.
 
 // Number instance methods:
 LEONumber	LEOGetNumberValueAsNumber( LEOValuePtr self, LEOUnit *outUnit, struct LEOContext* inContext );
@@ -1420,6 +1598,9 @@ void		LEOSetStringValueRangeAsString( LEOValuePtr self, LEOChunkType inType,
 void		LEOSetStringValuePredeterminedRangeAsString( LEOValuePtr self,
 												size_t inRangeStart, size_t inRangeEnd,
 												const char* inBuf, struct LEOContext* inContext );
+void		LEOSetStringValuePredeterminedRangeAsStringOfLength( LEOValuePtr self,
+												size_t inRangeStart, size_t inRangeEnd,
+												const char* inBuf, size_t inBufLen, struct LEOContext* inContext );	// Only for dynamic strings. inBuf may contain NUL bytes.
 bool		LEOCanGetStringValueAsNumber( LEOValuePtr self, struct LEOContext* inContext );
 void		LEOSetStringValueAsNativeObject( LEOValuePtr self, void* inNativeObject, struct LEOContext* inContext );
 void		LEOInitStringValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
@@ -1428,7 +1609,8 @@ void		LEODetermineChunkRangeOfSubstringOfStringValue( LEOValuePtr self, size_t *
 															size_t *ioBytesDelStart, size_t *ioBytesDelEnd,
 															LEOChunkType inType, size_t inRangeStart, size_t inRangeEnd,
 															struct LEOContext* inContext );
-LEOValuePtr	LEOGetStringValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
+LEOValuePtr	LEOGetStringValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );	// Keeps the parsed array around until the string changes.
+size_t		LEOGetStringValueKeyCount( LEOValuePtr self, struct LEOContext* inContext );
 void		LEOCleanUpStringValue( LEOValuePtr self, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
 void		LEOSetStringValueAsRect( LEOValuePtr self, LEOInteger l, LEOInteger t, LEOInteger r, LEOInteger b, struct LEOContext* inContext );
 void		LEOSetStringValueAsPoint( LEOValuePtr self, LEOInteger l, LEOInteger t, struct LEOContext* inContext );
@@ -1437,6 +1619,7 @@ void		LEOGetStringValueAsRect( LEOValuePtr self, LEOInteger *l, LEOInteger *t, L
 void		LEOGetStringValueAsPoint( LEOValuePtr self, LEOInteger *l, LEOInteger *t, struct LEOContext* inContext );
 void		LEOGetStringValueAsRange( LEOValuePtr self, LEOInteger *s, LEOInteger *e, LEOChunkType *t, struct LEOContext* inContext );
 bool		LEOCanGetStringValueAsInteger( LEOValuePtr self, struct LEOContext* inContext );
+void		LEOGetStringValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext );	// Also used for constant strings.
 
 // Replacement assignment methods and destructors for constant-referencing strings:
 void		LEOSetStringConstantValueAsNumber( LEOValuePtr self, LEONumber inNumber, LEOUnit inUnit, struct LEOContext* inContext );	// Makes it a dynamically allocated string.
@@ -1560,6 +1743,7 @@ void		LEOGetReferenceValueForKeyOfRange( LEOValuePtr self, const char* keyName,
 void		LEOSetReferenceValueForKeyOfRange( LEOValuePtr self, const char* keyName, LEOValuePtr inValue, size_t startOffset, size_t endOffset, struct LEOContext* inContext );
 bool		LEOGetReferenceValueIsUnset( LEOValuePtr self, struct LEOContext * inContext );
 bool		LEOCanGetReferenceValueAsInteger( LEOValuePtr self, struct LEOContext* inContext );
+void		LEOGetReferenceValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext );
 
 
 // Variant-specific replacements for certain instance methods:
@@ -1579,6 +1763,7 @@ void		LEOSetVariantValuePredeterminedRangeAsString( LEOValuePtr self,
 											const char* inBuf, struct LEOContext* inContext );
 LEOValuePtr	LEOGetStringVariantValueForKey( LEOValuePtr self, const char* keyName, union LEOValue *tempStorage, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );	// Converts the variant into an array, otherwise references can't change the value of a key (e.g. 'add' command).
 void		LEOSetStringVariantValueValueForKey( LEOValuePtr self, const char* keyName, LEOValuePtr inValue, struct LEOContext* inContext );
+size_t		LEOGetStringVariantValueKeyCount( LEOValuePtr self, struct LEOContext* inContext );	// Converts the variant into an array, like LEOGetStringVariantValueForKey.
 void		LEOInitNumberVariantValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
 void		LEOInitIntegerVariantValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
 void		LEOInitBooleanVariantValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
@@ -1595,6 +1780,7 @@ void		LEOInitArrayValue( struct LEOValueArray* self, struct LEOArrayEntry *inArr
 void		LEOInitArrayValueCopy( LEOValuePtr self, LEOValuePtr dest, LEOKeepReferencesFlag keepReferences, struct LEOContext* inContext );
 void		LEOPutArrayValueIntoValue( LEOValuePtr self, LEOValuePtr dest, struct LEOContext* inContext );
 const char*	LEOGetArrayValueAsString( LEOValuePtr self, char* outBuf, size_t bufSize, struct LEOContext* inContext );
+void		LEOGetArrayValueAsStringView( LEOValuePtr self, struct LEOStringView* outView, struct LEOContext* inContext );
 void		LEOGetArrayValueAsRangeOfString( LEOValuePtr self, LEOChunkType inType,
 												size_t inRangeStart, size_t inRangeEnd,
 												char* outBuf, size_t bufSize, struct LEOContext* inContext );
@@ -1617,11 +1803,15 @@ void		LEOSetArrayValueAsPoint( LEOValuePtr self, LEOInteger l, LEOInteger t, str
 struct LEOArrayEntry	*	LEOAllocNewEntry( const char* inKey, LEOValuePtr inValue /* may be NULL */, struct LEOContext* inContext );
 struct LEOArrayEntry	*	LEOCreateArrayFromString( const char* inString, size_t inStringLen, struct LEOContext* inContext );
 LEOValuePtr					LEOAddArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, LEOValuePtr inValue /* may be NULL */, struct LEOContext* inContext );
+LEOValuePtr					LEOAddArrayEntryWithIndexToRoot( struct LEOArrayEntry** arrayPtrByReference, size_t inIndex, LEOValuePtr inValue /* may be NULL */, struct LEOContext* inContext );	// Same as LEOAddArrayEntryToRoot with the index as a string key, but faster.
 void						LEODeleteArrayEntryFromRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, struct LEOContext* inContext );
-struct LEOArrayEntry*		LEOCopyArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext );
-LEOValuePtr					LEOGetArrayValueForKey( struct LEOArrayEntry* arrayPtr, const char* inKey );
-size_t						LEOGetArrayKeyCount( struct LEOArrayEntry* arrayPtr );
-void						LEOPrintArray( struct LEOArrayEntry* arrayPtr, char* strBuf, size_t bufSize, struct LEOContext* inContext );
+struct LEOArrayEntry*		LEOCopyArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext );	// Copies share their items until one of them is modified.
+void						LEOPrepareArrayForItemReferences( struct LEOArrayEntry** arrayPtrByReference, struct LEOContext* inContext );	// Call before creating a reference to a value in the array.
+LEOValuePtr					LEOGetArrayValueForKey( struct LEOArrayEntry* arrayPtr, const char* inKey );	// Don't modify the value unless you called LEOPrepareArrayForItemReferences, it may be shared.
+LEOValuePtr					LEOGetArrayValueForIndex( struct LEOArrayEntry* arrayPtr, size_t inIndex );	// Same as LEOGetArrayValueForKey with the index as a string key, but faster.
+size_t						LEOGetArrayKeyCount( struct LEOArrayEntry* arrayPtr );	// Doesn't need to look at the entries, so is fast even for huge arrays.
+void						LEOPrintArray( struct LEOArrayEntry* arrayPtr, char* strBuf, size_t bufSize, struct LEOContext* inContext );	// Truncates to fit in strBuf.
+void						LEOPrintArrayToStringBuilder( struct LEOArrayEntry* arrayPtr, struct LEOStringBuilder* ioBuilder, struct LEOContext* inContext );	// Appends the whole array, however long it is.
 void						LEOCleanUpArray( struct LEOArrayEntry* arrayPtr, struct LEOContext* inContext );
 
 // Convenience wrappers around LEOAddArrayEntryToRoot:
@@ -1634,13 +1824,72 @@ LEOValuePtr	LEOAddRectArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReferen
 LEOValuePtr	LEOAddPointArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, LEOInteger l, LEOInteger t, struct LEOContext* inContext );
 LEOValuePtr	LEOAddArrayArrayEntryToRoot( struct LEOArrayEntry** arrayPtrByReference, const char* inKey, LEOValueArray* inArray, struct LEOContext* inContext );
 
-// One array entry:
+// One entry in the keyed part of an array. These are kept in an AVL tree,
+//	sorted case-insensitively by key, except that keys that are positive
+//	integers ("1", "2" ... "10") sort numerically and before all other keys:
+struct LEOArrayKeyedEntry
+{
+	struct LEOArrayKeyedEntry	*	smallerItem;	// Subtree of entries with keys that sort before this one's.
+	struct LEOArrayKeyedEntry	*	largerItem;		// Subtree of entries with keys that sort after this one's.
+	size_t							height;			// Number of levels in the subtree starting at this entry, 1 for a leaf.
+	union LEOValue					value;
+	char							key[1];	// Must be last, dynamically sized array.
+};
+
+#define LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES		8
+
+// Memory the keyed entries of an array are carved out of, so adding an entry
+//	doesn't need its own malloc() and the whole tree can be freed in one go.
+//	Entries are sized in steps of 16 bytes depending on their key length, and
+//	deleted ones are kept on a free list per size, to be reused by new entries.
+//	Entries with keys too long for any size class are malloc()ed individually.
+struct LEOArrayKeyedEntryBlock
+{
+	struct LEOArrayKeyedEntryBlock	*	nextBlock;
+	size_t								size;		// Number of bytes after this header.
+	size_t								usedSize;	// Number of bytes after this header that have been handed out.
+	size_t								reserved;	// Keeps the entries after the header 16-byte aligned.
+};
+
+struct LEOArrayKeyedEntryArena
+{
+	struct LEOArrayKeyedEntryBlock	*	blocks;		// Most recently allocated block first. Entries are carved from this one.
+	size_t								numBlocks;
+	struct LEOArrayKeyedEntry		*	freeEntries[LEO_ARRAY_KEYED_ENTRY_NUM_SIZE_CLASSES];	// Deleted entries, linked through their smallerItem field.
+};
+
+// Height no keyed part of an array can reach. An AVL tree this deep would need
+//	more entries than fit in memory:
+#define LEO_ARRAY_MAX_TREE_HEIGHT			96
+
+// Walks the keyed part of an array in key order without recursing, so even
+//	huge arrays don't run out of stack. You may free the entry you just got
+//	from LEOArrayKeyedEntryIteratorNext before getting the next one:
+struct LEOArrayKeyedEntryIterator
+{
+	struct LEOArrayKeyedEntry	*	pendingEntries[LEO_ARRAY_MAX_TREE_HEIGHT];	// Entries whose smaller subtree we're in.
+	size_t							numPendingEntries;
+};
+
+void						LEOArrayKeyedEntryIteratorInit( struct LEOArrayKeyedEntryIterator* outIterator, struct LEOArrayEntry* arrayPtr );
+struct LEOArrayKeyedEntry*	LEOArrayKeyedEntryIteratorNext( struct LEOArrayKeyedEntryIterator* ioIterator );	// Returns NULL after the last entry.
+
+// An associative array. NULL is an empty array. Since most arrays are really
+//	lists, the values for the keys "1" through "numIndexedItems" are kept in a
+//	plain C array, and only the other keys go in the keyed part. (The name is
+//	historical, this used to be the root entry of the tree.)
+//	Copies of an array share the same LEOArrayEntry until one of them is
+//	modified, at which point the modified one gets its own copy.
 struct LEOArrayEntry
 {
-	struct LEOArrayEntry	*	smallerItem;
-	struct LEOArrayEntry	*	largerItem;
-	union LEOValue				value;
-	char						key[1];	// Must be last, dynamically sized array.
+	size_t							referenceCount;			// Number of array values using these items.
+	bool							itemsMayBeReferenced;	// Someone may have created references to the values in here, so they can't be shared.
+	size_t							numIndexedItems;		// Number of values in indexedItems.
+	size_t							indexedItemsCapacity;	// Number of values indexedItems has room for.
+	union LEOValue				*	indexedItems;			// The values for the keys "1" through "numIndexedItems", in order.
+	struct LEOArrayKeyedEntry	*	keyedItems;				// Root of the tree of all other entries.
+	size_t							numKeyedItems;			// Number of entries in keyedItems.
+	struct LEOArrayKeyedEntryArena	keyedItemsArena;		// Memory keyedItems are allocated from.
 };
 
 
@@ -8,14 +8,19 @@
  */
 
 #include "LEOInterpreter.h"
+#include "LEOInstructions.h"
+#include "LEOProfiler.h"
 #include "LEOChunks.h"
 #include "LEOContextGroup.h"
 #include "LEOScript.h"
+#include "LEOStringUtilities.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include "UTF8UTF32Utilities.h"
+#include "AnsiStrings.h"
 
 
 bool		gAnyTestFailed = false;
@@ -1045,6 +1050,2481 @@ void	DoUnicodeTests( void )
 }
 
 
+// Pushes the number 5, a reference to it, and then numPushes more integers
+//	onto the stack, so the stack has to grow while a reference points into it.
+static LEOContext*	RunStackGrowthLoop( LEOContextGroup* group, uint32_t numPushes )
+{
+	LEOInstruction		instructions[] =
+	{
+		{ LINE_MARKER_INSTR, 0, 1 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 5 },
+		{ PUSH_REFERENCE_INSTR, 0, 0 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, numPushes },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 1 },
+		{ ADD_INTEGER_INSTR, 2, (uint32_t) -1 },
+		{ JUMP_RELATIVE_IF_GT_ZERO_INSTR, 2, (uint32_t) -2 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	
+	LEORunInContext( instructions, ctx );
+	ctx->currentInstruction = NULL;	// instructions is about to go out of scope.
+	
+	return ctx;
+}
+
+
+void	DoStackGrowthTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	
+	printf( "\nnote: Stack growth tests\n" );
+	
+	LEOContext		*	ctx = RunStackGrowthLoop( group, 100 );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackSize >= 103 && ctx->stackSize <= LEO_STACK_SIZE );
+	ASSERT( ctx->stackEndPtr == ctx->stack +103 );
+	ASSERT( ctx->stackBasePtr == ctx->stack );
+	ASSERT( LEOGetValueAsInteger( ctx->stack +1, NULL, ctx ) == 5 );	// Reference still finds its value after the stack moved?
+	LEOContextRelease( ctx );
+	
+	ctx = RunStackGrowthLoop( group, LEO_STACK_SIZE * 2 );
+	ASSERT_STRING_MATCH( ctx->errMsg, "Stack overflow." );
+	ASSERT( ctx->stackEndPtr <= ctx->stack +LEO_STACK_SIZE );
+	LEOContextRelease( ctx );
+	
+	// Pushing a copy of something that's on the stack itself, when that moves the stack:
+	char			str[100] = { 0 };
+	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOPushStringValueOnStack( ctx, "Stack value", 11 );
+	while( ctx->stackEndPtr < ctx->stack +ctx->stackSize )
+		LEOPushIntegerOnStack( ctx, 0, kLEOUnitNone );
+	LEOValuePtr		copiedValue = LEOPushValueOnStack( ctx, ctx->stack );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( copiedValue, str, sizeof(str), ctx ), "Stack value" );
+	while( ctx->stackEndPtr < ctx->stack +ctx->stackSize )
+		LEOPushIntegerOnStack( ctx, 0, kLEOUnitNone );
+	copiedValue = LEOPushStringValueOnStack( ctx, LEOGetValueAsString( ctx->stack, NULL, 0, ctx ), 11 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( copiedValue, str, sizeof(str), ctx ), "Stack value" );
+	LEOContextRelease( ctx );
+	
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_BENCHMARK_NUM_MESSAGES			200000
+
+
+// Simulates a host sending LEO_BENCHMARK_NUM_MESSAGES short messages, each
+//	with its own context, and returns how long that took in seconds.
+static double	RunContextCreationBenchmark( LEOContextGroup* group, bool usePool )
+{
+	LEOInstruction		instructions[] =
+	{
+		{ LINE_MARKER_INSTR, 0, 1 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 41 },
+		{ ADD_INTEGER_INSTR, BACK_OF_STACK, 1 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	bool		allSucceeded = true;
+	
+	clock_t		startTime = clock();
+	for( size_t x = 0; x < LEO_BENCHMARK_NUM_MESSAGES; x++ )
+	{
+		LEOContext	*	ctx = usePool ? LEOContextCreateFromPool( group, NULL, NULL ) : LEOContextCreate( group, NULL, NULL );
+		LEORunInContextFast( instructions, ctx );
+		if( ctx->errMsg[0] != 0 || LEOGetValueAsInteger( ctx->stack, NULL, ctx ) != 42 )
+			allSucceeded = false;
+		LEOContextRelease( ctx );
+	}
+	clock_t		endTime = clock();
+	
+	ASSERT( allSucceeded );
+	
+	return (endTime -startTime) / (double)CLOCKS_PER_SEC;
+}
+
+
+void	DoContextPoolBenchmark( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	
+	printf( "\nnote: Context pool tests\n" );
+	
+	LEOContextGroupSetMaxPooledContexts( group, 4 );
+	LEOContext		*	firstCtx = LEOContextCreateFromPool( group, NULL, NULL );
+	firstCtx->itemDelimiter = ';';
+	firstCtx->flags &= ~kLEOContextKeepRunning;
+	strlcpy( firstCtx->errMsg, "Old error", sizeof(firstCtx->errMsg) );
+	LEOPushIntegerOnStack( firstCtx, 1, kLEOUnitNone );
+	LEOContext		*	secondCtx = LEOContextCreateFromPool( group, NULL, NULL );
+	ASSERT( secondCtx != firstCtx );
+	ASSERT( group->contextPool.highWaterMark == 2 );
+	LEOContextRelease( firstCtx );
+	ASSERT( group->contextPool.numIdleContexts == 1 );
+	LEOContext		*	reusedCtx = LEOContextCreateFromPool( group, NULL, NULL );
+	ASSERT( reusedCtx == firstCtx );
+	ASSERT( reusedCtx->itemDelimiter == ',' );
+	ASSERT( reusedCtx->errMsg[0] == 0 );
+	ASSERT( reusedCtx->flags == kLEOContextKeepRunning );
+	ASSERT( reusedCtx->stackEndPtr == NULL || reusedCtx->stackEndPtr == reusedCtx->stack );
+	ASSERT( reusedCtx->numCallStackEntries == 0 );
+	ASSERT( group->contextPool.hits == 1 && group->contextPool.misses == 2 );
+	LEOContextRelease( reusedCtx );
+	LEOContextRelease( secondCtx );
+	ASSERT( group->contextPool.numIdleContexts == 2 );
+	ASSERT( group->contextPool.numContextsInUse == 0 );
+	
+	double		unpooledSeconds = RunContextCreationBenchmark( group, false );
+	printf( "note: LEOContextCreate: %d messages in %f seconds (%.0f messages/sec)\n", LEO_BENCHMARK_NUM_MESSAGES, unpooledSeconds, LEO_BENCHMARK_NUM_MESSAGES / unpooledSeconds );
+	double		pooledSeconds = RunContextCreationBenchmark( group, true );
+	printf( "note: LEOContextCreateFromPool: %d messages in %f seconds (%.0f messages/sec)\n", LEO_BENCHMARK_NUM_MESSAGES, pooledSeconds, LEO_BENCHMARK_NUM_MESSAGES / pooledSeconds );
+	printf( "note: Pool hits: %zu misses: %zu high-water mark: %zu\n", group->contextPool.hits, group->contextPool.misses, group->contextPool.highWaterMark );
+	
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_BENCHMARK_LOOP_ITERATIONS		2000000
+
+
+// Counts down from LEO_BENCHMARK_LOOP_ITERATIONS in a tight loop of
+//	(LINE_MARKER, ADD_INTEGER, JUMP_RELATIVE_IF_GT_ZERO) and returns the time it
+//	took in seconds, and the number of instructions executed in outNumInstructions.
+static double	RunInterpreterBenchmarkLoop( bool useFastLoop, bool fuseInstructions, size_t *outNumInstructions )
+{
+	LEOInstruction		instructions[] =
+	{
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_BENCHMARK_LOOP_ITERATIONS },
+		{ LINE_MARKER_INSTR, 0, 1 },
+		{ ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 },
+		{ JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -2 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextGroupRelease( group );
+	
+	if( fuseInstructions )
+		LEOFuseInstructions( instructions, sizeof(instructions) / sizeof(LEOInstruction) );
+	
+	clock_t		startTime = clock();
+	if( useFastLoop )
+		LEORunInContextFast( instructions, ctx );
+	else
+		LEORunInContext( instructions, ctx );
+	clock_t		endTime = clock();
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +1 );
+	ASSERT( LEOGetValueAsInteger( ctx->stack, NULL, ctx ) == 0 );
+	
+	LEOContextRelease( ctx );
+	
+	*outNumInstructions = 2 + (LEO_BENCHMARK_LOOP_ITERATIONS * 3);
+	return (endTime -startTime) / (double)CLOCKS_PER_SEC;
+}
+
+
+void	DoInterpreterBenchmark( void )
+{
+	size_t		numInstructions = 0;
+	
+	printf( "\nnote: Interpreter loop benchmark\n" );
+	
+	double		slowSeconds = RunInterpreterBenchmarkLoop( false, false, &numInstructions );
+	printf( "note: LEORunInContext: %lu instructions in %f seconds (%.0f instructions/sec)\n", numInstructions, slowSeconds, numInstructions / slowSeconds );
+	double		fastSeconds = RunInterpreterBenchmarkLoop( true, false, &numInstructions );
+	printf( "note: LEORunInContextFast: %lu instructions in %f seconds (%.0f instructions/sec)\n", numInstructions, fastSeconds, numInstructions / fastSeconds );
+	double		fusedSeconds = RunInterpreterBenchmarkLoop( true, true, &numInstructions );
+	printf( "note: LEORunInContextFast with fused instructions: %lu instructions in %f seconds (%.0f instructions/sec)\n", numInstructions, fusedSeconds, numInstructions / fusedSeconds );
+}
+
+
+void	DoInstructionFusionTest( void )
+{
+	LEOInstruction		instructions[] =
+	{
+		{ LINE_MARKER_INSTR, 0, 7 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 3 },
+		{ LINE_MARKER_INSTR, 0, 8 },
+		{ LINE_MARKER_INSTR, 0, 9 },
+		{ ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 },
+		{ JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -3 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	size_t				numInstructions = sizeof(instructions) / sizeof(LEOInstruction);
+	size_t				lineNo = 0;
+	uint16_t			fileID = 0;
+	
+	LEOSetInstructionFusionMode( kLEOInstructionFusionOff );
+	LEOFuseInstructions( instructions, numInstructions );
+	ASSERT( instructions[0].instructionID == LINE_MARKER_INSTR );
+	ASSERT( instructions[4].instructionID == ADD_INTEGER_INSTR );
+	
+	LEOSetInstructionFusionMode( kLEOInstructionFusionAll );
+	LEOFuseInstructions( instructions, numInstructions );
+	ASSERT( instructions[0].instructionID == LINE_MARKER_AND_NEXT_INSTR );
+	ASSERT( instructions[2].instructionID == LINE_MARKER_INSTR );	// Next one is a line marker, too.
+	ASSERT( instructions[3].instructionID == LINE_MARKER_AND_NEXT_INSTR );
+	ASSERT( instructions[4].instructionID == ADD_INTEGER_AND_JUMP_IF_GT_ZERO_INSTR );
+	ASSERT( instructions[5].instructionID == JUMP_RELATIVE_IF_GT_ZERO_INSTR );	// Still there for jumps.
+	ASSERT( instructions[5].param2 == (uint32_t) -3 );
+	
+	LEOInstructionsFindLineForInstruction( instructions +1, &lineNo, &fileID );
+	ASSERT( lineNo == 7 );
+	LEOInstructionsFindLineForInstruction( instructions +5, &lineNo, &fileID );
+	ASSERT( lineNo == 9 );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextGroupRelease( group );
+	LEORunInContext( instructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +1 );
+	ASSERT( LEOGetValueAsInteger( ctx->stack, NULL, ctx ) == 0 );
+	LEOContextRelease( ctx );
+	
+	// Profile the unfused code, then only fuse the pairs that actually ran:
+	LEOInstruction		profiledInstructions[] =
+	{
+		{ LINE_MARKER_INSTR, 0, 1 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 5 },
+		{ ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 },
+		{ JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -1 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 },
+		{ EQUAL_OPERATOR_INSTR, 0, 0 },	// Never reached.
+		{ JUMP_RELATIVE_IF_FALSE_INSTR, 0, 0 }
+	};
+	numInstructions = sizeof(profiledInstructions) / sizeof(LEOInstruction);
+	LEOResetInstructionPairCounts();
+	group = LEOContextGroupCreate( NULL, NULL );
+	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextGroupRelease( group );
+	ctx->preInstructionProc = LEOInstructionPairProfilePreInstructionProc;
+	LEORunInContext( profiledInstructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	LEOContextRelease( ctx );
+	ASSERT( LEOGetInstructionPairCount( ADD_INTEGER_INSTR, JUMP_RELATIVE_IF_GT_ZERO_INSTR ) == 5 );
+	ASSERT( LEOGetInstructionPairCount( EQUAL_OPERATOR_INSTR, JUMP_RELATIVE_IF_FALSE_INSTR ) == 0 );
+	
+	LEOSetInstructionFusionMode( kLEOInstructionFusionProfileGuided );
+	LEOFuseInstructions( profiledInstructions, numInstructions );
+	ASSERT( profiledInstructions[2].instructionID == ADD_INTEGER_AND_JUMP_IF_GT_ZERO_INSTR );
+	ASSERT( profiledInstructions[5].instructionID == EQUAL_OPERATOR_INSTR );
+	
+	LEOSetInstructionFusionMode( kLEOInstructionFusionAll );
+	LEOResetInstructionPairCounts();
+	ASSERT( LEOGetInstructionPairCount( ADD_INTEGER_INSTR, JUMP_RELATIVE_IF_GT_ZERO_INSTR ) == 0 );
+}
+
+
+#define LEO_PROFILER_TEST_NESTED_LINES		1000
+
+
+void	ProfilerTestNestedRunInstruction( LEOContext* inContext )
+{
+	LEOInstruction	nestedInstructions[LEO_PROFILER_TEST_NESTED_LINES +1];
+	for( int x = 0; x < LEO_PROFILER_TEST_NESTED_LINES; x++ )
+	{
+		nestedInstructions[x].instructionID = LINE_MARKER_INSTR;
+		nestedInstructions[x].param1 = 0;
+		nestedInstructions[x].param2 = x +1;
+	}
+	nestedInstructions[LEO_PROFILER_TEST_NESTED_LINES].instructionID = EXIT_TO_TOP_INSTR;
+	nestedInstructions[LEO_PROFILER_TEST_NESTED_LINES].param1 = 0;
+	nestedInstructions[LEO_PROFILER_TEST_NESTED_LINES].param2 = 0;
+	
+	LEOContext	*	nestedCtx = LEOContextCreate( inContext->group, NULL, NULL );
+	LEORunInContext( nestedInstructions, nestedCtx );
+	LEOContextRelease( nestedCtx );
+	
+	inContext->currentInstruction++;
+}
+
+
+LEOINSTR_START(ProfilerTest,1)
+LEOINSTR_LAST(ProfilerTestNestedRunInstruction)
+
+
+void	DoProfilerTest( void )
+{
+	uint16_t			fileID = LEOFileIDForFileName( "ProfilerTest.hc" );
+	LEOInstruction		instructions[] =
+	{
+		{ LINE_MARKER_INSTR, fileID, 1 },
+		{ PUSH_INTEGER_INSTR, kLEOUnitNone, 10 },
+		{ LINE_MARKER_INSTR, fileID, 2 },
+		{ ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 },
+		{ JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -2 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	uint64_t			count = 0, ticks = 0;
+	
+	LEOProfilerReset();
+	LEOProfilerSetEnabled( true );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextGroupRelease( group );
+	LEORunInContextFast( instructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	LEOContextRelease( ctx );
+	
+	LEOProfilerSetEnabled( false );
+	
+	LEOProfilerGetInstructionStats( ADD_INTEGER_INSTR, &count, &ticks );
+	ASSERT( count == 10 );
+	LEOProfilerGetInstructionStats( LINE_MARKER_INSTR, &count, &ticks );
+	ASSERT( count == 11 );
+	LEOProfilerGetLineStats( fileID, 1, &count, &ticks );
+	ASSERT( count == 2 );
+	LEOProfilerGetLineStats( fileID, 2, &count, &ticks );
+	ASSERT( count == 31 );
+	LEOProfilerGetHandlerStats( NULL, &count, &ticks );
+	ASSERT( count == 33 );
+	
+	FILE*	outFile = tmpfile();
+	char	output[4096] = { 0 };
+	LEOProfilerWriteJSON( outFile );
+	rewind( outFile );
+	output[fread( output, 1, sizeof(output) -1, outFile )] = 0;
+	ASSERT( strstr( output, "{ \"name\": \"LEOAddIntegerInstruction\", \"count\": 10," ) != NULL );
+	ASSERT( strstr( output, "{ \"file\": \"ProfilerTest.hc\", \"line\": 2, \"count\": 31," ) != NULL );
+	fclose( outFile );
+	
+	outFile = tmpfile();
+	LEOProfilerWriteFoldedStacks( outFile );
+	rewind( outFile );
+	output[fread( output, 1, sizeof(output) -1, outFile )] = 0;
+	ASSERT( strstr( output, "(no_handler);ProfilerTest.hc:2;LEOAddIntegerInstruction " ) != NULL );
+	fclose( outFile );
+	
+	LEOProfilerReset();
+	LEOProfilerGetInstructionStats( ADD_INTEGER_INSTR, &count, &ticks );
+	ASSERT( count == 0 );
+	
+	// Instructions that run scripts themselves may add so many sites that they get moved,
+	//	and the nested context mustn't change the line of the outer one:
+	LEOInstructionID	firstNestedInstruction = 0;
+	LEOAddInstructionsToInstructionArray( gProfilerTestInstructions, 1, &firstNestedInstruction );
+	LEOInstruction		nestingInstructions[] =
+	{
+		{ LINE_MARKER_INSTR, fileID, LEO_PROFILER_TEST_NESTED_LINES +1 },
+		{ firstNestedInstruction, 0, 0 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	LEOProfilerSetEnabled( true );
+	group = LEOContextGroupCreate( NULL, NULL );
+	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextGroupRelease( group );
+	LEORunInContext( nestingInstructions, ctx );
+	LEOContextRelease( ctx );
+	LEOProfilerSetEnabled( false );
+	LEOProfilerGetInstructionStats( firstNestedInstruction, &count, &ticks );
+	ASSERT( count == 1 );
+	LEOProfilerGetInstructionStats( LINE_MARKER_INSTR, &count, &ticks );
+	ASSERT( count == LEO_PROFILER_TEST_NESTED_LINES +1 );
+	LEOProfilerGetLineStats( fileID, LEO_PROFILER_TEST_NESTED_LINES +1, &count, &ticks );
+	ASSERT( count == 3 );
+	LEOProfilerReset();
+}
+
+
+static void	HandlerProfilerTestNonexistentHandler( LEOContext* inContext, LEOHandlerID inHandler, TMayGoUnhandledFlag mayGoUnhandled )
+{
+	// Just ignore the call, the caller pops the parameters again.
+}
+
+
+static LEOScript*	HandlerProfilerTestGetParentScript( LEOScript* inScript, LEOContext* inContext, void* inParam )
+{
+	return NULL;
+}
+
+
+void	DoHandlerProfilerTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, HandlerProfilerTestGetParentScript );
+	LEOHandlerID		outerID = LEOContextGroupHandlerIDForHandlerName( group, "outer" );
+	LEOHandlerID		innerID = LEOContextGroupHandlerIDForHandlerName( group, "inner" );
+	LEOHandlerID		missingID = LEOContextGroupHandlerIDForHandlerName( group, "missing" );
+	LEOHandler		*	outerHandler = LEOScriptAddCommandHandlerWithID( theScript, outerID );
+	LEOHandlerAddInstruction( outerHandler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( outerHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+	LEOHandlerAddInstruction( outerHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Param count.
+	LEOHandlerAddInstruction( outerHandler, CALL_HANDLER_INSTR, 0, innerID );
+	LEOHandlerAddInstruction( outerHandler, CALL_HANDLER_INSTR, 0, missingID );
+	LEOHandlerAddInstruction( outerHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( outerHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( outerHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	LEOHandler		*	innerHandler = LEOScriptAddCommandHandlerWithID( theScript, innerID );
+	LEOHandlerAddInstruction( innerHandler, LINE_MARKER_INSTR, 0, 2 );
+	LEOHandlerAddInstruction( innerHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	outerHandler = LEOScriptFindCommandHandlerWithID( theScript, outerID );	// Adding inner may have moved it.
+	innerHandler = LEOScriptFindCommandHandlerWithID( theScript, innerID );
+	
+	LEOHandlerProfilerReset();
+	LEOHandlerProfilerSetEnabled( true );
+	
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	ctx->callNonexistentHandlerProc = HandlerProfilerTestNonexistentHandler;
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, outerHandler, theScript, NULL, NULL );
+	LEORunInContext( outerHandler->instructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->numCallStackEntries == 0 );
+	
+	ASSERT( LEOHandlerProfilerGetNumEntries() == 3 );
+	const LEOHandlerProfileEntry*	outerEntry = LEOHandlerProfilerFindEntry( theScript, outerID );
+	const LEOHandlerProfileEntry*	innerEntry = LEOHandlerProfilerFindEntry( theScript, innerID );
+	const LEOHandlerProfileEntry*	missingEntry = LEOHandlerProfilerFindEntry( theScript, missingID );
+	ASSERT( outerEntry != NULL && innerEntry != NULL && missingEntry != NULL );
+	ASSERT( strcmp( outerEntry->handlerName, "outer" ) == 0 );
+	ASSERT( outerEntry->callCount == 1 );
+	ASSERT( innerEntry->callCount == 1 );
+	ASSERT( missingEntry->callCount == 0 );
+	ASSERT( missingEntry->parentScriptFallthroughs == 1 );
+	ASSERT( missingEntry->nonexistentHandlerCalls == 1 );
+	ASSERT( outerEntry->inclusiveNanoseconds >= innerEntry->inclusiveNanoseconds );
+	ASSERT( outerEntry->exclusiveNanoseconds +innerEntry->inclusiveNanoseconds == outerEntry->inclusiveNanoseconds );
+	
+	// Recursion is counted, but only the outermost call adds to the inclusive time:
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, innerHandler, theScript, NULL, NULL );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, innerHandler, theScript, NULL, NULL );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, innerHandler, theScript, NULL, NULL );
+	LEOContextPopHandlerScriptReturnAddressAndBasePtr( ctx );
+	LEOContextPopHandlerScriptReturnAddressAndBasePtr( ctx );
+	ASSERT( innerEntry->callCount == 4 );
+	ASSERT( innerEntry->maxRecursionDepth == 3 );
+	LEOContextRelease( ctx );	// Records the still-running outermost call.
+	ASSERT( innerEntry->inclusiveNanoseconds == innerEntry->exclusiveNanoseconds );
+	
+	LEOHandlerProfilerSetEnabled( false );
+	
+	FILE*	outFile = tmpfile();
+	char	output[4096] = { 0 };
+	LEOHandlerProfilerWriteJSON( outFile );
+	rewind( outFile );
+	output[fread( output, 1, sizeof(output) -1, outFile )] = 0;
+	ASSERT( strstr( output, "{ \"name\": \"missing\"" ) != NULL );
+	ASSERT( strstr( output, "\"parentScriptFallthroughs\": 1, \"nonexistentHandlerCalls\": 1 }" ) != NULL );
+	fclose( outFile );
+	
+	LEOHandlerProfilerReset();
+	ASSERT( LEOHandlerProfilerGetNumEntries() == 0 );
+	ASSERT( LEOHandlerProfilerFindEntry( theScript, outerID ) == NULL );
+	
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoProfilerCallChainTest( void )
+{
+	uint16_t			fileID = LEOFileIDForFileName( "ProfilerCallChainTest.hc" );
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, HandlerProfilerTestGetParentScript );
+	LEOHandlerID		outerID = LEOContextGroupHandlerIDForHandlerName( group, "outer" );
+	LEOHandlerID		otherID = LEOContextGroupHandlerIDForHandlerName( group, "other" );
+	LEOHandlerID		innerID = LEOContextGroupHandlerIDForHandlerName( group, "inner" );
+	LEOHandler		*	outerHandler = LEOScriptAddCommandHandlerWithID( theScript, outerID );
+	LEOHandlerAddInstruction( outerHandler, LINE_MARKER_INSTR, fileID, 1 );
+	LEOHandlerAddInstruction( outerHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+	LEOHandlerAddInstruction( outerHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Param count.
+	LEOHandlerAddInstruction( outerHandler, CALL_HANDLER_INSTR, 0, innerID );
+	LEOHandlerAddInstruction( outerHandler, CALL_HANDLER_INSTR, 0, otherID );
+	LEOHandlerAddInstruction( outerHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( outerHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( outerHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	LEOHandler		*	otherHandler = LEOScriptAddCommandHandlerWithID( theScript, otherID );
+	LEOHandlerAddInstruction( otherHandler, LINE_MARKER_INSTR, fileID, 2 );
+	LEOHandlerAddInstruction( otherHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+	LEOHandlerAddInstruction( otherHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Param count.
+	LEOHandlerAddInstruction( otherHandler, CALL_HANDLER_INSTR, 0, innerID );
+	LEOHandlerAddInstruction( otherHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( otherHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( otherHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	LEOHandler		*	innerHandler = LEOScriptAddCommandHandlerWithID( theScript, innerID );
+	LEOHandlerAddInstruction( innerHandler, LINE_MARKER_INSTR, fileID, 3 );
+	LEOHandlerAddInstruction( innerHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	outerHandler = LEOScriptFindCommandHandlerWithID( theScript, outerID );	// Adding the others may have moved it.
+	
+	LEOProfilerReset();
+	LEOProfilerSetEnabled( true );
+	
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, outerHandler, theScript, NULL, NULL );
+	LEORunInContext( outerHandler->instructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	LEOContextRelease( ctx );
+	
+	LEOProfilerSetEnabled( false );
+	
+	// inner is called from two places, which must show up as separate stacks:
+	FILE*	outFile = tmpfile();
+	char	output[4096] = { 0 };
+	LEOProfilerWriteFoldedStacks( outFile );
+	rewind( outFile );
+	output[fread( output, 1, sizeof(output) -1, outFile )] = 0;
+	ASSERT( strstr( output, "outer;ProfilerCallChainTest.hc:1;" ) != NULL );
+	ASSERT( strstr( output, "outer;inner;ProfilerCallChainTest.hc:3;" ) != NULL );
+	ASSERT( strstr( output, "outer;other;ProfilerCallChainTest.hc:2;" ) != NULL );
+	ASSERT( strstr( output, "outer;other;inner;ProfilerCallChainTest.hc:3;" ) != NULL );
+	fclose( outFile );
+	
+	LEOProfilerReset();
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_CALL_BENCHMARK_HIERARCHY_DEPTH		8
+#define LEO_CALL_BENCHMARK_HANDLERS_PER_SCRIPT	20
+#define LEO_CALL_BENCHMARK_ITERATIONS			200000
+
+
+static LEOScript*	sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH] = { NULL };
+
+
+static LEOScript*	CallBenchmarkGetParentScript( LEOScript* inScript, LEOContext* inContext, void* inParam )
+{
+	for( size_t x = 0; x < (LEO_CALL_BENCHMARK_HIERARCHY_DEPTH -1); x++ )
+	{
+		if( sCallBenchmarkScripts[x] == inScript )
+			return sCallBenchmarkScripts[x +1];
+	}
+	return NULL;
+}
+
+
+// Calls a handler that is in the root of a hierarchy of scripts from its
+//	leaf LEO_CALL_BENCHMARK_ITERATIONS times, returning the time it took.
+static double	RunHandlerCallBenchmark( LEOContextGroup* group, LEOHandlerID targetID )
+{
+	LEOHandlerID	benchID = LEOContextGroupHandlerIDForHandlerName( group, "callBenchmark" );
+	LEOHandler*		benchHandler = LEOScriptFindCommandHandlerWithID( sCallBenchmarkScripts[0], benchID );
+	if( !benchHandler )
+	{
+		benchHandler = LEOScriptAddCommandHandlerWithID( sCallBenchmarkScripts[0], benchID );
+		LEOHandlerAddInstruction( benchHandler, LINE_MARKER_INSTR, 0, 1 );
+		LEOHandlerAddInstruction( benchHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_CALL_BENCHMARK_ITERATIONS );
+		LEOHandlerAddInstruction( benchHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+		LEOHandlerAddInstruction( benchHandler, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Param count.
+		LEOHandlerAddInstruction( benchHandler, CALL_HANDLER_INSTR, 0, targetID );
+		LEOHandlerAddInstruction( benchHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( benchHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( benchHandler, ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 );
+		LEOHandlerAddInstruction( benchHandler, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -6 );
+		LEOHandlerAddInstruction( benchHandler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( benchHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	}
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, benchHandler, sCallBenchmarkScripts[0], NULL, NULL );
+	
+	clock_t		startTime = clock();
+	LEORunInContextFast( benchHandler->instructions, ctx );
+	clock_t		endTime = clock();
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack );
+	LEOContextRelease( ctx );
+	
+	return (endTime -startTime) / (double)CLOCKS_PER_SEC;
+}
+
+
+void	DoHandlerLookupCacheTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOHandlerID		targetID = LEOContextGroupHandlerIDForHandlerName( group, "target" );
+	char				handlerName[64] = { 0 };
+	
+	printf( "\nnote: Handler lookup cache tests\n" );
+	
+	for( size_t x = 0; x < LEO_CALL_BENCHMARK_HIERARCHY_DEPTH; x++ )
+	{
+		sCallBenchmarkScripts[x] = LEOScriptCreateForOwner( 0, 0, CallBenchmarkGetParentScript );
+		for( size_t y = 0; y < LEO_CALL_BENCHMARK_HANDLERS_PER_SCRIPT; y++ )
+		{
+			snprintf( handlerName, sizeof(handlerName), "otherHandler%zu", y );
+			LEOHandler*	otherHandler = LEOScriptAddCommandHandlerWithID( sCallBenchmarkScripts[x], LEOContextGroupHandlerIDForHandlerName( group, handlerName ) );
+			LEOHandlerAddInstruction( otherHandler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+		}
+	}
+	LEOHandler*	rootTarget = LEOScriptAddCommandHandlerWithID( sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH -1], targetID );
+	LEOHandlerAddInstruction( rootTarget, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOHandlerProfilerReset();
+	LEOHandlerProfilerSetEnabled( true );
+	double	cachedSeconds = RunHandlerCallBenchmark( group, targetID );
+	LEOHandlerProfilerSetEnabled( false );
+	ASSERT( group->handlerLookupCache.misses == 1 );
+	ASSERT( group->handlerLookupCache.hits == LEO_CALL_BENCHMARK_ITERATIONS -1 );
+	ASSERT( LEOHandlerProfilerFindEntry( sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH -1], targetID )->callCount == LEO_CALL_BENCHMARK_ITERATIONS );
+	ASSERT( LEOHandlerProfilerFindEntry( sCallBenchmarkScripts[0], targetID )->parentScriptFallthroughs == LEO_CALL_BENCHMARK_ITERATIONS );
+	
+	// Overriding the handler closer to the caller must invalidate the cache:
+	LEOHandler*	middleTarget = LEOScriptAddCommandHandlerWithID( sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH / 2], targetID );
+	LEOHandlerAddInstruction( middleTarget, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	LEOHandlerProfilerReset();
+	LEOHandlerProfilerSetEnabled( true );
+	RunHandlerCallBenchmark( group, targetID );
+	LEOHandlerProfilerSetEnabled( false );
+	ASSERT( group->handlerLookupCache.misses == 2 );
+	ASSERT( LEOHandlerProfilerFindEntry( sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH / 2], targetID )->callCount == LEO_CALL_BENCHMARK_ITERATIONS );
+	ASSERT( LEOHandlerProfilerFindEntry( sCallBenchmarkScripts[LEO_CALL_BENCHMARK_HIERARCHY_DEPTH -1], targetID ) == NULL );
+	LEOHandlerProfilerReset();
+	
+	LEOInvalidateHandlerLookupCaches();
+	RunHandlerCallBenchmark( group, targetID );
+	ASSERT( group->handlerLookupCache.misses == 3 );
+	
+	cachedSeconds = RunHandlerCallBenchmark( group, targetID );
+	group->handlerLookupCache.disabled = true;
+	double	uncachedSeconds = RunHandlerCallBenchmark( group, targetID );
+	group->handlerLookupCache.disabled = false;
+	printf( "note: %d calls through %d scripts: %f seconds uncached (%.0f calls/sec), %f seconds cached (%.0f calls/sec)\n",
+			LEO_CALL_BENCHMARK_ITERATIONS, LEO_CALL_BENCHMARK_HIERARCHY_DEPTH / 2 +1,
+			uncachedSeconds, LEO_CALL_BENCHMARK_ITERATIONS / uncachedSeconds, cachedSeconds, LEO_CALL_BENCHMARK_ITERATIONS / cachedSeconds );
+	
+	for( size_t x = 0; x < LEO_CALL_BENCHMARK_HIERARCHY_DEPTH; x++ )
+	{
+		LEOScriptRelease( sCallBenchmarkScripts[x] );
+		sCallBenchmarkScripts[x] = NULL;
+	}
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_HANDLER_INDEX_TEST_NUM_HANDLERS		300
+#define LEO_HANDLER_INDEX_BENCHMARK_ROUNDS		1000
+
+
+void	DoHandlerIndexTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOHandlerID		handlerIDs[LEO_HANDLER_INDEX_TEST_NUM_HANDLERS];
+	char				handlerName[64] = { 0 };
+	
+	printf( "\nnote: Handler index tests\n" );
+	
+	for( size_t x = 0; x < LEO_HANDLER_INDEX_TEST_NUM_HANDLERS; x++ )
+	{
+		snprintf( handlerName, sizeof(handlerName), "handler%zu", x );
+		handlerIDs[x] = LEOContextGroupHandlerIDForHandlerName( group, handlerName );
+		LEOScriptAddCommandHandlerWithID( theScript, handlerIDs[x] );
+		if( (x % 2) == 0 )
+			LEOScriptAddFunctionHandlerWithID( theScript, handlerIDs[x] );
+	}
+	LEOScriptAddCommandHandlerWithID( theScript, handlerIDs[0] );	// Duplicate, first one should still win.
+	
+	bool	allFound = true;
+	for( size_t x = 0; x < LEO_HANDLER_INDEX_TEST_NUM_HANDLERS; x++ )
+	{
+		LEOHandler*	foundCommand = LEOScriptFindCommandHandlerWithID( theScript, handlerIDs[x] );
+		LEOHandler*	foundFunction = LEOScriptFindFunctionHandlerWithID( theScript, handlerIDs[x] );
+		if( foundCommand != theScript->commands +x || ((x % 2) == 0) != (foundFunction != NULL)
+			|| (foundFunction && foundFunction->handlerName != handlerIDs[x]) )
+			allFound = false;
+	}
+	ASSERT( allFound );
+	ASSERT( LEOScriptFindCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "nonexistentHandler" ) ) == NULL );
+	
+	// Measure lookups against a plain scan of the same array:
+	clock_t		startTime = clock();
+	size_t		numFound = 0;
+	for( size_t r = 0; r < LEO_HANDLER_INDEX_BENCHMARK_ROUNDS; r++ )
+	{
+		for( size_t x = 0; x < LEO_HANDLER_INDEX_TEST_NUM_HANDLERS; x++ )
+		{
+			for( size_t y = 0; y < theScript->numCommands; y++ )
+			{
+				if( theScript->commands[y].handlerName == handlerIDs[x] )
+				{
+					numFound++;
+					break;
+				}
+			}
+		}
+	}
+	double		scanSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	startTime = clock();
+	for( size_t r = 0; r < LEO_HANDLER_INDEX_BENCHMARK_ROUNDS; r++ )
+	{
+		for( size_t x = 0; x < LEO_HANDLER_INDEX_TEST_NUM_HANDLERS; x++ )
+		{
+			if( LEOScriptFindCommandHandlerWithID( theScript, handlerIDs[x] ) )
+				numFound++;
+		}
+	}
+	double		indexSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	ASSERT( numFound == 2 * LEO_HANDLER_INDEX_BENCHMARK_ROUNDS * LEO_HANDLER_INDEX_TEST_NUM_HANDLERS );
+	
+	size_t		handlerArraysSize = (theScript->numCommands +theScript->numFunctions) * sizeof(LEOHandler);
+	size_t		indexSize = LEOScriptGetHandlerIndexMemoryUsage( theScript );
+	ASSERT( indexSize > 0 );
+	printf( "note: %zu commands, %zu functions: index uses %zu bytes (%.1f%% of the %zu bytes of handler structs)\n",
+			theScript->numCommands, theScript->numFunctions, indexSize, (indexSize * 100.0) / handlerArraysSize, handlerArraysSize );
+	printf( "note: %d lookups: %f seconds scanning, %f seconds indexed\n",
+			LEO_HANDLER_INDEX_BENCHMARK_ROUNDS * LEO_HANDLER_INDEX_TEST_NUM_HANDLERS, scanSeconds, indexSeconds );
+	
+	// Small scripts don't need an index:
+	LEOScript*	smallScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOScriptAddCommandHandlerWithID( smallScript, handlerIDs[0] );
+	LEOScriptAddCommandHandlerWithID( smallScript, handlerIDs[1] );
+	ASSERT( LEOScriptGetHandlerIndexMemoryUsage( smallScript ) == 0 );
+	ASSERT( LEOScriptFindCommandHandlerWithID( smallScript, handlerIDs[1] ) == smallScript->commands +1 );
+	LEOScriptRelease( smallScript );
+	
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES	10000
+
+
+void	DoHandlerNameInterningTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	char				handlerName[64] = { 0 };
+	
+	printf( "\nnote: Handler name interning tests\n" );
+	
+	LEOHandlerID	umlautID = LEOContextGroupHandlerIDForHandlerName( group, "\xC3\x84nderung" );	// "Änderung"
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "\xC3\xA4NDERUNG" ) == umlautID );	// "äNDERUNG"
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "Anderung" ) != umlautID );
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "\xC3\x84nderungen" ) != umlautID );
+	ASSERT( strcmp( LEOContextGroupHandlerNameForHandlerID( group, umlautID ), "\xC3\x84nderung" ) == 0 );	// First spelling is kept.
+	
+	// Latin-1 and cut-off UTF8 sequences are compared byte by byte, without reading past the end:
+	char*			latin1Name = strdup( "caf\xE9" );	// "café"
+	char*			cutOffName = strdup( "CAF\xC3" );
+	LEOHandlerID	latin1ID = LEOContextGroupHandlerIDForHandlerName( group, latin1Name );
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "CAF\xE9" ) == latin1ID );
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, cutOffName ) != latin1ID );
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "caf\xC3" ) == LEOContextGroupHandlerIDForHandlerName( group, cutOffName ) );
+	ASSERT( LEOContextGroupHandlerIDForHandlerName( group, "caf" ) != latin1ID );
+	free( latin1Name );
+	free( cutOffName );
+	
+	// Load a big script's worth of handler names:
+	LEOHandlerID	firstID = LEOContextGroupHandlerIDForHandlerName( group, "handler0" );
+	clock_t		startTime = clock();
+	for( size_t x = 1; x < LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES; x++ )
+	{
+		snprintf( handlerName, sizeof(handlerName), "handler%zu", x );
+		LEOContextGroupHandlerIDForHandlerName( group, handlerName );
+	}
+	double		internSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	
+	// Look them all up again, spelled differently:
+	bool		allFound = true;
+	startTime = clock();
+	for( size_t x = 0; x < LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES; x++ )
+	{
+		snprintf( handlerName, sizeof(handlerName), "HANDLER%zu", x );
+		if( LEOContextGroupHandlerIDForHandlerName( group, handlerName ) != firstID +x )
+			allFound = false;
+	}
+	double		lookupSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	ASSERT( allFound );
+	ASSERT( group->numHandlerNames == firstID +LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES );
+	ASSERT( strcmp( LEOContextGroupHandlerNameForHandlerID( group, firstID +1234 ), "handler1234" ) == 0 );
+	
+	// For comparison, what a linear search through the names costs:
+	startTime = clock();
+	size_t		numFound = 0;
+	for( size_t x = 0; x < LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES; x++ )
+	{
+		snprintf( handlerName, sizeof(handlerName), "HANDLER%zu", x );
+		for( LEOHandlerID y = 0; y < group->numHandlerNames; y++ )
+		{
+			if( strcasecmp( group->handlerNames[y], handlerName ) == 0 )
+			{
+				numFound++;
+				break;
+			}
+		}
+	}
+	double		scanSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	ASSERT( numFound == LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES );
+	
+	printf( "note: %d handler names: %f seconds interning, %f seconds hashed lookup, %f seconds linear lookup\n",
+			LEO_HANDLER_NAME_BENCHMARK_NUM_NAMES, internSeconds, lookupSeconds, scanSeconds );
+	
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_REFERENCE_BENCHMARK_CYCLES	1000000
+
+
+void	DoReferenceTableBenchmark( void )
+{
+	size_t			tableSizes[] = { 1000, 10000, 100000 };
+	char			dummyValues[4] = { 0 };
+	
+	printf( "\nnote: Reference table benchmark\n" );
+	
+	for( size_t s = 0; s < sizeof(tableSizes) / sizeof(size_t); s++ )
+	{
+		LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+		size_t				numLive = tableSizes[s];
+		LEOObjectID		*	liveIDs = calloc( numLive, sizeof(LEOObjectID) );
+		
+		// Fill the table with references that stay around:
+		clock_t		startTime = clock();
+		for( size_t x = 0; x < numLive; x++ )
+			liveIDs[x] = LEOContextGroupCreateNewObjectIDForPointer( group, dummyValues +(x % 4) );
+		double		fillSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+		
+		bool		allValid = true;
+		for( size_t x = 0; x < numLive; x++ )
+		{
+			if( liveIDs[x] == kLEOObjectIDINVALID || liveIDs[x] >= group->numReferences
+				|| LEOContextGroupGetPointerForObjectIDAndSeed( group, liveIDs[x], LEOContextGroupGetSeedForObjectID( group, liveIDs[x] ) ) != dummyValues +(x % 4) )
+				allValid = false;
+		}
+		ASSERT( allValid );
+		
+		// Now create and release short-lived references on top of them:
+		startTime = clock();
+		for( size_t x = 0; x < LEO_REFERENCE_BENCHMARK_CYCLES; x++ )
+		{
+			LEOObjectID	tempID = LEOContextGroupCreateNewObjectIDForPointer( group, dummyValues );
+			LEOContextGroupRecycleObjectID( group, tempID );
+		}
+		double		cycleSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+		
+		// Freed slots are reused, and old references to them notice they're gone:
+		LEOObjectSeed	oldSeed = LEOContextGroupGetSeedForObjectID( group, liveIDs[numLive / 2] );
+		LEOContextGroupRecycleObjectID( group, liveIDs[numLive / 2] );
+		size_t			oldNumReferences = group->numReferences;
+		ASSERT( LEOContextGroupCreateNewObjectIDForPointer( group, dummyValues +1 ) == liveIDs[numLive / 2] );
+		ASSERT( group->numReferences == oldNumReferences );
+		ASSERT( LEOContextGroupGetPointerForObjectIDAndSeed( group, liveIDs[numLive / 2], oldSeed ) == NULL );
+		
+		printf( "note: %zu live references: %f ns per reference filling, %f ns per create/recycle\n", numLive,
+				(fillSeconds * 1000000000.0) / numLive, (cycleSeconds * 1000000000.0) / LEO_REFERENCE_BENCHMARK_CYCLES );
+		
+		free( liveIDs );
+		LEOContextGroupRelease( group );
+	}
+}
+
+
+// Returns the height of the subtree, or SIZE_MAX if it isn't a valid AVL tree:
+size_t	CheckArrayTreeBalance( struct LEOArrayKeyedEntry* inEntry )
+{
+	if( !inEntry )
+		return 0;
+	
+	size_t	smallerHeight = CheckArrayTreeBalance( inEntry->smallerItem ),
+			largerHeight = CheckArrayTreeBalance( inEntry->largerItem );
+	if( smallerHeight == SIZE_MAX || largerHeight == SIZE_MAX )
+		return SIZE_MAX;
+	if( smallerHeight > (largerHeight +1) || largerHeight > (smallerHeight +1) )
+		return SIZE_MAX;
+	size_t	height = ((smallerHeight > largerHeight) ? smallerHeight : largerHeight) +1;
+	if( height != inEntry->height )
+		return SIZE_MAX;
+	return height;
+}
+
+
+void	DoArrayTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	struct LEOArrayEntry*	theArray = NULL;
+	char				keyStr[64] = { 0 };
+	char				str[1024] = { 0 };
+	
+	printf( "\nnote: Array tests\n" );
+	
+	LEOAddCStringArrayEntryToRoot( &theArray, "Foo", "foo", ctx );
+	LEOAddCStringArrayEntryToRoot( &theArray, "bar", "bar", ctx );
+	for( int x = 12; x >= 1; x-- )
+	{
+		snprintf( keyStr, sizeof(keyStr), "%d", x );
+		LEOAddIntegerArrayEntryToRoot( &theArray, keyStr, x * 10, kLEOUnitNone, ctx );
+	}
+	LEOValuePtr	fiveValue = LEOGetArrayValueForKey( theArray, "5" );
+	LEOAddCStringArrayEntryToRoot( &theArray, "05", "leading zero", ctx );
+	LEOAddCStringArrayEntryToRoot( &theArray, "FOO", "FOO", ctx );	// Replaces "Foo".
+	
+	ASSERT( LEOGetArrayKeyCount( theArray ) == 15 );
+	ASSERT( theArray->numIndexedItems == 12 );	// Keys that were added before "1" were moved to the list part.
+	ASSERT( CheckArrayTreeBalance( theArray->keyedItems ) == 2 );
+	ASSERT( LEOGetArrayValueForIndex( theArray, 5 ) == fiveValue );
+	ASSERT( LEOGetArrayValueForKey( theArray, "5" ) == fiveValue );	// Rebalancing doesn't move values.
+	ASSERT( LEOGetValueAsInteger( fiveValue, NULL, ctx ) == 50 );
+	ASSERT( LEOGetArrayValueForKey( theArray, "BAR" ) != NULL );
+	ASSERT( LEOGetArrayValueForKey( theArray, "13" ) == NULL );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( theArray, "foo" ), str, sizeof(str), ctx ), "FOO" ) == 0 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( theArray, "05" ), str, sizeof(str), ctx ), "leading zero" ) == 0 );
+	
+	// Integer keys come first, in numerical order:
+	LEOPrintArray( theArray, str, sizeof(str), ctx );
+	ASSERT_STRING_MATCH( str, "1:10\n2:20\n3:30\n4:40\n5:50\n6:60\n7:70\n8:80\n9:90\n10:100\n11:110\n12:120\n05:leading zero\nbar:bar\nFoo:FOO\n" );
+	
+	union LEOValue	sixReference;
+	LEOInitReferenceValue( &sixReference, LEOGetArrayValueForKey( theArray, "6" ), kLEOInvalidateReferences, kLEOChunkTypeINVALID, 0, 0, ctx );
+	LEODeleteArrayEntryFromRoot( &theArray, "4", ctx );	// Moves "5" and up to the keyed part.
+	ASSERT( theArray->numIndexedItems == 3 );
+	ASSERT( LEOGetValueAsInteger( &sixReference, NULL, ctx ) == 60 );	// References follow moved values.
+	LEOCleanUpValue( &sixReference, kLEOInvalidateReferences, ctx );
+	LEODeleteArrayEntryFromRoot( &theArray, "Bar", ctx );
+	LEODeleteArrayEntryFromRoot( &theArray, "nonexistent", ctx );
+	for( int x = 7; x <= 12; x++ )
+	{
+		snprintf( keyStr, sizeof(keyStr), "%d", x );
+		LEODeleteArrayEntryFromRoot( &theArray, keyStr, ctx );
+	}
+	ASSERT( LEOGetArrayKeyCount( theArray ) == 7 );
+	ASSERT( CheckArrayTreeBalance( theArray->keyedItems ) != SIZE_MAX );
+	ASSERT( LEOGetValueAsInteger( LEOGetArrayValueForIndex( theArray, 5 ), NULL, ctx ) == 50 );
+	LEOPrintArray( theArray, str, sizeof(str), ctx );
+	ASSERT_STRING_MATCH( str, "1:10\n2:20\n3:30\n5:50\n6:60\n05:leading zero\nFoo:FOO\n" );
+	
+	struct LEOArrayEntry*	arrayCopy = LEOCopyArray( theArray, ctx );
+	ASSERT( CheckArrayTreeBalance( arrayCopy->keyedItems ) == CheckArrayTreeBalance( theArray->keyedItems ) );
+	ASSERT( arrayCopy->numIndexedItems == 3 );
+	LEOCleanUpArray( arrayCopy, ctx );
+	
+	// Filling the gap moves the following keys back into the list part:
+	LEOAddIntegerArrayEntryToRoot( &theArray, "4", 40, kLEOUnitNone, ctx );
+	ASSERT( theArray->numIndexedItems == 6 );
+	ASSERT( LEOGetArrayKeyCount( theArray ) == 8 );
+	LEODeleteArrayEntryFromRoot( &theArray, "05", ctx );
+	LEODeleteArrayEntryFromRoot( &theArray, "foo", ctx );
+	for( int x = 6; x >= 1; x-- )
+	{
+		snprintf( keyStr, sizeof(keyStr), "%d", x );
+		LEODeleteArrayEntryFromRoot( &theArray, keyStr, ctx );
+	}
+	ASSERT( theArray == NULL );	// Empty arrays are NULL.
+	
+	LEOAddCStringArrayEntryToRoot( &theArray, "1", "one", ctx );
+	LEOAddCStringArrayEntryToRoot( &theArray, "name", "original", ctx );
+	
+	// Deleted keyed entries are reused for new keys of similar length:
+	LEOValuePtr	deletedValue = LEOAddCStringArrayEntryToRoot( &theArray, "deleteMe", "gone", ctx );
+	size_t		numArenaBlocks = theArray->keyedItemsArena.numBlocks;
+	LEODeleteArrayEntryFromRoot( &theArray, "deleteMe", ctx );
+	ASSERT( LEOAddCStringArrayEntryToRoot( &theArray, "reuseMe", "new", ctx ) == deletedValue );
+	ASSERT( theArray->keyedItemsArena.numBlocks == numArenaBlocks );
+	LEODeleteArrayEntryFromRoot( &theArray, "reuseMe", ctx );
+	
+	// Copies share their items until one of them is changed:
+	arrayCopy = LEOCopyArray( theArray, ctx );
+	ASSERT( arrayCopy == theArray );
+	LEOAddCStringArrayEntryToRoot( &arrayCopy, "name", "changed", ctx );
+	ASSERT( arrayCopy != theArray );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( theArray, "name" ), str, sizeof(str), ctx ), "original" ) == 0 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( arrayCopy, "name" ), str, sizeof(str), ctx ), "changed" ) == 0 );
+	LEOCleanUpArray( arrayCopy, ctx );
+	
+	// Items that are referenced aren't shared, and references to them go away with the original:
+	union LEOValue	arrayValue, arrayValueCopy, itemValue, itemReference;
+	LEOInitArrayValue( &arrayValue.array, LEOCopyArray( theArray, ctx ), kLEOInvalidateReferences, ctx );
+	LEOInitArrayValueCopy( &arrayValue, &arrayValueCopy, kLEOInvalidateReferences, ctx );
+	ASSERT( arrayValueCopy.array.array == arrayValue.array.array );
+	LEOGetArrayValueValueForKey( &arrayValue, "name", &itemReference, kLEOInvalidateReferences, ctx );
+	ASSERT( arrayValueCopy.array.array != arrayValue.array.array );	// Taking a reference made arrayValue get its own copy.
+	LEOSetValueAsString( &itemReference, "set through reference", strlen("set through reference"), ctx );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( arrayValue.array.array, "name" ), str, sizeof(str), ctx ), "set through reference" ) == 0 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( arrayValueCopy.array.array, "name" ), str, sizeof(str), ctx ), "original" ) == 0 );
+	LEOCleanUpValue( &arrayValueCopy, kLEOInvalidateReferences, ctx );
+	LEOInitArrayValueCopy( &arrayValue, &arrayValueCopy, kLEOInvalidateReferences, ctx );
+	ASSERT( arrayValueCopy.array.array != arrayValue.array.array );
+	ASSERT( arrayValueCopy.array.array->numKeyedItems == 1 );
+	ASSERT( LEOGetArrayKeyCount( arrayValueCopy.array.array ) == 2 );
+	LEOCleanUpValue( &arrayValue, kLEOInvalidateReferences, ctx );
+	LEOInitUnsetValue( &itemValue, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsString( &itemReference, str, sizeof(str), ctx );
+	ASSERT( (ctx->flags & kLEOContextKeepRunning) == 0 );	// Reference to item of freed array is invalid.
+	ctx->flags |= kLEOContextKeepRunning;
+	ctx->errMsg[0] = 0;
+	LEOCleanUpValue( &itemReference, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &itemValue, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &arrayValueCopy, kLEOInvalidateReferences, ctx );
+	
+	LEOCleanUpArray( theArray, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_ARRAY_BENCHMARK_RANDOM_SEED		12345
+
+
+enum
+{
+	kArrayBenchmarkSequentialKeys,	// "1", "2", "3"... as strings.
+	kArrayBenchmarkIndexes,			// 1, 2, 3... using the index API.
+	kArrayBenchmarkRandomKeys,		// Random string keys.
+	kArrayBenchmarkNumKeyKinds
+};
+
+
+void	DoArrayBenchmark( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	size_t				arraySizes[] = { 10000, 1000000 };
+	const char*			keyKindNames[kArrayBenchmarkNumKeyKinds] = { "sequential", "indexed", "random" };
+	char				keyStr[64] = { 0 };
+	
+	printf( "\nnote: Array benchmark\n" );
+	
+	for( size_t s = 0; s < sizeof(arraySizes) / sizeof(size_t); s++ )
+	{
+		size_t		numEntries = arraySizes[s];
+		for( int keyKind = 0; keyKind < kArrayBenchmarkNumKeyKinds; keyKind++ )
+		{
+			struct LEOArrayEntry*	theArray = NULL;
+			uint32_t				randomState = LEO_ARRAY_BENCHMARK_RANDOM_SEED;
+			
+			clock_t		startTime = clock();
+			for( size_t x = 0; x < numEntries; x++ )
+			{
+				if( keyKind == kArrayBenchmarkIndexes )
+				{
+					LEOInitIntegerValue( LEOAddArrayEntryWithIndexToRoot( &theArray, x +1, NULL, ctx ), x, kLEOUnitNone, kLEOInvalidateReferences, ctx );
+					continue;
+				}
+				else if( keyKind == kArrayBenchmarkRandomKeys )
+				{
+					randomState = randomState * 1664525 + 1013904223;
+					snprintf( keyStr, sizeof(keyStr), "key%08X", randomState );
+				}
+				else
+					snprintf( keyStr, sizeof(keyStr), "%zu", x +1 );
+				LEOAddIntegerArrayEntryToRoot( &theArray, keyStr, x, kLEOUnitNone, ctx );
+			}
+			double		insertSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+			
+			randomState = LEO_ARRAY_BENCHMARK_RANDOM_SEED;
+			size_t		numFound = 0;
+			startTime = clock();
+			for( size_t x = 0; x < numEntries; x++ )
+			{
+				if( keyKind == kArrayBenchmarkIndexes )
+				{
+					if( LEOGetArrayValueForIndex( theArray, x +1 ) )
+						numFound++;
+					continue;
+				}
+				else if( keyKind == kArrayBenchmarkRandomKeys )
+				{
+					randomState = randomState * 1664525 + 1013904223;
+					snprintf( keyStr, sizeof(keyStr), "KEY%08x", randomState );
+				}
+				else
+					snprintf( keyStr, sizeof(keyStr), "%zu", x +1 );
+				if( LEOGetArrayValueForKey( theArray, keyStr ) )
+					numFound++;
+			}
+			double		lookupSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+			
+			size_t		height = CheckArrayTreeBalance( theArray->keyedItems );
+			size_t		numIterated = 0;
+			struct LEOArrayKeyedEntryIterator	iterator;
+			struct LEOArrayKeyedEntry		*	prevEntry = NULL, *currEntry = NULL;
+			bool		inOrder = true;
+			LEOArrayKeyedEntryIteratorInit( &iterator, theArray );
+			while( (currEntry = LEOArrayKeyedEntryIteratorNext( &iterator )) )
+			{
+				if( prevEntry && strcasecmp( prevEntry->key, currEntry->key ) >= 0 )
+					inOrder = false;
+				prevEntry = currEntry;
+				numIterated++;
+			}
+			ASSERT( inOrder );
+			ASSERT( numIterated == theArray->numKeyedItems );
+			ASSERT( numFound == numEntries );
+			ASSERT( height != SIZE_MAX );
+			ASSERT( LEOGetArrayKeyCount( theArray ) == numEntries );
+			printf( "note: %zu %s keys: %f seconds inserting, %f seconds looking up, %zu in list part, tree height %zu\n",
+					numEntries, keyKindNames[keyKind], insertSeconds, lookupSeconds, theArray->numIndexedItems, height );
+			
+			size_t		numAllocations = 1 +theArray->keyedItemsArena.numBlocks;	// Array itself plus arena blocks.
+			for( size_t capacity = theArray->indexedItemsCapacity; capacity > 4; capacity /= 2 )	// Plus list part growing.
+				numAllocations++;
+			startTime = clock();
+			LEOCleanUpArray( theArray, ctx );
+			double		teardownSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+			printf( "note: %f allocations per insert, %f seconds tearing down\n", numAllocations / (double)numEntries, teardownSeconds );
+		}
+	}
+	printf( "note: list items take %zu bytes each, keyed entries %zu bytes plus key\n", sizeof(union LEOValue), sizeof(struct LEOArrayKeyedEntry) );
+	
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_ARRAY_PARAMETER_BENCHMARK_NUM_ITEMS	50000
+#define LEO_ARRAY_PARAMETER_BENCHMARK_CALLS		1000
+
+
+// Calls a handler LEO_ARRAY_PARAMETER_BENCHMARK_CALLS times, passing it an
+//	array of LEO_ARRAY_PARAMETER_BENCHMARK_NUM_ITEMS items that it copies into
+//	a local variable, and returns the time this took. If readItem is true,
+//	an item of the array is fetched before each call.
+static double	RunArrayParameterBenchmark( bool shareArrays, bool readItem )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOHandlerID		receiverID = LEOContextGroupHandlerIDForHandlerName( group, "receiveArray" );
+	LEOHandler		*	receiver = LEOScriptAddCommandHandlerWithID( theScript, receiverID );
+	LEOHandlerAddInstruction( receiver, LINE_MARKER_INSTR, 0, 10 );
+	LEOHandlerAddInstruction( receiver, PARAMETER_INSTR, BACK_OF_STACK, 1 );
+	LEOHandlerAddInstruction( receiver, GET_ARRAY_ITEM_COUNT_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( receiver, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( receiver, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOHandler		*	caller = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "callWithArray" ) );
+	LEOHandlerAddInstruction( caller, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_ARRAY_PARAMETER_BENCHMARK_CALLS );
+	size_t				loopStart = caller->numInstructions;
+	if( readItem )
+	{
+		LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Item.
+		LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 123 );	// Key.
+		LEOHandlerAddInstruction( caller, PUSH_REFERENCE_INSTR, (uint16_t) -1, 0 );
+		LEOHandlerAddInstruction( caller, GET_ARRAY_ITEM_INSTR, 1, 0 );
+		LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	}
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+	LEOHandlerAddInstruction( caller, PUSH_REFERENCE_INSTR, (uint16_t) -1, 0 );	// The array we push below, right before the base pointer.
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 1 );	// Param count.
+	LEOHandlerAddInstruction( caller, CALL_HANDLER_INSTR, 0, receiverID );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 );
+	LEOHandlerAddInstruction( caller, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -(int32_t)(caller->numInstructions -loopStart) );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// Loop counter.
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// The array.
+	LEOHandlerAddInstruction( caller, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	struct LEOArrayEntry*	theArray = NULL;
+	for( size_t x = 1; x <= LEO_ARRAY_PARAMETER_BENCHMARK_NUM_ITEMS; x++ )
+		LEOInitIntegerValue( LEOAddArrayEntryWithIndexToRoot( &theArray, x, NULL, ctx ), x, kLEOUnitNone, kLEOInvalidateReferences, ctx );
+	if( !shareArrays )
+		theArray->itemsMayBeReferenced = true;	// Forces a real copy every time, like we used to.
+	theArray->referenceCount++;	// Keep it around so we can check on it afterwards.
+	
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, caller, theScript, NULL, NULL );
+	LEOPushArrayValueOnStack( ctx, theArray );
+	
+	clock_t		startTime = clock();
+	LEORunInContextFast( caller->instructions, ctx );
+	clock_t		endTime = clock();
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack );
+	ASSERT( theArray->itemsMayBeReferenced == !shareArrays );	// Reading items doesn't stop sharing.
+	LEOCleanUpArray( theArray, ctx );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+	
+	return (endTime -startTime) / (double)CLOCKS_PER_SEC;
+}
+
+
+void	DoArrayParameterBenchmark( void )
+{
+	printf( "\nnote: Array parameter passing benchmark\n" );
+	
+	double	copyingSeconds = RunArrayParameterBenchmark( false, false );
+	double	sharingSeconds = RunArrayParameterBenchmark( true, false );
+	double	readingSeconds = RunArrayParameterBenchmark( true, true );
+	printf( "note: %d calls with a %d item array: %f seconds copying, %f seconds sharing, %f seconds sharing and reading an item before each call\n",
+			LEO_ARRAY_PARAMETER_BENCHMARK_CALLS, LEO_ARRAY_PARAMETER_BENCHMARK_NUM_ITEMS, copyingSeconds, sharingSeconds, readingSeconds );
+}
+
+
+void	DoArrayStringTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	struct LEOArrayEntry*	theArray = NULL;
+	struct LEOArrayEntry*	nestedArray = NULL;
+	LEOStringBuilder	arrayStr;
+	char				longStr[5000] = { 0 };
+	char				str[1024] = { 0 };
+	
+	printf( "\nnote: Array string conversion tests\n" );
+	
+	// Returns and "¬" in values are escaped:
+	LEOAddCStringArrayEntryToRoot( &theArray, "1", "first\nsecond", ctx );
+	LEOAddCStringArrayEntryToRoot( &theArray, "not", "\xc2\xac" "1", ctx );
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( theArray, &arrayStr, ctx );
+	ASSERT_STRING_MATCH( LEOStringBuilderGetCString( &arrayStr ), "1:first\xc2\xac\nsecond\nnot:\xc2\xac\xc2\xac" "1\n" );
+	struct LEOArrayEntry*	parsedArray = LEOCreateArrayFromString( arrayStr.string, arrayStr.stringLen, ctx );
+	ASSERT( LEOGetArrayKeyCount( parsedArray ) == 2 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForIndex( parsedArray, 1 ), str, sizeof(str), ctx ), "first\xc2\xac\nsecond" ) == 0 );
+	LEOCleanUpArray( parsedArray, ctx );
+	LEOStringBuilderCleanUp( &arrayStr );
+	LEOCleanUpArray( theArray, ctx );
+	theArray = NULL;
+	
+	// Neither keys nor values are limited to a fixed size any more:
+	memset( longStr, 'x', sizeof(longStr) -1 );
+	LEOAddCStringArrayEntryToRoot( &theArray, longStr, "long key", ctx );
+	LEOAddCStringArrayEntryToRoot( &theArray, "long value", longStr, ctx );
+	LEOAddCStringArrayEntryToRoot( &nestedArray, "inner", longStr, ctx );
+	LEOAddArrayEntryToRoot( &theArray, "nested", NULL, ctx );
+	LEOInitArrayValue( &LEOGetArrayValueForKey( theArray, "nested" )->array, nestedArray, kLEOInvalidateReferences, ctx );
+	LEOStringBuilderInit( &arrayStr );
+	LEOPrintArrayToStringBuilder( theArray, &arrayStr, ctx );
+	ASSERT( arrayStr.stringLen == (3 * (sizeof(longStr) -1)) +strlen(":long key\nlong value:\nnested:inner:\n") );
+	parsedArray = LEOCreateArrayFromString( arrayStr.string, arrayStr.stringLen, ctx );
+	ASSERT( LEOGetArrayKeyCount( parsedArray ) == 3 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( parsedArray, longStr ), str, sizeof(str), ctx ), "long key" ) == 0 );
+	ASSERT( strcmp( LEOGetValueAsString( LEOGetArrayValueForKey( parsedArray, "long value" ), NULL, 0, ctx ), longStr ) == 0 );
+	LEOCleanUpArray( parsedArray, ctx );
+	LEOStringBuilderCleanUp( &arrayStr );
+	
+	// Strings that are used as arrays aren't truncated either:
+	union LEOValue	stringValue;
+	LEOInitStringValue( &stringValue, "", 0, kLEOInvalidateReferences, ctx );
+	LEOSetValueAsArray( &stringValue, theArray, ctx );
+	LEOSetValueForKey( &stringValue, "added", LEOGetArrayValueForKey( theArray, "long value" ), ctx );
+	ASSERT( strlen( LEOGetValueAsString( &stringValue, NULL, 0, ctx ) ) == (4 * (sizeof(longStr) -1)) +strlen(":long key\nadded:\nlong value:\nnested:inner:\n") );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	LEOCleanUpArray( theArray, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_ARRAY_STRING_BENCHMARK_NUM_ITEMS	200000
+
+
+void	DoArrayStringBenchmark( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	struct LEOArrayEntry*	theArray = NULL;
+	char				keyStr[64] = { 0 };
+	
+	printf( "\nnote: Array string conversion benchmark\n" );
+	
+	for( size_t x = 0; x < LEO_ARRAY_STRING_BENCHMARK_NUM_ITEMS; x++ )
+	{
+		snprintf( keyStr, sizeof(keyStr), ((x % 2) ? "key%zu" : "%zu"), x +1 );
+		LEOAddCStringArrayEntryToRoot( &theArray, keyStr, "Some value that\nspans two lines.", ctx );
+	}
+	
+	LEOStringBuilder	arrayStr;
+	LEOStringBuilderInit( &arrayStr );
+	clock_t		startTime = clock();
+	LEOPrintArrayToStringBuilder( theArray, &arrayStr, ctx );
+	double		printSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	
+	startTime = clock();
+	struct LEOArrayEntry*	parsedArray = LEOCreateArrayFromString( arrayStr.string, arrayStr.stringLen, ctx );
+	double		parseSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	
+	ASSERT( LEOGetArrayKeyCount( parsedArray ) == LEO_ARRAY_STRING_BENCHMARK_NUM_ITEMS );
+	double		megabytes = arrayStr.stringLen / (1024.0 * 1024.0);
+	printf( "note: %d entries, %.1f MB: printing %f seconds (%.0f MB/s), parsing %f seconds (%.0f MB/s)\n",
+			LEO_ARRAY_STRING_BENCHMARK_NUM_ITEMS, megabytes, printSeconds, megabytes / printSeconds, parseSeconds, megabytes / parseSeconds );
+	
+	LEOCleanUpArray( parsedArray, ctx );
+	LEOStringBuilderCleanUp( &arrayStr );
+	LEOCleanUpArray( theArray, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoStringAsArrayTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	union LEOValue		stringCopy;
+	union LEOValue		tempStorage;
+	char				str[1024] = { 0 };
+	
+	printf( "\nnote: String as array tests\n" );
+	
+	// A long string is only parsed the first time it is used as an array:
+	LEOInitStringValue( &stringValue, "alpha:1\nbravo:2\n", 16, kLEOInvalidateReferences, ctx );
+	ASSERT( stringValue.string.string != NULL && stringValue.string.storage.buffer.parsedArray == NULL );
+	LEOValuePtr		foundValue = LEOGetValueForKey( &stringValue, "bravo", &tempStorage, kLEOInvalidateReferences, ctx );
+	ASSERT( foundValue != NULL && strcmp( LEOGetValueAsString( foundValue, str, sizeof(str), ctx ), "2" ) == 0 );
+	LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+	struct LEOArrayEntry*	parsedArray = stringValue.string.storage.buffer.parsedArray;
+	ASSERT( parsedArray != NULL );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == 2 );
+	ASSERT( stringValue.string.storage.buffer.parsedArray == parsedArray );
+	ASSERT( LEOGetValueForKey( &stringValue, "charlie", &tempStorage, kLEOInvalidateReferences, ctx ) == NULL );
+	
+	// Copies of the string share its array form:
+	LEOInitCopy( &stringValue, &stringCopy, kLEOInvalidateReferences, ctx );
+	ASSERT( stringCopy.string.storage.buffer.parsedArray == parsedArray );
+	
+	// Changing the string forgets the array form, but leaves the copy's alone:
+	LEOSetValueAsString( &stringValue, "charlie:3\ndelta:4\n", 18, ctx );
+	ASSERT( stringValue.string.storage.buffer.parsedArray == NULL );
+	ASSERT( LEOGetValueForKey( &stringValue, "bravo", &tempStorage, kLEOInvalidateReferences, ctx ) == NULL );
+	foundValue = LEOGetValueForKey( &stringValue, "charlie", &tempStorage, kLEOInvalidateReferences, ctx );
+	ASSERT( foundValue != NULL && strcmp( LEOGetValueAsString( foundValue, str, sizeof(str), ctx ), "3" ) == 0 );
+	LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+	foundValue = LEOGetValueForKey( &stringCopy, "alpha", &tempStorage, kLEOInvalidateReferences, ctx );
+	ASSERT( foundValue != NULL && strcmp( LEOGetValueAsString( foundValue, str, sizeof(str), ctx ), "1" ) == 0 );
+	LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+	
+	LEOSetValueAsNumber( &stringCopy, 5, kLEOUnitNone, ctx );
+	ASSERT( stringCopy.string.string == NULL );	// Short enough to not need a block (or an array form).
+	ASSERT( stringValue.string.storage.buffer.parsedArray != NULL );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, 0, 1, "x", ctx );
+	ASSERT( stringValue.string.storage.buffer.parsedArray == NULL );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == 2 );
+	foundValue = LEOGetValueForKey( &stringValue, "xharlie", &tempStorage, kLEOInvalidateReferences, ctx );
+	ASSERT( foundValue != NULL && strcmp( LEOGetValueAsString( foundValue, str, sizeof(str), ctx ), "3" ) == 0 );
+	LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+	LEOSetValueForKey( &stringValue, "echo", &stringCopy, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, str, sizeof(str), ctx ), "delta:4\necho:5\nxharlie:3\n" );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == 3 );
+	LEOCleanUpValue( &stringCopy, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	// Short strings are simply parsed again each time:
+	LEOInitStringValue( &stringValue, "a:1\nb:2\n", 8, kLEOInvalidateReferences, ctx );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == 2 );
+	foundValue = LEOGetValueForKey( &stringValue, "b", &tempStorage, kLEOInvalidateReferences, ctx );
+	ASSERT( foundValue != NULL && strcmp( LEOGetValueAsString( foundValue, str, sizeof(str), ctx ), "2" ) == 0 );
+	LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	// Variants turn into arrays when asked for their keys:
+	LEOInitStringVariantValue( &stringValue, "a:1\nb:2\n", kLEOInvalidateReferences, ctx );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == 2 );
+	ASSERT( stringValue.base.isa == &kLeoValueTypeArrayVariant );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, str, sizeof(str), ctx ), "a:1\nb:2" );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS	20000
+
+
+void	DoStringAsArrayBenchmark( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOStringBuilder	arrayStr;
+	union LEOValue		stringValue;
+	union LEOValue		tempStorage;
+	char				keyStr[64] = { 0 };
+	
+	printf( "\nnote: String as array benchmark\n" );
+	
+	LEOStringBuilderInit( &arrayStr );
+	for( size_t x = 0; x < LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS; x++ )
+	{
+		snprintf( keyStr, sizeof(keyStr), "key%zu:Value %zu\n", x, x );
+		LEOStringBuilderAppendCString( &arrayStr, keyStr );
+	}
+	LEOInitStringValue( &stringValue, arrayStr.string, arrayStr.stringLen, kLEOInvalidateReferences, ctx );
+	
+	// Look up every key once, like a loop over the keys of a dictionary would:
+	clock_t		startTime = clock();
+	size_t		numFound = 0;
+	for( size_t x = 0; x < LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS; x++ )
+	{
+		snprintf( keyStr, sizeof(keyStr), "key%zu", x );
+		LEOValuePtr	foundValue = LEOGetValueForKey( &stringValue, keyStr, &tempStorage, kLEOInvalidateReferences, ctx );
+		if( foundValue )
+		{
+			numFound++;
+			LEOCleanUpValue( foundValue, kLEOInvalidateReferences, ctx );
+		}
+	}
+	double		seconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	ASSERT( numFound == LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS );
+	ASSERT( LEOGetKeyCount( &stringValue, ctx ) == LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS );
+	printf( "note: %d keyed lookups on a %zu byte string: %f seconds\n", LEO_STRING_AS_ARRAY_BENCHMARK_NUM_ITEMS, arrayStr.stringLen, seconds );
+	
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	LEOStringBuilderCleanUp( &arrayStr );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoShortStringTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	union LEOValue		movedValue;
+	char				str[1024] = { 0 };
+	
+	printf( "\nnote: Short string tests\n" );
+	
+	// Short strings are kept inside the value, even after it was moved:
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	LEOInitStringValue( &stringValue, "12", 2, kLEOInvalidateReferences, ctx );
+	ASSERT( stringValue.string.string == NULL );
+	memmove( &movedValue, &stringValue, sizeof(movedValue) );
+	memset( &stringValue, 0xff, sizeof(stringValue) );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "12" );
+	ASSERT( LEOGetValueAsInteger( &movedValue, NULL, ctx ) == 12 );
+	LEOSetValueAsBoolean( &movedValue, true, ctx );	// Turns into a constant.
+	LEOSetValueAsNumber( &movedValue, 1.5, kLEOUnitNone, ctx );
+	ASSERT( movedValue.base.isa == &kLeoValueTypeString && movedValue.string.string == NULL );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "1.5" );
+	LEOSetValuePredeterminedRangeAsString( &movedValue, 3, 3, "00", ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "1.500" );
+	ASSERT( gLEONumStringValueAllocations == numAllocations );
+	
+	// Longer ones get a block of exactly the right size, which is reused if it fits:
+	LEOSetValueAsRect( &movedValue, 1, 2, 3, 4, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "left:1\ntop:2\nright:3\nbottom:4" );
+	ASSERT( movedValue.string.string != NULL && movedValue.string.storage.buffer.sharedBuffer->capacity == movedValue.string.stringLen +1 );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	LEOSetValueAsString( &movedValue, "left:5\ntop:6\nright:7\nbottom:8", 29, ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "left:5\ntop:6\nright:7\nbottom:8" );
+	
+	// Setting a value to part of its own string works both ways round:
+	const char*	ownStr = LEOGetValueAsString( &movedValue, NULL, 0, ctx );
+	LEOSetValueAsString( &movedValue, ownStr +7, 5, ctx );
+	ASSERT( movedValue.string.string == NULL );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "top:6" );
+	ownStr = LEOGetValueAsString( &movedValue, NULL, 0, ctx );
+	LEOSetValueAsString( &movedValue, ownStr +1, 4, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "op:6" );
+	
+	// Copies of short strings don't allocate either, also when initialized in place:
+	numAllocations = gLEONumStringValueAllocations;
+	LEOInitCopy( &movedValue, &stringValue, kLEOInvalidateReferences, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, str, sizeof(str), ctx ), "op:6" );
+	LEOInitStringValue( &movedValue, LEOStringValueCharacters( &movedValue ) +1, 3, kLEOInvalidateReferences, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &movedValue, NULL, 0, ctx ), "p:6" );
+	ASSERT( gLEONumStringValueAllocations == numAllocations );
+	
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &movedValue, kLEOInvalidateReferences, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_STRING_SCRIPT_BENCHMARK_ITERATIONS	200000
+
+
+void	DoStringScriptBenchmark( void )
+{
+	printf( "\nnote: String script benchmark\n" );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	size_t				itemStrIndex = LEOScriptAddString( theScript, "item" );
+	size_t				trueStrIndex = LEOScriptAddString( theScript, "true" );
+	LEOHandler		*	handler = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "stringLoop" ) );
+	LEOHandlerAddInstruction( handler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_STRING_SCRIPT_BENCHMARK_ITERATIONS );
+	LEOHandlerAddInstruction( handler, PUSH_STR_FROM_TABLE_INSTR, 0, (uint32_t) itemStrIndex );	// "item" & 12 & "," & 0 is "true"
+	LEOHandlerAddInstruction( handler, PUSH_INTEGER_INSTR, kLEOUnitNone, 12 );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, PUSH_NUMBER_INSTR, kLEOUnitNone, 0 );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_INSTR, 0, ',' );
+	LEOHandlerAddInstruction( handler, PUSH_STR_FROM_TABLE_INSTR, 0, (uint32_t) trueStrIndex );
+	LEOHandlerAddInstruction( handler, EQUAL_OPERATOR_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( handler, ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 );
+	LEOHandlerAddInstruction( handler, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -9 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( handler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, handler, theScript, NULL, NULL );
+	
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	clock_t		startTime = clock();
+	LEORunInContextFast( handler->instructions, ctx );
+	double		seconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	numAllocations = gLEONumStringValueAllocations -numAllocations;
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack );
+	printf( "note: %d iterations: %f seconds, %f string allocations per iteration\n",
+			LEO_STRING_SCRIPT_BENCHMARK_ITERATIONS, seconds, numAllocations / (double)LEO_STRING_SCRIPT_BENCHMARK_ITERATIONS );
+	
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoSharedStringTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		original;
+	union LEOValue		copy;
+	union LEOValue		variant;
+	union LEOValue		range;
+	const char*			longStr = "first line,second item\nsecond line\nthird line";
+	size_t				longStrLen = strlen(longStr);
+	
+	printf( "\nnote: Shared string tests\n" );
+	
+	// Copies share the characters until one of them is changed:
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	LEOInitStringValue( &original, longStr, longStrLen, kLEOInvalidateReferences, ctx );
+	LEOInitCopy( &original, &copy, kLEOInvalidateReferences, ctx );
+	ASSERT( copy.string.string == original.string.string );
+	ASSERT( original.string.storage.buffer.sharedBuffer->refCount == 2 );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	LEOSetValuePredeterminedRangeAsString( &copy, 0, 5, "1st", ctx );
+	ASSERT( copy.string.string != original.string.string );
+	ASSERT( original.string.storage.buffer.sharedBuffer->refCount == 1 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &original, NULL, 0, ctx ), longStr );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &copy, NULL, 0, ctx ), "1st line,second item\nsecond line\nthird line" );
+	
+	// A buffer is only reused for a new string if no other value shares it:
+	numAllocations = gLEONumStringValueAllocations;
+	LEOSetValueAsString( &copy, longStr, longStrLen -6, ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations );
+	LEOCleanUpValue( &copy, kLEOInvalidateReferences, ctx );
+	LEOInitCopy( &original, &copy, kLEOInvalidateReferences, ctx );
+	LEOSetValueAsString( &original, "another string that is long", 28, ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &copy, NULL, 0, ctx ), longStr );
+	
+	// Putting a string into a variant shares it, too:
+	LEOInitIntegerVariantValue( &variant, 7, kLEOUnitNone, kLEOInvalidateReferences, ctx );
+	LEOPutValueIntoValue( &copy, &variant, ctx );
+	ASSERT( variant.base.isa == &kLeoValueTypeStringVariant );
+	ASSERT( variant.string.string == copy.string.string );
+	LEOPutValueIntoValue( &variant, &variant, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &variant, NULL, 0, ctx ), longStr );
+	
+	// Ranges reference their parent's characters, and only get their own
+	//	copy once someone needs them NUL-terminated:
+	numAllocations = gLEONumStringValueAllocations;
+	const char*	copyStr = LEOGetValueAsString( &copy, NULL, 0, ctx );
+	LEOInitStringValueWithRangeOfValue( &range, &copy, copyStr, 11, 34, kLEOInvalidateReferences, ctx );
+	ASSERT( range.string.string == copy.string.string +11 && range.string.stringLen == 23 );
+	ASSERT( gLEONumStringValueAllocations == numAllocations );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &range, NULL, 0, ctx ), "second item\nsecond line" );
+	ASSERT( range.string.string != copy.string.string +11 );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	LEOCleanUpValue( &range, kLEOInvalidateReferences, ctx );
+	LEOInitStringValueWithRangeOfValue( &range, &copy, copyStr, 11, longStrLen, kLEOInvalidateReferences, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &range, NULL, 0, ctx ), "second item\nsecond line\nthird line" );
+	ASSERT( range.string.string == copy.string.string +11 );
+	LEOCleanUpValue( &range, kLEOInvalidateReferences, ctx );
+	LEOInitStringValueWithRangeOfValue( &range, &copy, copyStr, 0, 5, kLEOInvalidateReferences, ctx );
+	ASSERT( range.string.string == NULL );	// Short ones are simply copied.
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &range, NULL, 0, ctx ), "first" );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +1 );
+	
+	// Short ranges of a long string are copied, so they don't keep all of it
+	//	around, and appending to it can still happen in place:
+	union LEOValue	longValue;
+	char			lineStr[40] = { 0 };
+	LEOInitStringValue( &longValue, "", 0, kLEOInvalidateReferences, ctx );
+	for( int x = 1; x <= 100; x++ )
+	{
+		snprintf( lineStr, sizeof(lineStr), "this is line %d\n", x );
+		LEOSetValuePredeterminedRangeAsString( &longValue, SIZE_MAX, SIZE_MAX, lineStr, ctx );
+	}
+	LEOCleanUpValue( &range, kLEOInvalidateReferences, ctx );
+	const char*	longStr2 = LEOGetValueAsString( &longValue, NULL, 0, ctx );
+	LEOInitStringValueWithRangeOfValue( &range, &longValue, longStr2, 0, 16, kLEOInvalidateReferences, ctx );	// "this is line 1\nt"
+	ASSERT( longValue.string.storage.buffer.sharedBuffer->refCount == 1 );
+	numAllocations = gLEONumStringValueAllocations;
+	for( int x = 0; x < 100; x++ )
+		LEOSetValuePredeterminedRangeAsString( &longValue, SIZE_MAX, SIZE_MAX, "more", ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations );
+	ASSERT( range.string.stringLen == 16 && memcmp( LEOStringValueCharacters( &range ), "this is line 1\nt", 16 ) == 0 );
+	LEOCleanUpValue( &longValue, kLEOInvalidateReferences, ctx );
+	
+	// Values stay valid when the one they share with goes away:
+	LEOCleanUpValue( &range, kLEOInvalidateReferences, ctx );
+	LEOInitStringValueWithRangeOfValue( &range, &variant, copyStr, 11, 34, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &copy, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &variant, kLEOInvalidateReferences, ctx );
+	ASSERT( range.string.storage.buffer.sharedBuffer->refCount == 1 );
+	ASSERT( LEOGetValueAsString( &range, NULL, 0, ctx ) != NULL );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &range, NULL, 0, ctx ), "second item\nsecond line" );
+	
+	LEOCleanUpValue( &range, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &original, kLEOInvalidateReferences, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_STRING_PARAMETER_BENCHMARK_CALLS		1000
+#define LEO_STRING_PARAMETER_BENCHMARK_SIZE			(10 * 1024 * 1024)
+
+
+void	DoStringParameterBenchmark( void )
+{
+	printf( "\nnote: String parameter passing benchmark\n" );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOHandlerID		receiverID = LEOContextGroupHandlerIDForHandlerName( group, "receiveString" );
+	LEOHandler		*	receiver = LEOScriptAddCommandHandlerWithID( theScript, receiverID );
+	LEOHandlerAddInstruction( receiver, LINE_MARKER_INSTR, 0, 30 );
+	LEOHandlerAddInstruction( receiver, PARAMETER_INSTR, BACK_OF_STACK, 1 );
+	LEOHandlerAddInstruction( receiver, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( receiver, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	for( int x = 0; x < 2; x++ )	// Two handlers that each pass their parameter on.
+	{
+		LEOHandlerID	forwarderID = LEOContextGroupHandlerIDForHandlerName( group, (x == 0) ? "forwardStringAgain" : "forwardString" );
+		LEOHandler	*	forwarder = LEOScriptAddCommandHandlerWithID( theScript, forwarderID );
+		LEOHandlerAddInstruction( forwarder, LINE_MARKER_INSTR, 0, 20 +x );
+		LEOHandlerAddInstruction( forwarder, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+		LEOHandlerAddInstruction( forwarder, PARAMETER_INSTR, BACK_OF_STACK, 1 );
+		LEOHandlerAddInstruction( forwarder, PUSH_INTEGER_INSTR, kLEOUnitNone, 1 );	// Param count.
+		LEOHandlerAddInstruction( forwarder, CALL_HANDLER_INSTR, 0, receiverID );
+		LEOHandlerAddInstruction( forwarder, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( forwarder, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( forwarder, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+		LEOHandlerAddInstruction( forwarder, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+		receiverID = forwarderID;
+	}
+	
+	LEOHandler		*	caller = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "callWithString" ) );
+	LEOHandlerAddInstruction( caller, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_STRING_PARAMETER_BENCHMARK_CALLS );
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 0 );	// Result.
+	LEOHandlerAddInstruction( caller, PARAMETER_INSTR, BACK_OF_STACK, 1 );	// Our own parameter, the document.
+	LEOHandlerAddInstruction( caller, PUSH_INTEGER_INSTR, kLEOUnitNone, 1 );	// Param count.
+	LEOHandlerAddInstruction( caller, CALL_HANDLER_INSTR, 0, receiverID );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( caller, ADD_INTEGER_INSTR, BACK_OF_STACK, (uint32_t) -1 );
+	LEOHandlerAddInstruction( caller, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -8 );
+	LEOHandlerAddInstruction( caller, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// Loop counter.
+	LEOHandlerAddInstruction( caller, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	char*	document = malloc( LEO_STRING_PARAMETER_BENCHMARK_SIZE );
+	memset( document, 'x', LEO_STRING_PARAMETER_BENCHMARK_SIZE );
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	LEOPushIntegerOnStack( ctx, 0, kLEOUnitNone );	// Result.
+	LEOPushStringValueOnStack( ctx, document, LEO_STRING_PARAMETER_BENCHMARK_SIZE );
+	LEOPushIntegerOnStack( ctx, 1, kLEOUnitNone );	// Param count.
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, caller, theScript, NULL, NULL );
+	
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	clock_t		startTime = clock();
+	LEORunInContextFast( caller->instructions, ctx );
+	double		seconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	numAllocations = gLEONumStringValueAllocations -numAllocations;
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +3 );
+	printf( "note: %d calls passing %d bytes through three handlers: %f seconds, %zu string allocations\n",
+			LEO_STRING_PARAMETER_BENCHMARK_CALLS, LEO_STRING_PARAMETER_BENCHMARK_SIZE, seconds, numAllocations );
+	
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+	free( document );
+}
+
+
+void	DoStringAppendTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	union LEOValue		copy;
+	
+	printf( "\nnote: String append tests\n" );
+	
+	// Growing a string leaves room for more:
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	LEOInitStringValue( &stringValue, "0123456789abcdef", 16, kLEOInvalidateReferences, ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, "ghij", ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +2 );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->capacity == 42 );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, "klmnopqrst", ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, 20, 20, "-", ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, 0, 10, NULL, ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +2 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, NULL, 0, ctx ), "abcdefghij-klmnopqrst" );
+	
+	// But not if someone else shares it:
+	LEOInitCopy( &stringValue, &copy, kLEOInvalidateReferences, ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, "uvw", ctx );
+	ASSERT( gLEONumStringValueAllocations == numAllocations +3 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &copy, NULL, 0, ctx ), "abcdefghij-klmnopqrst" );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, NULL, 0, ctx ), "abcdefghij-klmnopqrstuvw" );
+	
+	// Appending a string to itself:
+	LEOSetValuePredeterminedRangeAsString( &stringValue, 0, SIZE_MAX, LEOGetValueAsString( &stringValue, NULL, 0, ctx ) +10, ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, NULL, 0, ctx ), "-klmnopqrstuvw" );
+	LEOSetValueAsString( &stringValue, "0123456789abcdef", 16, ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, LEOGetValueAsString( &stringValue, NULL, 0, ctx ), ctx );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, LEOGetValueAsString( &stringValue, NULL, 0, ctx ), ctx );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( &stringValue, NULL, 0, ctx ), "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef" );
+	
+	LEOCleanUpValue( &copy, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	// Concatenation appends to temporary strings, but leaves variables alone:
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	size_t				longStrIndex = LEOScriptAddString( theScript, "a string variant long enough" );
+	size_t				endStrIndex = LEOScriptAddString( theScript, "end" );
+	LEOHandler		*	handler = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "concatenate" ) );
+	LEOHandlerAddInstruction( handler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_STR_VARIANT_FROM_TABLE_INSTR, 0, (uint32_t) longStrIndex );	// Our variable.
+	LEOHandlerAddInstruction( handler, PARAMETER_INSTR, BACK_OF_STACK, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_INTEGER_INSTR, kLEOUnitNone, 12 );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_INSTR, 0, ',' );
+	LEOHandlerAddInstruction( handler, PUSH_STR_FROM_TABLE_INSTR, 0, (uint32_t) endStrIndex );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_WITH_SPACE_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -3, 0 );	// Into the result.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -2, 0 );	// Our variable, into the parameter.
+	LEOHandlerAddInstruction( handler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOPushEmptyValueOnStack( ctx );	// Result.
+	LEOPushStringValueOnStack( ctx, "parameter long enough", 21 );
+	LEOPushIntegerOnStack( ctx, 1, kLEOUnitNone );	// Param count.
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, handler, theScript, NULL, NULL );
+	LEORunInContextFast( handler->instructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +3 );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( ctx->stack, NULL, 0, ctx ), "parameter long enough,12 enda string variant long enough" );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( ctx->stack +1, NULL, 0, ctx ), "a string variant long enough" );
+	
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_STRING_APPEND_BENCHMARK_APPENDS		1000000
+
+
+void	DoStringAppendBenchmark( void )
+{
+	printf( "\nnote: String append benchmark\n" );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	size_t				pieceStrIndex = LEOScriptAddString( theScript, "0123456789" );
+	LEOHandler		*	handler = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "buildString" ) );
+	LEOHandlerAddInstruction( handler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_INTEGER_INSTR, kLEOUnitNone, LEO_STRING_APPEND_BENCHMARK_APPENDS );
+	LEOHandlerAddInstruction( handler, PUSH_STR_VARIANT_FROM_TABLE_INSTR, 0, (uint32_t) pieceStrIndex );
+	LEOHandlerAddInstruction( handler, PUSH_STR_FROM_TABLE_INSTR, 0, (uint32_t) pieceStrIndex );
+	LEOHandlerAddInstruction( handler, CONCATENATE_VALUES_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, ADD_INTEGER_INSTR, 0, (uint32_t) -1 );
+	LEOHandlerAddInstruction( handler, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -3 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -1, 0 );	// Into the result.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( handler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	LEOPushEmptyValueOnStack( ctx );	// Result.
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, handler, theScript, NULL, NULL );
+	
+	size_t		numAllocations = gLEONumStringValueAllocations;
+	clock_t		startTime = clock();
+	LEORunInContextFast( handler->instructions, ctx );
+	double		seconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	numAllocations = gLEONumStringValueAllocations -numAllocations;
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +1 );
+	char	lengthStr[100] = { 0 };
+	snprintf( lengthStr, sizeof(lengthStr), "%zu", strlen( LEOGetValueAsString( ctx->stack, NULL, 0, ctx ) ) );
+	ASSERT_STRING_MATCH( lengthStr, "10000010" );
+	printf( "note: %d appends: %f seconds, %zu string allocations\n", LEO_STRING_APPEND_BENCHMARK_APPENDS, seconds, numAllocations );
+	
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+static bool	DoCountChunksCallback( const char* currStr, size_t currLen, size_t currStart, size_t currEnd, void* userData )
+{
+	(*(size_t*)userData)++;
+	
+	return true;
+}
+
+
+void	DoChunkIndexTest( void )
+{
+	const char*		testStrs[] = { "", "a", ",", ",,", "a,b,,c,", "one two  three", "  lead and trail  ",
+									"line 1\nline 2\r\nline 4\n", "\n", "\xc3\xa4\xc3\xb6 \xe2\x82\xac,x\ny", NULL };
+	LEOChunkType	testTypes[] = { kLEOChunkTypeByte, kLEOChunkTypeCharacter, kLEOChunkTypeItem, kLEOChunkTypeLine, kLEOChunkTypeWord, kLEOChunkTypeINVALID };
+	
+	printf( "\nnote: Chunk index tests\n" );
+	
+	// An index must give the same ranges as scanning the string:
+	bool	allRangesMatch = true,
+			allCountsMatch = true;
+	for( size_t s = 0; testStrs[s] != NULL; s++ )
+	{
+		size_t	theLen = strlen(testStrs[s]);
+		for( size_t t = 0; testTypes[t] != kLEOChunkTypeINVALID; t++ )
+		{
+			struct LEOChunkIndex*	theIndex = LEOChunkIndexCreate( testStrs[s], theLen, testTypes[t], ',' );
+			size_t					numChunks = 0;
+			LEODoForEachChunk( testStrs[s], theLen, testTypes[t], DoCountChunksCallback, ',', &numChunks );
+			if( numChunks != theIndex->numChunks )
+				allCountsMatch = false;
+			
+			for( size_t rangeStart = 0; rangeStart < numChunks +2; rangeStart++ )
+			{
+				for( size_t rangeEnd = 0; rangeEnd < numChunks +2; rangeEnd++ )
+				{
+					size_t	scanned[4] = { 99, 99, 99, 99 }, indexed[4] = { 99, 99, 99, 99 };
+					LEOGetChunkRanges( testStrs[s], testTypes[t], rangeStart, rangeEnd, scanned +0, scanned +1, scanned +2, scanned +3, ',' );
+					LEOGetChunkRangesFromIndex( theIndex, rangeStart, rangeEnd, indexed +0, indexed +1, indexed +2, indexed +3 );
+					if( memcmp( scanned, indexed, sizeof(scanned) ) != 0 )
+						allRangesMatch = false;
+				}
+			}
+			
+			LEOChunkIndexFree( theIndex );
+		}
+	}
+	ASSERT( allRangesMatch );
+	ASSERT( allCountsMatch );
+	
+	// String values get an index once chunks are looked up repeatedly, out of order:
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	union LEOValue		copy;
+	char				chunkStr[100] = { 0 };
+	LEOInitStringValue( &stringValue, "first line\nsecond line\nthird line", 33, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 2, 2, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "third line" );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkIndexes == NULL );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 0, 0, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "first line" );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkIndexes != NULL );
+	const char*		str = LEOGetValueAsString( &stringValue, NULL, 0, ctx );
+	ASSERT( LEOGetChunkCountOfValue( &stringValue, str, stringValue.string.stringLen, kLEOChunkTypeLine, ctx ) == 3 );
+	ASSERT( LEOGetChunkCountOfValue( &stringValue, str, stringValue.string.stringLen, kLEOChunkTypeWord, ctx ) == 6 );
+	
+	// Copies share it:
+	LEOInitCopy( &stringValue, &copy, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsRangeOfString( &copy, kLEOChunkTypeLine, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "second line" );
+	
+	// Changing the string gets rid of it:
+	LEOSetValueRangeAsString( &stringValue, kLEOChunkTypeLine, 1, 1, "2nd", ctx );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkIndexes == NULL );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "2nd" );
+	LEOSetValueRangeAsString( &stringValue, kLEOChunkTypeLine, 0, 0, "1st", ctx );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 2, 2, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "third line" );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 0, 0, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "1st" );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkIndexes != NULL );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, SIZE_MAX, SIZE_MAX, "\nfourth line", ctx );
+	str = LEOGetValueAsString( &stringValue, NULL, 0, ctx );
+	ASSERT( LEOGetChunkCountOfValue( &stringValue, str, stringValue.string.stringLen, kLEOChunkTypeLine, ctx ) == 4 );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 3, 3, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "fourth line" );
+	
+	LEOGetValueAsRangeOfString( &copy, kLEOChunkTypeLine, 2, 2, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "third line" );
+	
+	LEOCleanUpValue( &copy, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoChunkCursorTest( void )
+{
+	const char*		testStrs[] = { "", "a", ",", ",,", "a,b,,c,", "one two  three", "  lead and trail  ",
+									"line 1\nline 2\r\nline 4\n", "\n", "\xc3\xa4\xc3\xb6 \xe2\x82\xac,x\ny", NULL };
+	LEOChunkType	testTypes[] = { kLEOChunkTypeByte, kLEOChunkTypeCharacter, kLEOChunkTypeItem, kLEOChunkTypeLine, kLEOChunkTypeWord, kLEOChunkTypeINVALID };
+	
+	printf( "\nnote: Chunk cursor tests\n" );
+	
+	// Continuing from wherever the previous lookup left the cursor must give
+	//	the same ranges as scanning the whole string, in any order:
+	bool	allRangesMatch = true,
+			resumedAny = false;
+	for( size_t s = 0; testStrs[s] != NULL; s++ )
+	{
+		size_t	theLen = strlen(testStrs[s]);
+		for( size_t t = 0; testTypes[t] != kLEOChunkTypeINVALID; t++ )
+		{
+			struct LEOChunkCursor	theCursor = { kLEOChunkTypeINVALID, 0, 0, 0, 0, 0, 0 };
+			for( size_t n = 0; n < 2 * 64; n++ )
+			{
+				size_t	rangeStart = (n < 64) ? (n / 8) : ((127 -n) % 8),	// Forward, then backward.
+						rangeEnd = (n < 64) ? (n % 8) : ((127 -n) / 8);
+				size_t	scanned[4] = { 99, 99, 99, 99 }, resumed[4] = { 99, 99, 99, 99 };
+				if( LEOChunkCursorCanResume( &theCursor, theLen, testTypes[t], rangeStart, rangeEnd, ',' ) && theCursor.chunkNum > 0 )
+					resumedAny = true;
+				LEOGetChunkRanges( testStrs[s], testTypes[t], rangeStart, rangeEnd, scanned +0, scanned +1, scanned +2, scanned +3, ',' );
+				LEOGetChunkRangesWithCursor( testStrs[s], theLen, testTypes[t], rangeStart, rangeEnd, resumed +0, resumed +1, resumed +2, resumed +3, ',', &theCursor );
+				if( memcmp( scanned, resumed, sizeof(scanned) ) != 0 )
+					allRangesMatch = false;
+			}
+		}
+	}
+	ASSERT( allRangesMatch );
+	ASSERT( resumedAny );
+	
+	// Looking at one line after the other doesn't need an index:
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	char				chunkStr[100] = { 0 };
+	LEOInitStringValue( &stringValue, "first line\nsecond line\nthird line", 33, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 0, 0, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "first line" );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "second line" );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "second line" );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeLine, 2, 2, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "third line" );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkIndexes == NULL );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkCursor.chunkNum == 2 );
+	
+	// Changing the string resets the cursor:
+	LEOSetValueRangeAsString( &stringValue, kLEOChunkTypeLine, 2, 2, "3rd line, changed", ctx );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkCursor.type == kLEOChunkTypeINVALID );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeWord, 4, 4, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "3rd" );
+	LEOSetValuePredeterminedRangeAsString( &stringValue, 0, 5, "1st", ctx );
+	ASSERT( stringValue.string.storage.buffer.sharedBuffer->chunkCursor.type == kLEOChunkTypeINVALID );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeWord, 5, 6, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "line, changed" );
+	LEOSetValueAsString( &stringValue, "first line\nsecond line\nthird line", 33, ctx );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeWord, 4, 5, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "third line" );
+	
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_CHUNK_INDEX_BENCHMARK_LINES		100000
+
+
+void	DoChunkIndexBenchmark( void )
+{
+	printf( "\nnote: Chunk index benchmark\n" );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOHandler		*	handler = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "forEachLine" ) );
+	LEOHandlerAddInstruction( handler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, (uint16_t) -1, 0 );	// The text we push below, right before the base pointer.
+	LEOHandlerAddInstruction( handler, COUNT_CHUNKS_INSTR, 0, kLEOChunkTypeLine );	// Loop counter.
+	LEOHandlerAddInstruction( handler, PUSH_INTEGER_INSTR, kLEOUnitNone, 1 );	// Line number.
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, 1, 0 );
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, 1, 0 );
+	LEOHandlerAddInstruction( handler, PUSH_CHUNK_INSTR, (uint16_t) -1, kLEOChunkTypeLine );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -2, 0 );	// Into the result.
+	LEOHandlerAddInstruction( handler, ADD_INTEGER_INSTR, 1, 1 );
+	LEOHandlerAddInstruction( handler, ADD_INTEGER_INSTR, 0, (uint32_t) -1 );
+	LEOHandlerAddInstruction( handler, JUMP_RELATIVE_IF_GT_ZERO_INSTR, 0, (uint32_t) -6 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// Line number.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// Loop counter.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// The text.
+	LEOHandlerAddInstruction( handler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	LEOStringBuilder	text;
+	char				lineStr[100] = { 0 };
+	LEOStringBuilderInit( &text );
+	for( int x = 1; x <= LEO_CHUNK_INDEX_BENCHMARK_LINES; x++ )
+	{
+		snprintf( lineStr, sizeof(lineStr), (x > 1) ? "\nline %d" : "line %d", x );
+		LEOStringBuilderAppendCString( &text, lineStr );
+	}
+	
+	LEOContext*		ctx = LEOContextCreate( group, NULL, NULL );
+	LEOPushEmptyValueOnStack( ctx );	// Result.
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, handler, theScript, NULL, NULL );
+	LEOPushStringValueOnStack( ctx, text.string, text.stringLen );	// The text.
+	LEOStringBuilderCleanUp( &text );
+	
+	clock_t		startTime = clock();
+	LEORunInContextFast( handler->instructions, ctx );
+	double		seconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +1 );
+	snprintf( lineStr, sizeof(lineStr), "line %d", LEO_CHUNK_INDEX_BENCHMARK_LINES );
+	ASSERT_STRING_MATCH( LEOGetValueAsString( ctx->stack, NULL, 0, ctx ), lineStr );
+	printf( "note: Getting each of %d lines: %f seconds\n", LEO_CHUNK_INDEX_BENCHMARK_LINES, seconds );
+	
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoChunkScanTest( void )
+{
+	printf( "\nnote: Chunk delimiter scanning tests\n" );
+	
+	// Delimiters must be found wherever they are relative to the blocks of
+	//	bytes that are looked at together:
+	char	str[100] = { 0 };
+	bool	allItemsFound = true,
+			allLinesFound = true,
+			allWordsFound = true;
+	for( size_t theLen = 2; theLen < 80; theLen++ )
+	{
+		for( size_t pos = 0; pos < theLen; pos++ )
+		{
+			size_t	chunkStart = 0, chunkEnd = 0, delChunkStart = 0, delChunkEnd = 0, numChunks = 0;
+			memset( str, 'x', theLen );
+			str[theLen] = 0;
+			str[pos] = ',';
+			LEODoForEachChunk( str, theLen, kLEOChunkTypeItem, DoCountChunksCallback, ',', &numChunks );
+			LEOGetChunkRanges( str, kLEOChunkTypeItem, 1, 1, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+			if( numChunks != 2 || chunkStart != pos +1 || chunkEnd != theLen )
+				allItemsFound = false;
+			
+			str[pos] = '\r';
+			numChunks = 0;
+			LEODoForEachChunk( str, theLen, kLEOChunkTypeLine, DoCountChunksCallback, 0, &numChunks );
+			LEOGetChunkRanges( str, kLEOChunkTypeLine, 0, 0, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, 0 );
+			if( numChunks != 2 || chunkStart != 0 || chunkEnd != pos )
+				allLinesFound = false;
+			
+			str[pos] = '\t';
+			numChunks = 0;
+			LEODoForEachChunk( str, theLen, kLEOChunkTypeWord, DoCountChunksCallback, 0, &numChunks );
+			LEOGetChunkRanges( str, kLEOChunkTypeWord, 0, 0, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, 0 );
+			if( numChunks != ((pos == 0 || pos == theLen -1) ? 1 : 2) || chunkEnd != ((pos == 0) ? theLen : pos) )
+				allWordsFound = false;
+		}
+	}
+	ASSERT( allItemsFound );
+	ASSERT( allLinesFound );
+	ASSERT( allWordsFound );
+	
+	// Multi-byte characters are still decoded:
+	const char*	umlautStr = "0123456789012345678901234567890\xc3\xa4,0123456789012345678901234567890123\xc3\xa4";
+	size_t		chunkStart = 0, chunkEnd = 0, delChunkStart = 0, delChunkEnd = 0, numChunks = 0;
+	LEOGetChunkRanges( umlautStr, kLEOChunkTypeItem, 1, 1, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+	ASSERT( chunkStart == 34 && chunkEnd == 70 );
+	LEOGetChunkRanges( umlautStr, kLEOChunkTypeItem, 0, 0, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, 0xE4 );	// Matches the decoded umlaut.
+	ASSERT( chunkStart == 0 && chunkEnd == 31 );
+	LEODoForEachChunk( umlautStr, strlen(umlautStr), kLEOChunkTypeItem, DoCountChunksCallback, 0xE4, &numChunks );
+	ASSERT( numChunks == 3 );
+	
+	// Even for invalid UTF-8, we find the same delimiters as decoding each character would:
+	const char*	invalidStr = "01234567890123456789012345678901234567890\xc3,\xc0\xac" "0123456789012345678901234567890123456789";
+	numChunks = 0;
+	LEODoForEachChunk( invalidStr, strlen(invalidStr), kLEOChunkTypeItem, DoCountChunksCallback, ',', &numChunks );
+	ASSERT( numChunks == 2 );
+	LEOGetChunkRanges( invalidStr, kLEOChunkTypeItem, 1, 1, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+	ASSERT( chunkStart == 44 );
+	numChunks = 0;
+	LEODoForEachChunk( invalidStr, strlen(invalidStr), kLEOChunkTypeItem, DoCountChunksCallback, 0xAC, &numChunks );
+	ASSERT( numChunks == 1 );
+}
+
+
+#define LEO_CHUNK_SCAN_BENCHMARK_SIZE		(8 * 1024 * 1024)
+
+
+static double	RunChunkScanBenchmark( const char* inText, size_t inLen, LEOChunkType inType, uint32_t itemDelimiter, size_t *outNumChunks )
+{
+	clock_t		startTime = clock();
+	*outNumChunks = 0;
+	LEODoForEachChunk( inText, inLen, inType, DoCountChunksCallback, itemDelimiter, outNumChunks );
+	
+	return (clock() -startTime) / (double)CLOCKS_PER_SEC;
+}
+
+
+void	DoChunkScanBenchmark( void )
+{
+	printf( "\nnote: Chunk delimiter scanning benchmark\n" );
+	
+	LEOStringBuilder	csvText, logText;
+	LEOStringBuilderInit( &csvText );
+	LEOStringBuilderInit( &logText );
+	char				rowStr[200] = { 0 };
+	for( int x = 1; csvText.stringLen < LEO_CHUNK_SCAN_BENCHMARK_SIZE; x++ )
+	{
+		snprintf( rowStr, sizeof(rowStr), "%d,Jane Doe %d,jane.doe%d@example.com,2026-10-%02d,%d.%02d\n", x, x, x, (x % 28) +1, x % 1000, x % 100 );
+		LEOStringBuilderAppendCString( &csvText, rowStr );
+	}
+	for( int x = 1; logText.stringLen < LEO_CHUNK_SCAN_BENCHMARK_SIZE; x++ )
+	{
+		snprintf( rowStr, sizeof(rowStr), "2026-10-17 12:%02d:%02d.%03d INFO [worker-%d] GET /api/v1/items/%d served in %d ms\n", (x / 60) % 60, x % 60, x % 1000, x % 8, x, x % 97 );
+		LEOStringBuilderAppendCString( &logText, rowStr );
+	}
+	
+	size_t		numItems = 0, numLines = 0, numWords = 0;
+	double		itemSeconds = RunChunkScanBenchmark( csvText.string, csvText.stringLen, kLEOChunkTypeItem, ',', &numItems );
+	double		lineSeconds = RunChunkScanBenchmark( logText.string, logText.stringLen, kLEOChunkTypeLine, 0, &numLines );
+	double		wordSeconds = RunChunkScanBenchmark( logText.string, logText.stringLen, kLEOChunkTypeWord, 0, &numWords );
+	
+	size_t		chunkStart = 0, chunkEnd = 0, delChunkStart = 0, delChunkEnd = 0;
+	clock_t		startTime = clock();
+	LEOGetChunkRanges( logText.string, kLEOChunkTypeLine, numLines -2, numLines -2, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, 0 );
+	double		lastLineSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+	ASSERT( chunkEnd == logText.stringLen -1 );
+	
+	double		megabytes = LEO_CHUNK_SCAN_BENCHMARK_SIZE / (1024.0 * 1024.0);
+	printf( "note: %zu CSV items: %f seconds (%.0f MB/s)\n", numItems, itemSeconds, megabytes / itemSeconds );
+	printf( "note: %zu log lines: %f seconds (%.0f MB/s), last line: %f seconds\n", numLines, lineSeconds, megabytes / lineSeconds, lastLineSeconds );
+	printf( "note: %zu log words: %f seconds (%.0f MB/s)\n", numWords, wordSeconds, megabytes / wordSeconds );
+	
+	LEOStringBuilderCleanUp( &csvText );
+	LEOStringBuilderCleanUp( &logText );
+}
+
+
+void	DoChunkLengthTest( void )
+{
+	printf( "\nnote: Chunks of strings of known length\n" );
+	
+	// Strings of known length may contain NULs and don't need to be terminated:
+	size_t		chunkStart = 0, chunkEnd = 0, delChunkStart = 0, delChunkEnd = 0;
+	LEOGetChunkRangesOfLength( "a\0b,c\nd", 7, kLEOChunkTypeItem, 1, 1, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+	ASSERT( chunkStart == 4 && chunkEnd == 7 );
+	LEOGetChunkRangesOfLength( "a\0b,c\nd", 7, kLEOChunkTypeLine, 1, 1, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+	ASSERT( chunkStart == 6 && chunkEnd == 7 );
+	LEOGetChunkRangesOfLength( "abc,def", 3, kLEOChunkTypeItem, 0, 0, &chunkStart, &chunkEnd, &delChunkStart, &delChunkEnd, ',' );
+	ASSERT( chunkStart == 0 && chunkEnd == 3 );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		stringValue;
+	char				chunkStr[100] = { 0 };
+	LEOInitStringValue( &stringValue, "zero\0one,two,three", 18, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsRangeOfString( &stringValue, kLEOChunkTypeItem, 2, 2, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "three" );
+	ASSERT( LEOGetChunkCountOfValue( &stringValue, LEOGetValueAsString( &stringValue, NULL, 0, ctx ), 18, kLEOChunkTypeItem, ctx ) == 3 );
+	
+	// Chunks of a part of a string stay inside that part:
+	size_t		bytesStart = 0, bytesEnd = 3, bytesDelStart = 0, bytesDelEnd = 0;
+	LEOSetValueAsString( &stringValue, "a,b\nc,d", 7, ctx );
+	LEODetermineChunkRangeOfSubstring( &stringValue, &bytesStart, &bytesEnd, &bytesDelStart, &bytesDelEnd, kLEOChunkTypeItem, 1, 1, ctx );
+	ASSERT( bytesStart == 2 && bytesEnd == 3 );
+	bytesStart = 0;
+	bytesEnd = 3;
+	LEODetermineChunkRangeOfSubstring( &stringValue, &bytesStart, &bytesEnd, &bytesDelStart, &bytesDelEnd, kLEOChunkTypeItem, 2, 2, ctx );
+	ASSERT( bytesEnd <= 3 );	// Not item "d" of the next line.
+	bytesStart = 4;
+	bytesEnd = SIZE_MAX;
+	LEODetermineChunkRangeOfSubstring( &stringValue, &bytesStart, &bytesEnd, &bytesDelStart, &bytesDelEnd, kLEOChunkTypeItem, 1, 1, ctx );
+	ASSERT( bytesStart == 6 && bytesEnd == 7 );
+	LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	
+	// String constants have no buffer to keep track of chunks in:
+	union LEOValue		constantValue;
+	memset( &constantValue, 0, sizeof(constantValue) );
+	LEOInitStringConstantValue( &constantValue, "first,second,third", kLEOInvalidateReferences, ctx );
+	LEOGetValueAsRangeOfString( &constantValue, kLEOChunkTypeItem, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+	ASSERT_STRING_MATCH( chunkStr, "second" );
+	ASSERT( LEOGetChunkCountOfValue( &constantValue, LEOGetValueAsString( &constantValue, NULL, 0, ctx ), 18, kLEOChunkTypeItem, ctx ) == 3 );
+	LEOCleanUpValue( &constantValue, kLEOInvalidateReferences, ctx );
+	
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_CHUNK_LENGTH_BENCHMARK_CALLS		100000
+
+
+void	DoChunkLengthBenchmark( void )
+{
+	printf( "\nnote: Chunk lookup cost by string length benchmark\n" );
+	
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	
+	for( size_t theSize = 64 * 1024; theSize <= 16 * 1024 * 1024; theSize *= 16 )
+	{
+		LEOStringBuilder	text;
+		LEOStringBuilderInit( &text );
+		for( int x = 1; text.stringLen < theSize; x++ )
+		{
+			char	lineStr[100] = { 0 };
+			snprintf( lineStr, sizeof(lineStr), "line %d,with,some,items\n", x );
+			LEOStringBuilderAppendCString( &text, lineStr );
+		}
+		
+		union LEOValue		stringValue, rangeValue;
+		LEOInitStringValue( &stringValue, text.string, text.stringLen, kLEOInvalidateReferences, ctx );
+		LEOInitStringValueWithRangeOfValue( &rangeValue, &stringValue, LEOGetValueAsString( &stringValue, NULL, 0, ctx ), 0, text.stringLen -1, kLEOInvalidateReferences, ctx );
+		LEOStringBuilderCleanUp( &text );
+		
+		// Item 2 of line 2 of the whole string:
+		size_t		bytesStart = 0, bytesEnd = SIZE_MAX, bytesDelStart = 0, bytesDelEnd = 0;
+		clock_t		startTime = clock();
+		for( int x = 0; x < LEO_CHUNK_LENGTH_BENCHMARK_CALLS; x++ )
+		{
+			bytesStart = 0;
+			bytesEnd = SIZE_MAX;
+			LEODetermineChunkRangeOfSubstring( &stringValue, &bytesStart, &bytesEnd, &bytesDelStart, &bytesDelEnd, kLEOChunkTypeLine, 1, 1, ctx );
+			LEODetermineChunkRangeOfSubstring( &stringValue, &bytesStart, &bytesEnd, &bytesDelStart, &bytesDelEnd, kLEOChunkTypeItem, 1, 1, ctx );
+		}
+		double		wholeSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+		ASSERT( bytesStart == 30 && bytesEnd == 34 );
+		
+		// Line 2 of a value sharing all but the last character of the string:
+		char		chunkStr[100] = { 0 };
+		startTime = clock();
+		for( int x = 0; x < LEO_CHUNK_LENGTH_BENCHMARK_CALLS; x++ )
+			LEOGetValueAsRangeOfString( &rangeValue, kLEOChunkTypeLine, 1, 1, chunkStr, sizeof(chunkStr), ctx );
+		double		rangeSeconds = (clock() -startTime) / (double)CLOCKS_PER_SEC;
+		ASSERT_STRING_MATCH( chunkStr, "line 2,with,some,items" );
+		
+		printf( "note: %zu KB string: %.0f ns per item of a line, %.0f ns per line of a part\n", theSize / 1024,
+				wholeSeconds * 1e9 / LEO_CHUNK_LENGTH_BENCHMARK_CALLS, rangeSeconds * 1e9 / LEO_CHUNK_LENGTH_BENCHMARK_CALLS );
+		
+		LEOCleanUpValue( &rangeValue, kLEOInvalidateReferences, ctx );
+		LEOCleanUpValue( &stringValue, kLEOInvalidateReferences, ctx );
+	}
+	
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
+#define LEO_STRING_VIEW_TEST_CUSTOM_LENGTH		3000
+
+
+// Like value types written before GetAsStringView, can only copy its string into a buffer:
+static const char*	StringViewTestGetCustomValueAsString( LEOValuePtr self, char* outBuf, size_t bufSize, struct LEOContext* inContext )
+{
+	if( !outBuf )
+		return NULL;
+	
+	size_t	x = 0;
+	for( ; x < LEO_STRING_VIEW_TEST_CUSTOM_LENGTH && (x +1) < bufSize; x++ )
+		outBuf[x] = 'a' +(x % 26);
+	outBuf[x] = 0;
+	return outBuf;
+}
+
+
+void	DoStringViewTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	union LEOValue		theValue;
+	union LEOValue		refValue;
+	struct LEOStringView	theView;
+	
+	printf( "\nnote: String view tests\n" );
+	
+	// Strings are lent out, not copied:
+	LEOInitStringValue( &theValue, "first,second,third", 18, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsStringView( &theValue, &theView, ctx );
+	ASSERT( theView.string == LEOStringValueCharacters( &theValue ) && theView.stringLen == 18 );
+	ASSERT( theView.spilledString == NULL );
+	LEOCleanUpStringView( &theView );
+	
+	// So are the strings of referenced values, but chunks get copied:
+	LEOInitReferenceValue( &refValue, &theValue, kLEOInvalidateReferences, kLEOChunkTypeINVALID, 0, 0, ctx );
+	LEOGetValueAsStringView( &refValue, &theView, ctx );
+	ASSERT( theView.string == LEOStringValueCharacters( &theValue ) );
+	LEOCleanUpStringView( &theView );
+	LEOCleanUpValue( &refValue, kLEOInvalidateReferences, ctx );
+	LEOInitReferenceValue( &refValue, &theValue, kLEOInvalidateReferences, kLEOChunkTypeItem, 1, 1, ctx );
+	LEOGetValueAsStringView( &refValue, &theView, ctx );
+	ASSERT( theView.stringLen == 6 && strcmp( theView.string, "second" ) == 0 );
+	LEOCleanUpStringView( &theView );
+	LEOCleanUpValue( &refValue, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &theValue, kLEOInvalidateReferences, ctx );
+	
+	// Short generated strings need no allocation:
+	LEOInitNumberValue( &theValue, 1.5, kLEOUnitNone, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsStringView( &theValue, &theView, ctx );
+	ASSERT( theView.string == theView.shortString && theView.spilledString == NULL );
+	ASSERT_STRING_MATCH( theView.string, "1.5" );
+	LEOCleanUpStringView( &theView );
+	LEOCleanUpValue( &theValue, kLEOInvalidateReferences, ctx );
+	
+	// Long ones go on the heap instead of being cut off:
+	struct LEOArrayEntry*	theArray = NULL;
+	char					keyStr[20] = { 0 };
+	LEOInitStringValue( &refValue, "some longer item value", 22, kLEOInvalidateReferences, ctx );
+	for( int x = 1; x <= 100; x++ )
+	{
+		snprintf( keyStr, sizeof(keyStr), "%d", x );
+		LEOAddArrayEntryToRoot( &theArray, keyStr, &refValue, ctx );
+	}
+	LEOCleanUpValue( &refValue, kLEOInvalidateReferences, ctx );
+	LEOInitArrayValue( &theValue.array, theArray, kLEOInvalidateReferences, ctx );
+	LEOGetValueAsStringView( &theValue, &theView, ctx );
+	ASSERT( theView.spilledString != NULL && theView.stringLen > 2048 && strlen( theView.string ) == theView.stringLen );
+	ASSERT( strstr( theView.string, "100:some longer item value" ) != NULL );
+	ASSERT( theView.string[theView.stringLen -1] != '\n' );
+	LEOCleanUpStringView( &theView );
+	ASSERT( theView.spilledString == NULL && theView.stringLen == 0 );
+	LEOCleanUpValue( &theValue, kLEOInvalidateReferences, ctx );
+	
+	// Value types without GetAsStringView aren't cut off either, not even through a reference:
+	struct LEOValueType	customType = kLeoValueTypeNumber;
+	customType.displayTypeName = "custom";
+	customType.GetAsString = StringViewTestGetCustomValueAsString;
+	customType.GetAsStringView = NULL;
+	LEOInitNumberValue( &theValue, 0, kLEOUnitNone, kLEOInvalidateReferences, ctx );
+	theValue.base.isa = &customType;
+	LEOGetValueAsStringView( &theValue, &theView, ctx );
+	ASSERT( theView.stringLen == LEO_STRING_VIEW_TEST_CUSTOM_LENGTH && strlen( theView.string ) == theView.stringLen );
+	ASSERT( theView.string[LEO_STRING_VIEW_TEST_CUSTOM_LENGTH -1] == 'a' +((LEO_STRING_VIEW_TEST_CUSTOM_LENGTH -1) % 26) );
+	LEOCleanUpStringView( &theView );
+	LEOInitReferenceValue( &refValue, &theValue, kLEOInvalidateReferences, kLEOChunkTypeINVALID, 0, 0, ctx );
+	LEOGetValueAsStringView( &refValue, &theView, ctx );
+	ASSERT( theView.stringLen == LEO_STRING_VIEW_TEST_CUSTOM_LENGTH );
+	LEOCleanUpStringView( &theView );
+	LEOCleanUpValue( &refValue, kLEOInvalidateReferences, ctx );
+	LEOCleanUpValue( &theValue, kLEOInvalidateReferences, ctx );
+	
+	LEOContextRelease( ctx );
+	
+	// Instructions see all of a long value:
+	LEOScript		*	theScript = LEOScriptCreateForOwner( 0, 0, NULL );
+	LEOHandler		*	handler = LEOScriptAddCommandHandlerWithID( theScript, LEOContextGroupHandlerIDForHandlerName( group, "splitLongText" ) );
+	LEOHandlerAddInstruction( handler, LINE_MARKER_INSTR, 0, 1 );
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, (uint16_t) -2, 0 );	// The first text we push below.
+	LEOHandlerAddInstruction( handler, ASSIGN_CHUNK_ARRAY_INSTR, BACK_OF_STACK, kLEOChunkTypeItem );
+	LEOHandlerAddInstruction( handler, COUNT_CHUNKS_INSTR, 0, kLEOChunkTypeLine );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -4, 0 );	// Into the first result.
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, (uint16_t) -2, 0 );
+	LEOHandlerAddInstruction( handler, ASSIGN_CHUNK_ARRAY_INSTR, BACK_OF_STACK, kLEOChunkTypeItem );
+	LEOHandlerAddInstruction( handler, PUSH_REFERENCE_INSTR, (uint16_t) -1, 0 );	// The second text.
+	LEOHandlerAddInstruction( handler, ASSIGN_CHUNK_ARRAY_INSTR, BACK_OF_STACK, kLEOChunkTypeItem );
+	LEOHandlerAddInstruction( handler, EQUAL_OPERATOR_INSTR, 0, 0 );
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, (uint16_t) -3, 0 );	// Into the second result.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );	// The texts.
+	LEOHandlerAddInstruction( handler, POP_VALUE_INSTR, BACK_OF_STACK, 0 );
+	LEOHandlerAddInstruction( handler, RETURN_FROM_HANDLER_INSTR, 0, 0 );
+	
+	// Two texts with 300 items that only differ in the last one:
+	LEOStringBuilder	text;
+	char				itemStr[100] = { 0 };
+	LEOStringBuilderInit( &text );
+	for( int x = 1; x < 300; x++ )
+	{
+		snprintf( itemStr, sizeof(itemStr), "item %d,", x );
+		LEOStringBuilderAppendCString( &text, itemStr );
+	}
+	
+	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOPushEmptyValueOnStack( ctx );	// Results.
+	LEOPushEmptyValueOnStack( ctx );
+	LEOContextPushHandlerScriptReturnAddressAndBasePtr( ctx, handler, theScript, NULL, NULL );
+	LEOPushStringValueOnStack( ctx, text.string, text.stringLen );
+	LEOSetValuePredeterminedRangeAsString( ctx->stackEndPtr -1, SIZE_MAX, SIZE_MAX, "last", ctx );
+	LEOPushStringValueOnStack( ctx, text.string, text.stringLen );
+	LEOSetValuePredeterminedRangeAsString( ctx->stackEndPtr -1, SIZE_MAX, SIZE_MAX, "item 300", ctx );
+	LEOStringBuilderCleanUp( &text );
+	
+	LEORunInContext( handler->instructions, ctx );
+	
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +2 );
+	ASSERT( LEOGetValueAsInteger( ctx->stack, NULL, ctx ) == 300 );
+	ASSERT( LEOGetValueAsBoolean( ctx->stack +1, ctx ) == false );
+	
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOContextRelease( ctx );
+	LEOScriptRelease( theScript );
+	LEOContextGroupRelease( group );
+}
+
+
+void	DoEmbeddedNulStringTest( void )
+{
+	LEOContextGroup	*	group = LEOContextGroupCreate( NULL, NULL );
+	LEOContext		*	ctx = LEOContextCreate( group, NULL, NULL );
+	LEOInstruction		concatenateInstructions[] =
+	{
+		{ CONCATENATE_VALUES_INSTR, 0, '|' },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	LEOInstruction		compareInstructions[] =
+	{
+		{ EQUAL_OPERATOR_INSTR, 0, 0 },
+		{ EXIT_TO_TOP_INSTR, 0, 0 }
+	};
+	
+	printf( "\nnote: Embedded NUL string tests\n" );
+	
+	// Concatenation keeps everything after a NUL:
+	LEOPushStringValueOnStack( ctx, "one\0two", 7 );
+	LEOPushStringValueOnStack( ctx, "three\0four", 10 );
+	LEORunInContext( concatenateInstructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( ctx->stackEndPtr == ctx->stack +1 );
+	ASSERT( ctx->stack[0].string.stringLen == 18 );
+	ASSERT( memcmp( LEOStringValueCharacters( ctx->stack ), "one\0two|three\0four", 18 ) == 0 );
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	
+	// Comparisons look at everything after a NUL, too:
+	LEOPushStringValueOnStack( ctx, "same\0one", 8 );
+	LEOPushStringValueOnStack( ctx, "SAME\0two", 8 );
+	LEORunInContext( compareInstructions, ctx );
+	ASSERT( ctx->errMsg[0] == 0 );
+	ASSERT( LEOGetValueAsBoolean( ctx->stack, ctx ) == false );
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOPushStringValueOnStack( ctx, "same\0one", 8 );
+	LEOPushStringValueOnStack( ctx, "SAME\0ONE", 8 );
+	LEORunInContext( compareInstructions, ctx );
+	ASSERT( LEOGetValueAsBoolean( ctx->stack, ctx ) == true );
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	LEOPushStringValueOnStack( ctx, "same\0", 5 );
+	LEOPushStringValueOnStack( ctx, "same", 4 );
+	LEORunInContext( compareInstructions, ctx );
+	ASSERT( LEOGetValueAsBoolean( ctx->stack, ctx ) == false );
+	LEOCleanUpStackToPtr( ctx, ctx->stack );
+	
+	LEOContextRelease( ctx );
+	LEOContextGroupRelease( group );
+}
+
+
 int main( int argc, char** argv )
 {
 	LEOInitInstructionArray();
@@ -1063,6 +3543,41 @@ int main( int argc, char** argv )
 	
 	DoChunkReferenceTests();
 	
+	DoStackGrowthTest();
+	DoInstructionFusionTest();
+	DoProfilerTest();
+	DoHandlerProfilerTest();
+	DoProfilerCallChainTest();
+	DoHandlerLookupCacheTest();
+	DoHandlerIndexTest();
+	DoHandlerNameInterningTest();
+	DoReferenceTableBenchmark();
+	DoArrayTest();
+	DoArrayStringTest();
+	DoStringAsArrayTest();
+	DoShortStringTest();
+	DoSharedStringTest();
+	DoStringAppendTest();
+	DoChunkIndexTest();
+	DoChunkCursorTest();
+	DoChunkScanTest();
+	DoChunkLengthTest();
+	DoStringViewTest();
+	DoEmbeddedNulStringTest();
+	
+	DoInterpreterBenchmark();
+	DoContextPoolBenchmark();
+	DoArrayBenchmark();
+	DoArrayParameterBenchmark();
+	DoArrayStringBenchmark();
+	DoStringAsArrayBenchmark();
+	DoStringScriptBenchmark();
+	DoStringParameterBenchmark();
+	DoStringAppendBenchmark();
+	DoChunkIndexBenchmark();
+	DoChunkScanBenchmark();
+	DoChunkLengthBenchmark();
+	
 	if( gAnyTestFailed )
 		printf( "* BUILD FAILED *\n" );
 	
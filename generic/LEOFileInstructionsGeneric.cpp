@@ -19,6 +19,7 @@
 #include "LEOScript.h"
 #include <string.h>
 #include <stdlib.h>
+#include <string>
 #include "AnsiFiles.h"
 
 
@@ -100,17 +101,17 @@ struct THostCommandEntry		gFileHostFunctions[] =
 
 void	LEOWriteToFileInstruction( LEOContext* inContext )
 {
-	char			dataBuf[1024] = { 0 };
-	char			filePathBuf[1024] = { 0 };
+	struct LEOStringView	strToWrite;
+	struct LEOStringView	filePath;
 	union LEOValue*	theDataValue = inContext->stackEndPtr -2;
 	union LEOValue*	theFileValue = inContext->stackEndPtr -1;
-	const char* strToWrite = LEOGetValueAsString( theDataValue, dataBuf, sizeof(dataBuf), inContext );
-	const char* filePath = LEOGetValueAsString( theFileValue, filePathBuf, sizeof(filePathBuf), inContext );
-	FILE * theFile = LEOFOpen( filePath, "w" );
+	LEOGetValueAsStringView( theDataValue, &strToWrite, inContext );
+	LEOGetValueAsStringView( theFileValue, &filePath, inContext );
+	FILE * theFile = LEOFOpen( filePath.string, "w" );
 	if( theFile )
 	{
-		size_t itemsToWrite = strlen(strToWrite);
-		size_t itemsWritten = fwrite( strToWrite, 1, itemsToWrite, theFile );
+		size_t itemsToWrite = strToWrite.stringLen;
+		size_t itemsWritten = fwrite( strToWrite.string, 1, itemsToWrite, theFile );
 		fclose( theFile );
 		
 		if( itemsWritten != itemsToWrite )
@@ -122,6 +123,8 @@ void	LEOWriteToFileInstruction( LEOContext* inContext )
 	{
 		LEOContextSetLocalVariable( inContext, "result", "Couldn't open file for writing." );
 	}
+	LEOCleanUpStringView( &strToWrite );
+	LEOCleanUpStringView( &filePath );
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -2 );
 	
 	inContext->currentInstruction++;
@@ -130,10 +133,11 @@ void	LEOWriteToFileInstruction( LEOContext* inContext )
 
 void	LEOReadFromFileInstruction( LEOContext* inContext )
 {
-	char			filePathBuf[1024] = { 0 };
+	struct LEOStringView	filePath;
 	union LEOValue*	theFileValue = inContext->stackEndPtr -1;
-	const char* filePath = LEOGetValueAsString( theFileValue, filePathBuf, sizeof(filePathBuf), inContext );
-	FILE * theFile = LEOFOpen( filePath, "r" );
+	LEOGetValueAsStringView( theFileValue, &filePath, inContext );
+	FILE * theFile = LEOFOpen( filePath.string, "r" );
+	LEOCleanUpStringView( &filePath );
 	if( theFile )
 	{
 		fseek( theFile, 0, SEEK_END);
@@ -177,37 +181,41 @@ void	LEOReadFromFileInstruction( LEOContext* inContext )
 
 void	LEOCopyFileInstruction( LEOContext* inContext )
 {
-	char			dataBuf[1024] = { 0 };
+	struct LEOStringView	srcPathStr;
 	union LEOValue*	theSrcPathValue = inContext->stackEndPtr -2;
-	const char* srcPath = LEOGetValueAsString( theSrcPathValue, dataBuf, sizeof(dataBuf), inContext );
+	LEOGetValueAsStringView( theSrcPathValue, &srcPathStr, inContext );
+	std::string		srcPath( srcPathStr.string, srcPathStr.stringLen );
+	LEOCleanUpStringView( &srcPathStr );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 		return;
 	
-	char			dataBuf2[1024] = { 0 };
+	struct LEOStringView	dstPathStr;
 	union LEOValue*	theDstPathValue = inContext->stackEndPtr -1;
-	const char* dstPath = LEOGetValueAsString( theDstPathValue, dataBuf2, sizeof(dataBuf2), inContext );
+	LEOGetValueAsStringView( theDstPathValue, &dstPathStr, inContext );
+	std::string		dstPath( dstPathStr.string, dstPathStr.stringLen );
+	LEOCleanUpStringView( &dstPathStr );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
 		return;
 	
-	FILE * srcFile = LEOFOpen( srcPath, "r" );
+	FILE * srcFile = LEOFOpen( srcPath.c_str(), "r" );
 	if( !srcFile )
 	{
 		size_t		lineNo = SIZE_MAX;
 		uint16_t	fileID = 0;
 		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Can't open source file \"%s\" for reading.", srcPath );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Can't open source file \"%s\" for reading.", srcPath.c_str() );
 		return;
 	}
 	
-	filesystem::create_directories( filesystem::path(dstPath).parent_path() );
+	filesystem::create_directories( filesystem::path(dstPath.c_str()).parent_path() );
 	
-	FILE * dstFile = LEOFOpen( dstPath, "w" );
+	FILE * dstFile = LEOFOpen( dstPath.c_str(), "w" );
 	if( !dstFile )
 	{
 		size_t		lineNo = SIZE_MAX;
 		uint16_t	fileID = 0;
 		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Couldn't create file at \"%s\".", dstPath );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Couldn't create file at \"%s\".", dstPath.c_str() );
 		return;
 	}
 	
@@ -228,7 +236,7 @@ void	LEOCopyFileInstruction( LEOContext* inContext )
 			size_t		lineNo = SIZE_MAX;
 			uint16_t	fileID = 0;
 			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unable to read the remaining %zu bytes from file \"%s\".", bytesLeft, srcPath );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unable to read the remaining %zu bytes from file \"%s\".", bytesLeft, srcPath.c_str() );
 			return;
 		}
 		size_t currBytesWritten = fwrite( fileBuf, 1, currBytesRead, dstFile );
@@ -237,7 +245,7 @@ void	LEOCopyFileInstruction( LEOContext* inContext )
 			size_t		lineNo = SIZE_MAX;
 			uint16_t	fileID = 0;
 			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unable to write the remaining %zu bytes to file \"%s\".", bytesLeft, dstPath );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unable to write the remaining %zu bytes to file \"%s\".", bytesLeft, dstPath.c_str() );
 			return;
 		}
 		numBytesRead += currBytesRead;
@@ -256,17 +264,17 @@ void	LEOCopyFileInstruction( LEOContext* inContext )
 
 void	LEOListFilesInstruction( LEOContext* inContext )
 {
-	char			filePathBuf[1024] = { 0 };
+	struct LEOStringView	filePath;
 	union LEOValue*	theFileValue = inContext->stackEndPtr -1;
-	const char*		filePath = LEOGetValueAsString( theFileValue, filePathBuf, sizeof(filePathBuf), inContext );
+	LEOGetValueAsStringView( theFileValue, &filePath, inContext );
 	
-	filesystem::directory_iterator	currFile(filePath);
+	filesystem::directory_iterator	currFile(filePath.string);
+	LEOCleanUpStringView( &filePath );
 	
 	LEOCleanUpValue(theFileValue, kLEOInvalidateReferences, inContext);
 	LEOValueArray * theArrayValue = (LEOValueArray*)theFileValue;
 	LEOInitArrayValue( theArrayValue, NULL, kLEOInvalidateReferences, inContext );
 	
-	char	keyStr[100] = {};
 	size_t	x = 0;
 	for( ; currFile != filesystem::directory_iterator(); ++currFile )
 	{
@@ -275,9 +283,9 @@ void	LEOListFilesInstruction( LEOContext* inContext )
 		if( fname == "." || fname == ".." )
 			continue;
 		
-		snprintf( keyStr, sizeof(keyStr) -1, "%zu", ++x );
-		
-		LEOAddStringArrayEntryToRoot( &theArrayValue->array, keyStr, fname.data(), fname.size(), inContext );
+		LEOValuePtr	newValue = LEOAddArrayEntryWithIndexToRoot( &theArrayValue->array, ++x, NULL, inContext );
+		if( newValue )
+			LEOInitStringValue( newValue, fname.data(), fname.size(), kLEOInvalidateReferences, inContext );
 	}
 	
 	inContext->currentInstruction++;
@@ -38,12 +38,13 @@ std::ostream*			gLEOMsgOutputStream = &std::cout;
 
 void	LEOPrintInstruction( LEOContext* inContext )
 {
-	char			buf[1024] = { 0 };
+	struct LEOStringView	theString;
 	
 	bool			popOffStack = (inContext->currentInstruction->param1 == BACK_OF_STACK);
 	union LEOValue*	theValue = popOffStack ? (inContext->stackEndPtr -1) : (inContext->stackBasePtr +inContext->currentInstruction->param1);
-	const char* theString = LEOGetValueAsString( theValue, buf, sizeof(buf), inContext );
-	(*gLEOMsgOutputStream) << theString;
+	LEOGetValueAsStringView( theValue, &theString, inContext );
+	gLEOMsgOutputStream->write( theString.string, theString.stringLen );
+	LEOCleanUpStringView( &theString );
 	if( popOffStack )
 		LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
 	
@@ -76,16 +77,17 @@ static std::ostream*						sOriginalLEOMsgOutputStream = nullptr;
 
 void	LEOStartRecordingOutputInstruction( LEOContext* inContext )
 {
-	char			buf[1024] = { 0 };
+	struct LEOStringView	theString;
 	
 	union LEOValue*	theValue = inContext->stackEndPtr -1;
-	const char* theString = LEOGetValueAsString( theValue, buf, sizeof(buf), inContext );
+	LEOGetValueAsStringView( theValue, &theString, inContext );
 	
 	if( !sOriginalLEOMsgOutputStream )
 		sOriginalLEOMsgOutputStream = gLEOMsgOutputStream;
-	sOutputRecordingStack.push_back( LEOOutputRecordingEntry(theString) );
+	sOutputRecordingStack.push_back( LEOOutputRecordingEntry(theString.string) );
 	gLEOMsgOutputStream = &sOutputRecordingStack.back().mOutputDestination;
 	
+	LEOCleanUpStringView( &theString );
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
 	
 	inContext->currentInstruction++;
@@ -94,14 +96,14 @@ void	LEOStartRecordingOutputInstruction( LEOContext* inContext )
 
 void	LEOStopRecordingOutputInstruction( LEOContext* inContext )
 {
-	char			buf[1024] = { 0 };
+	struct LEOStringView	theString;
 	
 	union LEOValue*	theValue = inContext->stackEndPtr -1;
-	const char* theString = LEOGetValueAsString( theValue, buf, sizeof(buf), inContext );
+	LEOGetValueAsStringView( theValue, &theString, inContext );
 	
 	if( sOutputRecordingStack.size() > 0 )
 	{
-		if( strcasecmp( theString, sOutputRecordingStack.back().mOutputVariableName.c_str()) == 0 )
+		if( strcasecmp( theString.string, sOutputRecordingStack.back().mOutputVariableName.c_str()) == 0 )
 		{
 			LEOContextSetLocalVariable( inContext, sOutputRecordingStack.back().mOutputVariableName.c_str(), "%s", sOutputRecordingStack.back().mOutputDestination.str().c_str() );
 			sOutputRecordingStack.pop_back();	// Remove our override.
@@ -120,7 +122,7 @@ void	LEOStopRecordingOutputInstruction( LEOContext* inContext )
 			size_t		lineNo = SIZE_MAX;
 			uint16_t	fileID = 0;
 			LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unbalanced 'stop recording output' instruction. Original variable name given was '%s', name given for stop was '%s'.", sOutputRecordingStack.back().mOutputVariableName.c_str(), theString );
+			LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Unbalanced 'stop recording output' instruction. Original variable name given was '%s', name given for stop was '%s'.", sOutputRecordingStack.back().mOutputVariableName.c_str(), theString.string );
 		}
 	}
 	else
@@ -128,9 +130,10 @@ void	LEOStopRecordingOutputInstruction( LEOContext* inContext )
 		size_t		lineNo = SIZE_MAX;
 		uint16_t	fileID = 0;
 		LEOInstructionsFindLineForInstruction( inContext->currentInstruction, &lineNo, &fileID );
-		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Found 'stop recording output' instruction for variable '%s', but 'start recording output' was never called.", theString );
+		LEOContextStopWithError( inContext, lineNo, SIZE_MAX, fileID, "Found 'stop recording output' instruction for variable '%s', but 'start recording output' was never called.", theString.string );
 	}
 	
+	LEOCleanUpStringView( &theString );
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
 	
 	inContext->currentInstruction++;
@@ -49,13 +49,17 @@ struct TBuiltInFunctionEntry	gWebPageBuiltInFunctions[] =
 
 void	LEOHTMLEncodedInstruction( LEOContext* inContext )
 {
-	char			dataBuf[1024] = { 0 };
+	struct LEOStringView	dataStr;
 	union LEOValue*	theDataValue = inContext->stackEndPtr -1;
-	const char* strToEncode = LEOGetValueAsString( theDataValue, dataBuf, sizeof(dataBuf), inContext );
+	LEOGetValueAsStringView( theDataValue, &dataStr, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &dataStr );
 		return;
+	}
 	
-	size_t strToEncodeLen = strlen(strToEncode);
+	const char* strToEncode = dataStr.string;
+	size_t strToEncodeLen = dataStr.stringLen;
 	std::string	escapedStr;
 	escapedStr.reserve(strToEncodeLen);
 	for( size_t x = 0; x < strToEncodeLen; ++x )
@@ -70,6 +74,7 @@ void	LEOHTMLEncodedInstruction( LEOContext* inContext )
 			default: escapedStr.append( 1, strToEncode[x] );
 		}
 	}
+	LEOCleanUpStringView( &dataStr );
 	
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitStringValue( inContext->stackEndPtr -1, escapedStr.c_str(), escapedStr.length(), kLEOInvalidateReferences, inContext );
@@ -85,15 +90,18 @@ void	LEOHTMLEncodedInstruction( LEOContext* inContext )
 
 void	LEOMarkdownToHTMLInstruction( LEOContext* inContext )
 {
-	char			dataBuf[1024] = { 0 };
+	struct LEOStringView	dataStr;
 	union LEOValue*	theDataValue = inContext->stackEndPtr -1;
-	const char* strToEncode = LEOGetValueAsString( theDataValue, dataBuf, sizeof(dataBuf), inContext );
+	LEOGetValueAsStringView( theDataValue, &dataStr, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &dataStr );
 		return;
+	}
 	
-	size_t strToEncodeLen = strlen(strToEncode);
 	tinymarkdown::parser	parser;
-	std::string escapedStr = parser.parse( std::string( strToEncode, strToEncodeLen ) );
+	std::string escapedStr = parser.parse( std::string( dataStr.string, dataStr.stringLen ) );
+	LEOCleanUpStringView( &dataStr );
 	
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
 	LEOInitStringValue( inContext->stackEndPtr -1, escapedStr.c_str(), escapedStr.length(), kLEOInvalidateReferences, inContext );
@@ -110,22 +118,31 @@ void	LEOOffsetFunctionInstruction( LEOContext* inContext )
 				normalized text.
 	 */
 	
-	char			needleBuf[1024] = { 0 };
+	struct LEOStringView	needleView;
 	union LEOValue*	theNeedleValue = inContext->stackEndPtr -2;
-	const char	*	needleStr = LEOGetValueAsString( theNeedleValue, needleBuf, sizeof(needleBuf), inContext );
+	LEOGetValueAsStringView( theNeedleValue, &needleView, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &needleView );
 		return;
+	}
 
-	char			haystackBuf[1024] = { 0 };
+	struct LEOStringView	haystackView;
 	union LEOValue*	theHaystackValue = inContext->stackEndPtr -1;
-	const char	*	haystackStr = LEOGetValueAsString( theHaystackValue, haystackBuf, sizeof(haystackBuf), inContext );
+	LEOGetValueAsStringView( theHaystackValue, &haystackView, inContext );
 	if( (inContext->flags & kLEOContextKeepRunning) == 0 )
+	{
+		LEOCleanUpStringView( &needleView );
+		LEOCleanUpStringView( &haystackView );
 		return;
+	}
 	
 	LEOInteger	offset = -1;
 	
-	size_t haystackLen = strlen(haystackStr);
-	size_t needleLen = strlen(needleStr);
+	const char	*	needleStr = needleView.string;
+	const char	*	haystackStr = haystackView.string;
+	size_t haystackLen = haystackView.stringLen;
+	size_t needleLen = needleView.stringLen;
 	
 	if( haystackLen > needleLen && haystackLen > 0 && needleLen > 0 )
 	{
@@ -166,6 +183,8 @@ void	LEOOffsetFunctionInstruction( LEOContext* inContext )
 			}
 		}
 	}
+	LEOCleanUpStringView( &needleView );
+	LEOCleanUpStringView( &haystackView );
 	
 	LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
 	LEOCleanUpValue( inContext->stackEndPtr -1, kLEOInvalidateReferences, inContext );
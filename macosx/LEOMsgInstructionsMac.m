@@ -20,12 +20,13 @@ void	LEOPrintInstruction( LEOContext* inContext );
 
 void	LEOPrintInstruction( LEOContext* inContext )
 {
-	char				buf[1024] = { 0 };
+	struct LEOStringView	theString;
 	
 	bool				popOffStack = (inContext->currentInstruction->param1 == BACK_OF_STACK);
 	union LEOValue*		theValue = popOffStack ? (inContext->stackEndPtr -1) : (inContext->stackBasePtr +inContext->currentInstruction->param1);
-	LEOGetValueAsString( theValue, buf, sizeof(buf), inContext );
-	NSString		*	theStr = [NSString stringWithUTF8String: buf];
+	LEOGetValueAsStringView( theValue, &theString, inContext );
+	NSString		*	theStr = [NSString stringWithUTF8String: theString.string];
+	LEOCleanUpStringView( &theString );
 	[(LeonieAppDelegate*)[NSApp delegate] printMessage: theStr];
 	if( popOffStack )
 		LEOCleanUpStackToPtr( inContext, inContext->stackEndPtr -1 );
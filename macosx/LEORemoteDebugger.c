@@ -201,7 +201,7 @@ void LEORemoteDebuggerUpdateState( struct LEOContext* inContext )
 	if( actuallyWritten == SIZE_MAX ) { LEORemoteDebuggerDisconnect(); return; }
 
 	// Tell the debugger what source file we're dealing with:
-	if( inContext->currentInstruction->instructionID == LINE_MARKER_INSTR )
+	if( LEOInstructionIDIsLineMarker( inContext->currentInstruction->instructionID ) )
 	{
 		actuallyWritten = write( gLEORemoteDebuggerSocketFD, "LINE", 4 );
 		uint16_t	fileID = inContext->currentInstruction->param1;
@@ -398,7 +398,7 @@ void LEORemoteDebuggerPreInstructionProc( struct LEOContext* inContext )
 		}
 	}
 	
-	if( inContext->currentInstruction && inContext->currentInstruction->instructionID == LINE_MARKER_INSTR )
+	if( inContext->currentInstruction && LEOInstructionIDIsLineMarker( inContext->currentInstruction->instructionID ) )
 	{
 		LEOScript	*	theScript = LEOContextPeekCurrentScript( inContext );
 		if( theScript )